@@ -25,6 +25,11 @@
 
 #include <gst/gst.h>
 #include <string.h>
+#if defined(__ARM_NEON__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #include "gstscreenshot.h"
 
@@ -151,8 +156,8 @@ static gboolean async_bus_handler(GstBus *bus, GstMessage *msg,
 }
 
 /* takes ownership of the input buffer */
-gboolean bvw_frame_conv_convert(GstBuffer *buf, GstCaps *to_caps,
-				BvwFrameConvCb cb, gpointer cb_data)
+gboolean bvw_frame_conv_convert_pipeline(GstBuffer *buf, GstCaps *to_caps,
+					 BvwFrameConvCb cb, gpointer cb_data)
 {
 	static GstElement *src = NULL, *sink = NULL, *pipeline = NULL,
 		*filter1 = NULL, *filter2 = NULL;
@@ -257,3 +262,407 @@ gboolean bvw_frame_conv_convert(GstBuffer *buf, GstCaps *to_caps,
 
 	return TRUE;
 }
+
+/*
+ * In-process conversion of raw YUV frames to packed RGB, for the formats
+ * video sinks usually hand us.  Every output row is done in two passes:
+ * the first one picks (and scales) the Y, U and V samples into linear
+ * scratch lines, the second one converts those with fixed-point
+ * arithmetic, using NEON or SSE2 where available.
+ */
+
+/* output buffers kept around for the next frames */
+#define FRAME_CONV_POOL_SIZE 2
+
+typedef enum {
+	FRAME_CONV_I420,
+	FRAME_CONV_YV12,
+	FRAME_CONV_YUY2,
+	FRAME_CONV_UYVY,
+} FrameConvFormat;
+
+typedef struct {
+	GstBuffer *buf;
+	guint capacity;
+} FrameConvPoolItem;
+
+static FrameConvPoolItem frame_conv_pool[FRAME_CONV_POOL_SIZE];
+
+/* scratch lines of the converter, grown as needed */
+static guint8 *frame_conv_lines = NULL;
+static guint *frame_conv_xmap = NULL;
+static guint frame_conv_lines_width = 0;
+
+static gboolean get_native_format(GstStructure *s, FrameConvFormat *format)
+{
+	guint32 fourcc;
+
+	if (!gst_structure_has_name(s, "video/x-raw-yuv") ||
+	    !gst_structure_get_fourcc(s, "format", &fourcc))
+		return FALSE;
+
+	switch (fourcc) {
+	case GST_MAKE_FOURCC('I', '4', '2', '0'):
+	case GST_MAKE_FOURCC('I', 'Y', 'U', 'V'):
+		*format = FRAME_CONV_I420;
+		return TRUE;
+	case GST_MAKE_FOURCC('Y', 'V', '1', '2'):
+		*format = FRAME_CONV_YV12;
+		return TRUE;
+	case GST_MAKE_FOURCC('Y', 'U', 'Y', '2'):
+	case GST_MAKE_FOURCC('Y', 'U', 'Y', 'V'):
+		*format = FRAME_CONV_YUY2;
+		return TRUE;
+	case GST_MAKE_FOURCC('U', 'Y', 'V', 'Y'):
+		*format = FRAME_CONV_UYVY;
+		return TRUE;
+	default:
+		return FALSE;
+	}
+}
+
+/* We only produce what the worker asks for: 24 bit big endian RGB */
+static gboolean is_native_target(GstStructure *s)
+{
+	gint bpp, endianness, red_mask, green_mask, blue_mask;
+
+	return gst_structure_has_name(s, "video/x-raw-rgb") &&
+		gst_structure_get_int(s, "bpp", &bpp) && bpp == 24 &&
+		gst_structure_get_int(s, "endianness", &endianness) &&
+		endianness == G_BIG_ENDIAN &&
+		gst_structure_get_int(s, "red_mask", &red_mask) &&
+		red_mask == 0xff0000 &&
+		gst_structure_get_int(s, "green_mask", &green_mask) &&
+		green_mask == 0x00ff00 &&
+		gst_structure_get_int(s, "blue_mask", &blue_mask) &&
+		blue_mask == 0x0000ff;
+}
+
+/* Returns a buffer of @size bytes with @caps, reusing an idle one of the
+ * pool.  The caps are set while we are the only owner of the buffer,
+ * otherwise its metadata is not writable. */
+static GstBuffer *frame_conv_pool_get(guint size, GstCaps *caps)
+{
+	FrameConvPoolItem *free_item = NULL;
+	GstBuffer *buf;
+	guint i;
+
+	for (i = 0; i < FRAME_CONV_POOL_SIZE; i++) {
+		FrameConvPoolItem *item = &frame_conv_pool[i];
+
+		if (item->buf == NULL) {
+			if (free_item == NULL)
+				free_item = item;
+			continue;
+		}
+		/* Still used by someone else. */
+		if (GST_MINI_OBJECT_REFCOUNT_VALUE(item->buf) > 1)
+			continue;
+		if (item->capacity >= size) {
+			GST_BUFFER_SIZE(item->buf) = size;
+			gst_buffer_set_caps(item->buf, caps);
+			return gst_buffer_ref(item->buf);
+		}
+		/* Too small, make room for a bigger one. */
+		gst_buffer_unref(item->buf);
+		item->buf = NULL;
+		if (free_item == NULL)
+			free_item = item;
+	}
+
+	buf = gst_buffer_new_and_alloc(size);
+	gst_buffer_set_caps(buf, caps);
+	if (free_item != NULL) {
+		free_item->buf = gst_buffer_ref(buf);
+		free_item->capacity = size;
+	}
+	return buf;
+}
+
+static void frame_conv_ensure_lines(guint width)
+{
+	if (frame_conv_lines_width >= width)
+		return;
+	g_free(frame_conv_lines);
+	g_free(frame_conv_xmap);
+	frame_conv_lines = g_new(guint8, 3 * width);
+	frame_conv_xmap = g_new(guint, width);
+	frame_conv_lines_width = width;
+}
+
+static inline guint8 clamp_rgb(gint v)
+{
+	return v < 0 ? 0 : (v > 255 ? 255 : v);
+}
+
+/* ITU-R BT.601, studio range, 8 bits of fraction.  Eight pixels at a
+ * time with NEON or SSE2, the rest one by one. */
+static void yuv_line_to_rgb(const guint8 *y, const guint8 *u,
+			    const guint8 *v, guint8 *rgb, guint width)
+{
+	guint i = 0;
+
+#if defined(__ARM_NEON__)
+	for (; i + 8 <= width; i += 8) {
+		int16x8_t yy, dd, ee;
+		int32x4_t c, r[2], g[2], b[2];
+		uint8x8x3_t out;
+		gint h;
+
+		yy = vreinterpretq_s16_u16(vsubl_u8(vld1_u8(y + i),
+						    vdup_n_u8(16)));
+		dd = vreinterpretq_s16_u16(vsubl_u8(vld1_u8(u + i),
+						    vdup_n_u8(128)));
+		ee = vreinterpretq_s16_u16(vsubl_u8(vld1_u8(v + i),
+						    vdup_n_u8(128)));
+		for (h = 0; h < 2; h++) {
+			int16x4_t y4 = h ? vget_high_s16(yy) : vget_low_s16(yy);
+			int16x4_t d4 = h ? vget_high_s16(dd) : vget_low_s16(dd);
+			int16x4_t e4 = h ? vget_high_s16(ee) : vget_low_s16(ee);
+
+			c = vaddq_s32(vmull_n_s16(y4, 298), vdupq_n_s32(128));
+			r[h] = vmlal_n_s16(c, e4, 409);
+			g[h] = vmlsl_n_s16(vmlsl_n_s16(c, d4, 100), e4, 208);
+			b[h] = vmlal_n_s16(c, d4, 516);
+		}
+		/* Saturating narrowing clamps to 0..255 */
+		out.val[0] = vqmovun_s16(vcombine_s16(vqshrn_n_s32(r[0], 8),
+						      vqshrn_n_s32(r[1], 8)));
+		out.val[1] = vqmovun_s16(vcombine_s16(vqshrn_n_s32(g[0], 8),
+						      vqshrn_n_s32(g[1], 8)));
+		out.val[2] = vqmovun_s16(vcombine_s16(vqshrn_n_s32(b[0], 8),
+						      vqshrn_n_s32(b[1], 8)));
+		vst3_u8(rgb + 3 * i, out);
+	}
+#elif defined(__SSE2__)
+	/* Pairs of coefficients for _mm_madd_epi16() */
+	const __m128i k_ye = _mm_set_epi16(409, 298, 409, 298,
+					   409, 298, 409, 298);
+	const __m128i k_yd_g = _mm_set_epi16(-100, 298, -100, 298,
+					     -100, 298, -100, 298);
+	const __m128i k_de_g = _mm_set_epi16(-208, 0, -208, 0,
+					     -208, 0, -208, 0);
+	const __m128i k_yd_b = _mm_set_epi16(516, 298, 516, 298,
+					     516, 298, 516, 298);
+	const __m128i round = _mm_set1_epi32(128);
+	const __m128i zero = _mm_setzero_si128();
+
+	for (; i + 8 <= width; i += 8) {
+		__m128i yy, dd, ee, ye[2], yd[2], de[2], r[2], g[2], b[2];
+		guint8 rr[16], gg[16], bb[16];
+		gint h, j;
+
+		yy = _mm_sub_epi16(_mm_unpacklo_epi8(
+				_mm_loadl_epi64((const __m128i *)(y + i)),
+				zero), _mm_set1_epi16(16));
+		dd = _mm_sub_epi16(_mm_unpacklo_epi8(
+				_mm_loadl_epi64((const __m128i *)(u + i)),
+				zero), _mm_set1_epi16(128));
+		ee = _mm_sub_epi16(_mm_unpacklo_epi8(
+				_mm_loadl_epi64((const __m128i *)(v + i)),
+				zero), _mm_set1_epi16(128));
+		ye[0] = _mm_unpacklo_epi16(yy, ee);
+		ye[1] = _mm_unpackhi_epi16(yy, ee);
+		yd[0] = _mm_unpacklo_epi16(yy, dd);
+		yd[1] = _mm_unpackhi_epi16(yy, dd);
+		de[0] = _mm_unpacklo_epi16(dd, ee);
+		de[1] = _mm_unpackhi_epi16(dd, ee);
+		for (h = 0; h < 2; h++) {
+			r[h] = _mm_srai_epi32(_mm_add_epi32(
+				_mm_madd_epi16(ye[h], k_ye), round), 8);
+			g[h] = _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(
+				_mm_madd_epi16(yd[h], k_yd_g),
+				_mm_madd_epi16(de[h], k_de_g)), round), 8);
+			b[h] = _mm_srai_epi32(_mm_add_epi32(
+				_mm_madd_epi16(yd[h], k_yd_b), round), 8);
+		}
+		/* Saturating packing clamps to 0..255 */
+		_mm_storeu_si128((__m128i *)rr, _mm_packus_epi16(
+				_mm_packs_epi32(r[0], r[1]), zero));
+		_mm_storeu_si128((__m128i *)gg, _mm_packus_epi16(
+				_mm_packs_epi32(g[0], g[1]), zero));
+		_mm_storeu_si128((__m128i *)bb, _mm_packus_epi16(
+				_mm_packs_epi32(b[0], b[1]), zero));
+		/* SSE2 cannot store three planes interleaved */
+		for (j = 0; j < 8; j++) {
+			rgb[3 * (i + j)]     = rr[j];
+			rgb[3 * (i + j) + 1] = gg[j];
+			rgb[3 * (i + j) + 2] = bb[j];
+		}
+	}
+#endif
+
+	for (; i < width; i++) {
+		gint c = 298 * (y[i] - 16) + 128;
+		gint d = u[i] - 128;
+		gint e = v[i] - 128;
+
+		rgb[3 * i]     = clamp_rgb((c + 409 * e) >> 8);
+		rgb[3 * i + 1] = clamp_rgb((c - 100 * d - 208 * e) >> 8);
+		rgb[3 * i + 2] = clamp_rgb((c + 516 * d) >> 8);
+	}
+}
+
+/* Fills the scratch lines with the (nearest) samples of output row @row. */
+static void gather_yuv_line(const guint8 *data, FrameConvFormat format,
+			    gint in_width, gint in_height, guint row,
+			    guint width, guint8 *y, guint8 *u, guint8 *v)
+{
+	const guint *xmap = frame_conv_xmap;
+	guint i;
+
+	if (format == FRAME_CONV_I420 || format == FRAME_CONV_YV12) {
+		guint ystride = GST_ROUND_UP_4(in_width);
+		guint cstride = GST_ROUND_UP_8(in_width) / 2;
+		guint coffset = ystride * GST_ROUND_UP_2(in_height);
+		guint csize = cstride * (GST_ROUND_UP_2(in_height) / 2);
+		const guint8 *yrow, *urow, *vrow;
+
+		yrow = data + row * ystride;
+		urow = data + coffset + (row / 2) * cstride;
+		vrow = urow + csize;
+		if (format == FRAME_CONV_YV12) {
+			const guint8 *tmp = urow;
+
+			urow = vrow;
+			vrow = tmp;
+		}
+		for (i = 0; i < width; i++) {
+			y[i] = yrow[xmap[i]];
+			u[i] = urow[xmap[i] / 2];
+			v[i] = vrow[xmap[i] / 2];
+		}
+	} else {
+		/* Packed 4:2:2, a macropixel is two pixels in four bytes. */
+		const guint8 *line = data + row * GST_ROUND_UP_4(in_width * 2);
+		guint yoff, uoff, voff;
+
+		if (format == FRAME_CONV_YUY2) {
+			yoff = 0;
+			uoff = 1;
+			voff = 3;
+		} else {
+			yoff = 1;
+			uoff = 0;
+			voff = 2;
+		}
+		for (i = 0; i < width; i++) {
+			const guint8 *mp = line + (xmap[i] & ~1) * 2;
+
+			y[i] = line[xmap[i] * 2 + yoff];
+			u[i] = mp[uoff];
+			v[i] = mp[voff];
+		}
+	}
+}
+
+static guint frame_size(FrameConvFormat format, gint width, gint height)
+{
+	switch (format) {
+	case FRAME_CONV_I420:
+	case FRAME_CONV_YV12:
+		return GST_ROUND_UP_4(width) * GST_ROUND_UP_2(height) +
+			GST_ROUND_UP_8(width) / 2 *
+			(GST_ROUND_UP_2(height) / 2) * 2;
+	default:
+		return GST_ROUND_UP_4(width * 2) * height;
+	}
+}
+
+/**
+ * bvw_frame_conv_convert_native:
+ * @buf: raw video frame
+ * @to_caps: the requested format
+ *
+ * Converts @buf in-process, correcting for its pixel-aspect-ratio.  Does
+ * not take ownership of either argument.
+ *
+ * Returns: the converted frame, or %NULL if the conversion between these
+ * formats is not supported.
+ */
+GstBuffer *bvw_frame_conv_convert_native(GstBuffer *buf, GstCaps *to_caps)
+{
+	GstStructure *in_s, *out_s;
+	FrameConvFormat format;
+	gint in_width, in_height, par_n = 1, par_d = 1;
+	guint width, height, stride, row, i;
+	GstBuffer *result;
+	GstCaps *result_caps;
+	guint8 *y, *u, *v;
+
+	g_return_val_if_fail(GST_BUFFER_CAPS(buf) != NULL, NULL);
+
+	in_s = gst_caps_get_structure(GST_BUFFER_CAPS(buf), 0);
+	out_s = gst_caps_get_structure(to_caps, 0);
+	if (!get_native_format(in_s, &format) || !is_native_target(out_s))
+		return NULL;
+	if (!gst_structure_get_int(in_s, "width", &in_width) ||
+	    !gst_structure_get_int(in_s, "height", &in_height) ||
+	    in_width <= 0 || in_height <= 0)
+		return NULL;
+	if (GST_BUFFER_SIZE(buf) < frame_size(format, in_width, in_height))
+		return NULL;
+	gst_structure_get_fraction(in_s, "pixel-aspect-ratio",
+				   &par_n, &par_d);
+	if (par_n <= 0 || par_d <= 0)
+		par_n = par_d = 1;
+
+	/* Square the pixels the way videoscale does, keeping the height. */
+	width = gst_util_uint64_scale_int(in_width, par_n, par_d);
+	height = in_height;
+	if (width == 0)
+		return NULL;
+	stride = GST_ROUND_UP_4(3 * width);
+
+	frame_conv_ensure_lines(width);
+	for (i = 0; i < width; i++)
+		frame_conv_xmap[i] = gst_util_uint64_scale_int(i, in_width,
+							       width);
+	y = frame_conv_lines;
+	u = y + width;
+	v = u + width;
+
+	result_caps = gst_caps_copy(to_caps);
+	gst_caps_set_simple(result_caps,
+			    "width", G_TYPE_INT, width,
+			    "height", G_TYPE_INT, height,
+			    NULL);
+	result = frame_conv_pool_get(stride * height, result_caps);
+	gst_caps_unref(result_caps);
+	for (row = 0; row < height; row++) {
+		gather_yuv_line(GST_BUFFER_DATA(buf), format,
+				in_width, in_height, row, width, y, u, v);
+		yuv_line_to_rgb(y, u, v,
+				GST_BUFFER_DATA(result) + row * stride, width);
+	}
+
+
+	GST_DEBUG("converted buffer %p in-process to %p with caps %"
+		  GST_PTR_FORMAT, buf, result, GST_BUFFER_CAPS(result));
+
+	return result;
+}
+
+/* takes ownership of the input buffer */
+gboolean bvw_frame_conv_convert(GstBuffer *buf, GstCaps *to_caps,
+				BvwFrameConvCb cb, gpointer cb_data)
+{
+	GstBuffer *result;
+
+	g_return_val_if_fail(GST_BUFFER_CAPS(buf) != NULL, FALSE);
+	g_return_val_if_fail(cb != NULL, FALSE);
+
+	result = bvw_frame_conv_convert_native(buf, to_caps);
+	if (result == NULL) {
+		GST_DEBUG("no in-process conversion for %" GST_PTR_FORMAT
+			  ", using the pipeline", GST_BUFFER_CAPS(buf));
+		return bvw_frame_conv_convert_pipeline(buf, to_caps,
+						       cb, cb_data);
+	}
+
+	gst_buffer_unref(buf);
+	gst_caps_unref(to_caps);
+	cb(result, cb_data);
+
+	return TRUE;
+}
@@ -30,6 +30,9 @@ typedef void (*BvwFrameConvCb)(GstBuffer *result, gpointer user_data);
 
 gboolean bvw_frame_conv_convert (GstBuffer *buf, GstCaps *to,
 				 BvwFrameConvCb cb, gpointer cb_data);
+gboolean bvw_frame_conv_convert_pipeline (GstBuffer *buf, GstCaps *to,
+					  BvwFrameConvCb cb, gpointer cb_data);
+GstBuffer *bvw_frame_conv_convert_native (GstBuffer *buf, GstCaps *to);
 
 G_END_DECLS
 
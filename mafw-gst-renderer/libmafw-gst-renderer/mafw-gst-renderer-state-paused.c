@@ -70,6 +70,7 @@ static void _notify_play(MafwGstRendererState *self, GError **error);
 static void _notify_seek(MafwGstRendererState *self, GError **error);
 static void _notify_buffer_status(MafwGstRendererState *self, gdouble percent,
 				  GError **error);
+static void _notify_next(MafwGstRendererState *self, GError **error);
 
 /*----------------------------------------------------------------------------
   Playlist editing signals
@@ -139,6 +140,7 @@ static void mafw_gst_renderer_state_paused_class_init(
         /* state_class->notify_pause is not allowed */
         state_class->notify_seek = _notify_seek;
         state_class->notify_buffer_status = _notify_buffer_status;
+        state_class->notify_next = _notify_next;
 
 	/* Playlist editing signals */
 
@@ -298,6 +300,12 @@ static void _notify_buffer_status(MafwGstRendererState *self, gdouble percent,
 	mafw_gst_renderer_state_do_notify_buffer_status (self, percent, error);
 }
 
+static void _notify_next(MafwGstRendererState *self, GError **error)
+{
+	/* The previous clip was paused right at its end */
+	mafw_gst_renderer_state_do_notify_next(self, error);
+}
+
 /*----------------------------------------------------------------------------
   Playlist editing signals
   ----------------------------------------------------------------------------*/
@@ -73,6 +73,7 @@ static void _notify_seek(MafwGstRendererState *self, GError **error);
 static void _notify_buffer_status(MafwGstRendererState *self, gdouble percent,
 				  GError **error);
 static void _notify_eos(MafwGstRendererState *self, GError **error);
+static void _notify_next(MafwGstRendererState *self, GError **error);
 
 /*----------------------------------------------------------------------------
   Playlist editing signals
@@ -144,6 +145,7 @@ static void mafw_gst_renderer_state_playing_class_init(
         state_class->notify_seek          = _notify_seek;
         state_class->notify_buffer_status = _notify_buffer_status;
         state_class->notify_eos           = _notify_eos;
+        state_class->notify_next          = _notify_next;
 
 	/* Playlist editing signals */
 
@@ -385,6 +387,12 @@ static void _notify_eos(MafwGstRendererState *self, GError **error)
 	}
 }
 
+static void _notify_next(MafwGstRendererState *self, GError **error)
+{
+	g_return_if_fail(MAFW_IS_GST_RENDERER_STATE_PLAYING(self));
+	mafw_gst_renderer_state_do_notify_next(self, error);
+}
+
 /*----------------------------------------------------------------------------
   Playlist editing signals
   ----------------------------------------------------------------------------*/
@@ -28,8 +28,6 @@
 #undef  G_LOG_DOMAIN
 #define G_LOG_DOMAIN "mafw-gst-renderer-state-transitioning"
 
-#define UPDATE_DELAY 10
-
 /*----------------------------------------------------------------------------
   Playback
   ----------------------------------------------------------------------------*/
@@ -355,6 +353,9 @@ static void _notify_play(MafwGstRendererState *self, GError **error)
 	}
 
 	mafw_gst_renderer_set_state(renderer, Playing);
+
+	/* Have the next clip ready for gapless playback */
+	mafw_gst_renderer_prepare_next(renderer);
 }
 
 static void _notify_pause(MafwGstRendererState *self, GError **error)
@@ -26,6 +26,7 @@
 #include "config.h"
 #endif
 
+#include <string.h>
 #include <libmafw/mafw-renderer.h>
 #include <libmafw/mafw-errors.h>
 
@@ -173,6 +174,12 @@ static void _default_notify_eos(MafwGstRendererState *self, GError **error)
 		   MAFW_GST_RENDERER_STATE_GET_CLASS(self)->name);
 }
 
+static void _default_notify_next(MafwGstRendererState *self, GError **error)
+{
+	g_critical("Notify next: incorrect operation in %s state",
+		   MAFW_GST_RENDERER_STATE_GET_CLASS(self)->name);
+}
+
 /*----------------------------------------------------------------------------
   Default playlist editing signal handlers implementation
   ----------------------------------------------------------------------------*/
@@ -248,8 +255,7 @@ static void mafw_gst_renderer_state_class_init(MafwGstRendererStateClass *klass)
 	klass->notify_seek          = _default_notify_seek;
 	klass->notify_buffer_status = _default_notify_buffer_status;
 	klass->notify_eos           = _default_notify_eos;
-
-	klass->notify_eos           = _default_notify_eos;
+	klass->notify_next          = _default_notify_next;
 
 	/* Playlist editing signals */
 
@@ -386,6 +392,12 @@ void mafw_gst_renderer_state_notify_eos(MafwGstRendererState *self,
 	MAFW_GST_RENDERER_STATE_GET_CLASS(self)->notify_eos(self, error);
 }
 
+void mafw_gst_renderer_state_notify_next(MafwGstRendererState *self,
+					 GError **error)
+{
+	MAFW_GST_RENDERER_STATE_GET_CLASS(self)->notify_next(self, error);
+}
+
 /*----------------------------------------------------------------------------
   Playlist editing handlers
   ----------------------------------------------------------------------------*/
@@ -823,3 +835,61 @@ void mafw_gst_renderer_state_do_notify_buffer_status(MafwGstRendererState *self,
 
 	mafw_renderer_emit_buffering_info(MAFW_RENDERER(renderer), percent / 100.0);
 }
+
+void mafw_gst_renderer_state_do_notify_next(MafwGstRendererState *self,
+					    GError **error)
+{
+	MafwGstRenderer *renderer;
+	MafwGstRendererMedia *next;
+	MafwGstRendererMovementResult move_type;
+
+	g_return_if_fail(MAFW_IS_GST_RENDERER_STATE(self));
+
+	renderer = MAFW_GST_RENDERER_STATE(self)->renderer;
+
+	/* The worker has moved on to the clip prepared by
+	   mafw_gst_renderer_prepare_next() without stopping.  Update the
+	   playcount of the finished one, as on EOS */
+	if (renderer->update_playcount_id > 0) {
+		g_source_remove(renderer->update_playcount_id);
+		mafw_gst_renderer_update_stats(renderer);
+	}
+
+	/* Moving clears the prepared media, keep it */
+	next = renderer->next_media;
+	renderer->next_media = NULL;
+
+	move_type = mafw_gst_renderer_move(renderer,
+					   MAFW_GST_RENDERER_MOVE_TYPE_NEXT,
+					   0, error);
+
+	if (move_type == MAFW_GST_RENDERER_MOVE_RESULT_OK && next != NULL &&
+	    renderer->media->object_id != NULL &&
+	    !strcmp(renderer->media->object_id, next->object_id)) {
+		renderer->media->uri = next->uri;
+		next->uri = NULL;
+		renderer->media->seekability = next->seekability;
+		renderer->media->duration = next->duration;
+		renderer->play_failed_count = 0;
+
+		renderer->update_playcount_id = g_timeout_add_seconds(
+			UPDATE_DELAY,
+			mafw_gst_renderer_update_stats,
+			renderer);
+
+		mafw_gst_renderer_prepare_next(renderer);
+	} else if (move_type == MAFW_GST_RENDERER_MOVE_RESULT_OK) {
+		/* The playlist changed after the clip was handed to the
+		   worker, play the one that is next now */
+		mafw_gst_renderer_state_play(self, error);
+	} else {
+		mafw_gst_renderer_worker_stop(renderer->worker);
+		mafw_gst_renderer_set_state(renderer, Stopped);
+	}
+
+	if (next != NULL) {
+		g_free(next->object_id);
+		g_free(next->uri);
+		g_free(next);
+	}
+}
@@ -36,6 +36,9 @@ typedef struct _MafwGstRendererStateClass MafwGstRendererStateClass;
 
 G_BEGIN_DECLS
 
+/* Seconds a clip has to play to count as played */
+#define UPDATE_DELAY 10
+
 /*----------------------------------------------------------------------------
   GObject type conversion macros
   ----------------------------------------------------------------------------*/
@@ -103,6 +106,7 @@ struct _MafwGstRendererStateClass {
 	void (*notify_buffer_status)(MafwGstRendererState *self, gdouble percent,
 				     GError **error);
 	void (*notify_eos) (MafwGstRendererState *self, GError **error);
+	void (*notify_next) (MafwGstRendererState *self, GError **error);
 
 	/* Playlist editing signals */
 
@@ -181,6 +185,8 @@ void mafw_gst_renderer_state_notify_buffer_status(MafwGstRendererState *self,
                                                   GError **error);
 void mafw_gst_renderer_state_notify_eos(MafwGstRendererState *self,
                                         GError **error);
+void mafw_gst_renderer_state_notify_next(MafwGstRendererState *self,
+                                         GError **error);
 
 /*----------------------------------------------------------------------------
   Playlist editing handlers
@@ -233,6 +239,8 @@ void mafw_gst_renderer_state_do_notify_seek(MafwGstRendererState *self,
 void mafw_gst_renderer_state_do_notify_buffer_status(MafwGstRendererState *self,
                                                      gdouble percent,
                                                      GError **error);
+void mafw_gst_renderer_state_do_notify_next(MafwGstRendererState *self,
+                                            GError **error);
 
 G_END_DECLS
 
@@ -56,6 +56,8 @@
 #define MAFW_GST_MISSING_TYPE_DECODER "decoder"
 #define MAFW_GST_MISSING_TYPE_ENCODER "encoder"
 
+#define MAFW_GST_RENDERER_WORKER_PLAYLIST_CACHE_TTL 300
+
 #define MAFW_GST_BUFFER_TIME  600000L
 #define MAFW_GST_LATENCY_TIME (MAFW_GST_BUFFER_TIME / 2)
 
@@ -82,42 +84,12 @@ static void _do_play(MafwGstRendererWorker *worker);
 static void _do_seek(MafwGstRendererWorker *worker, GstSeekType seek_type,
 		     gint position, GError **error);
 static void _play_pl_next(MafwGstRendererWorker *worker);
+static void _set_pl_next(MafwGstRendererWorker *worker);
+static gboolean _async_bus_handler(GstBus *bus, GstMessage *msg,
+				   MafwGstRendererWorker *worker);
 
 static void _emit_metadatas(MafwGstRendererWorker *worker);
 
-/* Playlist parsing */
-static void _on_pl_entry_parsed(TotemPlParser *parser, gchar *uri,
-				gpointer metadata, GSList **plitems)
-{
-	if (uri != NULL) {
-		*plitems = g_slist_append(*plitems, g_strdup(uri));
-	}
-}
-static GSList *_parse_playlist(const gchar *uri)
-{
-	static TotemPlParser *pl_parser = NULL;
-	GSList *plitems = NULL;
-	gulong handler_id;
-
-	/* Initialize the playlist parser */
-	if (!pl_parser)
-	{
-		pl_parser = totem_pl_parser_new ();
-		g_object_set(pl_parser, "recurse", TRUE, "disable-unsafe",
-		     TRUE, NULL);
-	}
-	handler_id = g_signal_connect(G_OBJECT(pl_parser), "entry-parsed",
-			 G_CALLBACK(_on_pl_entry_parsed), &plitems);
-	/* Parsing */
-	if (totem_pl_parser_parse(pl_parser, uri, FALSE) !=
-	    TOTEM_PL_PARSER_RESULT_SUCCESS) {
-		/* An error happens while parsing */
-		
-	}
-	g_signal_handler_disconnect(pl_parser, handler_id);
-	return plitems;
-}
-		
 /*
  * Sends @error to MafwGstRenderer.  Only call this from the glib main thread, or
  * face the consequences.  @err is free'd.
@@ -142,64 +114,391 @@ static void _post_error(MafwGstRendererWorker *worker, GError *err)
 	g_error_free(err);
 }
 
+/* Playlist parsing */
+
+/*
+ * A playlist file being parsed in a separate thread.  The thread only touches
+ * @first and @items, everything else belongs to the main thread.
+ *
+ * first:    The first entry, playback starts with it
+ * items:    All the entries, once the parsing has finished
+ * error:    Sent if there are no entries at all
+ * deferred: Bus message reaching the end of the entries known so far,
+ *           handled again once all of them are known
+ * ref:      The thread and the idle callbacks own a reference each
+ */
+typedef struct {
+	MafwGstRendererWorker *worker;
+	gchar *uri;
+	gchar *first;
+	GSList *items;
+	GError *error;
+	GstMessage *deferred;
+	GTimer *timer;
+	gboolean cancelled;
+	gint ref;
+} PlaylistParsing;
+
+typedef struct {
+	GSList *items;
+	glong expires;
+} PlaylistCacheEntry;
+
+static void _free_pl_items(GSList *items)
+{
+	g_slist_foreach(items, (GFunc) g_free, NULL);
+	g_slist_free(items);
+}
+
+static GSList *_copy_pl_items(GSList *items)
+{
+	GSList *copy = NULL;
+
+	for (; items != NULL; items = items->next)
+		copy = g_slist_prepend(copy, g_strdup(items->data));
+
+	return g_slist_reverse(copy);
+}
+
+static void _pl_cache_entry_free(PlaylistCacheEntry *entry)
+{
+	_free_pl_items(entry->items);
+	g_free(entry);
+}
+
+static gboolean _pl_cache_entry_expired(gpointer key, PlaylistCacheEntry *entry,
+					GTimeVal *now)
+{
+	return entry->expires <= now->tv_sec;
+}
+
+/* Returns a copy of the entries of @uri if it has been parsed lately */
+static GSList *_pl_cache_lookup(MafwGstRendererWorker *worker,
+				const gchar *uri)
+{
+	PlaylistCacheEntry *entry;
+	GTimeVal now;
+
+	g_get_current_time(&now);
+	g_hash_table_foreach_remove(worker->pl_parser.cache,
+				    (GHRFunc) _pl_cache_entry_expired, &now);
+
+	entry = g_hash_table_lookup(worker->pl_parser.cache, uri);
+	if (entry == NULL)
+		return NULL;
+
+	worker->pl_parser.cache_hits++;
+	g_debug("playlist %s taken from the cache (%u parsed, %u cached)",
+		uri, worker->pl_parser.parsed, worker->pl_parser.cache_hits);
+	return _copy_pl_items(entry->items);
+}
+
+static void _pl_cache_insert(MafwGstRendererWorker *worker, const gchar *uri,
+			     GSList *items)
+{
+	PlaylistCacheEntry *entry;
+	GTimeVal now;
+
+	g_get_current_time(&now);
+	entry = g_new0(PlaylistCacheEntry, 1);
+	entry->items = _copy_pl_items(items);
+	entry->expires = now.tv_sec +
+		MAFW_GST_RENDERER_WORKER_PLAYLIST_CACHE_TTL;
+	g_hash_table_replace(worker->pl_parser.cache, g_strdup(uri), entry);
+}
+
+static void _pl_parsing_unref(PlaylistParsing *parsing)
+{
+	if (!g_atomic_int_dec_and_test(&parsing->ref))
+		return;
+
+	g_free(parsing->uri);
+	g_free(parsing->first);
+	_free_pl_items(parsing->items);
+	if (parsing->error)
+		g_error_free(parsing->error);
+	if (parsing->deferred)
+		gst_message_unref(parsing->deferred);
+	g_timer_destroy(parsing->timer);
+	g_free(parsing);
+}
+
+/* Runs in the main thread as soon as the first entry is known */
+static gboolean _pl_first_entry_cb(PlaylistParsing *parsing)
+{
+	MafwGstRendererWorker *worker = parsing->worker;
+
+	if (!parsing->cancelled) {
+		g_debug("playlist %s: first entry after %.3f s", parsing->uri,
+			g_timer_elapsed(parsing->timer, NULL));
+
+		/* Playing stops any parsing in progress, but this one */
+		worker->pl_parser.job = NULL;
+		mafw_gst_renderer_worker_play(
+			worker, NULL,
+			g_slist_append(NULL, g_strdup(parsing->first)));
+		worker->pl_parser.job = parsing;
+	}
+
+	_pl_parsing_unref(parsing);
+	return FALSE;
+}
+
+/* Runs in the main thread once the parsing has finished */
+static gboolean _pl_parsed_cb(PlaylistParsing *parsing)
+{
+	MafwGstRendererWorker *worker = parsing->worker;
+	gdouble elapsed;
+
+	if (parsing->cancelled) {
+		_pl_parsing_unref(parsing);
+		return FALSE;
+	}
+
+	worker->pl_parser.job = NULL;
+	elapsed = g_timer_elapsed(parsing->timer, NULL);
+	worker->pl_parser.parsed++;
+	worker->pl_parser.parse_time += elapsed;
+	g_debug("playlist %s parsed in %.3f s: %u entries "
+		"(%u parsed in %.3f s, %u cached)", parsing->uri, elapsed,
+		g_slist_length(parsing->items), worker->pl_parser.parsed,
+		worker->pl_parser.parse_time, worker->pl_parser.cache_hits);
+
+	if (parsing->items == NULL) {
+		_send_error(worker, parsing->error);
+		parsing->error = NULL;
+	} else {
+		_pl_cache_insert(worker, parsing->uri, parsing->items);
+
+		/* Playback started with the first entry, go on with all */
+		_free_pl_items(worker->pl.items);
+		worker->pl.items = parsing->items;
+		parsing->items = NULL;
+		_set_pl_next(worker);
+
+		if (parsing->deferred)
+			_async_bus_handler(worker->bus, parsing->deferred,
+					   worker);
+	}
+
+	_pl_parsing_unref(parsing);
+	return FALSE;
+}
+
+/* NOTE this function is called from the parsing thread. */
+static void _on_pl_entry_parsed(TotemPlParser *parser, gchar *uri,
+				gpointer metadata, PlaylistParsing *parsing)
+{
+	if (uri == NULL)
+		return;
+
+	parsing->items = g_slist_prepend(parsing->items, g_strdup(uri));
+	if (parsing->first == NULL) {
+		parsing->first = g_strdup(uri);
+		g_atomic_int_inc(&parsing->ref);
+		g_idle_add((GSourceFunc) _pl_first_entry_cb, parsing);
+	}
+}
+
+/* NOTE the parser emits its signals in the thread it was created in, so it
+ * is created here rather than shared. */
+static gpointer _pl_parsing_thread(PlaylistParsing *parsing)
+{
+	TotemPlParser *pl_parser;
+
+	pl_parser = totem_pl_parser_new();
+	g_object_set(pl_parser, "recurse", TRUE, "disable-unsafe", TRUE,
+		     NULL);
+	g_signal_connect(G_OBJECT(pl_parser), "entry-parsed",
+			 G_CALLBACK(_on_pl_entry_parsed), parsing);
+	if (totem_pl_parser_parse(pl_parser, parsing->uri, FALSE) !=
+	    TOTEM_PL_PARSER_RESULT_SUCCESS) {
+		/* Whatever has been parsed is still played */
+		g_debug("parsing playlist %s failed", parsing->uri);
+	}
+	g_object_unref(pl_parser);
+
+	parsing->items = g_slist_reverse(parsing->items);
+	g_idle_add((GSourceFunc) _pl_parsed_cb, parsing);
+	return NULL;
+}
+
+/*
+ * Parses the playlist at @uri without blocking the main thread.  Playback
+ * starts with the first entry as soon as it is known, @error is sent if the
+ * playlist has no entries.  @error is taken.
+ */
+static void _start_pl_parsing(MafwGstRendererWorker *worker, const gchar *uri,
+			      GError *error)
+{
+	PlaylistParsing *parsing;
+	GError *thread_error = NULL;
+
+	parsing = g_new0(PlaylistParsing, 1);
+	parsing->worker = worker;
+	parsing->uri = g_strdup(uri);
+	parsing->error = error;
+	parsing->timer = g_timer_new();
+	parsing->ref = 1;
+	worker->pl_parser.job = parsing;
+
+	if (!g_thread_create((GThreadFunc) _pl_parsing_thread, parsing, FALSE,
+			     &thread_error)) {
+		g_warning("cannot parse playlist in a thread: %s",
+			  thread_error->message);
+		g_error_free(thread_error);
+		_pl_parsing_thread(parsing);
+	}
+}
+
+static void _cancel_pl_parsing(MafwGstRendererWorker *worker)
+{
+	PlaylistParsing *parsing = worker->pl_parser.job;
+
+	/* The thread cannot be interrupted, its results are dropped */
+	if (parsing != NULL) {
+		parsing->cancelled = TRUE;
+		worker->pl_parser.job = NULL;
+	}
+}
+
+/*
+ * Keeps @msg, which has reached the end of the playlist entries known so far,
+ * until the rest are parsed.
+ */
+static gboolean _defer_until_pl_parsed(MafwGstRendererWorker *worker,
+				       GstMessage *msg)
+{
+	PlaylistParsing *parsing = worker->pl_parser.job;
+
+	if (parsing == NULL || worker->mode != WORKER_MODE_PLAYLIST)
+		return FALSE;
+
+	g_debug("waiting for the rest of playlist %s", parsing->uri);
+	if (parsing->deferred)
+		gst_message_unref(parsing->deferred);
+	parsing->deferred = gst_message_ref(msg);
+	return TRUE;
+}
+
 #ifdef HAVE_GDKPIXBUF
 typedef struct {
 	MafwGstRendererWorker *worker;
 	gchar *metadata_key;
+	gchar *checksum;
 	GdkPixbuf *pixbuf;
 } SaveGraphicData;
 
-static gchar *_init_tmp_file(void)
+typedef struct {
+	gchar *checksum;
+	gchar *path;
+} CachedGraphic;
+
+static void _cached_graphic_free(CachedGraphic *graphic)
 {
-	gint fd;
-	gchar *path = NULL;
+	g_unlink(graphic->path);
+	g_free(graphic->path);
+	g_free(graphic->checksum);
+	g_free(graphic);
+}
 
-	fd = g_file_open_tmp("mafw-gst-renderer-XXXXXX.jpeg", &path, NULL);
-	close(fd);
+static void _init_graphic_cache(MafwGstRendererWorker *worker)
+{
+	worker->graphic_cache = g_queue_new();
+}
 
-	return path;
+static void _destroy_graphic_cache(MafwGstRendererWorker *worker)
+{
+	g_queue_foreach(worker->graphic_cache, (GFunc)_cached_graphic_free,
+			NULL);
+	g_queue_free(worker->graphic_cache);
+	worker->graphic_cache = NULL;
 }
 
-static void _init_tmp_files_pool(MafwGstRendererWorker *worker)
+/*
+ * Checksum of what an image is made of: the same cover art or frame
+ * results in the same image file.
+ */
+static gchar *_graphic_checksum(GstBuffer *buffer)
 {
-	guint8 i;
+	GChecksum *checksum;
+	gchar *caps, *digest;
 
-	worker->tmp_files_pool_index = 0;
+	checksum = g_checksum_new(G_CHECKSUM_SHA1);
+	caps = gst_caps_to_string(GST_BUFFER_CAPS(buffer));
+	g_checksum_update(checksum, (const guchar *)caps, strlen(caps));
+	g_checksum_update(checksum, GST_BUFFER_DATA(buffer),
+			  GST_BUFFER_SIZE(buffer));
+	digest = g_strdup(g_checksum_get_string(checksum));
+	g_checksum_free(checksum);
+	g_free(caps);
 
-	for (i = 0; i < MAFW_GST_RENDERER_MAX_TMP_FILES; i++) {
-		worker->tmp_files_pool[i] = NULL;
-	}
+	return digest;
 }
 
-static void _destroy_tmp_files_pool(MafwGstRendererWorker *worker)
+/* Returns the image saved from the data of @checksum, if still around. */
+static const gchar *_lookup_graphic_cache(MafwGstRendererWorker *worker,
+					  const gchar *checksum)
 {
-	guint8 i;
+	GList *link;
+
+	for (link = worker->graphic_cache->head; link; link = link->next) {
+		CachedGraphic *graphic = link->data;
 
-	for (i = 0; (i < MAFW_GST_RENDERER_MAX_TMP_FILES) &&
-		     (worker->tmp_files_pool[i] != NULL); i++) {
-		g_unlink(worker->tmp_files_pool[i]);
-		g_free(worker->tmp_files_pool[i]);
+		if (!strcmp(graphic->checksum, checksum)) {
+			g_queue_unlink(worker->graphic_cache, link);
+			g_queue_push_head_link(worker->graphic_cache, link);
+			return graphic->path;
+		}
 	}
+	return NULL;
 }
 
-static const gchar *_get_tmp_file_from_pool(
-                        MafwGstRendererWorker *worker)
+/*
+ * Returns a new file for the image of @checksum, dropping the least
+ * recently used ones beyond MAFW_GST_RENDERER_MAX_TMP_FILES.  The checksum
+ * is part of the name, so the URI tells whether the image has changed.
+ */
+static const gchar *_add_to_graphic_cache(MafwGstRendererWorker *worker,
+					  const gchar *checksum)
 {
-	gchar *path = worker->tmp_files_pool[worker->tmp_files_pool_index];
+	CachedGraphic *graphic;
+	gchar *template, *path = NULL;
+	gint fd;
 
-	if (path == NULL) {
-		path = _init_tmp_file();
-		worker->tmp_files_pool[worker->tmp_files_pool_index] = path;
-	}
+	template = g_strdup_printf("mafw-gst-renderer-%s-XXXXXX.jpeg",
+				   checksum);
+	fd = g_file_open_tmp(template, &path, NULL);
+	g_free(template);
+	if (fd < 0)
+		return NULL;
+	close(fd);
 
-	if (++(worker->tmp_files_pool_index) >=
-	    MAFW_GST_RENDERER_MAX_TMP_FILES) {
-		worker->tmp_files_pool_index = 0;
-	}
+	while (g_queue_get_length(worker->graphic_cache) >=
+	       MAFW_GST_RENDERER_MAX_TMP_FILES)
+		_cached_graphic_free(g_queue_pop_tail(worker->graphic_cache));
+
+	graphic = g_new0(CachedGraphic, 1);
+	graphic->checksum = g_strdup(checksum);
+	graphic->path = path;
+	g_queue_push_head(worker->graphic_cache, graphic);
 
 	return path;
 }
 
+static void _emit_graphic_file(MafwGstRendererWorker *worker,
+			       const gchar *metadata_key,
+			       const gchar *filename)
+{
+	/* Add the info to the current metadata. */
+	_current_metadata_add(worker, metadata_key, G_TYPE_STRING,
+			      (gchar*)filename);
+
+	/* Emit the metadata. */
+	mafw_renderer_emit_metadata_string(worker->owner, metadata_key,
+					   (gchar *) filename);
+}
+
 static void _destroy_pixbuf (guchar *pixbuf, gpointer data)
 {
 	gst_buffer_unref(GST_BUFFER(data));
@@ -236,28 +535,26 @@ static void _emit_gst_buffer_as_graphic_file_cb(GstBuffer *new_buffer,
 	}
 
 	if (pixbuf != NULL) {
-		gboolean save_ok;
+		gboolean save_ok = FALSE;
 		GError *error = NULL;
 		const gchar *filename;
 
-		filename = _get_tmp_file_from_pool(sgd->worker);
+		filename = _add_to_graphic_cache(sgd->worker, sgd->checksum);
 
-		save_ok = gdk_pixbuf_save (pixbuf, filename, "jpeg", &error,
-					   NULL);
+		if (filename != NULL)
+			save_ok = gdk_pixbuf_save (pixbuf, filename, "jpeg",
+						   &error, NULL);
 
 		g_object_unref (pixbuf);
 
 		if (save_ok) {
-			/* Add the info to the current metadata. */
-			_current_metadata_add(sgd->worker, sgd->metadata_key,
-					      G_TYPE_STRING,
-					      (gchar*)filename);
-
-			/* Emit the metadata. */
-			mafw_renderer_emit_metadata_string(sgd->worker->owner,
-							   sgd->metadata_key,
-							   (gchar *) filename);
+			_emit_graphic_file(sgd->worker, sgd->metadata_key,
+					   filename);
 		} else {
+			/* Do not serve a broken file later. */
+			if (filename != NULL)
+				_cached_graphic_free(g_queue_pop_head(
+					sgd->worker->graphic_cache));
 			if (error != NULL) {
 				g_warning ("%s\n", error->message);
 				g_error_free (error);
@@ -271,6 +568,7 @@ static void _emit_gst_buffer_as_graphic_file_cb(GstBuffer *new_buffer,
 	}
 
 	g_free(sgd->metadata_key);
+	g_free(sgd->checksum);
 	g_free(sgd);
 }
 
@@ -302,6 +600,8 @@ static void _emit_gst_buffer_as_graphic_file(MafwGstRendererWorker *worker,
 	GdkPixbufLoader *loader;
 	GstStructure *structure;
 	const gchar *mime = NULL;
+	const gchar *filename;
+	gchar *checksum;
 	GError *error = NULL;
 
 	g_return_if_fail((buffer != NULL) && GST_IS_BUFFER(buffer));
@@ -309,6 +609,19 @@ static void _emit_gst_buffer_as_graphic_file(MafwGstRendererWorker *worker,
 	structure = gst_caps_get_structure(GST_BUFFER_CAPS(buffer), 0);
 	mime = gst_structure_get_name(structure);
 
+	/* The same cover art comes with every track of an album, and the
+	   same frame with every pause at the same position. */
+	checksum = _graphic_checksum(buffer);
+	filename = _lookup_graphic_cache(worker, checksum);
+	if (filename != NULL) {
+		g_debug("pixbuf: reusing %s", filename);
+		if (g_str_has_prefix(mime, "video/x-raw"))
+			gst_buffer_unref(buffer);
+		_emit_graphic_file(worker, metadata_key, filename);
+		g_free(checksum);
+		return;
+	}
+
 	if (g_str_has_prefix(mime, "video/x-raw")) {
 		gint framerate_d, framerate_n;
 		GstCaps *to_caps;
@@ -337,6 +650,7 @@ static void _emit_gst_buffer_as_graphic_file(MafwGstRendererWorker *worker,
 		sgd = g_new0(SaveGraphicData, 1);
 		sgd->worker = worker;
 		sgd->metadata_key = g_strdup(metadata_key);
+		sgd->checksum = checksum;
 
 		g_debug("pixbuf: using bvw to convert image format");
 		bvw_frame_conv_convert (buffer, to_caps,
@@ -376,6 +690,8 @@ static void _emit_gst_buffer_as_graphic_file(MafwGstRendererWorker *worker,
 					sgd->worker = worker;
 					sgd->metadata_key =
 						g_strdup(metadata_key);
+					sgd->checksum = checksum;
+					checksum = NULL;
 					sgd->pixbuf = pixbuf;
 
 					_emit_gst_buffer_as_graphic_file_cb(
@@ -384,6 +700,7 @@ static void _emit_gst_buffer_as_graphic_file(MafwGstRendererWorker *worker,
 			}
 			g_object_unref(loader);
 		}
+		g_free(checksum);
 	}
 }
 #endif
@@ -659,17 +976,22 @@ static void _free_taglist_item(GstMessage *msg, gpointer data)
 	gst_message_unref(msg);
 }
 
-static void _free_taglist(MafwGstRendererWorker *worker)
+static void _free_tag_messages(GPtrArray **tag_list)
 {
-	if (worker->tag_list != NULL)
+	if (*tag_list != NULL)
 	{
-		g_ptr_array_foreach(worker->tag_list, (GFunc)_free_taglist_item,
+		g_ptr_array_foreach(*tag_list, (GFunc)_free_taglist_item,
 				    NULL);
-		g_ptr_array_free(worker->tag_list, TRUE);
-		worker->tag_list = NULL;
+		g_ptr_array_free(*tag_list, TRUE);
+		*tag_list = NULL;
 	}
 }
 
+static void _free_taglist(MafwGstRendererWorker *worker)
+{
+	_free_tag_messages(&worker->tag_list);
+}
+
 static gboolean _seconds_duration_equal(gint64 duration1, gint64 duration2)
 {
 	gint64 duration1_seconds, duration2_seconds;
@@ -1090,8 +1412,65 @@ static GHashTable* _build_tagmap(void)
 	return hash_table;
 }
 
+static gboolean _value_arrays_equal(GValueArray *a, GValueArray *b)
+{
+	guint i;
+
+	if (a->n_values != b->n_values)
+		return FALSE;
+	for (i = 0; i < a->n_values; i++) {
+		if (G_VALUE_TYPE(&a->values[i]) != G_VALUE_TYPE(&b->values[i]))
+			return FALSE;
+		if (gst_value_compare(&a->values[i], &b->values[i]) !=
+		    GST_VALUE_EQUAL)
+			return FALSE;
+	}
+	return TRUE;
+}
+
 /*
- * Emits metadata-changed signals for gst tags.
+ * Emits the tags collected in @pending_metadata in one go.
+ */
+static void _flush_pending_metadata(MafwGstRendererWorker *worker)
+{
+	GHashTable *pending;
+
+	if (worker->pending_metadata_id) {
+		g_source_remove(worker->pending_metadata_id);
+		worker->pending_metadata_id = 0;
+	}
+	if (!worker->pending_metadata)
+		return;
+
+	/* Take it first, a handler might feed us new tags. */
+	pending = worker->pending_metadata;
+	worker->pending_metadata = NULL;
+	mafw_renderer_emit_metadatas(MAFW_RENDERER(worker->owner), pending);
+	mafw_metadata_release(pending);
+}
+
+static gboolean _flush_pending_metadata_cb(MafwGstRendererWorker *worker)
+{
+	worker->pending_metadata_id = 0;
+	_flush_pending_metadata(worker);
+	return FALSE;
+}
+
+static void _drop_pending_metadata(MafwGstRendererWorker *worker)
+{
+	if (worker->pending_metadata_id) {
+		g_source_remove(worker->pending_metadata_id);
+		worker->pending_metadata_id = 0;
+	}
+	if (worker->pending_metadata) {
+		mafw_metadata_release(worker->pending_metadata);
+		worker->pending_metadata = NULL;
+	}
+}
+
+/*
+ * Records the tags which differ from @current_metadata, to be emitted
+ * together once the pending bus messages have been dispatched.
  */
 static void _emit_tag(const GstTagList *list, const gchar *tag,
 		      MafwGstRendererWorker *worker)
@@ -1102,7 +1481,7 @@ static void _emit_tag(const GstTagList *list, const gchar *tag,
 	gint i, count;
 	const gchar *mafwtag;
 	GType type;
-	GValueArray *values;
+	GValueArray *values, *old;
 
 	if (tagmap == NULL) {
 		tagmap = _build_tagmap();
@@ -1134,42 +1513,56 @@ static void _emit_tag(const GstTagList *list, const gchar *tag,
 			gst_tag_list_get_value_index(list, tag, i);
 		if (type == G_TYPE_STRING) {
 			gchar *orig, *utf8;
+			GValue utf8gval = {0};
 
 			gst_tag_list_get_string_index(list, tag, i, &orig);
-			if (convert_utf8(orig, &utf8)) {
-				GValue utf8gval = {0};
-
-				g_value_init(&utf8gval, G_TYPE_STRING);
-				g_value_take_string(&utf8gval, utf8);
-				_current_metadata_add(worker, mafwtag, G_TYPE_STRING,
-							utf8);
-				g_value_array_append(values, &utf8gval);
-				g_value_unset(&utf8gval);
+			if (orig && g_utf8_validate(orig, -1, NULL)) {
+				utf8 = orig;
+			} else {
+				gboolean converted;
+
+				converted = convert_utf8(orig, &utf8);
+				g_free(orig);
+				if (!converted)
+					continue;
 			}
-			g_free(orig);
+			g_value_init(&utf8gval, G_TYPE_STRING);
+			g_value_take_string(&utf8gval, utf8);
+			g_value_array_append(values, &utf8gval);
+			g_value_unset(&utf8gval);
 		} else if (type == G_TYPE_UINT) {
 			GValue intgval = {0};
-			gint intval;
 
 			g_value_init(&intgval, G_TYPE_INT);
 			g_value_transform(v, &intgval);
-			intval = g_value_get_int(&intgval);
-			_current_metadata_add(worker, mafwtag, G_TYPE_INT,
-						intval);
 			g_value_array_append(values, &intgval);
 			g_value_unset(&intgval);
 		} else {
-			_current_metadata_add(worker, mafwtag, G_TYPE_VALUE,
-						v);
 			g_value_array_append(values, v);
 		}
 	}
 
-	/* Emit the metadata. */
-	g_signal_emit_by_name(worker->owner, "metadata-changed", mafwtag,
-			      values);
+	/* Repeated tag messages (typical of radio streams) carry mostly the
+	 * same values, which the clients have seen already. */
+	if (!worker->current_metadata)
+		worker->current_metadata = mafw_metadata_new();
+	old = g_hash_table_lookup(worker->current_metadata, mafwtag);
+	if (values->n_values == 0 ||
+	    (old && _value_arrays_equal(old, values))) {
+		g_value_array_free(values);
+		return;
+	}
+	g_hash_table_replace(worker->current_metadata, g_strdup(mafwtag),
+			     values);
 
-	g_value_array_free(values);
+	if (!worker->pending_metadata)
+		worker->pending_metadata = mafw_metadata_new();
+	g_hash_table_replace(worker->pending_metadata, g_strdup(mafwtag),
+			     g_value_array_copy(values));
+	if (!worker->pending_metadata_id)
+		worker->pending_metadata_id =
+			g_idle_add((GSourceFunc)_flush_pending_metadata_cb,
+				   worker);
 }
 
 /**
@@ -1177,6 +1570,15 @@ static void _emit_tag(const GstTagList *list, const gchar *tag,
  */
 static void _handle_tag(MafwGstRendererWorker *worker, GstMessage *msg)
 {
+	/* The tags of the next clip in gapless playback are read before the
+	   current one has finished, keep them until _handle_next() */
+	if (g_atomic_int_get(&worker->next.queued)) {
+		if (worker->next.tag_list == NULL)
+			worker->next.tag_list = g_ptr_array_new();
+		g_ptr_array_add(worker->next.tag_list, gst_message_ref(msg));
+		return;
+	}
+
 	/* Do not emit metadata until we get to PLAYING state to speed up
 	   playback start */
 	if (worker->tag_list == NULL)
@@ -1380,6 +1782,100 @@ static void _reset_pl_info(MafwGstRendererWorker *worker)
 	worker->pl.notify_play_pending = TRUE;
 }
 
+/*
+ * Forgets about the clip to continue with in gapless playback.  Only call
+ * this while the pipeline is not running, as the streaming threads use
+ * the flags and the tags.
+ */
+static void _reset_next(MafwGstRendererWorker *worker)
+{
+	g_mutex_lock(worker->next.lock);
+	g_free(worker->next.uri);
+	worker->next.uri = NULL;
+	g_free(worker->next.queued_uri);
+	worker->next.queued_uri = NULL;
+	g_mutex_unlock(worker->next.lock);
+	g_atomic_int_set(&worker->next.queued, FALSE);
+	g_atomic_int_set(&worker->next.flushing, FALSE);
+	_free_tag_messages(&worker->next.tag_list);
+}
+
+/*
+ * In playlist mode, lets the pipeline continue with the next item of the
+ * playlist without stopping.
+ */
+static void _set_pl_next(MafwGstRendererWorker *worker)
+{
+	if (worker->gapless &&
+	    worker->pl.current < (g_slist_length(worker->pl.items) - 1)) {
+		mafw_gst_renderer_worker_set_next(
+			worker,
+			g_slist_nth_data(worker->pl.items,
+					 worker->pl.current + 1));
+	}
+}
+
+/*
+ * Called when the pipeline has moved on to the clip queued in
+ * _about_to_finish_cb() instead of reaching EOS.  The pipeline stays in
+ * PLAYING, only the media information is renewed.
+ */
+static void _handle_next(MafwGstRendererWorker *worker)
+{
+	gchar *uri;
+
+	g_mutex_lock(worker->next.lock);
+	uri = worker->next.queued_uri;
+	worker->next.queued_uri = NULL;
+	g_mutex_unlock(worker->next.lock);
+
+	if (uri == NULL)
+		return;
+
+	g_debug("continuing with %s", uri);
+
+	g_free(worker->media.location);
+	worker->media.location = uri;
+	worker->media.length_nanos = -1;
+	worker->media.seekable = SEEKABILITY_UNKNOWN;
+	worker->is_stream = uri_is_stream(worker->media.location);
+	worker->seek_position = -1;
+	worker->eos = FALSE;
+
+	/* The metadata of the finished clip is gone, what has been read of
+	   the new one is current now */
+	_flush_pending_metadata(worker);
+	_free_taglist(worker);
+	worker->tag_list = worker->next.tag_list;
+	worker->next.tag_list = NULL;
+	if (worker->current_metadata) {
+		g_hash_table_destroy(worker->current_metadata);
+		worker->current_metadata = NULL;
+	}
+
+	switch (worker->mode) {
+	case WORKER_MODE_PLAYLIST:
+		/* Still in the same "playlist", nothing to notify */
+		worker->pl.current++;
+		_set_pl_next(worker);
+		break;
+	case WORKER_MODE_REDUNDANT:
+		/* One of the candidates made it, the next clip is not one
+		   of them */
+		worker->mode = WORKER_MODE_SINGLE_PLAY;
+		_reset_pl_info(worker);
+		/* Fall through */
+	case WORKER_MODE_SINGLE_PLAY:
+		if (worker->notify_next_handler)
+			worker->notify_next_handler(worker, worker->owner);
+		break;
+	}
+
+	if (worker->state == GST_STATE_PLAYING)
+		_emit_metadatas(worker);
+	_add_duration_seek_query_timeout(worker);
+}
+
 static GError * _get_specific_missing_plugin_error(GstMessage *msg)
 {
 	const GstStructure *gst_struct;
@@ -1492,6 +1988,10 @@ static gboolean _async_bus_handler(GstBus *bus, GstMessage *msg,
 					} else {
 						_play_pl_next(worker);
 					}
+				} else if (_defer_until_pl_parsed(worker,
+								  msg)) {
+					g_error_free(err);
+					break;
 				} else {
                                         /* Playlist EOS. We cannot try another
                                          * URI, so we have to go back to normal
@@ -1505,17 +2005,16 @@ static gboolean _async_bus_handler(GstBus *bus, GstMessage *msg,
 			if (worker->mode == WORKER_MODE_SINGLE_PLAY) {
 				if (err->domain == GST_STREAM_ERROR &&
 					err->code == GST_STREAM_ERROR_WRONG_TYPE)
-				{/* Maybe it is a playlist? */
-					GSList *plitems = _parse_playlist(worker->media.location);
-					
-					if (plitems)
-					{/* Yes, it is a plitem */
+				{/* Maybe it is a playlist?  The error is
+				    sent if it is not */
+					if (worker->pl_parser.job == NULL)
+						_start_pl_parsing(
+							worker,
+							worker->media.location,
+							err);
+					else
 						g_error_free(err);
-						mafw_gst_renderer_worker_play(worker, NULL, plitems);
-						break;
-					}
-					
-					
+					break;
 				}
 				_send_error(worker, err);
 			}
@@ -1531,6 +2030,9 @@ static gboolean _async_bus_handler(GstBus *bus, GstMessage *msg,
 					/* If the playlist EOS is not reached
 					   continue playing */
 					_play_pl_next(worker);
+				} else if (_defer_until_pl_parsed(worker,
+								  msg)) {
+					break;
 				} else {
 					/* Playlist EOS, go back to normal
 					   mode */
@@ -1585,6 +2087,11 @@ static gboolean _async_bus_handler(GstBus *bus, GstMessage *msg,
 		break;
 	case GST_MESSAGE_APPLICATION:
 		if (gst_structure_has_name(gst_message_get_structure(msg),
+					   "next"))
+		{
+			_handle_next(worker);
+		}
+		else if (gst_structure_has_name(gst_message_get_structure(msg),
 					   "ckey"))
 		{
 			GValue v = {0};
@@ -1600,6 +2107,74 @@ static gboolean _async_bus_handler(GstBus *bus, GstMessage *msg,
 	return TRUE;
 }
 
+/* NOTE this function is called from a streaming thread of the pipeline.  It is
+ * the moment to hand playbin2 the URI to continue with, if there is one.
+ * Otherwise the current clip reaches EOS and the next one is started from
+ * scratch. */
+static void _about_to_finish_cb(GstElement *pipeline,
+				MafwGstRendererWorker *worker)
+{
+	gchar *uri;
+
+	g_mutex_lock(worker->next.lock);
+	/* If the last switch is still to be handled, this (very short) clip
+	   is let to end normally */
+	uri = NULL;
+	if (worker->next.queued_uri == NULL) {
+		uri = worker->next.uri;
+		worker->next.uri = NULL;
+		worker->next.queued_uri = uri;
+	}
+	g_mutex_unlock(worker->next.lock);
+
+	if (uri == NULL)
+		return;
+
+	g_debug("about to finish, queueing %s", uri);
+	g_atomic_int_set(&worker->next.flushing, FALSE);
+	g_atomic_int_set(&worker->next.queued, TRUE);
+	g_object_set(pipeline, "uri", uri, NULL);
+}
+
+/* NOTE this function is called from a streaming thread of the pipeline.  The
+ * first new segment reaching the audio sink after _about_to_finish_cb()
+ * starts the queued clip, unless it comes from a seek in the current one. */
+static gboolean _next_event_probe(GstPad *pad, GstEvent *event,
+				  MafwGstRendererWorker *worker)
+{
+	gboolean update;
+
+	if (!g_atomic_int_get(&worker->next.queued))
+		return TRUE;
+
+	switch (GST_EVENT_TYPE(event)) {
+	case GST_EVENT_FLUSH_STOP:
+		g_atomic_int_set(&worker->next.flushing, TRUE);
+		break;
+	case GST_EVENT_NEWSEGMENT:
+		gst_event_parse_new_segment(event, &update, NULL, NULL, NULL,
+					    NULL, NULL);
+		/* Segment updates don't start a new stream */
+		if (update)
+			break;
+		if (g_atomic_int_get(&worker->next.flushing)) {
+			g_atomic_int_set(&worker->next.flushing, FALSE);
+		} else {
+			g_atomic_int_set(&worker->next.queued, FALSE);
+			/* Picked up by _async_bus_handler */
+			gst_bus_post(worker->bus,
+				     gst_message_new_application(
+					     GST_OBJECT(worker->pipeline),
+					     gst_structure_empty_new("next")));
+		}
+		break;
+	default:
+		break;
+	}
+
+	return TRUE;
+}
+
 /* NOTE this function will possibly be called from a different thread than the
  * glib main thread. */
 static void _stream_info_cb(GstObject *pipeline, GParamSpec *unused,
@@ -1848,6 +2423,8 @@ static void _construct_pipeline(MafwGstRendererWorker *worker)
 				"buffer-time", (gint64) MAFW_GST_BUFFER_TIME,
 				"latency-time", (gint64) MAFW_GST_LATENCY_TIME,
 				NULL);
+		gst_pad_add_event_probe(GST_BASE_SINK_PAD(worker->asink),
+					G_CALLBACK(_next_event_probe), worker);
 	}
 	g_object_set(worker->pipeline, "audio-sink", worker->asink, NULL);
 #endif
@@ -1873,6 +2450,15 @@ static void _construct_pipeline(MafwGstRendererWorker *worker)
 			"video-sink", worker->vsink,
 			"flags", 99,
 			NULL);
+
+	/* Gapless playback needs playbin2, and our own audio sink to tell
+	   when the next clip starts */
+	if (worker->asink &&
+	    g_signal_lookup("about-to-finish",
+			    G_OBJECT_TYPE(worker->pipeline)) != 0) {
+		g_signal_connect(worker->pipeline, "about-to-finish",
+				 G_CALLBACK(_about_to_finish_cb), worker);
+	}
 }
 
 /*
@@ -2097,6 +2683,7 @@ static void _play_pl_next(MafwGstRendererWorker *worker) {
 	worker->media.location = g_strdup(next);
 	_construct_pipeline(worker);
 	_start_play(worker);
+	_set_pl_next(worker);
 }
 
 static void _do_play(MafwGstRendererWorker *worker)
@@ -2139,28 +2726,26 @@ void mafw_gst_renderer_worker_play(MafwGstRendererWorker *worker,
 	mafw_gst_renderer_worker_stop(worker);
 	_reset_media_info(worker);
 	_reset_pl_info(worker);
+
+	/* Playlists parsed lately are not parsed again */
+	if (!plitems)
+		plitems = _pl_cache_lookup(worker, uri);
+
 	/* Check if the item to play is a single item or a playlist. */
 	if (plitems || uri_is_playlist(uri)){
 		gchar *item;
 		/* In case of a playlist we parse it and start playing the first
-		   item of the playlist. */
-		if (plitems)
-		{
-			worker->pl.items = plitems;
-		}
-		else
-		{
-			worker->pl.items = _parse_playlist(uri);
-		}
-		if (!worker->pl.items)
+		   item of the playlist, as soon as it is known. */
+		if (!plitems)
 		{
-			_send_error(worker,
+			_start_pl_parsing(worker, uri,
 			    g_error_new(MAFW_RENDERER_ERROR,
 					MAFW_RENDERER_ERROR_PLAYLIST_PARSING,
 					"Playlist parsing failed: %s",
 					uri));
 			return;
 		}
+		worker->pl.items = plitems;
 
 		/* Set the playback mode */
 		worker->mode = WORKER_MODE_PLAYLIST;
@@ -2179,6 +2764,8 @@ void mafw_gst_renderer_worker_play(MafwGstRendererWorker *worker,
 	}
 	_construct_pipeline(worker);
 	_start_play(worker);
+	if (worker->mode == WORKER_MODE_PLAYLIST)
+		_set_pl_next(worker);
 }
 
 void mafw_gst_renderer_worker_play_alternatives(MafwGstRendererWorker *worker,
@@ -2215,6 +2802,38 @@ void mafw_gst_renderer_worker_play_alternatives(MafwGstRendererWorker *worker,
         _start_play(worker);
 }
 
+/*
+ * Sets the URI to continue with once the current clip is about to finish,
+ * without stopping the pipeline.  %NULL lets the current clip reach EOS.
+ */
+void mafw_gst_renderer_worker_set_next(MafwGstRendererWorker *worker,
+				       const gchar *uri)
+{
+	g_assert(worker != NULL);
+
+	g_mutex_lock(worker->next.lock);
+	g_free(worker->next.uri);
+	worker->next.uri = g_strdup(uri);
+	g_mutex_unlock(worker->next.lock);
+}
+
+void mafw_gst_renderer_worker_set_gapless(MafwGstRendererWorker *worker,
+					  gboolean gapless)
+{
+	g_assert(worker != NULL);
+
+	worker->gapless = gapless;
+	if (!gapless)
+		mafw_gst_renderer_worker_set_next(worker, NULL);
+}
+
+gboolean mafw_gst_renderer_worker_get_gapless(MafwGstRendererWorker *worker)
+{
+	g_assert(worker != NULL);
+
+	return worker->gapless;
+}
+
 /*
  * Currently, stop destroys the Gst pipeline and resets the worker into
  * default startup configuration.
@@ -2256,6 +2875,7 @@ void mafw_gst_renderer_worker_stop(MafwGstRendererWorker *worker)
 	worker->seek_position = -1;
 	_remove_ready_timeout(worker);
 	_free_taglist(worker);
+	_drop_pending_metadata(worker);
 	if (worker->current_metadata) {
 		g_hash_table_destroy(worker->current_metadata);
 		worker->current_metadata = NULL;
@@ -2268,6 +2888,8 @@ void mafw_gst_renderer_worker_stop(MafwGstRendererWorker *worker)
 
 	/* Reset media iformation */
 	_reset_media_info(worker);
+	_reset_next(worker);
+	_cancel_pl_parsing(worker);
 
 	/* We are not playing, so we can let the screen blank */
 	blanking_allow();
@@ -2373,6 +2995,15 @@ MafwGstRendererWorker *mafw_gst_renderer_worker_new(gpointer owner)
 	worker->pl.items = NULL;
 	worker->pl.current = 0;
 	worker->pl.notify_play_pending = TRUE;
+	worker->next.lock = g_mutex_new();
+	worker->pl_parser.job = NULL;
+	worker->pl_parser.cache =
+		g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+				      (GDestroyNotify) _pl_cache_entry_free);
+	worker->pl_parser.parsed = 0;
+	worker->pl_parser.cache_hits = 0;
+	worker->pl_parser.parse_time = 0.0;
+	worker->gapless = FALSE;
 	worker->owner = owner;
 	worker->report_statechanges = TRUE;
 	worker->state = GST_STATE_NULL;
@@ -2386,16 +3017,19 @@ MafwGstRendererWorker *mafw_gst_renderer_worker_new(gpointer owner)
 	worker->asink = NULL;
 	worker->tag_list = NULL;
 	worker->current_metadata = NULL;
+	worker->pending_metadata = NULL;
+	worker->pending_metadata_id = 0;
 
 #ifdef HAVE_GDKPIXBUF
 	worker->current_frame_on_pause = FALSE;
-	_init_tmp_files_pool(worker);
+	_init_graphic_cache(worker);
 #endif
 	worker->notify_seek_handler = NULL;
 	worker->notify_pause_handler = NULL;
 	worker->notify_play_handler = NULL;
 	worker->notify_buffer_status_handler = NULL;
 	worker->notify_eos_handler = NULL;
+	worker->notify_next_handler = NULL;
 	worker->notify_error_handler = NULL;
 	Global_worker = worker;
 	main_context = g_main_context_default();
@@ -2419,9 +3053,11 @@ void mafw_gst_renderer_worker_exit(MafwGstRendererWorker *worker)
 {
 	blanking_deinit();
 #ifdef HAVE_GDKPIXBUF
-	_destroy_tmp_files_pool(worker);
+	_destroy_graphic_cache(worker);
 #endif
 	mafw_gst_renderer_worker_volume_destroy(worker->wvolume);
         mafw_gst_renderer_worker_stop(worker);
+	g_mutex_free(worker->next.lock);
+	g_hash_table_destroy(worker->pl_parser.cache);
 }
 /* vi: set noexpandtab ts=8 sw=8 cino=t0,(0: */
@@ -29,6 +29,7 @@
 #include <gst/gst.h>
 #include "mafw-gst-renderer-worker-volume.h"
 
+/* Bound of the renderer art and paused frame images kept on disk */
 #define MAFW_GST_RENDERER_MAX_TMP_FILES 5
 
 typedef struct _MafwGstRendererWorker MafwGstRendererWorker;
@@ -38,6 +39,7 @@ typedef void (*MafwGstRendererWorkerNotifyPauseCb)(MafwGstRendererWorker *worker
 typedef void (*MafwGstRendererWorkerNotifyPlayCb)(MafwGstRendererWorker *worker, gpointer owner);
 typedef void (*MafwGstRendererWorkerNotifyBufferStatusCb)(MafwGstRendererWorker *worker, gpointer owner, gdouble percent);
 typedef void (*MafwGstRendererWorkerNotifyEOSCb)(MafwGstRendererWorker *worker, gpointer owner);
+typedef void (*MafwGstRendererWorkerNotifyNextCb)(MafwGstRendererWorker *worker, gpointer owner);
 typedef void (*MafwGstRendererWorkerNotifyErrorCb)(MafwGstRendererWorker *worker,
                                                    gpointer owner,
                                                    const GError *error);
@@ -65,6 +67,22 @@ typedef enum {
  *   par_n:              Video pixel aspect ratio numerator
  *   par_d:              Video pixel aspect ratio denominator
  * owner:        Owner of the worker; usually a MafwGstRenderer (FIXME USUALLY?)
+ * next:         The clip to continue with, without stopping (gapless)
+ *   uri:                URI to hand to the pipeline when the current clip is
+ *                       about to finish
+ *   queued_uri:         URI handed to the pipeline, playing once the current
+ *                       clip has finished
+ *   queued:             @queued_uri has been handed to the pipeline
+ *   flushing:           A seek is in progress while @queued
+ *   tag_list:           Tags of @queued_uri, kept until it starts playing
+ *   lock:               Protects @uri and @queued_uri, which are taken in a
+ *                       streaming thread
+ * pl_parser:    Playlist files parsed in a separate thread
+ *   job:                Ongoing parsing, if any
+ *   cache:              Entries of the playlists parsed lately, by URI
+ *   parsed:             Number of playlists parsed so far
+ *   cache_hits:         Number of playlists taken from @cache
+ *   parse_time:         Time spent on parsing, in seconds
  * pipeline:     Playback pipeline
  * bus:          Message bus
  * state:        Current playback pipeline state
@@ -83,6 +101,9 @@ typedef enum {
  * asink:               Audio sink element of the pipeline
  * xid:                 XID for video playback
  * current_frame_on_pause: whether to emit current frame when pausing
+ * graphic_cache:       images saved lately, keyed by the checksum of their
+ *                      source data, most recently used first
+ * gapless:             continue with the next clip without stopping
  */
 struct _MafwGstRendererWorker {
 	struct {
@@ -102,6 +123,22 @@ struct _MafwGstRendererWorker {
 		gint current;
 		gboolean notify_play_pending;
 	} pl;
+	struct {
+		gchar *uri;
+		gchar *queued_uri;
+		gint queued;
+		gint flushing;
+		GPtrArray *tag_list;
+		GMutex *lock;
+	} next;
+	struct {
+		gpointer job;
+		GHashTable *cache;
+		guint parsed;
+		guint cache_hits;
+		gdouble parse_time;
+	} pl_parser;
+	gboolean gapless;
         gpointer owner;
 	GstElement *pipeline;
 	GstBus *bus;
@@ -155,11 +192,13 @@ struct _MafwGstRendererWorker {
 	gint colorkey;
 	GPtrArray *tag_list;
 	GHashTable *current_metadata;
+	/* Tags changed since the last metadatas-changed emission */
+	GHashTable *pending_metadata;
+	guint pending_metadata_id;
 
 #ifdef HAVE_GDKPIXBUF
 	gboolean current_frame_on_pause;
-	gchar *tmp_files_pool[MAFW_GST_RENDERER_MAX_TMP_FILES];
-	guint8 tmp_files_pool_index;
+	GQueue *graphic_cache;
 #endif
 
         /* Handlers for notifications */
@@ -168,6 +207,7 @@ struct _MafwGstRendererWorker {
         MafwGstRendererWorkerNotifyPlayCb notify_play_handler;
         MafwGstRendererWorkerNotifyBufferStatusCb notify_buffer_status_handler;
         MafwGstRendererWorkerNotifyEOSCb notify_eos_handler;
+        MafwGstRendererWorkerNotifyNextCb notify_next_handler;
         MafwGstRendererWorkerNotifyErrorCb notify_error_handler;
 };
 
@@ -202,6 +242,11 @@ gboolean mafw_gst_renderer_worker_get_seekable(MafwGstRendererWorker *worker);
 GHashTable *mafw_gst_renderer_worker_get_current_metadata(MafwGstRendererWorker *worker);
 void mafw_gst_renderer_worker_play(MafwGstRendererWorker *worker, const gchar *uri, GSList *plitems);
 void mafw_gst_renderer_worker_play_alternatives(MafwGstRendererWorker *worker, gchar **uris);
+void mafw_gst_renderer_worker_set_next(MafwGstRendererWorker *worker,
+				       const gchar *uri);
+void mafw_gst_renderer_worker_set_gapless(MafwGstRendererWorker *worker,
+					  gboolean gapless);
+gboolean mafw_gst_renderer_worker_get_gapless(MafwGstRendererWorker *worker);
 void mafw_gst_renderer_worker_stop(MafwGstRendererWorker *worker);
 void mafw_gst_renderer_worker_pause(MafwGstRendererWorker *worker);
 void mafw_gst_renderer_worker_resume(MafwGstRendererWorker *worker);
@@ -54,6 +54,10 @@
 	(((self)->media != NULL) && ((self)->media->uri != NULL) &&	\
 	 uri_is_stream((self)->media->uri))
 
+/* Playlist items resolved in advance, after and before the current one */
+#define PREFETCH_AHEAD 3
+#define PREFETCH_BEHIND 1
+
 #define GCONF_OSSO_AF "/system/osso/af"
 #define GCONF_BATTERY_COVER_OPEN "/system/osso/af/mmc-cover-open"
 #define HAL_VIDEOOUT_UDI "/org/freedesktop/Hal/devices" \
@@ -135,6 +139,14 @@ static void _notify_metadata(MafwSource *cb_source,
 			     gpointer cb_user_data,
 			     const GError *cb_error);
 
+/*----------------------------------------------------------------------------
+  Prefetch
+  ----------------------------------------------------------------------------*/
+
+static void _prefetch_item_free(gpointer data);
+static void _prefetch_invalidate(MafwGstRenderer *self);
+static void _prefetch_cancel_hit(MafwGstRenderer *self);
+
 /*----------------------------------------------------------------------------
   Notification operations
   ----------------------------------------------------------------------------*/
@@ -145,6 +157,7 @@ static void _notify_seek(MafwGstRendererWorker *worker, gpointer owner);
 static void _notify_buffer_status(MafwGstRendererWorker *worker, gpointer owner,
 				  gdouble percent);
 static void _notify_eos(MafwGstRendererWorker *worker, gpointer owner);
+static void _notify_next(MafwGstRendererWorker *worker, gpointer owner);
 static void _error_handler(MafwGstRendererWorker *worker, gpointer owner,
 			   const GError *error);
 
@@ -287,9 +300,20 @@ static void mafw_gst_renderer_init(MafwGstRenderer *self)
         mafw_extension_add_property(MAFW_EXTENSION(self),
                                     MAFW_PROPERTY_GST_RENDERER_TV_CONNECTED,
                                     G_TYPE_BOOLEAN);
+	mafw_extension_add_property(MAFW_EXTENSION(self),
+				    MAFW_PROPERTY_GST_RENDERER_GAPLESS,
+				    G_TYPE_BOOLEAN);
  	MAFW_EXTENSION_SUPPORTS_TRANSPORT_ACTIONS(self);
 	renderer->media = g_new0(MafwGstRendererMedia, 1);
 	renderer->media->seekability = SEEKABILITY_UNKNOWN;
+	renderer->next_media = NULL;
+	renderer->gapless = FALSE;
+	renderer->prefetch.items =
+		g_hash_table_new_full(g_direct_hash, g_direct_equal,
+				      NULL, _prefetch_item_free);
+	renderer->prefetch.request = NULL;
+	renderer->prefetch.hit = NULL;
+	renderer->prefetch.hit_id = 0;
 	renderer->current_state = Stopped;
 
 	renderer->playlist = NULL;
@@ -305,6 +329,7 @@ static void mafw_gst_renderer_init(MafwGstRenderer *self)
         renderer->worker->notify_seek_handler = _notify_seek;
         renderer->worker->notify_error_handler = _error_handler;
         renderer->worker->notify_eos_handler = _notify_eos;
+        renderer->worker->notify_next_handler = _notify_next;
 	renderer->worker->notify_buffer_status_handler = _notify_buffer_status;
 
 	renderer->states = g_new0 (MafwGstRendererState*, _LastMafwPlayState);
@@ -372,6 +397,13 @@ static void mafw_gst_renderer_dispose(GObject *object)
 		renderer->worker = NULL;
 	}
 
+	if (renderer->prefetch.items != NULL) {
+		_prefetch_cancel_hit(renderer);
+		_prefetch_invalidate(renderer);
+		g_hash_table_destroy(renderer->prefetch.items);
+		renderer->prefetch.items = NULL;
+	}
+
 	if (renderer->registry != NULL) {
 		g_object_unref(renderer->registry);
 		renderer->registry = NULL;
@@ -573,6 +605,199 @@ static MafwSource* _get_source(MafwGstRenderer *renderer,
 	return source;
 }
 
+/* List of metadata keys that we are interested in when going to
+   Transitioning state */
+static const gchar * const _play_metadata_keys[] =
+	{ MAFW_METADATA_KEY_URI,
+	  MAFW_METADATA_KEY_IS_SEEKABLE,
+	  MAFW_METADATA_KEY_DURATION,
+	  NULL };
+
+/*----------------------------------------------------------------------------
+  Prefetch
+  ----------------------------------------------------------------------------*/
+
+/* A playlist item whose metadata has been resolved in advance */
+typedef struct {
+	gchar *object_id;
+	GHashTable *metadata;
+} MafwGstRendererPrefetchItem;
+
+/* Closure of a mafw_playlist_get_items_md() operation, @renderer is unset
+   once the operation has been cancelled */
+typedef struct {
+	MafwGstRenderer *renderer;
+	gpointer op;
+} MafwGstRendererPrefetchRequest;
+
+static void _prefetch_item_free(gpointer data)
+{
+	MafwGstRendererPrefetchItem *item = data;
+
+	g_free(item->object_id);
+	mafw_metadata_release(item->metadata);
+	g_free(item);
+}
+
+static void _prefetch_request_free(MafwGstRendererPrefetchRequest *request)
+{
+	if (request->renderer != NULL)
+		request->renderer->prefetch.request = NULL;
+	g_free(request);
+}
+
+static void _prefetch_item_cb(MafwPlaylist *pls, guint index,
+			      const gchar *object_id, GHashTable *metadata,
+			      gpointer cbarg)
+{
+	MafwGstRendererPrefetchRequest *request = cbarg;
+	MafwGstRendererPrefetchItem *item;
+
+	/* Items without a URI are resolved again when played, so that
+	   the error is reported then */
+	if (request->renderer == NULL || metadata == NULL ||
+	    mafw_metadata_first(metadata, MAFW_METADATA_KEY_URI) == NULL)
+		return;
+
+	item = g_new0(MafwGstRendererPrefetchItem, 1);
+	item->object_id = g_strdup(object_id);
+	item->metadata = g_hash_table_ref(metadata);
+	g_hash_table_replace(request->renderer->prefetch.items,
+			     GINT_TO_POINTER(index), item);
+}
+
+static void _prefetch_cancel(MafwGstRenderer *self)
+{
+	MafwGstRendererPrefetchRequest *request = self->prefetch.request;
+
+	if (request != NULL) {
+		/* libmafw frees it when the operation winds up */
+		request->renderer = NULL;
+		mafw_playlist_cancel_get_items_md(request->op);
+		self->prefetch.request = NULL;
+	}
+}
+
+static void _prefetch_cancel_hit(MafwGstRenderer *self)
+{
+	if (self->prefetch.hit_id != 0) {
+		g_source_remove(self->prefetch.hit_id);
+		self->prefetch.hit_id = 0;
+	}
+	if (self->prefetch.hit != NULL) {
+		_prefetch_item_free(self->prefetch.hit);
+		self->prefetch.hit = NULL;
+	}
+}
+
+/* Forgets everything resolved so far, the playlist indexes are not valid
+   anymore */
+static void _prefetch_invalidate(MafwGstRenderer *self)
+{
+	_prefetch_cancel(self);
+	g_hash_table_remove_all(self->prefetch.items);
+}
+
+static gboolean _prefetch_is_outside(gpointer key, gpointer value,
+				     gpointer user_data)
+{
+	gint index = GPOINTER_TO_INT(key);
+	gint *window = user_data;
+
+	return index < window[0] || index > window[1];
+}
+
+/*
+ * Resolves the items around the current one in the playlist, so that moving
+ * to them does not need to wait for their sources.  Only the part of the
+ * window that is not known yet is requested.
+ */
+static void _prefetch_update(MafwGstRenderer *self)
+{
+	MafwGstRendererPrefetchRequest *request;
+	gint window[2];
+	gint current, size, first, last, i;
+
+	if (self->playlist == NULL ||
+	    self->playback_mode != MAFW_GST_RENDERER_MODE_PLAYLIST)
+		return;
+
+	/* The neighbours in the visual order are not the ones played next */
+	if (mafw_playlist_is_shuffled(self->playlist))
+		return;
+
+	current = mafw_playlist_iterator_get_current_index(self->iterator);
+	size = mafw_playlist_iterator_get_size(self->iterator, NULL);
+	if (current < 0 || size <= 0)
+		return;
+
+	window[0] = MAX(current - PREFETCH_BEHIND, 0);
+	window[1] = MIN(current + PREFETCH_AHEAD, size - 1);
+	g_hash_table_foreach_remove(self->prefetch.items,
+				    _prefetch_is_outside, window);
+
+	first = last = -1;
+	for (i = window[0]; i <= window[1]; i++) {
+		if (i != current &&
+		    g_hash_table_lookup(self->prefetch.items,
+					GINT_TO_POINTER(i)) == NULL) {
+			if (first < 0)
+				first = i;
+			last = i;
+		}
+	}
+	if (first < 0)
+		return;
+
+	_prefetch_cancel(self);
+
+	request = g_new0(MafwGstRendererPrefetchRequest, 1);
+	request->renderer = self;
+	request->op = mafw_playlist_get_items_md(
+		self->playlist, first, last, _play_metadata_keys,
+		_prefetch_item_cb, request,
+		(GDestroyNotify) _prefetch_request_free);
+
+	/* With an explicit range the closure is only taken over on success */
+	if (request->op != NULL)
+		self->prefetch.request = request;
+	else
+		g_free(request);
+}
+
+/* Looks up the prefetched metadata of @object_id at @index */
+static MafwGstRendererPrefetchItem *_prefetch_lookup(MafwGstRenderer *self,
+						     gint index,
+						     const gchar *object_id)
+{
+	MafwGstRendererPrefetchItem *item;
+
+	if (index < 0)
+		return NULL;
+
+	item = g_hash_table_lookup(self->prefetch.items,
+				   GINT_TO_POINTER(index));
+	if (item == NULL || strcmp(item->object_id, object_id) != 0)
+		return NULL;
+
+	return item;
+}
+
+static gboolean _prefetch_hit_cb(gpointer data)
+{
+	MafwGstRenderer *renderer = (MafwGstRenderer *) data;
+	MafwGstRendererPrefetchItem *hit = renderer->prefetch.hit;
+
+	renderer->prefetch.hit = NULL;
+	renderer->prefetch.hit_id = 0;
+
+	g_debug("playing prefetched item %s", hit->object_id);
+	_notify_metadata(NULL, hit->object_id, hit->metadata, renderer, NULL);
+	_prefetch_item_free(hit);
+
+	return FALSE;
+}
+
 void mafw_gst_renderer_get_metadata(MafwGstRenderer* self,
 				  const gchar* objectid,
 				  GError **error)
@@ -581,6 +806,29 @@ void mafw_gst_renderer_get_metadata(MafwGstRenderer* self,
 
 	g_assert(self != NULL);
 
+	_prefetch_cancel_hit(self);
+
+	/* The metadata may be at hand already.  It is still delivered from
+	   an idle callback, as the caller has to move to Transitioning
+	   first */
+	if (self->playback_mode == MAFW_GST_RENDERER_MODE_PLAYLIST &&
+	    self->iterator != NULL) {
+		MafwGstRendererPrefetchItem *item;
+		gint index;
+
+		index = mafw_playlist_iterator_get_current_index(self->iterator);
+		item = _prefetch_lookup(self, index, objectid);
+		if (item != NULL) {
+			g_hash_table_steal(self->prefetch.items,
+					   GINT_TO_POINTER(index));
+			self->prefetch.hit = item;
+			self->prefetch.hit_id = g_idle_add(_prefetch_hit_cb,
+							   self);
+			_prefetch_update(self);
+			return;
+		}
+	}
+
 	/*
 	 * Any error here is an error when trying to Play, so
 	 * it must be handled by error policy.
@@ -595,17 +843,9 @@ void mafw_gst_renderer_get_metadata(MafwGstRenderer* self,
 	source = _get_source(self, objectid);
 	if (source != NULL)
 	{
-		/* List of metadata keys that we are interested in when going to
-		   Transitioning state */
-		static const gchar * const keys[] =
-			{ MAFW_METADATA_KEY_URI,
-			  MAFW_METADATA_KEY_IS_SEEKABLE,
-			  MAFW_METADATA_KEY_DURATION,
-				NULL };
-
 		/* Source found, get metadata */
 		mafw_source_get_metadata(source, objectid,
-					 keys,
+					 _play_metadata_keys,
 					 _notify_metadata,
 					 self);
 
@@ -622,6 +862,9 @@ void mafw_gst_renderer_get_metadata(MafwGstRenderer* self,
 			     "Unable to find source for current object ID");
 		g_idle_add(mafw_gst_renderer_manage_error_idle, error_closure);
 	}
+
+	/* Get the neighbours ready while this one is being resolved */
+	_prefetch_update(self);
 }
 
 void mafw_gst_renderer_set_object(MafwGstRenderer *self, const gchar *object_id)
@@ -646,6 +889,19 @@ void mafw_gst_renderer_set_object(MafwGstRenderer *self, const gchar *object_id)
 }
 
 
+static void _clear_next_media(MafwGstRenderer *self)
+{
+	if (self->next_media != NULL) {
+		g_free(self->next_media->object_id);
+		g_free(self->next_media->uri);
+		g_free(self->next_media);
+		self->next_media = NULL;
+	}
+
+	if (self->worker != NULL)
+		mafw_gst_renderer_worker_set_next(self->worker, NULL);
+}
+
 /**
  * mafw_gst_renderer_clear_media:
  *
@@ -675,6 +931,10 @@ void mafw_gst_renderer_clear_media(MafwGstRenderer *self)
 
 	self->media->duration = 0;
 	self->media->position = 0;
+
+	/* The next item is relative to the current one */
+	_clear_next_media(self);
+	_prefetch_cancel_hit(self);
 }
 
 
@@ -704,6 +964,107 @@ void mafw_gst_renderer_set_media_playlist(MafwGstRenderer* self)
 	_signal_media_changed(self);
 }
 
+/*----------------------------------------------------------------------------
+  Gapless playback
+  ----------------------------------------------------------------------------*/
+
+static void _notify_next_metadata(MafwSource *cb_source,
+				  const gchar *cb_object_id,
+				  GHashTable *cb_metadata,
+				  gpointer cb_user_data,
+				  const GError *cb_error)
+{
+	MafwGstRenderer *renderer = (MafwGstRenderer*) cb_user_data;
+	MafwGstRendererMedia *next;
+	gpointer value;
+	GValue *mval;
+	const gchar *uri;
+
+	g_return_if_fail(MAFW_IS_GST_RENDERER(renderer));
+
+	/* Is this still the item after the current one? */
+	next = renderer->next_media;
+	if (next == NULL || next->uri != NULL || cb_object_id == NULL ||
+	    strcmp(cb_object_id, next->object_id) != 0)
+		return;
+
+	/* Without a single, plain URI the item is played the usual way,
+	   once the current one has reached EOS */
+	if (cb_error != NULL || cb_metadata == NULL)
+		return;
+	value = g_hash_table_lookup(cb_metadata, MAFW_METADATA_KEY_URI);
+	if (value == NULL || mafw_metadata_nvalues(value) != 1)
+		return;
+	mval = mafw_metadata_first(cb_metadata, MAFW_METADATA_KEY_URI);
+	uri = g_value_get_string(mval);
+	if (uri == NULL || uri_is_playlist(uri))
+		return;
+
+	next->uri = g_strdup(uri);
+
+	mval = mafw_metadata_first(cb_metadata, MAFW_METADATA_KEY_IS_SEEKABLE);
+	if (mval != NULL)
+		next->seekability = g_value_get_boolean(mval) ?
+			SEEKABILITY_SEEKABLE : SEEKABILITY_NO_SEEKABLE;
+	mval = mafw_metadata_first(cb_metadata, MAFW_METADATA_KEY_DURATION);
+	next->duration = mval != NULL ? g_value_get_int(mval) : -1;
+
+	g_debug("next clip ready for gapless playback: %s", next->uri);
+	mafw_gst_renderer_worker_set_next(renderer->worker, next->uri);
+}
+
+/**
+ * mafw_gst_renderer_prepare_next:
+ *
+ * @self A #MafwGstRenderer
+ *
+ * Resolves the URI of the playlist item after the current one, so that the
+ * worker can continue with it without stopping when the current one ends.
+ * Anything prepared before is dropped.
+ **/
+void mafw_gst_renderer_prepare_next(MafwGstRenderer *self)
+{
+	MafwGstRendererPrefetchItem *item;
+	MafwSource *source;
+	gchar *object_id = NULL;
+	gint index;
+
+	g_return_if_fail(MAFW_IS_GST_RENDERER(self));
+
+	_clear_next_media(self);
+
+	/* Playlists parsed by the worker go through their items on their
+	   own, the next playlist item comes after EOS */
+	if (!self->gapless || self->playlist == NULL ||
+	    self->playback_mode != MAFW_GST_RENDERER_MODE_PLAYLIST ||
+	    self->worker->mode == WORKER_MODE_PLAYLIST)
+		return;
+
+	if (mafw_playlist_iterator_get_next(self->iterator, &index,
+					     &object_id, NULL) !=
+	    MAFW_PLAYLIST_ITERATOR_MOVE_RESULT_OK)
+		return;
+
+	source = _get_source(self, object_id);
+	if (source == NULL) {
+		g_free(object_id);
+		return;
+	}
+
+	self->next_media = g_new0(MafwGstRendererMedia, 1);
+	self->next_media->object_id = object_id;
+	self->next_media->seekability = SEEKABILITY_UNKNOWN;
+
+	item = _prefetch_lookup(self, index, object_id);
+	if (item != NULL)
+		_notify_next_metadata(NULL, object_id, item->metadata, self,
+				      NULL);
+	else
+		mafw_source_get_metadata(source, object_id,
+					 _play_metadata_keys,
+					 _notify_next_metadata, self);
+}
+
 #ifdef HAVE_CONIC
 /*----------------------------------------------------------------------------
   Connection
@@ -1643,6 +2004,10 @@ static void _playlist_changed_handler(MafwPlaylistIterator *iterator,
 			clip_changed,
 			&error);
 
+		/* The item after the current one may have changed too */
+		if (renderer->next_media != NULL)
+			mafw_gst_renderer_prepare_next(renderer);
+
 		if (error != NULL) {
 			g_signal_emit_by_name(MAFW_EXTENSION(renderer), "error",
 					      error->domain, error->code,
@@ -1832,6 +2197,28 @@ static void _notify_eos(MafwGstRendererWorker *worker, gpointer owner)
   Status
   ----------------------------------------------------------------------------*/
 
+static void _notify_next(MafwGstRendererWorker *worker, gpointer owner)
+{
+	MafwGstRenderer *renderer = (MafwGstRenderer*) owner;
+	GError *error = NULL;
+
+	g_return_if_fail(MAFW_IS_GST_RENDERER (renderer));
+
+	g_return_if_fail((renderer->states != 0) &&
+			 (renderer->current_state != _LastMafwPlayState) &&
+			 (renderer->states[renderer->current_state] != NULL));
+
+	mafw_gst_renderer_state_notify_next(renderer->states[renderer->current_state],
+					  &error);
+
+	if (error != NULL) {
+		g_signal_emit_by_name(MAFW_EXTENSION(renderer), "error",
+				      error->domain, error->code,
+				      error->message);
+		g_error_free(error);
+	}
+}
+
 void mafw_gst_renderer_get_status(MafwRenderer *self, MafwRendererStatusCB callback,
 				gpointer user_data)
 {
@@ -1889,6 +2276,11 @@ _playlist_contents_changed_handler(MafwPlaylist *playlist,
 	/* Item(s) added to playlist, so new playable items could come */
 	if (nreplace)
 		renderer->play_failed_count = 0;
+
+	/* The items around the current one may have moved */
+	_prefetch_invalidate(renderer);
+	if (renderer->current_state != Stopped)
+		_prefetch_update(renderer);
 }
 
 gboolean mafw_gst_renderer_assign_playlist(MafwRenderer *self,
@@ -1900,6 +2292,7 @@ gboolean mafw_gst_renderer_assign_playlist(MafwRenderer *self,
 	g_return_val_if_fail(MAFW_IS_GST_RENDERER(self), FALSE);
 
 	/* Get rid of previously assigned playlist  */
+	_prefetch_invalidate(renderer);
 	if (renderer->playlist != NULL) {
 		g_signal_handlers_disconnect_matched(renderer->iterator,
 						     (GSignalMatchType) G_SIGNAL_MATCH_FUNC,
@@ -2110,6 +2503,11 @@ static void mafw_gst_renderer_get_property(MafwExtension *self,
                 g_value_init(value, G_TYPE_BOOLEAN);
                 g_value_set_boolean(value, renderer->tv_connected);
         }
+	else if (!strcmp(key, MAFW_PROPERTY_GST_RENDERER_GAPLESS)) {
+		value = g_new0(GValue, 1);
+		g_value_init(value, G_TYPE_BOOLEAN);
+		g_value_set_boolean(value, renderer->gapless);
+	}
 	else if (!strcmp(key,
 			 MAFW_PROPERTY_RENDERER_TRANSPORT_ACTIONS)){
 		/* Delegate in the state. */
@@ -2186,6 +2584,15 @@ static void mafw_gst_renderer_set_property(MafwExtension *self,
 									   current_frame_on_pause);
 	}
 #endif
+	else if (!strcmp(key, MAFW_PROPERTY_GST_RENDERER_GAPLESS)) {
+		renderer->gapless = g_value_get_boolean(value);
+		mafw_gst_renderer_worker_set_gapless(renderer->worker,
+						     renderer->gapless);
+		/* Takes effect from the current clip on */
+		if (renderer->current_state == Playing ||
+		    renderer->current_state == Paused)
+			mafw_gst_renderer_prepare_next(renderer);
+	}
 	else return;
 
 	/* FIXME I'm not sure when to emit property-changed signals.
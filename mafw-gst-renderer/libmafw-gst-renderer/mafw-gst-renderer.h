@@ -74,6 +74,7 @@ typedef enum {
 #endif
 
 #define MAFW_PROPERTY_GST_RENDERER_TV_CONNECTED "tv-connected"
+#define MAFW_PROPERTY_GST_RENDERER_GAPLESS "gapless-playback"
 
 /*----------------------------------------------------------------------------
   GObject type conversion macros
@@ -126,6 +127,8 @@ struct _MafwGstRendererClass {
 
 /*
  * media:             Current media details
+ * next_media:        Details of the next playlist item, resolved in advance
+ *                    for gapless playback
  * worker:            Worker
  * registry:          The registry that owns this renderer
  * media_timer:      Stream timer data
@@ -143,11 +146,19 @@ struct _MafwGstRendererClass {
  * states:            State array
  * error_policy:      error policy
  * tv_connected:      if TV-out cable is connected
+ * gapless:           continue with the next playlist item without stopping
+ * prefetch:          Look-ahead metadata of the playlist items around the
+ *                    current one
+ *   items:           Resolved items by playlist index
+ *   request:         Ongoing mafw_playlist_get_items_md() filling @items
+ *   hit:             Prefetched item waiting to be played
+ *   hit_id:          Idle source delivering @hit
  */
 struct _MafwGstRenderer{
 	MafwRenderer parent;
 
 	MafwGstRendererMedia *media;
+	MafwGstRendererMedia *next_media;
 	MafwGstRendererWorker *worker;
 	MafwRegistry *registry;
 	LibHalContext *hal_ctx;
@@ -166,6 +177,14 @@ struct _MafwGstRenderer{
  	MafwGstRendererState **states;
 	MafwRendererErrorPolicy error_policy;
         gboolean tv_connected;
+	gboolean gapless;
+
+	struct {
+		GHashTable *items;
+		gpointer request;
+		gpointer hit;
+		guint hit_id;
+	} prefetch;
 
 #ifdef HAVE_CONIC
 	gboolean connected;
@@ -247,6 +266,7 @@ MafwGstRendererMovementResult mafw_gst_renderer_move(MafwGstRenderer *renderer,
   ----------------------------------------------------------------------------*/
 
 void mafw_gst_renderer_set_media_playlist(MafwGstRenderer* self);
+void mafw_gst_renderer_prepare_next(MafwGstRenderer *self);
 
 /*----------------------------------------------------------------------------
   Position
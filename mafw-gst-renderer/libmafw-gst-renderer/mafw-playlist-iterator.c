@@ -420,6 +420,35 @@ mafw_playlist_iterator_move_to_next(MafwPlaylistIterator *iterator,
 								  error);
 }
 
+/* Finds the item that mafw_playlist_iterator_move_to_next() would move to,
+ * without moving.  @objectid is set to a newly allocated string. */
+MafwPlaylistIteratorMovementResult
+mafw_playlist_iterator_get_next(MafwPlaylistIterator *iterator,
+				 gint *index, gchar **objectid,
+				 GError **error)
+{
+	guint next_index;
+	GError *new_error = NULL;
+
+	g_return_val_if_fail(mafw_playlist_iterator_is_valid(iterator),
+			     MAFW_PLAYLIST_ITERATOR_MOVE_RESULT_INVALID);
+
+	next_index = iterator->priv->current_index;
+	*objectid = NULL;
+
+	if (!mafw_playlist_get_next(iterator->priv->playlist, &next_index,
+				    objectid, &new_error)) {
+		if (new_error != NULL) {
+			g_propagate_error(error, new_error);
+			return MAFW_PLAYLIST_ITERATOR_MOVE_RESULT_ERROR;
+		}
+		return MAFW_PLAYLIST_ITERATOR_MOVE_RESULT_LIMIT;
+	}
+
+	*index = next_index;
+	return MAFW_PLAYLIST_ITERATOR_MOVE_RESULT_OK;
+}
+
 MafwPlaylistIteratorMovementResult
 mafw_playlist_iterator_move_to_prev(MafwPlaylistIterator *iterator,
 				     GError **error)
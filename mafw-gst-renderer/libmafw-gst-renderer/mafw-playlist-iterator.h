@@ -81,6 +81,10 @@ void mafw_playlist_iterator_reset(MafwPlaylistIterator *iterator, GError **error
 void mafw_playlist_iterator_move_to_last(MafwPlaylistIterator *iterator, GError **error);
 MafwPlaylistIteratorMovementResult mafw_playlist_iterator_move_to_next(MafwPlaylistIterator *iterator,
 									 GError **error);
+MafwPlaylistIteratorMovementResult mafw_playlist_iterator_get_next(MafwPlaylistIterator *iterator,
+								     gint *index,
+								     gchar **objectid,
+								     GError **error);
 MafwPlaylistIteratorMovementResult mafw_playlist_iterator_move_to_prev(MafwPlaylistIterator *iterator,
 									 GError **error);
 MafwPlaylistIteratorMovementResult mafw_playlist_iterator_move_to_index(MafwPlaylistIterator *iterator,
@@ -0,0 +1,171 @@
+/*
+ * This file is a part of MAFW
+ *
+ * Copyright (C) 2007, 2008, 2009 Nokia Corporation, all rights reserved.
+ *
+ * Contact: Visa Smolander <visa.smolander@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+/*
+ * bench-frame-conv.c
+ *
+ * Compares the in-process frame conversion with the conversion pipeline,
+ * converting the same synthetic frame to what the worker asks for when
+ * it saves the current frame.
+ *
+ * Usage: bench-frame-conv [iterations] [width] [height]
+ */
+
+#include <stdlib.h>
+#include <gst/gst.h>
+
+#include "gstscreenshot.h"
+
+static GMainLoop *Loop;
+static GstBuffer *Pipeline_result;
+
+static GstCaps *make_rgb_caps(void)
+{
+	return gst_caps_new_simple("video/x-raw-rgb",
+				   "bpp", G_TYPE_INT, 24,
+				   "depth", G_TYPE_INT, 24,
+				   "framerate", GST_TYPE_FRACTION, 25, 1,
+				   "pixel-aspect-ratio", GST_TYPE_FRACTION,
+				   1, 1,
+				   "endianness", G_TYPE_INT, G_BIG_ENDIAN,
+				   "red_mask", G_TYPE_INT, 0xff0000,
+				   "green_mask", G_TYPE_INT, 0x00ff00,
+				   "blue_mask", G_TYPE_INT, 0x0000ff,
+				   NULL);
+}
+
+/* An I420 frame with some gradients, non-square pixels. */
+static GstBuffer *make_frame(gint width, gint height)
+{
+	GstBuffer *buf;
+	GstCaps *caps;
+	guint ystride, cstride, csize, k;
+	gint i, j;
+	guint8 *data;
+
+	ystride = GST_ROUND_UP_4(width);
+	cstride = GST_ROUND_UP_8(width) / 2;
+	csize = cstride * (GST_ROUND_UP_2(height) / 2);
+	buf = gst_buffer_new_and_alloc(ystride * GST_ROUND_UP_2(height) +
+				       2 * csize);
+	data = GST_BUFFER_DATA(buf);
+
+	for (i = 0; i < height; i++)
+		for (j = 0; j < width; j++)
+			data[i * ystride + j] = 16 + (i + j) % 220;
+	data += ystride * GST_ROUND_UP_2(height);
+	for (k = 0; k < csize; k++) {
+		data[k] = k % 256;
+		data[csize + k] = 255 - k % 256;
+	}
+
+	caps = gst_caps_new_simple("video/x-raw-yuv",
+				   "format", GST_TYPE_FOURCC,
+				   GST_MAKE_FOURCC('I', '4', '2', '0'),
+				   "width", G_TYPE_INT, width,
+				   "height", G_TYPE_INT, height,
+				   "framerate", GST_TYPE_FRACTION, 25, 1,
+				   "pixel-aspect-ratio", GST_TYPE_FRACTION,
+				   16, 15,
+				   NULL);
+	gst_buffer_set_caps(buf, caps);
+	gst_caps_unref(caps);
+
+	return buf;
+}
+
+static void pipeline_done(GstBuffer *result, gpointer user_data)
+{
+	Pipeline_result = result;
+	g_main_loop_quit(Loop);
+}
+
+int main(int argc, char *argv[])
+{
+	gint iterations = 50, width = 640, height = 480, i;
+	GstBuffer *frame, *result;
+	GTimer *timer;
+	gdouble native_time, pipeline_time;
+
+	gst_init(&argc, &argv);
+	if (argc > 1)
+		iterations = atoi(argv[1]);
+	if (argc > 3) {
+		width = atoi(argv[2]);
+		height = atoi(argv[3]);
+	}
+	if (iterations <= 0 || width <= 0 || height <= 0) {
+		g_printerr("usage: %s [iterations] [width] [height]\n",
+			   argv[0]);
+		return 1;
+	}
+
+	Loop = g_main_loop_new(NULL, FALSE);
+	frame = make_frame(width, height);
+	timer = g_timer_new();
+
+	g_timer_start(timer);
+	for (i = 0; i < iterations; i++) {
+		GstCaps *caps = make_rgb_caps();
+
+		result = bvw_frame_conv_convert_native(frame, caps);
+		gst_caps_unref(caps);
+		if (result == NULL) {
+			g_printerr("in-process conversion not supported\n");
+			return 1;
+		}
+		gst_buffer_unref(result);
+	}
+	native_time = g_timer_elapsed(timer, NULL);
+
+	g_timer_start(timer);
+	for (i = 0; i < iterations; i++) {
+		Pipeline_result = NULL;
+		if (!bvw_frame_conv_convert_pipeline(gst_buffer_ref(frame),
+						     make_rgb_caps(),
+						     pipeline_done, NULL)) {
+			g_printerr("could not run the conversion pipeline\n");
+			return 1;
+		}
+		g_main_loop_run(Loop);
+		if (Pipeline_result == NULL) {
+			g_printerr("the conversion pipeline failed\n");
+			return 1;
+		}
+		gst_buffer_unref(Pipeline_result);
+	}
+	pipeline_time = g_timer_elapsed(timer, NULL);
+
+	g_print("%dx%d I420 -> RGB, %d frames\n", width, height, iterations);
+	g_print("  in-process: %8.3f ms/frame\n",
+		1000 * native_time / iterations);
+	g_print("  pipeline:   %8.3f ms/frame\n",
+		1000 * pipeline_time / iterations);
+
+	g_timer_destroy(timer);
+	gst_buffer_unref(frame);
+	g_main_loop_unref(Loop);
+
+	return 0;
+}
@@ -45,6 +45,9 @@
 #include "config.h"
 
 #include "mafw-gst-renderer.h"
+#ifdef HAVE_GDKPIXBUF
+#include "gstscreenshot.h"
+#endif
 #include "mafw-mock-playlist.h"
 #include "mafw-mock-pulseaudio.h"
 
@@ -53,6 +56,7 @@
 
 #define SAMPLE_AUDIO_CLIP "test.wav"
 #define SAMPLE_VIDEO_CLIP "test.avi"
+#define SAMPLE_PLAYLIST "test.m3u"
 #define SAMPLE_IMAGE "testframe.png"
 
 /* Base timeout used when waiting for state transitions or execution of
@@ -850,6 +854,12 @@ START_TEST(test_playlist_playback)
 		fail(state_err_msg, "mafw_renderer_play", "Playing", s.state);
 	}
 
+	/* The following items have been resolved meanwhile */
+	fail_if(g_hash_table_lookup(
+			MAFW_GST_RENDERER(g_gst_renderer)->prefetch.items,
+			GINT_TO_POINTER(s.index + 1)) == NULL,
+		"Next playlist item was not prefetched");
+
 	/* --- Stop --- */
 
 	reset_callback_info(&c);
@@ -1243,6 +1253,85 @@ START_TEST(test_playlist_playback)
 END_TEST
 
 
+START_TEST(test_playlist_file_playback)
+{
+	RendererInfo s = {0, };
+	CallbackInfo c = {0, };
+	gchar *objectid = NULL;
+	gint i;
+
+	/* Initialize callback info */
+	c.err_msg = NULL;
+	c.error_signal_expected = FALSE;
+	c.error_signal_received = NULL;
+	c.property_expected = NULL;
+	c.property_received = NULL;
+
+	/* Connect to renderer signals */
+	g_signal_connect(g_gst_renderer, "error",
+			 G_CALLBACK(error_cb),
+			 &c);
+	g_signal_connect(g_gst_renderer, "state-changed",
+			 G_CALLBACK(state_changed_cb),
+			 &s);
+
+	/* The second time the playlist entries come from the cache */
+
+	objectid = get_sample_clip_objectid(SAMPLE_PLAYLIST);
+	for (i = 0; i < 2; i++) {
+
+		/* --- Play object --- */
+
+		reset_callback_info(&c);
+
+		g_debug("play_object... %s", objectid);
+		mafw_renderer_play_object(g_gst_renderer, objectid,
+					  playback_cb, &c);
+
+		if (wait_for_callback(&c, wait_tout_val)) {
+			if (c.error)
+				fail(callback_err_msg, "playing a playlist",
+				     c.err_code, c.err_msg);
+		} else {
+			fail(no_callback_msg);
+		}
+
+		if (wait_for_state(&s, Playing, wait_tout_val) == FALSE) {
+			fail(state_err_msg, "mafw_renderer_play_object",
+			     "Playing", s.state);
+		}
+
+		/* --- Stop --- */
+
+		reset_callback_info(&c);
+
+		g_debug("stop...");
+		mafw_renderer_stop(g_gst_renderer, playback_cb, &c);
+
+		if (wait_for_callback(&c, wait_tout_val)) {
+			if (c.error)
+				fail(callback_err_msg, "stopping", c.err_code,
+				     c.err_msg);
+		} else {
+			fail(no_callback_msg);
+		}
+
+		if (wait_for_state(&s, Stopped, wait_tout_val) == FALSE) {
+			fail(state_err_msg, "mafw_renderer_stop", "Stopped",
+			     s.state);
+		}
+	}
+	g_free(objectid);
+
+	fail_if(MAFW_GST_RENDERER(g_gst_renderer)->worker->pl_parser.parsed != 1,
+		"The playlist was parsed %d times",
+		MAFW_GST_RENDERER(g_gst_renderer)->worker->pl_parser.parsed);
+	fail_if(MAFW_GST_RENDERER(g_gst_renderer)->worker->pl_parser.cache_hits != 1,
+		"The playlist was taken from the cache %d times",
+		MAFW_GST_RENDERER(g_gst_renderer)->worker->pl_parser.cache_hits);
+}
+END_TEST
+
 START_TEST(test_repeat_mode_playback)
 {
 	MafwPlaylist *playlist = NULL;
@@ -1760,6 +1849,108 @@ GObject* mock_source_new(void)
 }
 
 
+/* A source answering get_metadata() from an idle callback with a URI for
+ * every object, and counting the requests per object ID. */
+typedef struct {
+	MafwSourceClass parent;
+} PrefetchSourceClass;
+
+typedef struct {
+	MafwSource parent;
+} PrefetchSource;
+
+GType prefetch_source_get_type(void);
+
+G_DEFINE_TYPE(PrefetchSource, prefetch_source, MAFW_TYPE_SOURCE);
+
+static GHashTable *prefetch_requests;	/* object ID -> number of requests */
+
+typedef struct {
+	MafwSource *source;
+	gchar *object_id;
+	MafwSourceMetadataResultCb callback;
+	gpointer user_data;
+} PrefetchSourceRequest;
+
+/* "prefetchsrc::c" names the sample clip differently than the others */
+static gchar *prefetch_source_uri(const gchar *object_id)
+{
+	if (!strcmp(object_id, "prefetchsrc::c"))
+		return get_sample_clip_path("../media/" SAMPLE_AUDIO_CLIP);
+	return get_sample_clip_path(SAMPLE_AUDIO_CLIP);
+}
+
+static guint prefetch_source_requests(const gchar *object_id)
+{
+	return GPOINTER_TO_UINT(g_hash_table_lookup(prefetch_requests,
+						    object_id));
+}
+
+static gboolean prefetch_source_reply(gpointer data)
+{
+	PrefetchSourceRequest *req = data;
+	GHashTable *md;
+	gchar *uri;
+
+	uri = prefetch_source_uri(req->object_id);
+	md = mafw_metadata_new();
+	mafw_metadata_add_str(md, MAFW_METADATA_KEY_URI, uri);
+	req->callback(req->source, req->object_id, md, req->user_data, NULL);
+	mafw_metadata_release(md);
+	g_free(uri);
+	g_free(req->object_id);
+	g_free(req);
+	return FALSE;
+}
+
+static void prefetch_source_get_metadata(MafwSource *self,
+					 const gchar *object_id,
+					 const gchar *const *metadata,
+					 MafwSourceMetadataResultCb callback,
+					 gpointer user_data)
+{
+	PrefetchSourceRequest *req;
+
+	g_hash_table_replace(prefetch_requests, g_strdup(object_id),
+			     GUINT_TO_POINTER(
+				     prefetch_source_requests(object_id) + 1));
+
+	req = g_new0(PrefetchSourceRequest, 1);
+	req->source = self;
+	req->object_id = g_strdup(object_id);
+	req->callback = callback;
+	req->user_data = user_data;
+	g_idle_add(prefetch_source_reply, req);
+}
+
+static void prefetch_source_class_init(PrefetchSourceClass *klass)
+{
+	MAFW_SOURCE_CLASS(klass)->get_metadata = prefetch_source_get_metadata;
+}
+
+static void prefetch_source_init(PrefetchSource *source)
+{
+	/* NOP */
+}
+
+/* Waits until the metadata of the item at @index has reached @renderer */
+static gboolean wait_for_prefetched(MafwGstRenderer *renderer, gint index,
+				    guint millis)
+{
+	guint timeout;
+	gboolean stop_wait = FALSE;
+
+	timeout = g_timeout_add(millis, stop_wait_timeout, &stop_wait);
+	while (g_hash_table_lookup(renderer->prefetch.items,
+				   GINT_TO_POINTER(index)) == NULL &&
+	       !stop_wait)
+		g_main_context_iteration(NULL, TRUE);
+	if (!stop_wait)
+		g_source_remove(timeout);
+
+	return !stop_wait;
+}
+
 START_TEST(test_update_stats)
 {
 	MafwGstRenderer *renderer = NULL;
@@ -1824,6 +2015,185 @@ START_TEST(test_update_stats)
 }
 END_TEST
 
+/* Moving to an item around the current one uses the metadata resolved in
+ * advance, and editing the playlist drops what was resolved. */
+START_TEST(test_prefetch_window)
+{
+	MafwPlaylist *playlist;
+	MafwGstRenderer *renderer;
+	MafwRegistry *registry;
+	MafwSource *src;
+	RendererInfo s = {0, };
+	CallbackInfo c = {0, };
+	gchar *uri;
+
+	/* Initialize callback info */
+	c.err_msg = NULL;
+	c.error_signal_expected = FALSE;
+	c.error_signal_received = NULL;
+	c.property_expected = NULL;
+	c.property_received = NULL;
+
+	renderer = MAFW_GST_RENDERER(g_gst_renderer);
+	registry = MAFW_REGISTRY(mafw_registry_get_instance());
+	prefetch_requests = g_hash_table_new_full(g_str_hash, g_str_equal,
+						  g_free, NULL);
+	src = MAFW_SOURCE(g_object_new(prefetch_source_get_type(),
+				       "plugin", "mockland",
+				       "uuid", "prefetchsrc",
+				       "name", "prefetchsrc",
+				       NULL));
+	mafw_registry_add_extension(registry, MAFW_EXTENSION(src));
+
+	g_signal_connect(g_gst_renderer, "error",
+			 G_CALLBACK(error_cb),
+			 &c);
+	g_signal_connect(g_gst_renderer, "state-changed",
+			 G_CALLBACK(state_changed_cb),
+			 &s);
+	g_signal_connect(g_gst_renderer, "media-changed",
+			 G_CALLBACK(media_changed_cb),
+			 &s);
+
+	/* --- Create and assign a playlist --- */
+
+	playlist = MAFW_PLAYLIST(mafw_mock_playlist_new());
+	mafw_playlist_insert_item(playlist, 0, "prefetchsrc::a", NULL);
+	mafw_playlist_insert_item(playlist, 1, "prefetchsrc::b", NULL);
+	mafw_playlist_insert_item(playlist, 2, "prefetchsrc::d", NULL);
+	mafw_playlist_set_repeat(playlist, FALSE);
+
+	if (!mafw_renderer_assign_playlist(g_gst_renderer, playlist, NULL))
+		fail("Assign playlist failed");
+
+	wait_for_state(&s, Stopped, wait_tout_val);
+
+	/* --- Play, the next items are resolved meanwhile --- */
+
+	reset_callback_info(&c);
+
+	mafw_renderer_play(g_gst_renderer, playback_cb, &c);
+
+	if (wait_for_callback(&c, wait_tout_val)) {
+		if (c.error)
+			fail(callback_err_msg, "playing", c.err_code,
+			     c.err_msg);
+	} else {
+		fail(no_callback_msg);
+	}
+
+	if (wait_for_state(&s, Playing, wait_tout_val) == FALSE) {
+		fail(state_err_msg, "mafw_renderer_play", "Playing", s.state);
+	}
+
+	fail_unless(wait_for_prefetched(renderer, 1, wait_tout_val),
+		    "Next item was not prefetched");
+	fail_unless(wait_for_prefetched(renderer, 2, wait_tout_val),
+		    "Item after the next one was not prefetched");
+	fail_unless(prefetch_source_requests("prefetchsrc::a") == 1);
+	fail_unless(prefetch_source_requests("prefetchsrc::b") == 1);
+
+	/* --- Next, without asking the source again --- */
+
+	reset_callback_info(&c);
+
+	mafw_renderer_next(g_gst_renderer, playback_cb, &c);
+
+	if (wait_for_callback(&c, wait_tout_val)) {
+		if (c.error)
+			fail(callback_err_msg, "moving to next", c.err_code,
+			     c.err_msg);
+	} else {
+		fail(no_callback_msg);
+	}
+
+	fail_if(s.index != 1, index_err_msg, s.index, 1);
+
+	if (wait_for_state(&s, Transitioning, wait_tout_val) == FALSE) {
+		fail(state_err_msg, "mafw_renderer_next", "Transitioning",
+		     s.state);
+	}
+	if (wait_for_state(&s, Playing, wait_tout_val) == FALSE) {
+		fail(state_err_msg, "mafw_renderer_next", "Playing", s.state);
+	}
+
+	fail_if(prefetch_source_requests("prefetchsrc::b") != 1,
+		"Prefetched item was asked for %u times",
+		prefetch_source_requests("prefetchsrc::b"));
+	fail_if(g_strcmp0(renderer->media->object_id, "prefetchsrc::b"));
+	uri = prefetch_source_uri("prefetchsrc::b");
+	fail_if(g_strcmp0(renderer->media->uri, uri),
+		"Playing %s instead of %s", renderer->media->uri, uri);
+	g_free(uri);
+
+	/* --- Editing the playlist invalidates the window --- */
+
+	mafw_playlist_insert_item(playlist, 2, "prefetchsrc::c", NULL);
+
+	fail_if(g_hash_table_lookup(renderer->prefetch.items,
+				    GINT_TO_POINTER(2)) != NULL,
+		"Item prefetched before the edit was kept");
+	fail_unless(wait_for_prefetched(renderer, 2, wait_tout_val),
+		    "Inserted item was not prefetched");
+	fail_unless(prefetch_source_requests("prefetchsrc::c") == 1);
+
+	/* --- Next, plays what is there now --- */
+
+	reset_callback_info(&c);
+
+	mafw_renderer_next(g_gst_renderer, playback_cb, &c);
+
+	if (wait_for_callback(&c, wait_tout_val)) {
+		if (c.error)
+			fail(callback_err_msg, "moving to next", c.err_code,
+			     c.err_msg);
+	} else {
+		fail(no_callback_msg);
+	}
+
+	fail_if(s.index != 2, index_err_msg, s.index, 2);
+
+	if (wait_for_state(&s, Transitioning, wait_tout_val) == FALSE) {
+		fail(state_err_msg, "mafw_renderer_next", "Transitioning",
+		     s.state);
+	}
+	if (wait_for_state(&s, Playing, wait_tout_val) == FALSE) {
+		fail(state_err_msg, "mafw_renderer_next", "Playing", s.state);
+	}
+
+	fail_if(prefetch_source_requests("prefetchsrc::c") != 1,
+		"Prefetched item was asked for %u times",
+		prefetch_source_requests("prefetchsrc::c"));
+	fail_if(g_strcmp0(renderer->media->object_id, "prefetchsrc::c"));
+	uri = prefetch_source_uri("prefetchsrc::c");
+	fail_if(g_strcmp0(renderer->media->uri, uri),
+		"Playing %s instead of %s", renderer->media->uri, uri);
+	g_free(uri);
+
+	/* --- Stop --- */
+
+	reset_callback_info(&c);
+
+	mafw_renderer_stop(g_gst_renderer, playback_cb, &c);
+
+	if (wait_for_callback(&c, wait_tout_val)) {
+		if (c.error)
+			fail(callback_err_msg, "stopping", c.err_code,
+			     c.err_msg);
+	} else {
+		fail(no_callback_msg);
+	}
+
+	if (wait_for_state(&s, Stopped, wait_tout_val) == FALSE) {
+		fail(state_err_msg, "mafw_renderer_stop", "Stopped", s.state);
+	}
+
+	g_object_unref(playlist);
+	g_hash_table_destroy(prefetch_requests);
+	prefetch_requests = NULL;
+}
+END_TEST
+
 START_TEST(test_play_state)
 {
 	MafwPlaylist *playlist = NULL;
@@ -3251,6 +3621,137 @@ START_TEST(test_state_class)
 }
 END_TEST
 
+static void count_state_changes_cb(MafwRenderer *s, MafwPlayState state,
+				   gpointer user_data)
+{
+	(*(gint *) user_data)++;
+}
+
+START_TEST(test_gapless_next)
+{
+	MafwPlaylist *playlist = NULL;
+	MafwGstRenderer *renderer;
+	RendererInfo s = {0, };
+	CallbackInfo c = {0, };
+	gchar *objectid;
+	gint i, state_changes;
+
+	/* Initialize callback info */
+	c.err_msg = NULL;
+	c.error_signal_expected = FALSE;
+	c.error_signal_received = NULL;
+	c.property_expected = NULL;
+	c.property_received = NULL;
+
+	renderer = MAFW_GST_RENDERER(g_gst_renderer);
+
+	/* Connect to renderer signals */
+	g_signal_connect(g_gst_renderer, "error",
+			 G_CALLBACK(error_cb),
+			 &c);
+	g_signal_connect(g_gst_renderer, "state-changed",
+			 G_CALLBACK(state_changed_cb),
+			 &s);
+	g_signal_connect(g_gst_renderer, "media-changed",
+			 G_CALLBACK(media_changed_cb),
+			 &s);
+
+	/* --- Create and assign a playlist --- */
+
+	playlist = MAFW_PLAYLIST(mafw_mock_playlist_new());
+	for (i = 0; i < 2; i++) {
+		objectid = get_sample_clip_objectid(SAMPLE_AUDIO_CLIP);
+		mafw_playlist_insert_item(playlist, i, objectid, NULL);
+		g_free(objectid);
+	}
+	mafw_playlist_set_repeat(playlist, FALSE);
+
+	if (!mafw_renderer_assign_playlist(g_gst_renderer, playlist, NULL))
+		fail("Assign playlist failed");
+
+	wait_for_state(&s, Stopped, wait_tout_val);
+
+	/* --- Play --- */
+
+	reset_callback_info(&c);
+
+	mafw_renderer_play(g_gst_renderer, playback_cb, &c);
+
+	if (wait_for_callback(&c, wait_tout_val)) {
+		if (c.error)
+			fail(callback_err_msg, "playing", c.err_code,
+			     c.err_msg);
+	} else {
+		fail(no_callback_msg);
+	}
+
+	if (wait_for_state(&s, Playing, wait_tout_val) == FALSE) {
+		fail(state_err_msg, "mafw_renderer_play", "Playing",
+		     s.state);
+	}
+	fail_if(s.index != 0, index_err_msg, s.index, 0);
+
+	/* --- The worker continues with the prepared clip --- */
+
+	fail_if(renderer->next_media != NULL,
+		"Nothing should be prepared with gapless playback off");
+	renderer->next_media = g_new0(MafwGstRendererMedia, 1);
+	renderer->next_media->object_id =
+		get_sample_clip_objectid(SAMPLE_AUDIO_CLIP);
+	renderer->next_media->uri = g_strdup("file:///gapless/next.wav");
+	renderer->next_media->duration = 42;
+
+	state_changes = 0;
+	g_signal_connect(g_gst_renderer, "state-changed",
+			 G_CALLBACK(count_state_changes_cb),
+			 &state_changes);
+	media_changed_called = FALSE;
+
+	mafw_gst_renderer_state_notify_next(
+		renderer->states[renderer->current_state], NULL);
+
+	fail_unless(media_changed_called, "No media-changed received");
+	fail_if(s.index != 1, index_err_msg, s.index, 1);
+	fail_if(state_changes != 0,
+		"The state changed %d times moving on to the next clip",
+		state_changes);
+	fail_if(renderer->current_state != Playing,
+		"Renderer should be still Playing, and it is %d",
+		renderer->current_state);
+	fail_if(g_strcmp0(renderer->media->uri, "file:///gapless/next.wav"),
+		"Media URI should come from the prepared clip, it is %s",
+		renderer->media->uri);
+	fail_if(renderer->media->duration != 42,
+		"Duration should come from the prepared clip");
+	fail_if(renderer->next_media != NULL,
+		"The prepared clip should have been taken");
+
+	g_signal_handlers_disconnect_by_func(g_gst_renderer,
+					     count_state_changes_cb,
+					     &state_changes);
+
+	/* --- Stop --- */
+
+	reset_callback_info(&c);
+
+	mafw_renderer_stop(g_gst_renderer, playback_cb, &c);
+
+	if (wait_for_callback(&c, wait_tout_val)) {
+		if (c.error)
+			fail(callback_err_msg, "stopping", c.err_code,
+			     c.err_msg);
+	} else {
+		fail(no_callback_msg);
+	}
+
+	if (wait_for_state(&s, Stopped, wait_tout_val) == FALSE) {
+		fail(state_err_msg, "mafw_renderer_stop", "Stopped", s.state);
+	}
+
+	g_object_unref(playlist);
+}
+END_TEST
+
 START_TEST(test_playlist_iterator)
 {
 	MafwPlaylist *playlist = NULL;
@@ -3260,6 +3761,8 @@ START_TEST(test_playlist_iterator)
 	GError *error = NULL;
 	gint size;
 	gint index;
+	gchar *next_objectid;
+	MafwPlaylistIteratorMovementResult result;
 
 	/* Initialize callback info */
 	c.err_msg = NULL;
@@ -3322,6 +3825,27 @@ START_TEST(test_playlist_iterator)
 	index = mafw_playlist_iterator_get_current_index(iterator);
 	fail_if(index != 0, "Index should be 0 and it is %d", index);
 
+	/* Peeking at the next item does not move */
+	next_objectid = NULL;
+	result = mafw_playlist_iterator_get_next(iterator, &index,
+						  &next_objectid, NULL);
+	fail_if(result != MAFW_PLAYLIST_ITERATOR_MOVE_RESULT_OK,
+		"Next item should be found");
+	fail_if(index != 1, "Next index should be 1 and it is %d", index);
+	fail_if(next_objectid == NULL, "Next item should have an object ID");
+	g_free(next_objectid);
+	index = mafw_playlist_iterator_get_current_index(iterator);
+	fail_if(index != 0, "Index should be 0 and it is %d", index);
+
+	mafw_playlist_iterator_move_to_next(iterator, NULL);
+	next_objectid = NULL;
+	result = mafw_playlist_iterator_get_next(iterator, &index,
+						  &next_objectid, NULL);
+	fail_if(result != MAFW_PLAYLIST_ITERATOR_MOVE_RESULT_LIMIT,
+		"There should be no item after the last one");
+	fail_if(next_objectid != NULL, "No object ID expected");
+	mafw_playlist_iterator_reset(iterator, NULL);
+
 	mafw_playlist_remove_item(playlist, 0, &error);
 	if (error != NULL) {
 		fail("Error found: %s, %d, %s",
@@ -3520,6 +4044,7 @@ START_TEST(test_media_art)
 	gchar *image_path = NULL;
 	gsize image_length;
 	GstCaps *caps = NULL;
+	gchar *art_uri = NULL;
 
 	/* Initialize callback info */
 	c.err_msg = NULL;
@@ -3652,6 +4177,31 @@ START_TEST(test_media_art)
 	fail_if(m.value == NULL, "Metadata "
 		MAFW_METADATA_KEY_RENDERER_ART_URI " not received");
 
+	art_uri = g_value_dup_string(m.value);
+	g_value_unset(m.value);
+	g_free(m.value);
+	m.value = NULL;
+
+	/* The same image again is served from the same file */
+
+	list = gst_tag_list_new();
+	gst_tag_list_add(list, GST_TAG_MERGE_APPEND, GST_TAG_IMAGE, buffer,
+			 NULL);
+
+	message = gst_message_new_tag(NULL, list);
+	gst_bus_post(bus, message);
+
+	if (wait_for_metadata(&m, wait_tout_val) == FALSE) {
+		fail("Expected " MAFW_METADATA_KEY_RENDERER_ART_URI
+		     ", but not received");
+	}
+
+	fail_if(m.value == NULL, "Metadata "
+		MAFW_METADATA_KEY_RENDERER_ART_URI " not received");
+	fail_if(strcmp(g_value_get_string(m.value), art_uri) != 0,
+		"Unchanged art was saved into a new file");
+
+	g_free(art_uri);
 	g_value_unset(m.value);
 	g_free(m.value);
 	m.value = NULL;
@@ -3668,6 +4218,168 @@ START_TEST(test_media_art)
 }
 END_TEST
 
+#ifdef HAVE_GDKPIXBUF
+/* A frame of @fourcc, each row in its own shade, the same chroma all over
+ * so that the way of scaling does not matter. */
+static GstBuffer *make_yuv_frame(guint32 fourcc, gint width, gint height)
+{
+	GstBuffer *buf;
+	GstCaps *caps;
+	guint8 *data;
+	gint x, y;
+
+	if (fourcc == GST_MAKE_FOURCC('I', '4', '2', '0') ||
+	    fourcc == GST_MAKE_FOURCC('Y', 'V', '1', '2')) {
+		guint ystride = GST_ROUND_UP_4(width);
+		guint cstride = GST_ROUND_UP_8(width) / 2;
+		guint ysize = ystride * GST_ROUND_UP_2(height);
+		guint csize = cstride * (GST_ROUND_UP_2(height) / 2);
+
+		buf = gst_buffer_new_and_alloc(ysize + 2 * csize);
+		data = GST_BUFFER_DATA(buf);
+		for (y = 0; y < height; y++)
+			memset(data + y * ystride, 40 + 8 * y, ystride);
+		/* U then V for I420, the other way around for YV12 */
+		memset(data + ysize,
+		       fourcc == GST_MAKE_FOURCC('I', '4', '2', '0') ? 90 : 170,
+		       csize);
+		memset(data + ysize + csize,
+		       fourcc == GST_MAKE_FOURCC('I', '4', '2', '0') ? 170 : 90,
+		       csize);
+	} else {
+		guint stride = GST_ROUND_UP_4(width * 2);
+		gboolean yuy2 = fourcc == GST_MAKE_FOURCC('Y', 'U', 'Y', '2');
+
+		buf = gst_buffer_new_and_alloc(stride * height);
+		data = GST_BUFFER_DATA(buf);
+		for (y = 0; y < height; y++) {
+			guint8 *row = data + y * stride;
+
+			for (x = 0; x < GST_ROUND_UP_2(width) / 2; x++) {
+				guint8 *mp = row + 4 * x;
+
+				mp[yuy2 ? 0 : 1] = 40 + 8 * y;
+				mp[yuy2 ? 2 : 3] = 40 + 8 * y;
+				mp[yuy2 ? 1 : 0] = 90;
+				mp[yuy2 ? 3 : 2] = 170;
+			}
+		}
+	}
+
+	caps = gst_caps_new_simple("video/x-raw-yuv",
+				   "format", GST_TYPE_FOURCC, fourcc,
+				   "width", G_TYPE_INT, width,
+				   "height", G_TYPE_INT, height,
+				   "framerate", GST_TYPE_FRACTION, 25, 1,
+				   "pixel-aspect-ratio", GST_TYPE_FRACTION,
+				   4, 3,
+				   NULL);
+	gst_buffer_set_caps(buf, caps);
+	gst_caps_unref(caps);
+
+	return buf;
+}
+
+static void frame_converted_cb(GstBuffer *result, gpointer user_data)
+{
+	GstBuffer **converted = user_data;
+
+	*converted = result;
+}
+
+static gboolean frame_conversion_timeout(gpointer user_data)
+{
+	*(gboolean *)user_data = TRUE;
+	return FALSE;
+}
+
+START_TEST(test_frame_conversion)
+{
+	static const guint32 fourccs[] = {
+		GST_MAKE_FOURCC('I', '4', '2', '0'),
+		GST_MAKE_FOURCC('Y', 'V', '1', '2'),
+		GST_MAKE_FOURCC('Y', 'U', 'Y', '2'),
+		GST_MAKE_FOURCC('U', 'Y', 'V', 'Y'),
+	};
+	guint f;
+
+	for (f = 0; f < G_N_ELEMENTS(fourccs); f++) {
+		GstBuffer *frame, *native, *converted = NULL;
+		GstStructure *ns, *ps;
+		GstCaps *to_caps;
+		gint nwidth, nheight, pwidth, pheight, x, y;
+		gboolean timeout = FALSE;
+		guint tid;
+
+		frame = make_yuv_frame(fourccs[f], 33, 19);
+		to_caps = gst_caps_new_simple("video/x-raw-rgb",
+					      "bpp", G_TYPE_INT, 24,
+					      "depth", G_TYPE_INT, 24,
+					      "framerate", GST_TYPE_FRACTION,
+					      25, 1,
+					      "pixel-aspect-ratio",
+					      GST_TYPE_FRACTION, 1, 1,
+					      "endianness", G_TYPE_INT,
+					      G_BIG_ENDIAN,
+					      "red_mask", G_TYPE_INT, 0xff0000,
+					      "green_mask", G_TYPE_INT, 0x00ff00,
+					      "blue_mask", G_TYPE_INT, 0x0000ff,
+					      NULL);
+
+		native = bvw_frame_conv_convert_native(frame, to_caps);
+		fail_if(native == NULL, "%" GST_FOURCC_FORMAT
+			" not converted in-process",
+			GST_FOURCC_ARGS(fourccs[f]));
+
+		/* Takes both */
+		fail_unless(bvw_frame_conv_convert_pipeline(
+				    gst_buffer_ref(frame), to_caps,
+				    frame_converted_cb, &converted));
+		tid = g_timeout_add(wait_tout_val, frame_conversion_timeout,
+				    &timeout);
+		while (converted == NULL && !timeout)
+			g_main_context_iteration(NULL, TRUE);
+		if (!timeout)
+			g_source_remove(tid);
+		fail_if(converted == NULL, "%" GST_FOURCC_FORMAT
+			" not converted by the pipeline",
+			GST_FOURCC_ARGS(fourccs[f]));
+
+		ns = gst_caps_get_structure(GST_BUFFER_CAPS(native), 0);
+		ps = gst_caps_get_structure(GST_BUFFER_CAPS(converted), 0);
+		fail_unless(gst_structure_get_int(ns, "width", &nwidth) &&
+			    gst_structure_get_int(ns, "height", &nheight) &&
+			    gst_structure_get_int(ps, "width", &pwidth) &&
+			    gst_structure_get_int(ps, "height", &pheight));
+		fail_if(nwidth != pwidth || nheight != pheight,
+			"%" GST_FOURCC_FORMAT ": %dx%d instead of %dx%d",
+			GST_FOURCC_ARGS(fourccs[f]), nwidth, nheight,
+			pwidth, pheight);
+		fail_if(nwidth != 44 || nheight != 19);
+
+		for (y = 0; y < nheight; y++) {
+			const guint8 *nrow, *prow;
+
+			nrow = GST_BUFFER_DATA(native) +
+				y * GST_ROUND_UP_4(3 * nwidth);
+			prow = GST_BUFFER_DATA(converted) +
+				y * GST_ROUND_UP_4(3 * pwidth);
+			for (x = 0; x < 3 * nwidth; x++)
+				fail_if(ABS(nrow[x] - prow[x]) > 2,
+					"%" GST_FOURCC_FORMAT
+					": byte %d of row %d is %u instead "
+					"of %u", GST_FOURCC_ARGS(fourccs[f]),
+					x, y, nrow[x], prow[x]);
+		}
+
+		gst_buffer_unref(native);
+		gst_buffer_unref(converted);
+		gst_buffer_unref(frame);
+	}
+}
+END_TEST
+#endif
+
 START_TEST(test_properties_management)
 {
 	RendererInfo s;
@@ -3905,6 +4617,33 @@ START_TEST(test_properties_management)
 		fail(no_callback_msg);
 	}
 
+	fail_if(c.property_received == NULL,
+		"No property %s received and expected", c.property_expected);
+	fail_if(c.property_received != NULL &&
+		g_value_get_boolean(c.property_received) != TRUE,
+		"Property with value %d and %d expected",
+		g_value_get_boolean(c.property_received), TRUE);
+
+	/* --- gapless playback --- */
+
+	reset_callback_info(&c);
+
+	c.property_expected = MAFW_PROPERTY_GST_RENDERER_GAPLESS;
+
+	mafw_extension_set_property_boolean(MAFW_EXTENSION(g_gst_renderer),
+					    c.property_expected, TRUE);
+
+	mafw_extension_get_property(MAFW_EXTENSION(g_gst_renderer),
+				    c.property_expected, get_property_cb, &c);
+
+	if (wait_for_callback(&c, wait_tout_val)) {
+		if (c.error)
+			fail(callback_err_msg, "get_property", c.err_code,
+			     c.err_msg);
+	} else {
+		fail(no_callback_msg);
+	}
+
 	fail_if(c.property_received == NULL,
 		"No property %s received and expected", c.property_expected);
 	fail_if(c.property_received != NULL &&
@@ -4147,17 +4886,23 @@ SRunner * configure_tests(void)
 				  fx_teardown_dummy_gst_renderer);
 if (1)	tcase_add_test(tc1, test_basic_playback);
 if (1)	tcase_add_test(tc1, test_playlist_playback);
+if (1)	tcase_add_test(tc1, test_playlist_file_playback);
 if (1)	tcase_add_test(tc1, test_repeat_mode_playback);
 if (1)	tcase_add_test(tc1, test_gst_renderer_mode);
 if (1)	tcase_add_test(tc1, test_update_stats);
+if (1)	tcase_add_test(tc1, test_prefetch_window);
 if (1)  tcase_add_test(tc1, test_play_state);
 if (1)  tcase_add_test(tc1, test_pause_state);
 if (1)  tcase_add_test(tc1, test_stop_state);
 if (1)  tcase_add_test(tc1, test_transitioning_state);
 if (1)  tcase_add_test(tc1, test_state_class);
+if (1)  tcase_add_test(tc1, test_gapless_next);
 if (1)  tcase_add_test(tc1, test_playlist_iterator);
 if (1)  tcase_add_test(tc1, test_video);
 if (1)  tcase_add_test(tc1, test_media_art);
+#ifdef HAVE_GDKPIXBUF
+if (1)  tcase_add_test(tc1, test_frame_conversion);
+#endif
 if (1)  tcase_add_test(tc1, test_properties_management);
 if (1)  tcase_add_test(tc1, test_buffering);
 
@@ -47,6 +47,8 @@ struct _MafwIradioSourcePrivate
 	guint last_browse_id;
 	GList *browse_requests;
 	sqlite3_stmt *stmt_object_list;
+	sqlite3_stmt *stmt_object_page;
+	sqlite3_stmt *stmt_query_page;
 	sqlite3_stmt *stmt_get_value;
 	sqlite3_stmt *stmt_get_key_value;
 	sqlite3_stmt *stmt_insert;
@@ -733,14 +735,10 @@ struct browse_data_container {
 	MafwSource *self;
 	MafwSourceBrowseResultCb cb;
 	guint skip_count;
-	guint item_count;
 	gpointer user_data;
 	guint64 current_id;
 	gchar **metadata_keys;
 	guint next_index;
-	gchar **sorting_terms;
-	const gchar **relevant_metadata_keys;
-	MafwFilter *filter;
 	GList *object_list;
 	guint bid;
 	guint sid;
@@ -752,6 +750,18 @@ struct metadata_data {
 	guint64 id;
 };
 
+/**
+ * Filter and sorting terms of the browse query being executed, consulted by
+ * the iradio_browse_key() SQL aggregate
+ **/
+struct browse_query {
+	const gchar **keys;
+	MafwCompiledFilter *cfilter;
+	gchar **sorting_terms;
+};
+
+static struct browse_query *current_query;
+
 /**
  * Removes the specified pointer from the list, and releases that data with
  * its content
@@ -771,12 +781,6 @@ static GList *browse_result_free_list_item(GList *list,
  **/
 static void free_browse_data(struct browse_data_container *browse_data)
 {
-	if (browse_data->sorting_terms)
-		g_strfreev(browse_data->sorting_terms);
-	if (browse_data->relevant_metadata_keys)
-		g_free(browse_data->relevant_metadata_keys);
-	if (browse_data->filter)
-		mafw_filter_free(browse_data->filter);
 	if (browse_data->metadata_keys)
 		g_strfreev(browse_data->metadata_keys);
 	while (browse_data->object_list)
@@ -801,26 +805,91 @@ static void remove_browse_request(MafwIradioSource *src,
 }
 
 /**
- * Helper function to sort the items according to the sorting terms
+ * Step function of the iradio_browse_key(key, value) SQL aggregate. Collects
+ * the values of the keys the filter and the sorting terms refer to.
+ **/
+static void browse_key_step(sqlite3_context *ctx, int argc,
+				sqlite3_value **argv)
+{
+	GHashTable **metadata;
+	const gchar *key;
+	GByteArray *bary;
+	gsize b_size = 0;
+	gint i;
+
+	metadata = sqlite3_aggregate_context(ctx, sizeof(*metadata));
+	if (!metadata)
+	{
+		sqlite3_result_error_nomem(ctx);
+		return;
+	}
+	if (!*metadata)
+		*metadata = mafw_metadata_new();
+
+	key = (const gchar *)sqlite3_value_text(argv[0]);
+	for (i = 0; key && current_query->keys && current_query->keys[i]; i++)
+	{
+		if (strcmp(current_query->keys[i], key))
+			continue;
+		bary = g_byte_array_new();
+		bary = g_byte_array_append(bary, sqlite3_value_blob(argv[1]),
+					sqlite3_value_bytes(argv[1]));
+		g_hash_table_insert(*metadata, g_strdup(key),
+				mafw_metadata_val_thaw_bary(bary, &b_size));
+		g_byte_array_free(bary, TRUE);
+		break;
+	}
+}
+
+/**
+ * Final function of the iradio_browse_key() SQL aggregate. Evaluates the
+ * filter on the collected metadata, and returns NULL if it does not match,
+ * the sort key of the station otherwise. Sort keys order as BLOBs the same
+ * way as with mafw_metadata_sort_key_compare().
  **/
-static gint sort_metadata_cb(struct metadata_data *a, struct metadata_data *b,
-				const gchar **sorting_terms)
+static void browse_key_final(sqlite3_context *ctx)
 {
-	return mafw_metadata_compare(a->metadata, b->metadata, sorting_terms,
-					NULL);
+	GHashTable **metadata;
+	GHashTable *md;
+	MafwMetadataSortKey *sort_key;
+	const guint8 *data;
+	gsize len;
+
+	metadata = sqlite3_aggregate_context(ctx, 0);
+	md = metadata ? *metadata : NULL;
+
+	if (!mafw_compiled_filter_eval(current_query->cfilter, md))
+	{
+		sqlite3_result_null(ctx);
+	}
+	else if (current_query->sorting_terms)
+	{
+		sort_key = mafw_metadata_sort_key_new(md,
+				(const gchar *const *)current_query->
+								sorting_terms);
+		data = mafw_metadata_sort_key_data(sort_key, &len);
+		sqlite3_result_blob(ctx, data, len, SQLITE_TRANSIENT);
+		mafw_metadata_sort_key_free(sort_key);
+	}
+	else
+	{
+		sqlite3_result_zeroblob(ctx, 0);
+	}
+
+	if (md)
+		mafw_metadata_release(md);
 }
 
 /**
- * If the result-list was not sorted, and filtered according to the skip and
- * item count, it does this preparation. After this, it calls the cb function
- * with the results, one by one
+ * Calls the cb function with the results, one by one. The results are already
+ * filtered, sorted and limited according to the skip and item count by the
+ * browse query.
  **/
 static gboolean emit_browse_res(struct browse_data_container *browse_data)
 {
 	gchar *current_object_id = NULL;
 	struct metadata_data *current_data = NULL;
 	GHashTable *current_metadata = NULL;
-	MafwIradioSourcePrivate *privdat;
 	
 	if (browse_data->free_req)
 	{
@@ -830,62 +899,23 @@ static gboolean emit_browse_res(struct browse_data_container *browse_data)
 		return FALSE;
 	}
 	
-	if (browse_data->sorting_terms)
-	{/* Sort the filtered results at first */
-		browse_data->object_list = g_list_sort_with_data(
-					browse_data->object_list,
-					(GCompareDataFunc)sort_metadata_cb,
-					browse_data->sorting_terms);
-		g_strfreev(browse_data->sorting_terms);
-		browse_data->sorting_terms = NULL;
+	if (browse_data->skip_count && !browse_data->object_list)
+	{/* list is not so long...... error */
+		GError *err;
+		g_debug("Skip count filtered all the results");
+		err = g_error_new (MAFW_SOURCE_ERROR,
+				MAFW_SOURCE_ERROR_BROWSE_RESULT_FAILED,
+				"Skip count filtered all the results");
 		
+		browse_data->cb(browse_data->self, browse_data->bid, 0,
+				0, NULL, NULL,
+				browse_data->user_data, err);
+		g_error_free(err);
+		browse_data->free_req = TRUE;
 		
+		return TRUE;
 	}
 	
-	if (browse_data->skip_count)
-	{
-		if (browse_data->skip_count >= g_list_length(
-						browse_data->object_list))
-		{/* list is not so long...... error */
-			GError *err;
-			g_debug("Skip count filtered all the results");
-			err = g_error_new (MAFW_SOURCE_ERROR,
-					MAFW_SOURCE_ERROR_BROWSE_RESULT_FAILED,
-					"Skip count filtered all the results");
-			
-			browse_data->cb(browse_data->self, browse_data->bid, 0,
-					0, NULL, NULL,
-					browse_data->user_data, err);
-			g_error_free(err);
-			browse_data->free_req = TRUE;
-			
-			return TRUE;
-		}
-		/* remove not-needed items, according to item_count and
-			skip_count */
-		while (browse_data->skip_count && browse_data->object_list)
-		{
-			browse_data->object_list = browse_result_free_list_item(
-						browse_data->object_list,
-						browse_data->object_list->data);
-			browse_data->skip_count--;
-		}
-	}
-	
-	if (browse_data->item_count &&
-		(g_list_length(browse_data->object_list) >
-				browse_data->item_count))
-	{
-		GList *last_item = g_list_nth(browse_data->object_list, 
-						browse_data->item_count-1);
-		while (last_item->next)
-			browse_data->object_list = browse_result_free_list_item(
-						browse_data->object_list,
-						last_item->next->data);
-		browse_data->item_count = 0;
-	}
-	
-	privdat = MAFW_IRADIO_SOURCE(browse_data->self)->priv;
 	if (browse_data->object_list)
 	{
 		current_data = browse_data->object_list->data;
@@ -958,32 +988,67 @@ static gboolean emit_browse_res(struct browse_data_container *browse_data)
 
 /**
  * Get-metadata-cb, to process the metadata results, and create the
- * browse-result list. It filters the result, according to the given filter
- * criteria, and adds the result to a list. Filtering according to the item
- * count, and skip count, and the sorting is not done here
+ * browse-result list.
  **/
 static void browse_metadata_cb(MafwSource *self, const gchar *object_id,
 				GHashTable *metadata,
 				struct browse_data_container *browse_data,
 				const GError *error)
 {
-	if (!metadata || !browse_data->filter ||
-		mafw_metadata_filter(metadata, browse_data->filter,NULL))
-	{ /* Filter passed.... */
-		struct metadata_data *new_metadata = g_new0(
-						struct metadata_data, 1);
-		
-		new_metadata->metadata = metadata;
-		new_metadata->id = browse_data->current_id;
-		browse_data->object_list = g_list_prepend(
-						browse_data->object_list,
+	struct metadata_data *new_metadata = g_new0(struct metadata_data, 1);
+	
+	new_metadata->metadata = metadata;
+	new_metadata->id = browse_data->current_id;
+	browse_data->object_list = g_list_prepend(browse_data->object_list,
 					new_metadata);
+}
+
+/**
+ * Returns the IDs of the stations matching @filter, sorted according to
+ * @sorting_terms, from @skip_count at most @item_count of them, with a single
+ * query. Without filter and sorting only the requested page of IDs is
+ * read from the database.
+ **/
+static GArray *query_object_page(MafwIradioSourcePrivate *privdat,
+				const MafwFilter *filter,
+				gchar **sorting_terms,
+				guint skip_count, guint item_count)
+{
+	struct browse_query query;
+	sqlite3_stmt *stmt;
+	GArray *ids;
+	guint64 id;
+
+	memset(&query, 0, sizeof query);
+	if (filter || sorting_terms)
+	{
+		query.keys = mafw_metadata_relevant_keys(NULL, filter,
+					(const gchar *const *)sorting_terms);
+		query.cfilter = mafw_filter_compile(filter, NULL);
+		query.sorting_terms = sorting_terms;
+		current_query = &query;
+		stmt = privdat->stmt_query_page;
 	}
 	else
 	{
-		mafw_metadata_release(metadata);
+		stmt = privdat->stmt_object_page;
 	}
-	
+
+	ids = g_array_new(FALSE, FALSE, sizeof(guint64));
+	mafw_db_bind_int(stmt, 0, item_count ? (gint)item_count : -1);
+	mafw_db_bind_int(stmt, 1, skip_count);
+	while (mafw_db_select(stmt, FALSE) == SQLITE_ROW)
+	{
+		id = mafw_db_column_int64(stmt, 0);
+		g_array_append_val(ids, id);
+	}
+	sqlite3_reset(stmt);
+
+	current_query = NULL;
+	mafw_compiled_filter_free(query.cfilter);
+	g_free(query.keys);
+
+	return ids;
 }
 
 static guint browse(MafwSource *self, const gchar *object_id,
@@ -996,6 +1061,9 @@ static guint browse(MafwSource *self, const gchar *object_id,
 	struct browse_data_container *browse_data;
 	MafwIradioSourcePrivate *privdat;
 	struct data_container current_data;
+	gchar **sorting_terms;
+	GArray *ids;
+	guint i;
 	
 	g_debug("Browsing %s. Recursive: %d, Filter: %s, Sort criteria: %s,"
 		"Skip: %u, Item count: %u", object_id, recursive,
@@ -1014,43 +1082,30 @@ static guint browse(MafwSource *self, const gchar *object_id,
 	browse_data = g_new0(struct browse_data_container, 1);
 	current_data.user_data = browse_data;
 	
-	browse_data->filter = mafw_filter_copy(filter);
-	
 	privdat->last_browse_id++;
 	browse_data->bid = privdat->last_browse_id;
 	
 	g_debug("New browse-id: %u", browse_data->bid);
 	
-	/* This will filter the results */
+	/* Filter, sort and cut the results in the database */
+	sorting_terms = mafw_metadata_sorting_terms(sort_criteria);
+	ids = query_object_page(privdat, filter, sorting_terms, skip_count,
+				item_count);
+	g_strfreev(sorting_terms);
+
+	/* Then read the metadata of the page only */
 	current_data.cb = browse_metadata_cb;
 	current_data.self = self;
-	browse_data->sorting_terms =
-				mafw_metadata_sorting_terms(sort_criteria);
-	current_data.metadata_keys = (gchar**)mafw_metadata_relevant_keys(
-				metadata_keys,
-				browse_data->filter, 
-				(const gchar *const *)browse_data->
-								sorting_terms);
-	if (metadata_keys_contain_wildcard(
-				(const gchar**)current_data.metadata_keys))
-	{
-		g_free(current_data.metadata_keys);
+	if (metadata_keys_contain_wildcard(metadata_keys))
 		current_data.metadata_keys = g_strdupv(
 						(gchar**)MAFW_SOURCE_ALL_KEYS);
-	}
-	else if (current_data.metadata_keys)
-	{
-		gchar **temp = current_data.metadata_keys;
-		current_data.metadata_keys = g_strdupv(temp);
-		g_free(temp);
-	}
+	else if (metadata_keys && metadata_keys[0])
+		current_data.metadata_keys = g_strdupv((gchar**)metadata_keys);
 	
-	while (mafw_db_select(privdat->stmt_object_list, FALSE) == SQLITE_ROW)
+	for (i = 0; i < ids->len; i++)
 	{
 		current_data.id = browse_data->current_id =
-					mafw_db_column_int64(privdat->
-							stmt_object_list,
-							0);
+					g_array_index(ids, guint64, i);
 		if (current_data.metadata_keys)
 			get_metadata_cb(&current_data);
 		else
@@ -1058,9 +1113,8 @@ static guint browse(MafwSource *self, const gchar *object_id,
 			browse_metadata_cb(NULL, NULL, NULL, browse_data, NULL);
 		}
 	}
-	sqlite3_reset(privdat->stmt_object_list);
-	mafw_filter_free(browse_data->filter);
-	browse_data->filter = NULL;
+	g_array_free(ids, TRUE);
+	browse_data->object_list = g_list_reverse(browse_data->object_list);
 	g_strfreev(current_data.metadata_keys);
 	current_data.metadata_keys = NULL;
 	
@@ -1068,7 +1122,6 @@ static guint browse(MafwSource *self, const gchar *object_id,
 	browse_data->cb = cb;
 	browse_data->user_data = user_data;
 	browse_data->skip_count = skip_count;
-	browse_data->item_count = item_count;
 	if (metadata_keys)
 	{
 		if (metadata_keys_contain_wildcard(metadata_keys))
@@ -1143,7 +1196,7 @@ static gboolean cancel_browse(MafwSource *self, guint browse_id,
  **/
 static void init_db(void)
 {
-	sqlite3_stmt *db_check = mafw_db_prepare(
+	sqlite3_stmt *db_check = mafw_db_prepare_cached(
 		"SELECT name FROM sqlite_master WHERE type = 'table' AND "
 		"name = '" IRADIO_TABLE "'");
 
@@ -1156,7 +1209,7 @@ static void init_db(void)
 		load_vendor = TRUE;
 	}
 
-	sqlite3_finalize(db_check);
+	sqlite3_reset(db_check);
 
 	/*
 	 * TABLE iradiobookmarks:
@@ -1168,6 +1221,17 @@ static void init_db(void)
 		"id		INTEGER		NOT NULL,\n"
 		"key		TEXT		NOT NULL,\n"
 		"value		BLOB		)");
+
+	/* Databases created by earlier versions lack the index, every
+	 * lookup by id used to scan the whole table. */
+	mafw_db_exec(
+		"CREATE INDEX IF NOT EXISTS " IRADIO_TABLE "_id_key ON "
+		IRADIO_TABLE "(id, key)");
+
+	/* Filters and sorts the stations of a browse query */
+	sqlite3_create_function(mafw_db_get(), "iradio_browse_key", 2,
+				SQLITE_UTF8, NULL, NULL,
+				browse_key_step, browse_key_final);
 }
 
 
@@ -1183,7 +1247,7 @@ static void set_vendorfile_date(MafwIradioSource *self, time_t mod_time)
 	sqlite3_stmt *stmt_vendofile_setdate;
 
 	new_id = get_next_id(self);
-	stmt_vendofile_setdate = mafw_db_prepare("INSERT "
+	stmt_vendofile_setdate = mafw_db_prepare_cached("INSERT "
 					"INTO " IRADIO_TABLE "("
 						"id, key, value) "
 					"VALUES(:id, '', :value)");
@@ -1195,8 +1259,8 @@ static void set_vendorfile_date(MafwIradioSource *self, time_t mod_time)
 	if (mafw_db_change(stmt_vendofile_setdate, FALSE) != SQLITE_DONE)
 		g_assert_not_reached();
 	g_assert(mafw_db_nchanges() == 1);
+	sqlite3_reset(stmt_vendofile_setdate);
 	g_assert(mafw_db_commit());
-	sqlite3_finalize(stmt_vendofile_setdate);
 }
 
 static void mafw_iradio_source_init(MafwIradioSource *self)
@@ -1206,6 +1270,16 @@ static void mafw_iradio_source_init(MafwIradioSource *self)
 
 	self->priv->stmt_object_list = mafw_db_prepare("SELECT DISTINCT id "
 					"FROM " IRADIO_TABLE " WHERE key != ''");
+	self->priv->stmt_object_page = mafw_db_prepare("SELECT DISTINCT id "
+					"FROM " IRADIO_TABLE " WHERE key != '' "
+					"ORDER BY id DESC "
+					"LIMIT :count OFFSET :skip");
+	self->priv->stmt_query_page = mafw_db_prepare("SELECT id, "
+					"iradio_browse_key(key, value) AS sk "
+					"FROM " IRADIO_TABLE " WHERE key != '' "
+					"GROUP BY id HAVING sk IS NOT NULL "
+					"ORDER BY sk, id DESC "
+					"LIMIT :count OFFSET :skip");
 	self->priv->stmt_get_value = mafw_db_prepare("SELECT value FROM "
 					IRADIO_TABLE " WHERE id = :id AND "
 							"key = :key AND key != ''");
@@ -1257,7 +1331,7 @@ static void mafw_iradio_source_init(MafwIradioSource *self)
 			return;
 		}
 
-		stmt_vendorfile_date = mafw_db_prepare("SELECT "
+		stmt_vendorfile_date = mafw_db_prepare_cached("SELECT "
 					"value FROM "
 					IRADIO_TABLE " WHERE key = ''");
 		g_assert(stmt_vendorfile_date);
@@ -1275,7 +1349,7 @@ static void mafw_iradio_source_init(MafwIradioSource *self)
 		}
 
 		g_free(vendorfile);
-		sqlite3_finalize(stmt_vendorfile_date);
+		sqlite3_reset(stmt_vendorfile_date);
 
 		if (vendorstat.st_mtime != last_mod)
 		{/* New vendor file.... db should be updated */
@@ -1308,6 +1382,8 @@ static void dispose(GObject *object)
 	}
 	
 	sqlite3_finalize(self->priv->stmt_object_list);
+	sqlite3_finalize(self->priv->stmt_object_page);
+	sqlite3_finalize(self->priv->stmt_query_page);
 	sqlite3_finalize(self->priv->stmt_get_value);
 	sqlite3_finalize(self->priv->stmt_get_key_value);
 	sqlite3_finalize(self->priv->stmt_insert);
@@ -105,7 +105,7 @@ static void mafw_iradio_create_bookmark_object(MafwSource* self,
 		{
 			gchar *serialized_data;
 			gsize str_size = 0;
-			sqlite3_stmt *stmt_dupfind = mafw_db_prepare("SELECT "
+			sqlite3_stmt *stmt_dupfind = mafw_db_prepare_cached("SELECT "
 					"id FROM "
 					IRADIO_TABLE " WHERE key = '" 
 					MAFW_METADATA_KEY_URI "' AND value = :value");
@@ -116,11 +116,11 @@ static void mafw_iradio_create_bookmark_object(MafwSource* self,
 			g_assert(stmt_dupfind);
 			if (mafw_db_select(stmt_dupfind, FALSE) == SQLITE_ROW)
 			{
-				sqlite3_finalize(stmt_dupfind);
+				sqlite3_reset(stmt_dupfind);
 				g_free(serialized_data);
 				return;
 			}
-			sqlite3_finalize(stmt_dupfind);
+			sqlite3_reset(stmt_dupfind);
 			g_free(serialized_data);
 
 		}
@@ -272,6 +272,15 @@
  */
 #define MAFW_RENDERER_SIGNAL_METADATA_CHANGED "metadata_changed"
 
+/**
+ * metadatas_changed:
+ * @metadata: the changed metadata (%MAFW_DBUS_TYPE_METADATA).
+ *
+ * Wraps MafwRenderer::metadatas-changed.  The keys in it are not sent
+ * separately with metadata_changed.
+ */
+#define MAFW_RENDERER_SIGNAL_METADATAS_CHANGED "metadatas_changed"
+
 /*----------------------------------------------------------------------------
   Source
   ----------------------------------------------------------------------------*/
@@ -454,6 +463,31 @@
  */
 #define MAFW_PROXY_SOURCE_METHOD_BROWSE_RESULT "browse_result"
 
+/*
+ * Run-time properties the wrapper adds to every exported source to tune
+ * how browse results are batched into %MAFW_PROXY_SOURCE_METHOD_BROWSE_RESULT
+ * messages.  All of them are %G_TYPE_UINT.
+ *
+ * browse-batch-bytes:	    the (estimated) payload size a message may grow
+ *			    to before it is sent.  The first messages of a
+ *			    browse get a fraction of this budget, so that the
+ *			    first results arrive quickly.
+ * browse-batch-latency:    milliseconds the first message of a browse may
+ *			    wait for more results.
+ * browse-batch-max-latency: the wait grows with the budget up to this many
+ *			    milliseconds.
+ * browse-max-queued:	    if more than this many bytes are waiting to be
+ *			    written to the wrapper's bus connection, messages
+ *			    are held back and coalesced until it catches up.
+ *			    The connection is shared by all clients, so this
+ *			    throttles every browse of the wrapper at once.
+ */
+#define MAFW_WRAPPER_PROPERTY_BROWSE_BATCH_BYTES "browse-batch-bytes"
+#define MAFW_WRAPPER_PROPERTY_BROWSE_BATCH_LATENCY "browse-batch-latency"
+#define MAFW_WRAPPER_PROPERTY_BROWSE_BATCH_MAX_LATENCY \
+	"browse-batch-max-latency"
+#define MAFW_WRAPPER_PROPERTY_BROWSE_MAX_QUEUED "browse-max-queued"
+
 /*******************************************************************
  * MAFW Playlist daemon interface
  *******************************************************************/
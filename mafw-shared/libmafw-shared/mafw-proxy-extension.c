@@ -36,6 +36,8 @@
 struct _extension_attach_data {
 	GObject *extension;
 	MafwRegistry *registry;
+	/* Number of replies we're still waiting for. */
+	guint pending;
 };
 
 static DBusConnection *conn;
@@ -289,6 +291,29 @@ static void proxy_extension_detach(gpointer data, GObject *extension)
 	g_free(proxy_extension_return_service(extension));
 }
 
+/* Adds the extension to the registry when both its name and properties
+ * have arrived. */
+static void attach_done(struct _extension_attach_data *att_data)
+{
+	if (--att_data->pending > 0)
+		return;
+	if (!mafw_registry_get_extension_by_uuid(
+                    MAFW_REGISTRY(att_data->registry),
+                    mafw_extension_get_uuid(
+                            MAFW_EXTENSION(att_data->extension))))
+		mafw_registry_add_extension(
+                        att_data->registry,
+                        MAFW_EXTENSION(att_data->extension));
+	else {
+		/* Registered meanwhile by somebody else, this one won't be
+		 * announced. */
+		mafw_shared_discovery_forget(mafw_extension_get_uuid(
+                        MAFW_EXTENSION(att_data->extension)));
+		g_object_unref(att_data->extension);
+	}
+	g_free(att_data);
+}
+
 static void got_prop_lists(DBusPendingCall *pendelum,
                            struct _extension_attach_data *att_data)
 {
@@ -322,24 +347,14 @@ static void got_prop_lists(DBusPendingCall *pendelum,
 		dbus_error_free(&dbuserr);
 	}
 	dbus_message_unref(reply);
-	if (!mafw_registry_get_extension_by_uuid(
-                    MAFW_REGISTRY(att_data->registry),
-                    mafw_extension_get_uuid(
-                            MAFW_EXTENSION(att_data->extension))))
-		mafw_registry_add_extension(
-                        att_data->registry,
-                        MAFW_EXTENSION(att_data->extension));
-	else
-		g_object_unref(att_data->extension);
-	g_free(att_data);
 	dbus_pending_call_unref(pendelum);
+	attach_done(att_data);
 }
 
 static void got_name(DBusPendingCall *pendelum,
                      struct _extension_attach_data *att_data)
 {
 	DBusMessage *reply;
-	DBusPendingCall *pending_list_prop;
 	gchar *name = NULL;
 
 	reply = dbus_pending_call_steal_reply(pendelum);
@@ -370,34 +385,23 @@ static void got_name(DBusPendingCall *pendelum,
 	g_signal_connect(att_data->extension, "notify::name",
                          G_CALLBACK(extension_name_set),
 			 conn);
-	/* XXX we do an early list_properties because mafw_extension_*
-	 * functions check registered properties and fail since the
-	 * proxy doesn't have any properties on its own until
-	 * list_properties has been called. */
-	mafw_dbus_send_async(
-                conn,
-                &pending_list_prop,
-                mafw_dbus_method_full(
-                        proxy_extension_return_service(att_data->extension),
-                        proxy_extension_return_path(att_data->extension),
-                        MAFW_EXTENSION_INTERFACE,
-                        MAFW_EXTENSION_METHOD_LIST_PROPERTIES));
-	dbus_pending_call_set_notify(pending_list_prop,
-				     (gpointer)got_prop_lists,
-				     (gpointer)att_data, NULL);
 	dbus_pending_call_unref(pendelum);
+	attach_done(att_data);
 }
 
 void proxy_extension_attach(GObject *extension, DBusConnection *connection,
 			const gchar *plugin, MafwRegistry *registry)
 {
 	gchar *path, *service, *match_str;
-	DBusPendingCall *pending_name;
+	DBusPendingCall *pending_name, *pending_list_prop;
 	struct _extension_attach_data *att_data =
                 g_new0(struct _extension_attach_data, 1);
 
 	att_data->extension = extension;
 	att_data->registry = registry;
+	/* Hold the registration until both calls have been issued,
+	 * in case the first reply is processed right away. */
+	att_data->pending = 3;
 
 	path = get_extension_path(MAFW_EXTENSION(extension));
 	service = get_extension_service(MAFW_EXTENSION(extension), plugin);
@@ -424,5 +428,22 @@ void proxy_extension_attach(GObject *extension, DBusConnection *connection,
 				     (gpointer)got_name,
 				     (gpointer)att_data, NULL);
 
+	/* XXX we do an early list_properties because mafw_extension_*
+	 * functions check registered properties and fail since the
+	 * proxy doesn't have any properties on its own until
+	 * list_properties has been called.  It's sent together with
+	 * get_name rather than after its reply to save a round trip. */
+	mafw_dbus_send_async(conn,
+		       &pending_list_prop,
+		       mafw_dbus_method_full(
+					service,
+					path,
+					MAFW_EXTENSION_INTERFACE,
+					MAFW_EXTENSION_METHOD_LIST_PROPERTIES));
+	dbus_pending_call_set_notify(pending_list_prop,
+				     (gpointer)got_prop_lists,
+				     (gpointer)att_data, NULL);
+
 	g_object_weak_ref(extension, proxy_extension_detach, NULL);
+	attach_done(att_data);
 }
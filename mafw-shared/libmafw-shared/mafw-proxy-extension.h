@@ -56,4 +56,7 @@ extern void proxy_extension_attach(GObject *extension, DBusConnection *conn,
 DBusHandlerResult proxy_extension_dispatch(DBusConnection *conn,
 					     DBusMessage *msg,
 					     gpointer extension);
+
+/* From mafw-shared.c: */
+extern void mafw_shared_discovery_forget(const gchar *uuid);
 #endif
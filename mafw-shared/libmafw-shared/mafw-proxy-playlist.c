@@ -47,6 +47,15 @@ struct _MafwProxyPlaylistPrivate {
 	guint id;
 	DBusConnection *connection;
 	gchar *obj_path;
+
+	/* Item cache, see mafw_proxy_playlist_set_cache_window().
+	 * $witems are the object IDs of the items from $wfirst on. */
+	guint window;
+	gint size;		/* -1 if not known */
+	guint wfirst;
+	GPtrArray *witems;
+	guint generation;	/* Bumped whenever the cache is cut back. */
+	DBusPendingCall *prefetch;
 };
 
 #define MAFW_PROXY_PLAYLIST_GET_PRIVATE(o)			\
@@ -231,6 +240,7 @@ static void mafw_proxy_playlist_finalize(GObject *object)
 	MafwProxyPlaylistPrivate *priv;
 
 	priv = MAFW_PROXY_PLAYLIST_GET_PRIVATE(playlist);
+	mafw_proxy_playlist_set_cache_window(playlist, 0);
 
 	dbus_connection_unregister_object_path(priv->connection,
                                                priv->obj_path);
@@ -263,7 +273,7 @@ static void mafw_proxy_playlist_init(MafwProxyPlaylist *self)
 						 MAFW_TYPE_PROXY_PLAYLIST,
 						 MafwProxyPlaylistPrivate);
 	memset(self->priv, 0, sizeof(*self->priv));
-
+	self->priv->size = -1;
 }
 
 
@@ -339,6 +349,318 @@ guint mafw_proxy_playlist_get_id(MafwProxyPlaylist *self)
 	return self->priv->id;
 }
 
+/*---------------------------------------------------------------------------
+  Item cache
+  ---------------------------------------------------------------------------*/
+
+/* The cache holds a contiguous window of object IDs and the size of the
+ * playlist.  It's filled by GET_ITEMS requests of $window items, and
+ * prefetched asynchronously when the reader gets close to its edge.
+ *
+ * contents_changed and item_moved only ever throw away the part of the
+ * window they may affect; they never patch it.  We can't tell whether a
+ * signal is about a change we have already seen (eg. one made through
+ * this proxy, whose signal arrives after our call returned and the cache
+ * was refilled), and discarding is safe either way. */
+
+/* How many windows' worth of items are kept at most. */
+#define CACHE_MAX_WINDOWS	3
+
+/* Returns the index after the last cached item. */
+#define CACHE_END(priv)	((priv)->wfirst + (priv)->witems->len)
+
+static void cache_cancel_prefetch(MafwProxyPlaylistPrivate *priv)
+{
+	if (priv->prefetch) {
+		dbus_pending_call_cancel(priv->prefetch);
+		dbus_pending_call_unref(priv->prefetch);
+		priv->prefetch = NULL;
+	}
+}
+
+/* Forgets about the items from $index on, and also about the size of
+ * the playlist if it may have changed. */
+static void cache_cut(MafwProxyPlaylistPrivate *priv, guint index,
+		      gboolean resized)
+{
+	guint i;
+
+	if (!priv->witems)
+		return;
+	if (resized)
+		priv->size = -1;
+	priv->generation++;
+	cache_cancel_prefetch(priv);
+
+	if (index <= priv->wfirst)
+		index = priv->wfirst;
+	else if (index >= CACHE_END(priv))
+		return;
+	for (i = index - priv->wfirst; i < priv->witems->len; i++)
+		g_free(priv->witems->pdata[i]);
+	g_ptr_array_set_size(priv->witems, index - priv->wfirst);
+}
+
+/* Adds $oids (taking them) starting at $first to the cache.  If they
+ * don't border on the window, they replace it.  $requested is the
+ * number of items asked for; if fewer came, we have reached the end of
+ * the playlist. */
+static void cache_fill(MafwProxyPlaylistPrivate *priv, guint first,
+		       gchar **oids, guint requested)
+{
+	GPtrArray *items;
+	guint n, i, max;
+
+	n = g_strv_length(oids);
+	if (n < requested)
+		priv->size = first + n;
+
+	if (first == CACHE_END(priv)) {
+		/* Forward: append and drop from the front. */
+		for (i = 0; i < n; i++)
+			g_ptr_array_add(priv->witems, oids[i]);
+		max = priv->window * CACHE_MAX_WINDOWS;
+		if (priv->witems->len > max) {
+			n = priv->witems->len - max;
+			for (i = 0; i < n; i++)
+				g_free(priv->witems->pdata[i]);
+			g_ptr_array_remove_range(priv->witems, 0, n);
+			priv->wfirst += n;
+		}
+	} else if (first + n == priv->wfirst && priv->witems->len) {
+		/* Backward: prepend and drop from the end. */
+		items = g_ptr_array_sized_new(n + priv->witems->len);
+		for (i = 0; i < n; i++)
+			g_ptr_array_add(items, oids[i]);
+		for (i = 0; i < priv->witems->len; i++)
+			g_ptr_array_add(items, priv->witems->pdata[i]);
+		g_ptr_array_free(priv->witems, TRUE);
+		priv->witems = items;
+		priv->wfirst = first;
+		max = priv->window * CACHE_MAX_WINDOWS;
+		if (priv->witems->len > max) {
+			for (i = max; i < priv->witems->len; i++)
+				g_free(priv->witems->pdata[i]);
+			g_ptr_array_set_size(priv->witems, max);
+		}
+	} else {
+		for (i = 0; i < priv->witems->len; i++)
+			g_free(priv->witems->pdata[i]);
+		g_ptr_array_set_size(priv->witems, 0);
+		priv->wfirst = first;
+		for (i = 0; i < n; i++)
+			g_ptr_array_add(priv->witems, oids[i]);
+	}
+	/* The strings are in the cache now. */
+	g_free(oids);
+}
+
+/* Fetches the items between $first and $last (inclusive) into the cache.
+ * Returns FALSE if the daemon didn't like the range. */
+static gboolean cache_load(MafwProxyPlaylist *self, guint first, guint last)
+{
+	MafwProxyPlaylistPrivate *priv = self->priv;
+	DBusMessage *reply;
+	gchar **oids;
+
+	reply = mafw_dbus_call(priv->connection, mafw_dbus_method_full(
+					MAFW_DBUS_DESTINATION,
+					priv->obj_path,
+					MAFW_DBUS_INTERFACE,
+				       MAFW_PLAYLIST_METHOD_GET_ITEMS,
+				       DBUS_TYPE_UINT32, first,
+				       DBUS_TYPE_UINT32, last),
+			       MAFW_PLAYLIST_ERROR, NULL);
+	if (!reply)
+		return FALSE;
+	mafw_dbus_parse(reply, MAFW_DBUS_TYPE_STRVZ, &oids);
+	dbus_message_unref(reply);
+
+	/* Something may have been prefetched meanwhile. */
+	cache_cancel_prefetch(priv);
+	cache_fill(priv, first, oids, last - first + 1);
+	return TRUE;
+}
+
+struct prefetch_info {
+	MafwProxyPlaylist *self;
+	guint first, last;
+	guint generation;
+};
+
+static void prefetched(DBusPendingCall *pending, struct prefetch_info *info)
+{
+	MafwProxyPlaylistPrivate *priv = info->self->priv;
+	DBusMessage *reply;
+	gchar **oids;
+
+	g_assert(pending == priv->prefetch);
+	priv->prefetch = NULL;
+
+	reply = dbus_pending_call_steal_reply(pending);
+	if (dbus_message_get_type(reply) == DBUS_MESSAGE_TYPE_METHOD_RETURN
+	    && info->generation == priv->generation) {
+		mafw_dbus_parse(reply, MAFW_DBUS_TYPE_STRVZ, &oids);
+		cache_fill(priv, info->first, oids,
+			   info->last - info->first + 1);
+	}
+	dbus_message_unref(reply);
+	dbus_pending_call_unref(pending);
+}
+
+/* Starts fetching the next window in the direction the reader at $index
+ * is heading to, if it's close to the edge. */
+static void cache_prefetch(MafwProxyPlaylist *self, guint index)
+{
+	MafwProxyPlaylistPrivate *priv = self->priv;
+	struct prefetch_info *info;
+	guint margin, first, last;
+
+	if (priv->prefetch || !priv->witems->len)
+		return;
+
+	margin = priv->window / 4;
+	if (index + margin >= CACHE_END(priv)
+	    && (priv->size < 0 || CACHE_END(priv) < (guint)priv->size)) {
+		first = CACHE_END(priv);
+		last = first + priv->window - 1;
+	} else if (index < priv->wfirst + margin && priv->wfirst > 0) {
+		last = priv->wfirst - 1;
+		first = last >= priv->window ? last - priv->window + 1 : 0;
+	} else
+		return;
+
+	mafw_dbus_send_async(priv->connection, &priv->prefetch,
+			     mafw_dbus_method_full(
+				MAFW_DBUS_DESTINATION,
+				priv->obj_path,
+				MAFW_DBUS_INTERFACE,
+				MAFW_PLAYLIST_METHOD_GET_ITEMS,
+				DBUS_TYPE_UINT32, first,
+				DBUS_TYPE_UINT32, last));
+	if (!priv->prefetch)
+		return;
+
+	info = g_new(struct prefetch_info, 1);
+	info->self = self;
+	info->first = first;
+	info->last = last;
+	info->generation = priv->generation;
+	dbus_pending_call_set_notify(priv->prefetch,
+				     (DBusPendingCallNotifyFunction)prefetched,
+				     info, g_free);
+}
+
+/* Makes sure $index is in the cache, unless it's past the end of the
+ * playlist.  Returns whether it is. */
+static gboolean cache_ensure(MafwProxyPlaylist *self, guint index)
+{
+	MafwProxyPlaylistPrivate *priv = self->priv;
+	guint first;
+
+	if (index >= priv->wfirst && index < CACHE_END(priv))
+		return TRUE;
+	if (priv->size >= 0 && index >= (guint)priv->size)
+		return FALSE;
+
+	/* Load a window ahead of a reader going forward, behind one going
+	 * backward, and around $index otherwise. */
+	if (index == CACHE_END(priv) && priv->witems->len)
+		first = index;
+	else if (index + 1 == priv->wfirst)
+		first = index >= priv->window - 1
+			? index - (priv->window - 1) : 0;
+	else
+		first = index >= priv->window / 2
+			? index - priv->window / 2 : 0;
+	if (!cache_load(self, first, first + priv->window - 1))
+		return FALSE;
+	return index >= priv->wfirst && index < CACHE_END(priv);
+}
+
+/* Returns the items between $first and $last (inclusive, clipped at the
+ * end of the playlist) from the cache, loading them if necessary.
+ * Returns NULL if they couldn't be loaded. */
+static gchar **cache_get_items(MafwProxyPlaylist *self,
+			       guint first, guint last)
+{
+	MafwProxyPlaylistPrivate *priv = self->priv;
+	gchar **items;
+	guint i, n;
+
+	/* Large ranges aren't worth to go through the cache. */
+	n = last - first + 1;
+	if (n > priv->window)
+		return NULL;
+
+	if (first < priv->wfirst || first >= CACHE_END(priv)) {
+		if (priv->size >= 0 && first >= (guint)priv->size)
+			/* Let the daemon return the error. */
+			return NULL;
+		if (!cache_load(self, first, first + priv->window - 1))
+			return NULL;
+	} else if (last >= CACHE_END(priv)
+		   && (priv->size < 0
+		       || CACHE_END(priv) < (guint)priv->size)) {
+		if (!cache_load(self, CACHE_END(priv),
+				CACHE_END(priv) + priv->window - 1))
+			return NULL;
+	}
+	if (first < priv->wfirst || first >= CACHE_END(priv))
+		return NULL;
+	if (last >= CACHE_END(priv)) {
+		/* Only acceptable if it's the end of the playlist. */
+		if (priv->size < 0 || CACHE_END(priv) != (guint)priv->size)
+			return NULL;
+		last = CACHE_END(priv) - 1;
+	}
+
+	n = last - first + 1;
+	items = g_new(gchar *, n + 1);
+	for (i = 0; i < n; i++)
+		items[i] = g_strdup(priv->witems->pdata[first - priv->wfirst + i]);
+	items[n] = NULL;
+	cache_prefetch(self, last);
+	return items;
+}
+
+/**
+ * mafw_proxy_playlist_set_cache_window:
+ * @self: a #MafwProxyPlaylist.
+ * @window: the number of items to fetch at once, 0 to disable caching.
+ *
+ * Makes @self keep a window of the playlist's items locally, so that
+ * mafw_playlist_get_item(), mafw_playlist_get_items() and
+ * mafw_playlist_get_size() need not ask the playlist daemon every time.
+ * Items are fetched @window at a time, and the next window is fetched in
+ * the background as reading approaches the edge of the cached ones.
+ *
+ * The cache follows the #MafwPlaylist::contents-changed and
+ * #MafwPlaylist::item-moved signals, so changes made by other processes
+ * are only seen after they have been dispatched from the main loop.
+ * Caching is disabled by default.
+ */
+void mafw_proxy_playlist_set_cache_window(MafwProxyPlaylist *self,
+					  guint window)
+{
+	MafwProxyPlaylistPrivate *priv;
+	guint i;
+
+	g_return_if_fail(MAFW_IS_PROXY_PLAYLIST(self));
+
+	priv = self->priv;
+	if (priv->witems) {
+		cache_cut(priv, 0, TRUE);
+		for (i = 0; i < priv->witems->len; i++)
+			g_free(priv->witems->pdata[i]);
+		g_ptr_array_free(priv->witems, TRUE);
+		priv->witems = NULL;
+	}
+	priv->window = window;
+	if (window)
+		priv->witems = g_ptr_array_sized_new(window);
+}
+
 /*---------------------------------------------------------------------------
   Set name
   ---------------------------------------------------------------------------*/
@@ -635,6 +957,7 @@ gboolean mafw_proxy_playlist_insert_item(MafwPlaylist *self, guint index,
 
 	if (reply) {
 		dbus_message_unref(reply);
+		cache_cut(priv, index, TRUE);
 		return TRUE;
 	}
 	return FALSE;
@@ -662,6 +985,7 @@ gboolean mafw_proxy_playlist_insert_items(MafwPlaylist *self, guint index,
 
 	if (reply) {
 		dbus_message_unref(reply);
+		cache_cut(priv, index, TRUE);
 		return TRUE;
 	}
 	return FALSE;
@@ -688,6 +1012,7 @@ gboolean mafw_proxy_playlist_append_item(MafwPlaylist *self,
 				MAFW_PLAYLIST_ERROR, error);
 	if (reply) {
 		dbus_message_unref(reply);
+		cache_cut(priv, G_MAXUINT, TRUE);
 		return TRUE;
 	}
 	return FALSE;
@@ -713,6 +1038,7 @@ gboolean mafw_proxy_playlist_append_items(MafwPlaylist *self,
 				MAFW_PLAYLIST_ERROR, error);
 	if (reply) {
 		dbus_message_unref(reply);
+		cache_cut(priv, G_MAXUINT, TRUE);
 		return TRUE;
 	}
 	return FALSE;
@@ -746,6 +1072,8 @@ gboolean mafw_proxy_playlist_remove_item(MafwPlaylist *self, guint index,
 	if (reply) {
 		mafw_dbus_parse(reply,DBUS_TYPE_BOOLEAN, &retval);
 		dbus_message_unref(reply);
+		if (retval)
+			cache_cut(priv, index, TRUE);
 		return retval;
 	}
 
@@ -766,6 +1094,18 @@ gchar *mafw_proxy_playlist_get_item(MafwPlaylist *self, guint index,
 
 	priv = MAFW_PROXY_PLAYLIST_GET_PRIVATE(playlist);
 	g_return_val_if_fail(priv->connection != NULL, NULL);
+
+	if (priv->witems) {
+		if (cache_ensure(playlist, index)) {
+			cache_prefetch(playlist, index);
+			return g_strdup(priv->witems->pdata[
+						index - priv->wfirst]);
+		}
+		if (priv->size >= 0 && index >= (guint)priv->size)
+			return NULL;
+		/* Let the daemon tell what's wrong. */
+	}
+
 	reply = mafw_dbus_call(priv->connection, mafw_dbus_method_full(
 					MAFW_DBUS_DESTINATION,
 					priv->obj_path,
@@ -794,6 +1134,13 @@ gchar **mafw_proxy_playlist_get_items(MafwPlaylist *self,
 
 	priv = MAFW_PROXY_PLAYLIST_GET_PRIVATE(playlist);
 	g_return_val_if_fail(priv->connection != NULL, NULL);
+
+	if (priv->witems && first_index <= last_index) {
+		retval = cache_get_items(playlist, first_index, last_index);
+		if (retval)
+			return retval;
+	}
+
 	reply = mafw_dbus_call(priv->connection, mafw_dbus_method_full(
 					MAFW_DBUS_DESTINATION,
 					priv->obj_path,
@@ -930,6 +1277,8 @@ gboolean mafw_proxy_playlist_move_item(MafwPlaylist *self, guint from,
 	if (reply) {
 		mafw_dbus_parse(reply,DBUS_TYPE_BOOLEAN, &retval);
 		dbus_message_unref(reply);
+		if (retval)
+			cache_cut(priv, MIN(from, to), FALSE);
 		return retval;
 	}
 
@@ -951,6 +1300,9 @@ guint mafw_proxy_playlist_get_size(MafwPlaylist *self, GError **error)
 	priv = MAFW_PROXY_PLAYLIST_GET_PRIVATE(playlist);
 	g_return_val_if_fail(priv->connection != NULL, 0);
 
+	if (priv->witems && priv->size >= 0)
+		return priv->size;
+
 	reply = mafw_dbus_call(priv->connection, mafw_dbus_method_full(
 					MAFW_DBUS_DESTINATION,
 					priv->obj_path,
@@ -961,6 +1313,8 @@ guint mafw_proxy_playlist_get_size(MafwPlaylist *self, GError **error)
 	if (reply) {
 		mafw_dbus_parse(reply, DBUS_TYPE_UINT32, &retval);
 		dbus_message_unref(reply);
+		if (priv->witems)
+			priv->size = retval;
 	}
 
 
@@ -990,6 +1344,9 @@ gboolean mafw_proxy_playlist_clear(MafwPlaylist *self, GError **error)
 			       MAFW_PLAYLIST_ERROR, error);
 	if (reply) {
 		dbus_message_unref(reply);
+		cache_cut(priv, 0, TRUE);
+		if (priv->witems)
+			priv->size = 0;
 		return TRUE;
 	}
 
@@ -1023,6 +1380,7 @@ static void mafw_proxy_playlist_handle_signal_contents_changed(
 			DBUS_TYPE_UINT32, &nremove,
 			DBUS_TYPE_UINT32, &nreplace);
 
+	cache_cut(self->priv, from, nremove != nreplace);
 	g_signal_emit_by_name(self, "contents-changed",
 			      from, nremove, nreplace);
 }
@@ -1071,6 +1429,7 @@ static void handle_signal_item_moved(MafwProxyPlaylist *self, DBusMessage *msg)
 			DBUS_TYPE_UINT32, &from,
 			DBUS_TYPE_UINT32, &to);
 
+	cache_cut(self->priv, MIN(from, to), FALSE);
 	g_signal_emit_by_name(self, "item-moved",
 			      from, to);
 }
@@ -97,6 +97,8 @@ struct _MafwProxyPlaylistClass
 GType mafw_proxy_playlist_get_type(void);
 GObject *mafw_proxy_playlist_new(guint id);
 guint mafw_proxy_playlist_get_id(MafwProxyPlaylist *self);
+void mafw_proxy_playlist_set_cache_window(MafwProxyPlaylist *self,
+					  guint window);
 
 #endif
 
@@ -177,6 +177,22 @@ mafw_proxy_renderer_handle_signal_metadata_changed(MafwProxyRenderer *self,
 	g_value_array_free(values);
 }
 
+static void
+mafw_proxy_renderer_handle_signal_metadatas_changed(MafwProxyRenderer *self,
+                                                    DBusMessage *msg)
+{
+	GHashTable *metadata;
+
+	g_assert(self != NULL);
+	g_assert(msg != NULL);
+
+	mafw_dbus_parse(msg,
+			MAFW_DBUS_TYPE_METADATA, &metadata);
+
+	g_signal_emit_by_name(self, "metadatas-changed", metadata);
+	mafw_metadata_release(metadata);
+}
+
 
 /**
  * mafw_proxy_renderer_dispatch_message:
@@ -222,6 +238,10 @@ mafw_proxy_renderer_dispatch_message(DBusConnection *conn,
                                        MAFW_RENDERER_SIGNAL_METADATA_CHANGED)) {
 		mafw_proxy_renderer_handle_signal_metadata_changed(self, msg);
 		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+	} else if (mafw_dbus_is_signal(msg,
+                                       MAFW_RENDERER_SIGNAL_METADATAS_CHANGED)) {
+		mafw_proxy_renderer_handle_signal_metadatas_changed(self, msg);
+		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 	}
 
 	return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
@@ -1037,7 +1057,6 @@ GObject *mafw_proxy_renderer_new(const gchar *uuid, const gchar *plugin,
 					"plugin", plugin,
 					NULL);
 	MafwProxyRenderer *renderer_obj;
-	DBusError err;
 	gchar *match_str = NULL, *path;
 	DBusObjectPathVTable path_vtable;
 
@@ -1057,18 +1076,15 @@ GObject *mafw_proxy_renderer_new(const gchar *uuid, const gchar *plugin,
 
 	if (!connection) goto renderer_new_error;
 
-	dbus_error_init(&err);
-
+	/* See mafw-proxy-source.c as to why there's no error checking. */
 	match_str = g_strdup_printf(MAFW_EXTENSION_MATCH,
                                     MAFW_RENDERER_INTERFACE,
                                     path);
 
-	dbus_bus_add_match(connection, match_str, &err);
+	dbus_bus_add_match(connection, match_str, NULL);
 
 	g_free(match_str);
 
-	if (dbus_error_is_set(&err)) goto renderer_new_error;
-
 	if (!dbus_connection_register_object_path(connection,
 			path,
 			&path_vtable,
@@ -69,11 +69,26 @@ typedef struct {
 	};
 	gpointer cbdata;
 
+	/* For the metadata cache: the key set of the request, the
+	 * cache generation it was issued in, and the results already
+	 * found in the cache. */
+	gchar *keyset;
+	guint generation;
+	GHashTable *cached;
+
 	union {
 		char *objectid;
 	};
 } RequestReplyInfo;
 
+/* An entry of the metadata cache.  $link is its node in the LRU list. */
+typedef struct {
+	gchar *key;		/* "<object id>\n<keyset>" */
+	gsize oidlen;
+	GHashTable *metadata;
+	GList link;
+} MetadataCacheEntry;
+
 struct _MafwProxySourceMetadataReq {
 	MafwSourceMetadataResultCb metadata_cb;
 	gpointer user_data;
@@ -88,10 +103,147 @@ struct _MafwProxySourceBrowseReq {
 
 struct _MafwProxySourcePrivate {
 	GHashTable *browse_requests;
+
+	/* Metadata cache, see mafw_proxy_source_set_metadata_cache_size().
+	 * $cache_generation is bumped on every invalidation, so that replies
+	 * to requests issued before that are not cached. */
+	guint cache_size;
+	GHashTable *cache;
+	GQueue cache_lru;
+	guint cache_generation;
+	guint cache_hits, cache_misses;
 };
 
 static DBusConnection *connection;
 
+/* Metadata cache.  It maps (object id, metadata keys) pairs to the
+ * metadata last received for them, and is only consulted by
+ * get_metadata() and get_metadatas().  Entries of an object are dropped
+ * when the source says its metadata changed; everything is dropped when
+ * a container changes, since we can't tell which objects it affects. */
+
+static gint cmp_keys(gconstpointer a, gconstpointer b)
+{
+	return strcmp(*(const gchar **)a, *(const gchar **)b);
+}
+
+/* Returns the canonical form of $keys, which doesn't depend on their
+ * order. */
+static gchar *cache_keyset(const gchar *const *keys)
+{
+	GPtrArray *sorted;
+	GString *keyset;
+	guint i;
+
+	sorted = g_ptr_array_new();
+	for (; *keys; keys++)
+		g_ptr_array_add(sorted, (gpointer)*keys);
+	g_ptr_array_sort(sorted, cmp_keys);
+
+	keyset = g_string_new(NULL);
+	for (i = 0; i < sorted->len; i++) {
+		if (i > 0 && !strcmp(sorted->pdata[i], sorted->pdata[i-1]))
+			continue;
+		g_string_append(keyset, sorted->pdata[i]);
+		g_string_append_c(keyset, '\n');
+	}
+	g_ptr_array_free(sorted, TRUE);
+	return g_string_free(keyset, FALSE);
+}
+
+static void cache_entry_free(MetadataCacheEntry *entry)
+{
+	mafw_metadata_release(entry->metadata);
+	g_free(entry->key);
+	g_free(entry);
+}
+
+static void cache_drop(MafwProxySourcePrivate *priv,
+		       MetadataCacheEntry *entry)
+{
+	g_queue_unlink(&priv->cache_lru, &entry->link);
+	g_hash_table_remove(priv->cache, entry->key);
+}
+
+/* Returns the cached metadata of $oid for $keyset or %NULL. */
+static GHashTable *cache_lookup(MafwProxySourcePrivate *priv,
+				const gchar *oid, const gchar *keyset)
+{
+	MetadataCacheEntry *entry;
+	gchar *key;
+
+	key = g_strconcat(oid, "\n", keyset, NULL);
+	entry = g_hash_table_lookup(priv->cache, key);
+	g_free(key);
+	if (!entry) {
+		priv->cache_misses++;
+		return NULL;
+	}
+
+	priv->cache_hits++;
+	g_queue_unlink(&priv->cache_lru, &entry->link);
+	g_queue_push_head_link(&priv->cache_lru, &entry->link);
+	return entry->metadata;
+}
+
+/* Stores $metadata of $oid unless the cache was invalidated since
+ * $generation. */
+static void cache_store(MafwProxySourcePrivate *priv, guint generation,
+			const gchar *oid, const gchar *keyset,
+			GHashTable *metadata)
+{
+	MetadataCacheEntry *entry;
+	gchar *key;
+
+	if (!priv->cache_size || generation != priv->cache_generation)
+		return;
+
+	key = g_strconcat(oid, "\n", keyset, NULL);
+	if ((entry = g_hash_table_lookup(priv->cache, key)) != NULL) {
+		g_free(key);
+		mafw_metadata_release(entry->metadata);
+		g_queue_unlink(&priv->cache_lru, &entry->link);
+	} else {
+		entry = g_new0(MetadataCacheEntry, 1);
+		entry->key = key;
+		entry->oidlen = strlen(oid);
+		entry->link.data = entry;
+		g_hash_table_insert(priv->cache, entry->key, entry);
+	}
+	entry->metadata = g_hash_table_ref(metadata);
+	g_queue_push_head_link(&priv->cache_lru, &entry->link);
+
+	while (priv->cache_lru.length > priv->cache_size)
+		cache_drop(priv, priv->cache_lru.tail->data);
+}
+
+/* Drops the cached metadata of $oid, or everything if it's %NULL. */
+static void cache_invalidate(MafwProxySourcePrivate *priv, const gchar *oid)
+{
+	GList *l, *next;
+	MetadataCacheEntry *entry;
+	gsize oidlen;
+
+	if (!priv->cache)
+		return;
+	priv->cache_generation++;
+
+	if (!oid) {
+		g_hash_table_remove_all(priv->cache);
+		g_queue_init(&priv->cache_lru);
+		return;
+	}
+
+	oidlen = strlen(oid);
+	for (l = priv->cache_lru.head; l; l = next) {
+		next = l->next;
+		entry = l->data;
+		if (entry->oidlen == oidlen
+		    && !strncmp(entry->key, oid, oidlen))
+			cache_drop(priv, entry);
+	}
+}
+
 static DBusHandlerResult handle_container_changed_signal(MafwProxySource *self,
 							 DBusMessage *msg)
 {
@@ -100,6 +252,7 @@ static DBusHandlerResult handle_container_changed_signal(MafwProxySource *self,
 	/* Read the message and signal the values */
 	mafw_dbus_parse(msg,
 			DBUS_TYPE_STRING, &obj_id);
+	cache_invalidate(self->priv, NULL);
 	g_signal_emit_by_name(self, "container-changed", obj_id);
 
 	return DBUS_HANDLER_RESULT_HANDLED;
@@ -113,6 +266,7 @@ static DBusHandlerResult handle_metadata_changed_signal(MafwProxySource *self,
 	/* Read the message and signal the values */
 	mafw_dbus_parse(msg,
 			DBUS_TYPE_STRING, &obj_id);
+	cache_invalidate(self->priv, obj_id);
 	g_signal_emit_by_name(self, "metadata-changed", obj_id);
 
 	return DBUS_HANDLER_RESULT_HANDLED;
@@ -140,10 +294,12 @@ static DBusHandlerResult handle_updating_signal(MafwProxySource *self,
 
 
 /**
- * SECTION:mafw-proxy-source
+ * SECTION:mafwproxysource
+ * @short_description: Proxy for sources of other processes
  *
- * #MafwProxySource is ...  `not documented', for example.
- * TODO
+ * #MafwProxySource stands for a #MafwSource living in another process,
+ * forwarding requests to it over D-Bus.  Proxies are created by
+ * mafw_shared_init() as the sources are discovered.
  */
 
 static DBusHandlerResult
@@ -466,6 +622,9 @@ static RequestReplyInfo *new_request_reply_info(DBusPendingCall *pendelum,
  * end of the structure. */
 static void free_request_reply_info(RequestReplyInfo *info)
 {
+	g_free(info->keyset);
+	if (info->cached)
+		g_hash_table_unref(info->cached);
 	g_object_unref(info->src);
 	g_free(info);
 }
@@ -537,6 +696,10 @@ static void got_metadata(DBusPendingCall *pendelum, RequestReplyInfo *info)
                          DBUS_MESSAGE_TYPE_METHOD_RETURN);
 		mafw_dbus_parse(reply,
 				MAFW_DBUS_TYPE_METADATA, &metadata);
+		if (info->keyset)
+			cache_store(MAFW_PROXY_SOURCE(info->src)->priv,
+				    info->generation, info->objectid,
+				    info->keyset, metadata);
 		info->got_metadata_cb(info->src,
 				      info->objectid, metadata,
 				      info->cbdata, NULL);
@@ -551,6 +714,15 @@ static void got_metadata(DBusPendingCall *pendelum, RequestReplyInfo *info)
 	dbus_pending_call_unref(pendelum);
 }
 
+/* Returns the metadata of a get_metadata() request found in the cache
+ * from the main loop, like a reply would be. */
+static gboolean got_cached_metadata(RequestReplyInfo *info)
+{
+	info->got_metadata_cb(info->src, info->objectid, info->cached,
+			      info->cbdata, NULL);
+	return FALSE;
+}
+
 static void mafw_proxy_source_get_metadata(MafwSource *self,
                                            const gchar *object_id,
                                            const gchar *const *metadata_keys,
@@ -560,6 +732,7 @@ static void mafw_proxy_source_get_metadata(MafwSource *self,
 	MafwProxySource *proxy;
 	DBusPendingCall *pendelum = NULL;
 	RequestReplyInfo *rri;
+	gchar *keyset = NULL;
 
 	/* We consider calling this with metadata_keys==NULL an error. */
 	g_assert(metadata_keys);
@@ -567,6 +740,26 @@ static void mafw_proxy_source_get_metadata(MafwSource *self,
 
 	proxy = MAFW_PROXY_SOURCE(self);
 
+	if (proxy->priv->cache_size) {
+		GHashTable *metadata;
+
+		keyset = cache_keyset(metadata_keys);
+		metadata = cache_lookup(proxy->priv, object_id, keyset);
+		if (metadata) {
+			rri = g_new0(RequestReplyInfo, 1);
+			rri->src = g_object_ref(self);
+			rri->cb = cb;
+			rri->cbdata = cbdata;
+			rri->objectid = g_strdup(object_id);
+			rri->cached = g_hash_table_ref(metadata);
+			g_idle_add_full(G_PRIORITY_DEFAULT,
+					(GSourceFunc)got_cached_metadata, rri,
+					(GDestroyNotify)free_reply_info_and_oid);
+			g_free(keyset);
+			return;
+		}
+	}
+
 	mafw_dbus_send_async(
                 connection, &pendelum,
                 mafw_dbus_method_full(proxy_extension_return_service(proxy),
@@ -583,17 +776,35 @@ static void mafw_proxy_source_get_metadata(MafwSource *self,
 			    "Source disconnected.");
 		cb(self, object_id, NULL, cbdata, errp);
 		g_error_free(errp);
+		g_free(keyset);
 		return;
 	}
 
 	rri = new_request_reply_info(pendelum, self, cb, cbdata);
 	rri->objectid = g_strdup(object_id);
+	rri->keyset = keyset;
+	rri->generation = proxy->priv->cache_generation;
 	dbus_pending_call_set_notify(pendelum,
 				     (gpointer)got_metadata,
 				     rri, (gpointer)free_reply_info_and_oid);
 }
 
 /* MafwSource::get_metadatas */
+static void add_cached_metadata(const gchar *object_id, GHashTable *metadata,
+				GHashTable *metadatas)
+{
+	g_hash_table_insert(metadatas, g_strdup(object_id),
+			    g_hash_table_ref(metadata));
+}
+
+/* Returns the results of a get_metadatas() request all found in the
+ * cache. */
+static gboolean got_cached_metadatas(RequestReplyInfo *info)
+{
+	info->got_metadatas_cb(info->src, info->cached, info->cbdata, NULL);
+	return FALSE;
+}
+
 static void got_metadatas(DBusPendingCall *pendelum, RequestReplyInfo *info)
 {
 	GError *error;
@@ -628,6 +839,12 @@ static void got_metadatas(DBusPendingCall *pendelum, RequestReplyInfo *info)
 				dbus_message_iter_next(&istr);
 				mafw_dbus_message_parse_metadata(&istr,
 							&cur_metadata);
+				if (info->keyset)
+					cache_store(
+						MAFW_PROXY_SOURCE(
+							info->src)->priv,
+						info->generation, object_id,
+						info->keyset, cur_metadata);
 				g_hash_table_insert(metadatas,
                                                     g_strdup(object_id),
                                                     cur_metadata);
@@ -645,6 +862,19 @@ static void got_metadatas(DBusPendingCall *pendelum, RequestReplyInfo *info)
 					g_quark_from_string(domain_str),
 					    code, "%s", message);
 
+		/* Add what was found in the cache. */
+		if (info->cached) {
+			if (!metadatas)
+				metadatas = g_hash_table_new_full(
+                                        g_str_hash,
+                                        g_str_equal,
+                                        (GDestroyNotify)g_free,
+                                        (GDestroyNotify)mafw_metadata_release);
+			g_hash_table_foreach(info->cached,
+					     (GHFunc)add_cached_metadata,
+					     metadatas);
+		}
+
 		info->got_metadatas_cb(info->src,
 				      metadatas,
 				      info->cbdata, error);
@@ -670,6 +900,9 @@ mafw_proxy_source_get_metadatas(MafwSource *self,
 	MafwProxySource *proxy;
 	DBusPendingCall *pendelum = NULL;
 	RequestReplyInfo *rri;
+	gchar *keyset = NULL;
+	GHashTable *cached = NULL;
+	GPtrArray *missing = NULL;
 
 	/* We consider calling this with metadata_keys==NULL an error. */
 	g_assert(metadata_keys);
@@ -677,6 +910,46 @@ mafw_proxy_source_get_metadatas(MafwSource *self,
 
 	proxy = MAFW_PROXY_SOURCE(self);
 
+	/* Only ask for the objects not found in the cache. */
+	if (proxy->priv->cache_size) {
+		const gchar **oid;
+		GHashTable *metadata;
+
+		keyset = cache_keyset(metadata_keys);
+		missing = g_ptr_array_new();
+		for (oid = object_ids; *oid; oid++) {
+			metadata = cache_lookup(proxy->priv, *oid, keyset);
+			if (!metadata) {
+				g_ptr_array_add(missing, (gpointer)*oid);
+				continue;
+			}
+			if (!cached)
+				cached = g_hash_table_new_full(
+                                        g_str_hash,
+                                        g_str_equal,
+                                        (GDestroyNotify)g_free,
+                                        (GDestroyNotify)mafw_metadata_release);
+			g_hash_table_replace(cached, g_strdup(*oid),
+					     g_hash_table_ref(metadata));
+		}
+		g_ptr_array_add(missing, NULL);
+		object_ids = (const gchar **)missing->pdata;
+
+		if (!*object_ids) {
+			rri = g_new0(RequestReplyInfo, 1);
+			rri->src = g_object_ref(self);
+			rri->cb = cb;
+			rri->cbdata = cbdata;
+			rri->cached = cached;
+			g_idle_add_full(G_PRIORITY_DEFAULT,
+					(GSourceFunc)got_cached_metadatas, rri,
+					(GDestroyNotify)free_reply_info_and_oid);
+			g_ptr_array_free(missing, TRUE);
+			g_free(keyset);
+			return;
+		}
+	}
+
 	mafw_dbus_send_async(
                 connection, &pendelum,
                 mafw_dbus_method_full(proxy_extension_return_service(proxy),
@@ -685,6 +958,8 @@ mafw_proxy_source_get_metadatas(MafwSource *self,
                                       MAFW_SOURCE_METHOD_GET_METADATAS,
                                       MAFW_DBUS_STRVZ(object_ids),
                                       MAFW_DBUS_STRVZ(metadata_keys)));
+	if (missing)
+		g_ptr_array_free(missing, TRUE);
 	if (!pendelum)
 	{
 		GError *errp = NULL;
@@ -693,10 +968,16 @@ mafw_proxy_source_get_metadatas(MafwSource *self,
 			    "Source disconnected.");
 		cb(self, NULL, cbdata, errp);
 		g_error_free(errp);
+		if (cached)
+			g_hash_table_unref(cached);
+		g_free(keyset);
 		return;
 	}
 
 	rri = new_request_reply_info(pendelum, self, cb, cbdata);
+	rri->keyset = keyset;
+	rri->generation = proxy->priv->cache_generation;
+	rri->cached = cached;
 	dbus_pending_call_set_notify(pendelum,
 				     (gpointer)got_metadatas,
 				     rri, (gpointer)free_reply_info_and_oid);
@@ -811,6 +1092,7 @@ static void mafw_proxy_source_destroy_object(MafwSource *self,
 	RequestReplyInfo *rri;
 
 	proxy = MAFW_PROXY_SOURCE(self);
+	cache_invalidate(proxy->priv, objectid);
 
 	mafw_dbus_send_async(
                 connection, &pendelum,
@@ -909,6 +1191,7 @@ static void mafw_proxy_source_set_metadata(MafwSource *self,
 	RequestReplyInfo *rri;
 
 	proxy = MAFW_PROXY_SOURCE(self);
+	cache_invalidate(proxy->priv, object_id);
 
 	mafw_dbus_send_async(
                 connection, &pendelum,
@@ -957,6 +1240,7 @@ static void mafw_proxy_source_dispose (GObject *obj)
 	}
 	if (source_obj->priv->browse_requests)
 		g_hash_table_destroy(source_obj->priv->browse_requests);
+	mafw_proxy_source_set_metadata_cache_size(source_obj, 0);
 }
 
 
@@ -991,6 +1275,72 @@ static void mafw_proxy_source_init(MafwProxySource *self)
 	g_return_if_fail(MAFW_IS_PROXY_SOURCE(self));
 
 	self->priv = MAFW_PROXY_SOURCE_GET_PRIVATE(self);
+	g_queue_init(&self->priv->cache_lru);
+}
+
+/**
+ * mafw_proxy_source_set_metadata_cache_size:
+ * @self: a #MafwProxySource instance.
+ * @size: how many results to remember, 0 to disable the cache.
+ *
+ * Makes @self remember the results of the last @size distinct
+ * mafw_source_get_metadata() requests (and of the objects in
+ * mafw_source_get_metadatas() requests), identified by the object ID
+ * and the set of metadata keys asked for.  Repeated requests are then
+ * answered from the cache, without asking the source, but still
+ * asynchronously.  Cached results are forgotten when the source
+ * signals #MafwSource::metadata-changed for their object or any
+ * #MafwSource::container-changed, and when they are modified via @self.
+ *
+ * The cache is disabled by default.  Clients must not modify the
+ * metadata they receive if it is enabled.
+ */
+void mafw_proxy_source_set_metadata_cache_size(MafwProxySource *self,
+					       guint size)
+{
+	MafwProxySourcePrivate *priv;
+
+	g_return_if_fail(MAFW_IS_PROXY_SOURCE(self));
+
+	priv = self->priv;
+	priv->cache_size = size;
+	if (!size) {
+		if (priv->cache) {
+			cache_invalidate(priv, NULL);
+			g_hash_table_destroy(priv->cache);
+			priv->cache = NULL;
+		}
+		return;
+	}
+
+	if (!priv->cache)
+		priv->cache = g_hash_table_new_full(
+			g_str_hash, g_str_equal, NULL,
+			(GDestroyNotify)cache_entry_free);
+	while (priv->cache_lru.length > size)
+		cache_drop(priv, priv->cache_lru.tail->data);
+}
+
+/**
+ * mafw_proxy_source_get_metadata_cache_stats:
+ * @self: a #MafwProxySource instance.
+ * @hits: location for the number of requests answered from the cache,
+ *        or %NULL.
+ * @misses: location for the number of requests the source had to be
+ *          asked for, or %NULL.
+ *
+ * Tells how effective the metadata cache of @self has been.  Each object
+ * of a mafw_source_get_metadatas() request is counted separately.
+ */
+void mafw_proxy_source_get_metadata_cache_stats(MafwProxySource *self,
+						guint *hits, guint *misses)
+{
+	g_return_if_fail(MAFW_IS_PROXY_SOURCE(self));
+
+	if (hits)
+		*hits = self->priv->cache_hits;
+	if (misses)
+		*misses = self->priv->cache_misses;
 }
 
 /**
@@ -1008,7 +1358,6 @@ GObject *mafw_proxy_source_new(const gchar *uuid, const gchar *plugin,
 					"plugin", plugin,
 					NULL);
 	MafwProxySource *source_obj;
-	DBusError err;
 	gchar *match_str = NULL, *path = NULL;
 	DBusObjectPathVTable path_vtable;
 
@@ -1026,15 +1375,13 @@ GObject *mafw_proxy_source_new(const gchar *uuid, const gchar *plugin,
 
 	if (!connection) goto source_new_error;
 
-	dbus_error_init(&err);
-
 	path = g_strdup_printf(MAFW_SOURCE_OBJECT "/%s", uuid);
 
+	/* Not waiting for the reply saves a round trip per proxy. */
 	match_str = g_strdup_printf(MAFW_EXTENSION_MATCH, MAFW_SOURCE_INTERFACE,
 					path);
-	dbus_bus_add_match(connection, match_str, &err);
+	dbus_bus_add_match(connection, match_str, NULL);
 	g_free(match_str);
-	if (dbus_error_is_set(&err)) goto source_new_error;
 
 	if (!dbus_connection_register_object_path(connection,
 			path,
@@ -72,6 +72,11 @@ GType mafw_proxy_source_get_type(void);
 GObject *mafw_proxy_source_new(const gchar *uuid, const gchar *plugin,
 				MafwRegistry *registry);
 
+void mafw_proxy_source_set_metadata_cache_size(MafwProxySource *self,
+					       guint size);
+void mafw_proxy_source_get_metadata_cache_stats(MafwProxySource *self,
+						guint *hits, guint *misses);
+
 
 G_END_DECLS
 #endif				/* __MAFW_PROXY_SOURCE_H__ */
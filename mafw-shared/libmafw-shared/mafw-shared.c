@@ -49,6 +49,7 @@
 #include "common/dbus-interface.h"
 #include "mafw-proxy-renderer.h"
 #include "mafw-proxy-source.h"
+#include "mafw-proxy-extension.h"
 
 #undef  G_LOG_DOMAIN
 #define G_LOG_DOMAIN "mafw-shared"
@@ -58,6 +59,23 @@
 /* Private variables */
 static DBusConnection *connection = NULL;
 
+/* State of the initial discovery, between mafw_shared_init() and
+ * the emission of MafwRegistry::discovery-complete. */
+static struct {
+	MafwRegistry *registry;
+	DBusPendingCall *list_names;
+	/* uuid -> the time we started to create its proxy */
+	GHashTable *pending;
+	GTimer *timer;
+	gboolean listed;
+	guint idle;
+	MafwSharedDiscoveryStats stats;
+} Discovery;
+
+static guint Discovery_complete_signal;
+
+static void discovery_check(void);
+
 /* Program code */
 
 /**
@@ -97,13 +115,16 @@ static gboolean split_servicename(const gchar *svc, GType *kind,
 
 /**
  * Interprets @svc, and if it represents a MAFW component, tries to create
- * either a renderer or source proxy, and adds it to @registry.
+ * either a renderer or source proxy, and adds it to @registry.  If @track
+ * is %TRUE, the initial discovery waits for the proxy to be registered.
  */
 static void create_proxy(MafwRegistry *registry,
-			 const gchar *svc)
+			 const gchar *svc, gboolean track)
 {
 	GType pxtype;
 	gchar *plugin, *uuid;
+	gpointer proxy;
+	gdouble *started;
 
 
 	/* Extensions are exported using the name:
@@ -117,30 +138,42 @@ static void create_proxy(MafwRegistry *registry,
 	if (!mafw_registry_get_extension_by_uuid(MAFW_REGISTRY(registry),
 						  uuid))
 	{
-		DBusError err;
 		gchar *matchstr;
-		dbus_error_init(&err);
+
+		/* The proxy may get registered before we return
+		 * (think mockbus), so start tracking it first. */
+		if (track) {
+			started = g_new(gdouble, 1);
+			*started = g_timer_elapsed(Discovery.timer, NULL);
+			g_hash_table_insert(Discovery.pending, g_strdup(uuid),
+					    started);
+		}
+		proxy = NULL;
 		if (pxtype == MAFW_TYPE_PROXY_SOURCE)
-			mafw_proxy_source_new(uuid,
-					      plugin,
-					      registry);
+			proxy = mafw_proxy_source_new(uuid,
+						      plugin,
+						      registry);
 		else if (pxtype == MAFW_TYPE_PROXY_RENDERER)
-			mafw_proxy_renderer_new(uuid,
-						plugin,
-						registry);
+			proxy = mafw_proxy_renderer_new(uuid,
+							plugin,
+							registry);
+		if (!proxy) {
+			if (track)
+				g_hash_table_remove(Discovery.pending, uuid);
+			goto out;
+		}
+		if (track)
+			Discovery.stats.nextensions++;
 
 		/* Do not add the created SiSo-s to the registry.... It will be
 		   added automatically, soon after it collected all the needed
 		   informations about the wrapped object */
 		g_debug("proxy added for '%s'", svc);
-		matchstr = g_strdup_printf(MATCH_STR, svc);
-		dbus_bus_add_match(connection, matchstr, &err);
 
-		if (dbus_error_is_set(&err))
-		{
-                	g_critical("Unable to add match: %s", matchstr);
-			dbus_error_free(&err);
-		}
+		/* Don't wait for the bus to acknowledge the match,
+		 * it would cost a round trip for every extension. */
+		matchstr = g_strdup_printf(MATCH_STR, svc);
+		dbus_bus_add_match(connection, matchstr, NULL);
 		g_free(matchstr);
 	}
 out:	if (plugin)
@@ -161,7 +194,7 @@ static DBusHandlerResult handle_message(DBusConnection *conn,
 		gchar *name;
 		mafw_dbus_parse(msg,
 				 DBUS_TYPE_STRING, &name);
-		create_proxy(registry, name);
+		create_proxy(registry, name, FALSE);
 	} else if (dbus_message_is_signal(msg, DBUS_INTERFACE_DBUS,
 				   "NameOwnerChanged"))
 	{
@@ -192,6 +225,9 @@ static DBusHandlerResult handle_message(DBusConnection *conn,
 			extension = mafw_registry_get_extension_by_uuid(
 				MAFW_REGISTRY(registry),
 				uuid);
+			/* Gone before its proxy could be registered, do not
+			 * wait for it any longer. */
+			mafw_shared_discovery_forget(uuid);
 			g_free(uuid);
 			if (extension)
 			{
@@ -207,27 +243,156 @@ static DBusHandlerResult handle_message(DBusConnection *conn,
 	return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 }
 
+/* Initial discovery */
+
+static void discovery_stop(void)
+{
+	if (!Discovery.registry)
+		return;
+	if (Discovery.list_names) {
+		dbus_pending_call_cancel(Discovery.list_names);
+		dbus_pending_call_unref(Discovery.list_names);
+	}
+	if (Discovery.idle)
+		g_source_remove(Discovery.idle);
+	g_signal_handlers_disconnect_matched(Discovery.registry,
+					     G_SIGNAL_MATCH_DATA,
+					     0, 0, NULL, NULL, &Discovery);
+	g_hash_table_destroy(Discovery.pending);
+	g_timer_destroy(Discovery.timer);
+	memset(&Discovery, 0, sizeof(Discovery));
+}
+
+static gboolean emit_discovery_complete(gpointer unused)
+{
+	MafwRegistry *registry;
+	MafwSharedDiscoveryStats stats;
+
+	registry = g_object_ref(Discovery.registry);
+	stats = Discovery.stats;
+	Discovery.idle = 0;
+	discovery_stop();
+
+	g_debug("discovered %u extensions out of %u names in %.3fs "
+		"(ListNames: %.3fs, slowest extension: %.3fs)",
+		stats.nextensions, stats.nnames, stats.total_time,
+		stats.list_time, stats.slowest_time);
+	g_signal_emit(registry, Discovery_complete_signal, 0, &stats);
+	g_object_unref(registry);
+	return FALSE;
+}
+
+/* Schedules the completion signal if everything has been registered.
+ * It's emitted from the main loop to give the caller of
+ * mafw_shared_init() a chance to connect to it even if no proxies were
+ * created at all. */
+static void discovery_check(void)
+{
+	if (!Discovery.listed || g_hash_table_size(Discovery.pending)
+	    || Discovery.idle)
+		return;
+	Discovery.stats.total_time = g_timer_elapsed(Discovery.timer, NULL);
+	Discovery.idle = g_idle_add(emit_discovery_complete, NULL);
+}
+
+/* Stops waiting for the proxy of @uuid, which is not going to be
+ * registered.  Called by proxy_extension_attach() as well. */
+void mafw_shared_discovery_forget(const gchar *uuid)
+{
+	if (Discovery.pending && g_hash_table_remove(Discovery.pending, uuid))
+		discovery_check();
+}
+
+/* MafwRegistry::{source,renderer}-added handler. */
+static void extension_registered(MafwRegistry *registry,
+				 MafwExtension *extension, gpointer unused)
+{
+	const gdouble *started;
+	gdouble took;
+
+	started = g_hash_table_lookup(Discovery.pending,
+				      mafw_extension_get_uuid(extension));
+	if (!started)
+		return;
+	took = g_timer_elapsed(Discovery.timer, NULL) - *started;
+	if (took > Discovery.stats.slowest_time)
+		Discovery.stats.slowest_time = took;
+	g_hash_table_remove(Discovery.pending,
+			    mafw_extension_get_uuid(extension));
+	discovery_check();
+}
+
+/* Creates proxies for the components found on the bus.  They're all
+ * created at once, and each of them queries its extension without
+ * waiting for the others. */
+static void got_names(DBusPendingCall *pending, gpointer unused)
+{
+	DBusMessage *reply;
+	gchar **found_extensions, **ext;
+
+	Discovery.list_names = NULL;
+	Discovery.stats.list_time = g_timer_elapsed(Discovery.timer, NULL);
+
+	reply = dbus_pending_call_steal_reply(pending);
+	if (dbus_message_get_type(reply) == DBUS_MESSAGE_TYPE_METHOD_RETURN) {
+		mafw_dbus_parse(reply, MAFW_DBUS_TYPE_STRVZ,
+				&found_extensions);
+		for (ext = found_extensions; *ext; ext++) {
+			Discovery.stats.nnames++;
+			create_proxy(Discovery.registry, *ext, TRUE);
+		}
+		g_strfreev(found_extensions);
+	} else
+		g_warning("Unable to list the names on the session bus");
+	dbus_message_unref(reply);
+	dbus_pending_call_unref(pending);
+
+	Discovery.listed = TRUE;
+	discovery_check();
+}
+
 /**
- * Creates proxies for existing components.
+ * Starts creating proxies for existing components.
  */
 static void create_proxy_extensions(MafwRegistry *registry)
 {
-	DBusMessage *ret;
-	gchar **found_extensions, **ext;
-
-	ret = mafw_dbus_call(connection,
-			      mafw_dbus_method_full(
+	if (!Discovery_complete_signal)
+		/**
+		 * MafwRegistry::discovery-complete:
+		 * @registry: the registry passed to mafw_shared_init().
+		 * @stats: a #MafwSharedDiscoveryStats about the discovery.
+		 *
+		 * Emitted when all the extensions that were on the session
+		 * bus when mafw_shared_init() was called have been added
+		 * to @registry.  Extensions appearing later are added
+		 * just like before, without further notice.
+		 */
+		Discovery_complete_signal =
+			g_signal_new("discovery-complete",
+				     MAFW_TYPE_REGISTRY,
+				     G_SIGNAL_RUN_LAST,
+				     0, NULL, NULL,
+				     g_cclosure_marshal_VOID__POINTER,
+				     G_TYPE_NONE, 1, G_TYPE_POINTER);
+
+	Discovery.registry = registry;
+	Discovery.pending = g_hash_table_new_full(g_str_hash, g_str_equal,
+						  g_free, g_free);
+	Discovery.timer = g_timer_new();
+	g_signal_connect(registry, "source-added",
+			 G_CALLBACK(extension_registered), &Discovery);
+	g_signal_connect(registry, "renderer-added",
+			 G_CALLBACK(extension_registered), &Discovery);
+
+	mafw_dbus_send_async(connection, &Discovery.list_names,
+			     mafw_dbus_method_full(
 				      DBUS_SERVICE_DBUS,
 				      DBUS_PATH_DBUS,
 				      DBUS_INTERFACE_DBUS,
-				      "ListNames"),
-			      0, NULL);
-
-	mafw_dbus_parse(ret, MAFW_DBUS_TYPE_STRVZ, &found_extensions);
-	dbus_message_unref(ret);
-	for (ext = found_extensions; *ext; ext++)
-		create_proxy(registry, *ext);
-	g_strfreev(found_extensions);
+				      "ListNames"));
+	/* NOTE got_names() may be called right away. */
+	dbus_pending_call_set_notify(Discovery.list_names, got_names,
+				     NULL, NULL);
 }
 
 /* Public API */
@@ -241,6 +406,11 @@ static void create_proxy_extensions(MafwRegistry *registry)
  * Tracks renderers and sources exported in session bus and adds/removes them
  * from the provided registry when they show up/get removed from session bus.
  *
+ * The extensions already on the bus are discovered asynchronously: this
+ * function returns without waiting for them, and they are added to @reg
+ * as soon as their proxies are ready.  When all of them have been added,
+ * #MafwRegistry::discovery-complete is emitted on @reg.
+ *
  * Returns: %TRUE if all went OK, %FALSE otherwise.
  */
 gboolean mafw_shared_init(MafwRegistry *reg, GError **error)
@@ -294,6 +464,7 @@ void mafw_shared_deinit(void)
 	if (!connection)
 		return;
 
+	discovery_stop();
 	dbus_connection_remove_filter(connection, handle_message, NULL);
         dbus_connection_unref(connection);
         connection = NULL;
@@ -33,6 +33,25 @@
 
 G_BEGIN_DECLS
 
+/**
+ * MafwSharedDiscoveryStats:
+ * @nnames:       the number of names on the session bus.
+ * @nextensions:  the number of proxies created for them.
+ * @list_time:    seconds it took to list the names on the bus.
+ * @slowest_time: seconds the slowest extension took to be added
+ *                to the registry after its proxy was created.
+ * @total_time:   seconds until the last extension was added.
+ *
+ * Passed to #MafwRegistry::discovery-complete.
+ */
+typedef struct {
+	guint nnames;
+	guint nextensions;
+	gdouble list_time;
+	gdouble slowest_time;
+	gdouble total_time;
+} MafwSharedDiscoveryStats;
+
 extern gboolean mafw_shared_init(MafwRegistry *reg, GError **error);
 extern void mafw_shared_deinit(void);
 
@@ -499,6 +499,45 @@ static void metadata_changed(MafwRenderer *self,
 					MAFW_DBUS_GVALUEARRAY(values)));
 }
 
+/*
+ * metadata_data:
+ *
+ * @ecomp:               The exported renderer.
+ * @metadata_changed_id: Handler of metadata-changed, blocked while the
+ *                       renderer emits the keys of metadatas-changed one by
+ *                       one, as they have gone out together already.
+ */
+struct metadata_data {
+	ExportedComponent *ecomp;
+	gulong metadata_changed_id;
+};
+
+/**
+ * metadatas_changed:
+ *
+ * Handle metadatas_changed signal from a renderer.  Forward it to
+ * session bus in one message.
+ */
+static void metadatas_changed(MafwRenderer *self, GHashTable *metadata,
+			      struct metadata_data *mddata)
+{
+	mafw_dbus_send(mddata->ecomp->connection,
+		       mafw_dbus_signal_full(
+					NULL,
+					mddata->ecomp->object_path,
+					MAFW_RENDERER_INTERFACE,
+					MAFW_RENDERER_SIGNAL_METADATAS_CHANGED,
+					MAFW_DBUS_METADATA(metadata)));
+	g_signal_handler_block(self, mddata->metadata_changed_id);
+}
+
+/* Runs after the default handler of metadatas-changed. */
+static void metadatas_changed_after(MafwRenderer *self, GHashTable *metadata,
+				    struct metadata_data *mddata)
+{
+	g_signal_handler_unblock(self, mddata->metadata_changed_id);
+}
+
 static void _destroy_bufdata(struct buffering_data *bufdata, GClosure *closure)
 {
 	_remove_buffering_tout(bufdata);
@@ -508,6 +547,7 @@ static void _destroy_bufdata(struct buffering_data *bufdata, GClosure *closure)
 void connect_to_renderer_signals(gpointer ecomp)
 {
 	struct buffering_data *bufdata = g_new0(struct buffering_data, 1);
+	struct metadata_data *mddata = g_new0(struct metadata_data, 1);
 	gulong id;
 	GError *err = NULL;
 	MafwRegistry *registry;
@@ -527,7 +567,20 @@ void connect_to_renderer_signals(gpointer ecomp)
 
 	connect_signal(ecomp, "playlist-changed", playlist_changed);
 	connect_signal(ecomp, "media-changed", media_changed);
-	connect_signal(ecomp, "metadata-changed", metadata_changed);
+
+	mddata->ecomp = ecomp;
+	mddata->metadata_changed_id =
+		g_signal_connect(mddata->ecomp->comp, "metadata-changed",
+				 (GCallback)metadata_changed, ecomp);
+	g_array_append_val(mddata->ecomp->sighandlers,
+			   mddata->metadata_changed_id);
+	id = g_signal_connect_data(mddata->ecomp->comp, "metadatas-changed",
+				   (GCallback)metadatas_changed, mddata,
+				   (GClosureNotify)g_free, 0);
+	g_array_append_val(mddata->ecomp->sighandlers, id);
+	id = g_signal_connect_after(mddata->ecomp->comp, "metadatas-changed",
+				    (GCallback)metadatas_changed_after, mddata);
+	g_array_append_val(mddata->ecomp->sighandlers, id);
 
 	registry = mafw_registry_get_instance();
         mafw_shared_init(registry, &err);
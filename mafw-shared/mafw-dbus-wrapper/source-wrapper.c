@@ -42,43 +42,175 @@
 #define MAFW_DBUS_PATH MAFW_OBJECT
 #define MAFW_DBUS_INTERFACE MAFW_SOURCE_INTERFACE
 
-#define INITIAL_BROWSE_TIMEOUT 100 /* The initial time value in ms, until the
-				   wrapper collects the first browse-results */
-#define INITIAL_MAX_RESULTS 25	/* The number of the maximal amount of
-				   browse-results, what the first browse-results
-				   message can contain */
-#define TIMEOUT_INCREMENT 500	/* Increments the timeout value (in ms), if the
-				   message contains the currently allowed
-				   browse-results */
-#define MAX_TIMEOUT 1000	/* Maximum time value (in ms), until the wrapper
-				   collects the browse results */
-#define MAX_BROWSE_RESULT 500	/* Maximum number of the results, what a message
-				   can contain */
+/* Browse results are collected into BROWSE_RESULT messages.  A message is
+ * sent when its estimated size reaches the current byte budget, or when
+ * its oldest result has waited for the current latency.  Both start small,
+ * so that the first screenful of results arrives quickly, then grow with
+ * every message up to the limits set by the source's browse-batch-*
+ * properties: later messages are big, which spares the client the
+ * per-message overhead.  The defaults are below. */
+#define DEFAULT_BATCH_BYTES (64 * 1024)
+#define DEFAULT_BATCH_LATENCY 100	/* ms */
+#define DEFAULT_BATCH_MAX_LATENCY 1000	/* ms */
+#define DEFAULT_MAX_QUEUED (256 * 1024)
+#define BATCH_INITIAL_SHIFT 4	/* The first budget is batch-bytes >> this. */
+#define BATCH_GROWTH 3		/* The budget is multiplied by this... */
+#define LATENCY_GROWTH 2	/* ...and the latency by this after each
+				   message. */
+/* If the wrapper's bus connection has more than browse-max-queued bytes
+ * waiting to be written, the bus is falling behind.  Messages are then
+ * held back (and keep growing) until the backlog drains, rechecking it
+ * every BACKLOG_POLL ms.  A held message is sent anyway when it reaches
+ * BACKLOG_HARD_LIMIT times browse-batch-bytes, since the source can't be
+ * paused.
+ *
+ * The backlog is that of the connection shared by all the clients, not
+ * of any one of them: a slow reader throttles every ongoing browse, and
+ * results for a fast one are held back while the queue is busy.  libdbus
+ * does not tell the recipients of the queued messages apart. */
+#define BACKLOG_POLL 20
+#define BACKLOG_HARD_LIMIT 4
+/* Accounts for the framing of a result besides the object ID and the
+ * metadata. */
+#define RESULT_OVERHEAD 32
+
+#define BATCH_TUNING_KEY "mafw-source-wrapper-batching"
+
+struct batch_tuning {
+	guint bytes;
+	guint latency;
+	guint max_latency;
+	guint max_queued;
+};
+
+static const struct {
+	const gchar *name;
+	gsize offset;
+} Batch_props[] = {
+	{ MAFW_WRAPPER_PROPERTY_BROWSE_BATCH_BYTES,
+	  G_STRUCT_OFFSET(struct batch_tuning, bytes) },
+	{ MAFW_WRAPPER_PROPERTY_BROWSE_BATCH_LATENCY,
+	  G_STRUCT_OFFSET(struct batch_tuning, latency) },
+	{ MAFW_WRAPPER_PROPERTY_BROWSE_BATCH_MAX_LATENCY,
+	  G_STRUCT_OFFSET(struct batch_tuning, max_latency) },
+	{ MAFW_WRAPPER_PROPERTY_BROWSE_MAX_QUEUED,
+	  G_STRUCT_OFFSET(struct batch_tuning, max_queued) },
+};
 
 struct browse_data {
 	MafwDBusOpCompletedInfo *oci;
 	guint timeout_id;	/* timeout GSource ID */
-	guint timeout_time;	/* The timeout value of the current
-                                 * message-array */
+	guint latency;		/* How long the current message may wait
+				 * for more results (ms). */
+	gsize budget;		/* The byte budget of the current message */
+	gsize size;		/* The estimated size of the current
+				 * message */
+	gdouble opened;		/* When the first result of the current
+				 * message was added ($timer) */
+	gboolean held;		/* Whether the current message is held
+				 * back because of a backlog */
 	guint results;		/* The number of messages already added */
-	guint maxresults;	/* The maximal number of messages */
 	DBusMessage *message_to_send;
 	DBusMessageIter iter_array, iter_msg;
 	ExportedComponent *ecomp;
+	const struct batch_tuning *tuning;
+
+	/* Statistics, logged when the browse is finished. */
+	GTimer *timer;
+	guint nresults;		/* Results sent */
+	guint nmessages;	/* Messages sent */
+	gsize nbytes;		/* Estimated bytes sent */
+	guint nheld;		/* Messages held back */
+	guint nforced;		/* Messages sent despite a backlog */
+	gdouble max_delay;	/* Longest time a result waited (s) */
 };
 
 static GHashTable *browse_requests;
 
-static gboolean send_browse_res(struct browse_data *bdat)
+static const struct batch_tuning *get_tuning(ExportedComponent *ecomp)
 {
-	if (bdat->message_to_send)
-	{
-		dbus_message_iter_close_container(&bdat->iter_msg,
-						&bdat->iter_array);
-		mafw_dbus_send(bdat->oci->con, bdat->message_to_send);
-		bdat->message_to_send = NULL;
+	return g_object_get_data(G_OBJECT(ecomp->comp), BATCH_TUNING_KEY);
+}
+
+/* Tells whether the messages already queued on the bus connection (for
+ * any client) exceed the limit of $bdata. */
+static gboolean bus_behind(const struct browse_data *bdata)
+{
+	return dbus_connection_get_outgoing_size(bdata->oci->con)
+		> (glong)bdata->tuning->max_queued;
+}
+
+/* Sends the current message of $bdata and adjusts the budget and latency
+ * of the next one.  The $last message is flushed at once; the others are
+ * only queued, so that the connection's backlog shows how far behind the
+ * bus is. */
+static void send_batch(struct browse_data *bdata, gboolean last)
+{
+	gdouble delay;
+
+	if (bdata->timeout_id) {
+		g_source_remove(bdata->timeout_id);
+		bdata->timeout_id = 0;
 	}
-	return TRUE;
+	if (!bdata->message_to_send)
+		return;
+
+	dbus_message_iter_close_container(&bdata->iter_msg,
+					  &bdata->iter_array);
+	if (last) {
+		mafw_dbus_send(bdata->oci->con, bdata->message_to_send);
+	} else {
+		if (!dbus_connection_send(bdata->oci->con,
+					  bdata->message_to_send, NULL))
+			g_critical("Unable to send browse results");
+		dbus_message_unref(bdata->message_to_send);
+	}
+	bdata->message_to_send = NULL;
+
+	delay = g_timer_elapsed(bdata->timer, NULL) - bdata->opened;
+	if (delay > bdata->max_delay)
+		bdata->max_delay = delay;
+	bdata->nmessages++;
+	bdata->nresults += bdata->results;
+	bdata->nbytes += bdata->size;
+	bdata->results = 0;
+	bdata->size = 0;
+	bdata->held = FALSE;
+
+	bdata->budget = MIN(bdata->budget * BATCH_GROWTH,
+			    bdata->tuning->bytes);
+	bdata->latency = MIN(bdata->latency * LATENCY_GROWTH,
+			     MAX(bdata->tuning->max_latency,
+				 bdata->tuning->latency));
+}
+
+/* The current message of $bdata has waited long enough. */
+static gboolean batch_timeout(struct browse_data *bdata)
+{
+	if (bus_behind(bdata)) {
+		if (!bdata->held) {
+			bdata->held = TRUE;
+			bdata->nheld++;
+		}
+		bdata->timeout_id = g_timeout_add(BACKLOG_POLL,
+						  (GSourceFunc)batch_timeout,
+						  bdata);
+	} else {
+		bdata->timeout_id = 0;
+		send_batch(bdata, FALSE);
+	}
+	return FALSE;
+}
+
+static void log_browse_stats(const struct browse_data *bdata,
+			     guint browse_id)
+{
+	g_debug("browse %u: %u results in %u messages (%" G_GSIZE_FORMAT
+		" bytes), %u held back, %u forced, max delay %.0f ms, "
+		"took %.0f ms", browse_id, bdata->nresults, bdata->nmessages,
+		bdata->nbytes, bdata->nheld, bdata->nforced,
+		bdata->max_delay * 1000.0,
+		g_timer_elapsed(bdata->timer, NULL) * 1000.0);
 }
 
 static gboolean remove_from_hash(guint browse_id)
@@ -96,6 +228,7 @@ static void free_browse_req(struct browse_data *bdata)
 		dbus_message_unref(bdata->message_to_send);
 	if (bdata->oci)
 		mafw_dbus_oci_free(bdata->oci);
+	g_timer_destroy(bdata->timer);
 	g_free(bdata);
 }
 
@@ -135,6 +268,11 @@ static void emit_browse_result(MafwSource *self, guint browse_id,
 				MAFW_SOURCE_INTERFACE,
 				MAFW_PROXY_SOURCE_METHOD_BROWSE_RESULT);
 		bdata->results = 0;
+		bdata->size = 0;
+		bdata->opened = g_timer_elapsed(bdata->timer, NULL);
+		bdata->timeout_id = g_timeout_add(bdata->latency,
+						  (GSourceFunc)batch_timeout,
+						  bdata);
 		dbus_message_iter_init_append(bdata->message_to_send,
 						&bdata->iter_msg);
 		dbus_message_iter_append_basic(&bdata->iter_msg,
@@ -146,6 +284,7 @@ static void emit_browse_result(MafwSource *self, guint browse_id,
 	}
 
 	ba = mafw_metadata_freeze_bary(metadata);
+	bdata->size += RESULT_OVERHEAD + strlen(object_id) + ba->len;
 
 	dbus_message_iter_open_container(&bdata->iter_array,
 						DBUS_TYPE_STRUCT,
@@ -187,12 +326,8 @@ static void emit_browse_result(MafwSource *self, guint browse_id,
 	   In case an error happened, no more browse-result
 	   should come.*/
 	if (remaining_count == 0 || error) {
-		dbus_message_iter_close_container(&bdata->iter_msg,
-							&bdata->iter_array);
-		mafw_dbus_send(bdata->oci->con, bdata->message_to_send);
-		bdata->message_to_send = NULL;
-		g_source_remove(bdata->timeout_id);
-		bdata->timeout_id = 0;
+		send_batch(bdata, TRUE);
+		log_browse_stats(bdata, browse_id);
 		/* At this point, it could happen, that the browse did not
 		return, so the data is not added to the hash-table */
 		if (browse_id != MAFW_SOURCE_INVALID_BROWSE_ID)
@@ -203,45 +338,21 @@ static void emit_browse_result(MafwSource *self, guint browse_id,
 		return;
 	}
 
-	/* In case, the source is very "fast", to keep the UI as responsible
-	   as possible, it is better if the wrapper sends huge amount of
-	   results in one message. If the browse-results reaches the current
-	   maximal result-number, the results are send immediately, and the next
-	   max batched browse-results are trippled, and the collection-timeout
-	   is increased. The timeout, and the max-results have a defined
-	   maximums.
-	   The max-browse-results increases so drastically if needed, because if
-	   the UI displays these results in a GTKTreeView, the treeview will
-	   need more and more time to render the newly added items. So to finish
-	   the whole procedure earlier, it is better to send as less
-	   browse-results-messages as possible */
-	if (bdata->results >= bdata->maxresults)
+	/* The message is due.  Unless the connection is still busy with
+	   the previous ones: then let it grow, and batch_timeout() will
+	   send it when the backlog has drained. */
+	if (bdata->size >= bdata->budget)
 	{
-		g_source_remove(bdata->timeout_id);
-		dbus_message_iter_close_container(&bdata->iter_msg,
-						&bdata->iter_array);
-		mafw_dbus_send(bdata->oci->con, bdata->message_to_send);
-		bdata->results = 0;
-		bdata->message_to_send = NULL;
-		if (bdata->maxresults != MAX_BROWSE_RESULT)
-		{
-			bdata->maxresults *= 3;
-			if (bdata->maxresults > MAX_BROWSE_RESULT)
-			{
-				bdata->maxresults = MAX_BROWSE_RESULT;
-			}
-			else
-			{
-				bdata->timeout_time += TIMEOUT_INCREMENT;
-			}
-			if (bdata->timeout_time > MAX_TIMEOUT)
-			{
-				bdata->timeout_time = MAX_TIMEOUT;
-			}
+		if (!bus_behind(bdata)) {
+			send_batch(bdata, FALSE);
+		} else if (bdata->size
+			   >= bdata->tuning->bytes * BACKLOG_HARD_LIMIT) {
+			bdata->nforced++;
+			send_batch(bdata, FALSE);
+		} else if (!bdata->held) {
+			bdata->held = TRUE;
+			bdata->nheld++;
 		}
-
-		bdata->timeout_id = g_timeout_add(bdata->timeout_time,
-					(GSourceFunc)send_browse_res, bdata);
 	}
 }
 
@@ -394,6 +505,57 @@ static void metadata_set(MafwSource *src, const gchar *objectid,
 	mafw_dbus_oci_free(info);
 }
 
+/* Handles {set,get}_extension_property on the browse-batch-* properties,
+ * which belong to the wrapper rather than to the source.  Returns %FALSE
+ * if $msg is about something else. */
+static gboolean handle_batching_property(DBusConnection *conn,
+					 DBusMessage *msg,
+					 ExportedComponent *ecomp)
+{
+	struct batch_tuning *tuning;
+	const gchar *prop;
+	GValue val = { 0 };
+	guint *field;
+	guint i;
+
+	if (mafw_dbus_is_method(msg, MAFW_EXTENSION_METHOD_SET_PROPERTY))
+		mafw_dbus_parse(msg, DBUS_TYPE_STRING, &prop,
+				MAFW_DBUS_TYPE_GVALUE, &val);
+	else if (mafw_dbus_is_method(msg, MAFW_EXTENSION_METHOD_GET_PROPERTY))
+		mafw_dbus_parse(msg, DBUS_TYPE_STRING, &prop);
+	else
+		return FALSE;
+
+	for (i = 0; i < G_N_ELEMENTS(Batch_props); i++)
+		if (!strcmp(prop, Batch_props[i].name))
+			break;
+	if (i == G_N_ELEMENTS(Batch_props)) {
+		if (G_VALUE_TYPE(&val) != G_TYPE_INVALID)
+			g_value_unset(&val);
+		return FALSE;
+	}
+
+	tuning = (struct batch_tuning *)get_tuning(ecomp);
+	field = G_STRUCT_MEMBER_P(tuning, Batch_props[i].offset);
+	if (G_VALUE_TYPE(&val) == G_TYPE_INVALID) {
+		/* get_extension_property */
+		g_value_init(&val, G_TYPE_UINT);
+		g_value_set_uint(&val, *field);
+		mafw_dbus_send(conn, mafw_dbus_reply(msg,
+						     MAFW_DBUS_STRING(prop),
+						     MAFW_DBUS_GVALUE(&val)));
+	} else if (G_VALUE_TYPE(&val) == G_TYPE_UINT) {
+		/* Running browses pick it up with their next message. */
+		*field = g_value_get_uint(&val);
+		mafw_extension_emit_property_changed(
+			MAFW_EXTENSION(ecomp->comp), prop, &val);
+	} else {
+		g_warning("%s: expected an unsigned integer", prop);
+	}
+	g_value_unset(&val);
+	return TRUE;
+}
+
 /**
  * handle_source_msg:
  * @conn: the #DBusConnection on which this message arrived.
@@ -413,8 +575,11 @@ DBusHandlerResult handle_source_msg(DBusConnection *conn,
 	ecomp = (ExportedComponent *)data;
 	source = MAFW_SOURCE(ecomp->comp);
 
-	if (dbus_message_has_interface(msg, MAFW_EXTENSION_INTERFACE))
+	if (dbus_message_has_interface(msg, MAFW_EXTENSION_INTERFACE)) {
+		if (handle_batching_property(conn, msg, ecomp))
+			return DBUS_HANDLER_RESULT_HANDLED;
 		return handle_extension_msg(conn, msg, data);
+	}
 
 	if (dbus_message_has_member(msg, MAFW_SOURCE_METHOD_BROWSE)) {
 
@@ -451,12 +616,11 @@ DBusHandlerResult handle_source_msg(DBusConnection *conn,
 		   This is used to route the results to correct
 		   destination. */
 		bdata->oci = mafw_dbus_oci_new(conn, msg);
-		bdata->maxresults = INITIAL_MAX_RESULTS;
-		bdata->timeout_id = g_timeout_add(INITIAL_BROWSE_TIMEOUT,
-						(GSourceFunc)send_browse_res,
-						bdata);
-		bdata->timeout_time = INITIAL_BROWSE_TIMEOUT;
 		bdata->ecomp = ecomp;
+		bdata->tuning = get_tuning(ecomp);
+		bdata->budget = bdata->tuning->bytes >> BATCH_INITIAL_SHIFT;
+		bdata->latency = bdata->tuning->latency;
+		bdata->timer = g_timer_new();
 
 		/* Invoke real object method and forward reply. */
 		browse_id = mafw_source_browse(source, object_id, recursive,
@@ -658,6 +822,25 @@ static void metadata_changed(MafwSource *source, const gchar *object_id,
 
 void connect_to_source_signals(gpointer ecomp)
 {
+	MafwExtension *comp;
+	struct batch_tuning *tuning;
+	guint i;
+
+	/* Sources are exported only once, but be safe. */
+	comp = MAFW_EXTENSION(((ExportedComponent *)ecomp)->comp);
+	if (!g_object_get_data(G_OBJECT(comp), BATCH_TUNING_KEY)) {
+		tuning = g_new(struct batch_tuning, 1);
+		tuning->bytes = DEFAULT_BATCH_BYTES;
+		tuning->latency = DEFAULT_BATCH_LATENCY;
+		tuning->max_latency = DEFAULT_BATCH_MAX_LATENCY;
+		tuning->max_queued = DEFAULT_MAX_QUEUED;
+		g_object_set_data_full(G_OBJECT(comp), BATCH_TUNING_KEY,
+				       tuning, g_free);
+		for (i = 0; i < G_N_ELEMENTS(Batch_props); i++)
+			mafw_extension_add_property(comp, Batch_props[i].name,
+						    G_TYPE_UINT);
+	}
+
 	connect_signal(ecomp, "metadata-changed", metadata_changed);
 	connect_signal(ecomp, "container-changed", container_changed);
         connect_signal(ecomp, "updating", updating);
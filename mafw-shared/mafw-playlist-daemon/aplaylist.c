@@ -25,16 +25,77 @@
 # include "config.h"
 #endif
 #include <errno.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <glib.h>
 #include <glib/gprintf.h>
 
 #include "mpd-internal.h"
 
-#define APLAYLIST_VERSION "2"
+#define APLAYLIST_VERSION "3"
+
+/* Header of binary (V3) playlist files.  Integers are stored in host byte
+ * order; @byteorder is there to refuse files written on a different
+ * architecture instead of misreading them. */
+typedef struct {
+	gchar magic[4];
+	guint32 byteorder;
+	guint32 id;
+	guint32 repeat;
+	guint32 shuffled;
+	guint32 len;
+	guint32 poolst;
+	guint32 namelen;
+	guint32 strtablen;
+	guint32 generation;
+} PlsHeader;
+
+#define PLS_MAGIC	"V" APLAYLIST_VERSION "\n"
+#define PLS_BYTEORDER	0x01020304
+/* Rounds $n up to keep the arrays following the name 4-byte aligned. */
+#define PLS_ALIGN(n)	(((n) + 3) & ~3)
+
+/* Header of playlist journals.  A journal only applies to the snapshot with
+ * the same @generation; anything else is a leftover from before the last
+ * snapshot and is ignored. */
+typedef struct {
+	gchar magic[4];
+	guint32 byteorder;
+	guint32 generation;
+} JournalHeader;
+
+/* Journal record, followed by @size bytes of '\0'-terminated strings. */
+typedef struct {
+	guint32 size;
+	guint32 op;
+	guint32 a;
+	guint32 b;
+} JournalRecord;
+
+/* Journaled operations and the meaning of their arguments. */
+enum {
+	JOP_INSERT = 1,		/* index, count, object ids */
+	JOP_REMOVE,		/* index */
+	JOP_MOVE,		/* from, to */
+	JOP_CLEAR,
+	JOP_SHUFFLE,
+	JOP_UNSHUFFLE,
+	JOP_PICK,		/* playing index moved to the pool start */
+	JOP_REPEAT,		/* repeat mode */
+	JOP_NAME,		/* name */
+};
+
+#define JOURNAL_MAGIC	"J" APLAYLIST_VERSION "\n"
+/* Journals smaller than this are never compacted. */
+#define JOURNAL_MIN	4096
+/* Beyond this many unsaved bytes we give up journaling until the next
+ * snapshot. */
+#define JOURNAL_MAX_PENDING	(256 * 1024)
 
 extern gboolean initialize;
 
@@ -45,11 +106,288 @@ extern gboolean initialize;
  * maximally. */
 guint Settle_time = 1;
 
+/* When the journal of a playlist grows beyond this percentage of its last
+ * snapshot, the next save writes a new snapshot instead of appending. */
+guint Journal_ratio = 50;
+
+/* Number of tree nodes (re)linked so far, for the tests to tell how much
+ * an edit costs. */
+guint Node_updates;
+
 /* Forward declarations */
 static gboolean ops_settled(Pls *pls);
 
-/* Check pls is well-formed. That is, both pidx and iidx must contain all
- * indexes in the playlist, exactly once. */
+/* An object id, kept in visual order in Pls.oids.  @oid is interned (see
+ * oidpool.c), and the playlist holds a reference of it. */
+typedef struct {
+	PlsNode node;
+	const gchar *oid;
+} PlsOid;
+
+/* A visual position of a shuffled playlist, kept both in visual (@v, in
+ * Pls.vslots) and in playing (@p, in Pls.pslots) order.  Playing indexes
+ * belong to positions rather than to object ids, so that pls_move() leaves
+ * the playing order of positions alone, while the trees make pidx and iidx
+ * rank queries. */
+typedef struct {
+	PlsNode v;
+	PlsNode p;
+} PlsSlot;
+
+#define PLS_OID(n)	((PlsOid *)(n))
+#define PLS_SLOT_V(n)	((PlsSlot *)((gchar *)(n) - G_STRUCT_OFFSET(PlsSlot, v)))
+#define PLS_SLOT_P(n)	((PlsSlot *)((gchar *)(n) - G_STRUCT_OFFSET(PlsSlot, p)))
+
+/* Implicit treaps: binary trees ordered by position, heap-ordered by a random
+ * priority, with subtree sizes.  Insertion, removal, lookup by index and
+ * computing the index of a node are all O(log n) expected. */
+
+static guint node_size(const PlsNode *n)
+{
+	return n ? n->size : 0;
+}
+
+/* Recomputes the size of $n and adopts its children. */
+static void node_update(PlsNode *n)
+{
+	Node_updates++;
+	n->size = 1 + node_size(n->left) + node_size(n->right);
+	if (n->left)
+		n->left->parent = n;
+	if (n->right)
+		n->right->parent = n;
+}
+
+static void node_init(PlsNode *n)
+{
+	n->left = n->right = n->parent = NULL;
+	n->size = 1;
+}
+
+/* Joins the trees $a and $b, the nodes of $a preceding those of $b. */
+static PlsNode *treap_merge(PlsNode *a, PlsNode *b)
+{
+	if (!a)
+		return b;
+	if (!b)
+		return a;
+	if (a->prio > b->prio) {
+		a->right = treap_merge(a->right, b);
+		node_update(a);
+		return a;
+	} else {
+		b->left = treap_merge(a, b->left);
+		node_update(b);
+		return b;
+	}
+}
+
+/* Splits $t into its first $k nodes ($l) and the rest ($r).  The parents of
+ * the resulting roots are left for the caller to fix. */
+static void treap_split(PlsNode *t, guint k, PlsNode **l, PlsNode **r)
+{
+	if (!t) {
+		*l = *r = NULL;
+	} else if (node_size(t->left) < k) {
+		treap_split(t->right, k - node_size(t->left) - 1, &t->right, r);
+		node_update(t);
+		*l = t;
+	} else {
+		treap_split(t->left, k, l, &t->left);
+		node_update(t);
+		*r = t;
+	}
+}
+
+/* Inserts the tree $sub into *$root, so that its first node ends up at
+ * position $k. */
+static void treap_paste(PlsNode **root, guint k, PlsNode *sub)
+{
+	PlsNode *l, *r;
+
+	treap_split(*root, k, &l, &r);
+	*root = treap_merge(treap_merge(l, sub), r);
+	if (*root)
+		(*root)->parent = NULL;
+}
+
+/* Takes out and returns the $k-th node of *$root. */
+static PlsNode *treap_cut(PlsNode **root, guint k)
+{
+	PlsNode *l, *m, *r;
+
+	treap_split(*root, k, &l, &r);
+	treap_split(r, 1, &m, &r);
+	*root = treap_merge(l, r);
+	if (*root)
+		(*root)->parent = NULL;
+	m->parent = NULL;
+	return m;
+}
+
+/* Returns the $k-th node of $t. */
+static PlsNode *treap_select(PlsNode *t, guint k)
+{
+	guint ls;
+
+	while (t) {
+		ls = node_size(t->left);
+		if (k < ls) {
+			t = t->left;
+		} else if (k == ls) {
+			break;
+		} else {
+			k -= ls + 1;
+			t = t->right;
+		}
+	}
+	return t;
+}
+
+/* Returns the position of $n in its tree. */
+static guint treap_rank(const PlsNode *n)
+{
+	guint r;
+
+	r = node_size(n->left);
+	for (; n->parent; n = n->parent) {
+		if (n == n->parent->right)
+			r += node_size(n->parent->left) + 1;
+	}
+	return r;
+}
+
+/* Returns the node following $n, or NULL. */
+static PlsNode *treap_next(PlsNode *n)
+{
+	if (n->right) {
+		for (n = n->right; n->left; n = n->left);
+		return n;
+	}
+	while (n->parent && n == n->parent->right)
+		n = n->parent;
+	return n->parent;
+}
+
+/* Builds a balanced tree of the $n nodes in $nodes, with priorities below
+ * $prio, in O(n). */
+static PlsNode *treap_build(PlsNode **nodes, guint n, guint32 prio)
+{
+	PlsNode *t;
+	guint mid;
+
+	if (!n)
+		return NULL;
+	mid = n / 2;
+	t = nodes[mid];
+	t->parent = NULL;
+	t->prio = prio / 2 + g_random_int() % (prio / 2 + 1);
+	t->left = treap_build(nodes, mid, t->prio);
+	t->right = treap_build(nodes + mid + 1, n - mid - 1, t->prio);
+	node_update(t);
+	return t;
+}
+
+/* Verifies the links, sizes and priorities of $t.  Returns its size, or
+ * G_MAXUINT if broken. */
+static guint treap_check(const PlsNode *t)
+{
+	guint ls, rs;
+
+	if (!t)
+		return 0;
+	if ((t->left && (t->left->parent != t || t->left->prio > t->prio)) ||
+	    (t->right && (t->right->parent != t || t->right->prio > t->prio)))
+		return G_MAXUINT;
+	ls = treap_check(t->left);
+	rs = treap_check(t->right);
+	if (ls == G_MAXUINT || rs == G_MAXUINT || t->size != ls + rs + 1)
+		return G_MAXUINT;
+	return t->size;
+}
+
+static void free_oids(PlsNode *t)
+{
+	if (!t)
+		return;
+	free_oids(t->left);
+	free_oids(t->right);
+	oidpool_unref(PLS_OID(t)->oid);
+	g_slice_free(PlsOid, PLS_OID(t));
+}
+
+static void free_slots(PlsNode *t)
+{
+	if (!t)
+		return;
+	free_slots(t->left);
+	free_slots(t->right);
+	g_slice_free(PlsSlot, PLS_SLOT_V(t));
+}
+
+/* Creates $len slots, and returns them in $vnodes and $pnodes for building
+ * the trees. */
+static void new_slots(guint len, PlsNode **vnodes, PlsNode **pnodes)
+{
+	PlsSlot *s;
+	guint i;
+
+	for (i = 0; i < len; ++i) {
+		s = g_slice_new(PlsSlot);
+		node_init(&s->v);
+		node_init(&s->p);
+		vnodes[i] = &s->v;
+		pnodes[i] = &s->p;
+	}
+}
+
+/* Sets the object ids of the empty $pls to the $len interned strings of
+ * $oids, whose references it takes over. */
+static void set_oids(Pls *pls, const gchar **oids, guint len)
+{
+	PlsNode **nodes;
+	PlsOid *o;
+	guint i;
+
+	nodes = g_new(PlsNode *, len);
+	for (i = 0; i < len; ++i) {
+		o = g_slice_new(PlsOid);
+		node_init(&o->node);
+		o->oid = oids[i];
+		nodes[i] = &o->node;
+	}
+	pls->oids = treap_build(nodes, len, G_MAXUINT32);
+	pls->len = len;
+	g_free(nodes);
+}
+
+/* Returns the object id at visual index $idx, without copying.  $idx must be
+ * in range. */
+const gchar *pls_oid(Pls *pls, guint idx)
+{
+	return PLS_OID(treap_select(pls->oids, idx))->oid;
+}
+
+/* Returns the visual index of the element to be played $i-th (pidx[$i]). */
+guint pls_pidx(Pls *pls, guint i)
+{
+	if (!pls->shuffled)
+		return i;
+	return treap_rank(&PLS_SLOT_P(treap_select(pls->pslots, i))->v);
+}
+
+/* Returns the playing position of the element at visual index $idx
+ * (iidx[$idx]). */
+guint pls_iidx(Pls *pls, guint idx)
+{
+	if (!pls->shuffled)
+		return idx;
+	return treap_rank(&PLS_SLOT_V(treap_select(pls->vslots, idx))->p);
+}
+
+/* Check pls is well-formed.  That is, the trees must be consistent, and
+ * both pidx and iidx must contain all indexes in the playlist, exactly
+ * once. */
 gboolean pls_check(Pls *pls)
 {
 	gboolean isok;
@@ -59,12 +397,32 @@ gboolean pls_check(Pls *pls)
 
 	isok = TRUE;
 
+	if (treap_check(pls->oids) != pls->len) {
+		g_critical("object id tree is broken");
+		return FALSE;
+	}
+
         if (pls->shuffled) {
+		if (treap_check(pls->vslots) != pls->len ||
+		    treap_check(pls->pslots) != pls->len) {
+			g_critical("position trees are broken");
+			return FALSE;
+		}
+		if (pls->poolst > pls->len) {
+			g_critical("pool start %u is beyond the end",
+				   pls->poolst);
+			isok = FALSE;
+		}
                 hist_pidx = g_new0(guint, pls->len);
                 hist_iidx = g_new0(guint, pls->len);
                 for (i = 0; i < pls->len; ++i) {
-                        hist_pidx[pls->pidx[i]]++;
-                        hist_iidx[pls->iidx[i]]++;
+                        hist_pidx[pls_pidx(pls, i)]++;
+                        hist_iidx[pls_iidx(pls, i)]++;
+			if (pls_iidx(pls, pls_pidx(pls, i)) != i) {
+				g_critical("iidx does not invert pidx at %u",
+					   i);
+				isok = FALSE;
+			}
                 }
                 for (i = 0; i < pls->len; ++i) {
                         if (hist_pidx[i] == 0) {
@@ -85,7 +443,10 @@ gboolean pls_check(Pls *pls)
                 }
                 g_free(hist_pidx);
                 g_free(hist_iidx);
-        }
+        } else if (pls->vslots || pls->pslots) {
+		g_critical("unshuffled playlist has positions");
+		isok = FALSE;
+	}
 	return isok;
 }
 
@@ -93,30 +454,24 @@ gboolean pls_check(Pls *pls)
 void pls_dump(Pls *pls, gboolean items)
 {
 	guint i;
+	PlsNode *n;
 
 	g_print("-- id   : %u\n"
 		"-- name : %s\n"
-		"-- alloc: %u\n"
 		"-- len  : %u\n"
-		"-- waste: %u bytes\n", pls->id, pls->name,
-		pls->alloc, pls->len,
-		(sizeof(*pls->vidx) + sizeof(*pls->pidx)) *
-		(pls->alloc - pls->len));
+		"-- nodes: %u bytes\n", pls->id, pls->name, pls->len,
+		pls->len * (sizeof(PlsOid) +
+			    (pls->shuffled ? sizeof(PlsSlot) : 0)));
 
 	if (!items) {
 		return;
         }
 
 	g_print("VI PL OID\n");
-        if (pls->shuffled) {
-                for (i = 0; i < pls->len; ++i) {
-                        g_print("%2u %2u %s\n", i, pls->pidx[i], pls->vidx[i]);
-                }
-        } else {
-                for (i = 0; i < pls->len; ++i) {
-                        g_print("%2u %2u %s\n", i, i, pls->vidx[i]);
-                }
-        }
+	for (i = 0, n = treap_select(pls->oids, 0); n;
+	     ++i, n = treap_next(n)) {
+		g_print("%2u %2u %s\n", i, pls_pidx(pls, i), PLS_OID(n)->oid);
+	}
 
 	pls_check(pls);
 }
@@ -152,33 +507,82 @@ static gboolean ops_settled(Pls *pls)
 	return FALSE;
 }
 
-/* Swap two elements by updating pidx and iidx accordingly */
-static void swap_elements(Pls *pls, gint index1, gint index2)
+/* Records an operation to be appended to the journal at the next save, unless
+ * that save is going to write a full snapshot anyway. */
+static void journal_op(Pls *pls, guint32 op, guint32 a, guint32 b,
+		       const gchar **strs, guint nstrs)
 {
-        gint tmp;
+	JournalRecord rec;
+	guint i;
+
+	if (pls->compact) {
+		return;
+	}
+
+	if (!pls->journal) {
+		pls->journal = g_byte_array_new();
+	}
 
-        tmp = pls->pidx[index1];
-        pls->pidx[index1] = pls->pidx[index2];
-        pls->pidx[index2] = tmp;
-        pls->iidx[pls->pidx[index1]] = index1;
-        pls->iidx[pls->pidx[index2]] = index2;
+	rec.size = 0;
+	rec.op = op;
+	rec.a = a;
+	rec.b = b;
+	for (i = 0; i < nstrs; ++i) {
+		rec.size += strlen(strs[i]) + 1;
+	}
+	g_byte_array_append(pls->journal, (const guint8 *)&rec, sizeof(rec));
+	for (i = 0; i < nstrs; ++i) {
+		g_byte_array_append(pls->journal, (const guint8 *)strs[i],
+				    strlen(strs[i]) + 1);
+	}
+
+	if (pls->journal->len > JOURNAL_MAX_PENDING) {
+		g_byte_array_free(pls->journal, TRUE);
+		pls->journal = NULL;
+		pls->compact = TRUE;
+	}
+}
+
+/* Swap two elements of the playing order */
+static void swap_elements(Pls *pls, guint index1, guint index2)
+{
+        PlsNode *n1, *n2;
+        guint tmp;
+
+        if (index1 == index2) {
+                return;
+        }
+        if (index1 > index2) {
+                tmp = index1;
+                index1 = index2;
+                index2 = tmp;
+        }
+        n2 = treap_cut(&pls->pslots, index2);
+        n1 = treap_cut(&pls->pslots, index1);
+        treap_paste(&pls->pslots, index1, n2);
+        treap_paste(&pls->pslots, index2, n1);
+}
+
+/* Moves the element at playing index $sidx to the start of the pool, and
+ * takes it out of the pool. */
+static void pick_element(Pls *pls, guint sidx)
+{
+        swap_elements(pls, pls->poolst, sidx);
+        pls->poolst++;
+        journal_op(pls, JOP_PICK, sidx, 0, NULL, 0);
 }
 
 /* Randomize amount elements from pool */
 static void shuffle_elements(Pls *pls, gint amount)
 {
-        gint sidx, i;
+        gint i;
 
         /* Adjust amount to not overflow */
         if (amount > (pls->len - pls->poolst)) {
                 amount = pls->len - pls->poolst;
         }
         for (i = 0; i < amount; i++) {
-                sidx = g_random_int_range(pls->poolst, pls->len);
-                swap_elements(pls,
-                              pls->poolst,g_random_int_range(pls->poolst,
-                                                             pls->len));
-                pls->poolst++;
+                pick_element(pls, g_random_int_range(pls->poolst, pls->len));
         }
 }
 
@@ -196,10 +600,48 @@ Pls *pls_new(guint id, const gchar *name)
 	p->dirty = TRUE;
 	p->use_count = 0;
 	p->dirty_timer = 0;
+	/* There is no snapshot to journal against yet. */
+	p->compact = TRUE;
 	pls_set_name(p, name);
 	return p;
 }
 
+/* Returns a copy of $pls with $id and $name. */
+Pls *pls_dup(Pls *pls, guint id, const gchar *name)
+{
+	Pls *p;
+	PlsNode *n;
+	const gchar **oids;
+	guint *pidx;
+	guint i;
+
+	p = pls_new(id, name);
+	if (!p) {
+		return NULL;
+	}
+	p->repeat = pls->repeat;
+
+	oids = g_new(const gchar *, pls->len);
+	for (i = 0, n = treap_select(pls->oids, 0); n;
+	     ++i, n = treap_next(n)) {
+		oids[i] = oidpool_ref(PLS_OID(n)->oid);
+	}
+	set_oids(p, oids, pls->len);
+	g_free(oids);
+
+	if (pls->shuffled) {
+		p->shuffled = TRUE;
+		pidx = g_new(guint, pls->len);
+		for (i = 0, n = treap_select(pls->pslots, 0); n;
+		     ++i, n = treap_next(n)) {
+			pidx[i] = treap_rank(&PLS_SLOT_P(n)->v);
+		}
+		pls_set_order(p, pidx, pls->poolst);
+		g_free(pidx);
+	}
+	return p;
+}
+
 /* Change playlist name */
 gboolean pls_set_name(Pls *pls, const gchar *name)
 {
@@ -213,6 +655,7 @@ gboolean pls_set_name(Pls *pls, const gchar *name)
 	pls->name = g_strdup(name);
 
 	if (!initialize) {
+		journal_op(pls, JOP_NAME, 0, 0, &name, 1);
 		i_am_dirty(pls);
         }
 
@@ -222,19 +665,11 @@ gboolean pls_set_name(Pls *pls, const gchar *name)
 /* Empties playlist */
 void pls_clear(Pls *pls)
 {
-	guint i;
-
-	for (i = 0; i < pls->len; ++i) {
-		g_free(pls->vidx[i]);
-        }
-
-	g_free(pls->vidx);
-	g_free(pls->pidx);
-        g_free(pls->iidx);
-	pls->vidx = NULL;
-	pls->pidx = NULL;
-        pls->iidx = NULL;
-	pls->len = pls->poolst = pls->alloc = 0;
+	free_oids(pls->oids);
+	free_slots(pls->vslots);
+	pls->oids = pls->vslots = pls->pslots = NULL;
+	pls->len = pls->poolst = 0;
+	journal_op(pls, JOP_CLEAR, 0, 0, NULL, 0);
 	i_am_dirty(pls);
 }
 
@@ -251,28 +686,11 @@ void pls_free(Pls *pls)
 		g_free(pls->name);
         }
 
-	g_free(pls);
-}
-
-static void maybe_realloc(Pls *pls, guint want_to_add)
-{
-	guint wantsize, s;
+	if (pls->journal) {
+		g_byte_array_free(pls->journal, TRUE);
+	}
 
-	g_assert(pls->alloc >= pls->len);
-	wantsize = pls->len + want_to_add;
-	/* TODO: this could also compact the array if len << alloc. */
-	if (wantsize <= pls->alloc)
-		return;
-	/* min 16 items, otherwise nearest power of 2 */
-	for (s = 16; s < wantsize; s <<= 1);
-	pls->alloc = s;
-	pls->vidx = g_realloc(pls->vidx, pls->alloc * sizeof(*pls->vidx));
-        if (pls->shuffled) {
-                pls->pidx = g_realloc(pls->pidx,
-                                      pls->alloc * sizeof(*pls->pidx));
-                pls->iidx = g_realloc(pls->iidx,
-                                      pls->alloc * sizeof(*pls->iidx));
-        }
+	g_free(pls);
 }
 
 /* Insert oids array (len sized) in playlist, at idx-th position. Already
@@ -280,9 +698,9 @@ static void maybe_realloc(Pls *pls, guint want_to_add)
  * inserted */
 gboolean pls_inserts(Pls *pls, guint idx, const gchar **oids, guint len)
 {
+	PlsNode **nodes, **pnodes;
+	PlsOid *o;
 	guint i;
-	/* The inserted item `steals' the playing index from the element whose
-	 * place it takes. */
 
         if (!oids || !len) {
                 return FALSE;
@@ -293,35 +711,31 @@ gboolean pls_inserts(Pls *pls, guint idx, const gchar **oids, guint len)
 		return FALSE;
 	}
 
-	maybe_realloc(pls, len);
-
-	/* Push vidx up to alloc the new elements */
-	g_memmove(&pls->vidx[idx + len], &pls->vidx[idx],
-		  (pls->len - idx) * sizeof(pls->vidx[0]));
-
         /* Insert the new elements */
+	nodes = g_new(PlsNode *, len);
         for (i = 0; i < len; i++) {
-                pls->vidx[idx+i] = g_strdup(oids[i]);
+		o = g_slice_new(PlsOid);
+		node_init(&o->node);
+		o->oid = oidpool_intern(oids[i]);
+		nodes[i] = &o->node;
         }
+	treap_paste(&pls->oids, idx, treap_build(nodes, len, G_MAXUINT32));
 
         if (pls->shuffled) {
-                /* Readjust old references in pidx and iidx */
-                for (i = 0; i < pls->len; i++) {
-                        if (pls->pidx[i] >= idx) {
-                                pls->pidx[i] += len;
-                                pls->iidx[pls->pidx[i]] = i;
-                        }
-                }
-
-                /* Insert the new references in pidx and iidx */
-                for (i = 0; i < len; i++) {
-                        pls->pidx[pls->len+i] = idx+i;
-                        pls->iidx[idx+i] = pls->len+i;
-                }
+                /* The new positions are played last, in the pool. */
+		pnodes = g_new(PlsNode *, len);
+		new_slots(len, nodes, pnodes);
+		treap_paste(&pls->vslots, idx,
+			    treap_build(nodes, len, G_MAXUINT32));
+		treap_paste(&pls->pslots, pls->len,
+			    treap_build(pnodes, len, G_MAXUINT32));
+		g_free(pnodes);
         }
+	g_free(nodes);
 
         pls->len += len;
 
+	journal_op(pls, JOP_INSERT, idx, len, oids, len);
 	i_am_dirty(pls);
 
 	return TRUE;
@@ -351,72 +765,112 @@ gboolean pls_append(Pls *pls, const gchar *oid)
  * successful */
 gboolean pls_remove(Pls *pls, guint idx)
 {
-	guint opx, i;
+	PlsOid *o;
+	PlsSlot *s;
+	guint opx;
 
 	if (idx >= pls->len) {
 		return FALSE;
         }
 
-	g_free(pls->vidx[idx]);
-
-	/* Push the rest downwards */
-	g_memmove(&pls->vidx[idx], &pls->vidx[idx + 1],
-		  (pls->len - idx - 1) * sizeof(pls->vidx[0]));
+	o = PLS_OID(treap_cut(&pls->oids, idx));
+	oidpool_unref(o->oid);
+	g_slice_free(PlsOid, o);
 
         if (pls->shuffled) {
-                opx = pls->iidx[idx];
+		/* The position is removed from the playing order too. */
+		s = PLS_SLOT_V(treap_cut(&pls->vslots, idx));
+		opx = treap_rank(&s->p);
+		treap_cut(&pls->pslots, opx);
+		g_slice_free(PlsSlot, s);
 
-                /* Renumber pidxes to reflect removal */
-                for (i = 0; i < pls->len; i++) {
-                        if (pls->pidx[i] > idx) {
-                                pls->pidx[i]--;
-                        }
-                }
-
-                /* If element was shuffled, push remaining downwards */
                 if (opx < pls->poolst) {
-                        g_memmove(&pls->pidx[opx], &pls->pidx[opx+1],
-                                  (pls->poolst - opx - 1)*sizeof(pls->pidx[0]));
-
-                        /* Adjust pool index */
+                        /* Element was shuffled, adjust pool index */
                         pls->poolst--;
-                } else {
+                } else if (opx < pls->len - 1) {
                         /* Overwrite removed element with latest */
-                        pls->pidx[opx] = pls->pidx[pls->len-1];
-                }
-
-                /* Rebuild iidx */
-                for (i = 0; i < pls->len-1; i++) {
-                        pls->iidx[pls->pidx[i]] = i;
+                        treap_paste(&pls->pslots, opx,
+                                    treap_cut(&pls->pslots, pls->len - 2));
                 }
         }
 
         pls->len--;
 
+	journal_op(pls, JOP_REMOVE, idx, 0, NULL, 0);
 	i_am_dirty(pls);
 
 	return TRUE;
 }
 
+/* Sets the playing order of a shuffled $pls: $pidx (of pls->len elements) is
+ * the permutation of visual indexes, $poolst the pool start.  Returns FALSE
+ * if $pidx is not a permutation.  Used when loading or copying playlists;
+ * the next save is going to write a full snapshot. */
+gboolean pls_set_order(Pls *pls, const guint *pidx, guint poolst)
+{
+	PlsNode **vnodes, **pnodes, **porder;
+	guint8 *seen;
+	gboolean isok;
+	guint i;
+
+	if (!pls->shuffled || poolst > pls->len) {
+		return FALSE;
+	}
+
+	isok = TRUE;
+	seen = g_new0(guint8, pls->len);
+	for (i = 0; i < pls->len && isok; ++i) {
+		isok = pidx[i] < pls->len && !seen[pidx[i]]++;
+	}
+	g_free(seen);
+	if (!isok) {
+		return FALSE;
+	}
+
+	vnodes = g_new(PlsNode *, pls->len);
+	pnodes = g_new(PlsNode *, pls->len);
+	porder = g_new(PlsNode *, pls->len);
+	new_slots(pls->len, vnodes, pnodes);
+	for (i = 0; i < pls->len; ++i) {
+		porder[i] = pnodes[pidx[i]];
+	}
+	free_slots(pls->vslots);
+	pls->vslots = treap_build(vnodes, pls->len, G_MAXUINT32);
+	pls->pslots = treap_build(porder, pls->len, G_MAXUINT32);
+	pls->poolst = poolst;
+	g_free(vnodes);
+	g_free(pnodes);
+	g_free(porder);
+
+	pls->compact = TRUE;
+	if (pls->journal) {
+		g_byte_array_free(pls->journal, TRUE);
+		pls->journal = NULL;
+	}
+	return TRUE;
+}
+
 /* Shuffle playlist */
 void pls_shuffle(Pls *pls)
 {
-        gint i;
+	PlsNode **vnodes, **pnodes;
 
-        /* If playlist wasn't shuffled, assign room to store pidx and iidx */
+        /* If playlist wasn't shuffled, create the positions, in playing
+         * order for now */
         if (!pls->shuffled) {
-                pls->pidx = g_new(guint, pls->alloc);
-                pls->iidx = g_new(gint, pls->alloc);
-
-                /* Initializes pidx and iidx */
-                for (i = 0; i < pls->len; i++) {
-                        pls->pidx[i] = pls->iidx[i] = i;
-                }
+		vnodes = g_new(PlsNode *, pls->len);
+		pnodes = g_new(PlsNode *, pls->len);
+		new_slots(pls->len, vnodes, pnodes);
+		pls->vslots = treap_build(vnodes, pls->len, G_MAXUINT32);
+		pls->pslots = treap_build(pnodes, pls->len, G_MAXUINT32);
+		g_free(vnodes);
+		g_free(pnodes);
         }
 
         pls->shuffled = TRUE;
         pls->poolst = 0;
 
+        journal_op(pls, JOP_SHUFFLE, 0, 0, NULL, 0);
         i_am_dirty(pls);
 }
 
@@ -426,12 +880,10 @@ void pls_unshuffle(Pls *pls)
         if (pls->shuffled) {
                 pls->shuffled = FALSE;
 
-                /* Free pidx and iidx */
-                g_free(pls->pidx);
-                g_free(pls->iidx);
-
-                pls->pidx = NULL;
-                pls->iidx = NULL;
+                /* Free the positions */
+                free_slots(pls->vslots);
+                pls->vslots = pls->pslots = NULL;
+                journal_op(pls, JOP_UNSHUFFLE, 0, 0, NULL, 0);
                 i_am_dirty(pls);
         }
 }
@@ -444,7 +896,7 @@ gchar *pls_get_item(Pls *pls, guint idx)
 		return NULL;
         }
 
-	return g_strdup(pls->vidx[idx]);
+	return g_strdup(pls_oid(pls, idx));
 }
 
 /* Returns a chunk of elements from playlist, starting in fidx and ending in
@@ -453,6 +905,7 @@ gchar **pls_get_items(Pls *pls, guint fidx, guint lidx)
 {
 	GPtrArray *oidarray = NULL;
 	gchar **oids;
+	PlsNode *n;
 	guint i;
 
         /* Check range */
@@ -468,8 +921,9 @@ gchar **pls_get_items(Pls *pls, guint fidx, guint lidx)
 	oidarray = g_ptr_array_sized_new(lidx - fidx + 2);
 
         /* Copy chunk playlist */
-	for (i=fidx; i <= lidx; i++) {
-		g_ptr_array_add(oidarray, pls->vidx[i]);
+	n = treap_select(pls->oids, fidx);
+	for (i=fidx; i <= lidx; i++, n = treap_next(n)) {
+		g_ptr_array_add(oidarray, (gpointer)PLS_OID(n)->oid);
 	}
 
 	g_ptr_array_add(oidarray, NULL);
@@ -487,14 +941,14 @@ void pls_get_starting(Pls *pls, guint *index, gchar **oid)
 	if (pls->len) {
                 if (!pls->shuffled) {
                         *index = 0;
-                        *oid = g_strdup(pls->vidx[0]);
+                        *oid = g_strdup(pls_oid(pls, 0));
                 } else {
                         /* If there are no shuffled elements, shuffle one */
                         if (pls->poolst == 0) {
                                 shuffle_elements(pls, 1);
                         }
-                        *index = pls->pidx[0];
-                        *oid = g_strdup(pls->vidx[*index]);
+                        *index = pls_pidx(pls, 0);
+                        *oid = g_strdup(pls_oid(pls, *index));
                 }
         }
 }
@@ -506,12 +960,12 @@ void pls_get_last(Pls *pls, guint *index, gchar **oid)
 	if (pls->len) {
                 if (!pls->shuffled) {
                         *index = pls->len-1;
-                        *oid = g_strdup(pls->vidx[pls->len-1]);
+                        *oid = g_strdup(pls_oid(pls, pls->len-1));
                 } else {
                         /* Need to shuffle all elements */
                         shuffle_elements(pls, pls->len);
-                        *index = pls->pidx[pls->len-1];
-                        *oid = g_strdup(pls->vidx[*index]);
+                        *index = pls_pidx(pls, pls->len-1);
+                        *oid = g_strdup(pls_oid(pls, *index));
                 }
 	}
 }
@@ -531,11 +985,11 @@ gboolean pls_get_next(Pls *pls, guint *index, gchar **oid)
                  * first */
                 if (*index < pls->len-1) {
                         (*index)++;
-                        *oid = g_strdup(pls->vidx[*index]);
+                        *oid = g_strdup(pls_oid(pls, *index));
                         return TRUE;
                 } else if (pls->repeat) {
                         *index = 0;
-                        *oid = g_strdup(pls->vidx[0]);
+                        *oid = g_strdup(pls_oid(pls, 0));
                         return TRUE;
                 } else {
                         /* Out of range */
@@ -543,28 +997,27 @@ gboolean pls_get_next(Pls *pls, guint *index, gchar **oid)
                 }
         } else {
                 /* Is the next element still shuffled? */
-                if ((pls->iidx[*index]+1) < pls->poolst) {
-                        *index = pls->pidx[pls->iidx[*index]+1];
-                        *oid = g_strdup(pls->vidx[*index]);
+                if ((pls_iidx(pls, *index)+1) < pls->poolst) {
+                        *index = pls_pidx(pls, pls_iidx(pls, *index)+1);
+                        *oid = g_strdup(pls_oid(pls, *index));
                         return TRUE;
                 }
 
                 /* Is the element unshuffled? If so, shuffle it, and continue */
-                if (pls->iidx[*index] >= pls->poolst) {
-                        swap_elements(pls, pls->poolst, pls->iidx[*index]);
-                        pls->poolst++;
+                if (pls_iidx(pls, *index) >= pls->poolst) {
+                        pick_element(pls, pls_iidx(pls, *index));
                 }
 
                 /* Shuffle a new element, if available. Else, if repeat is on
                  * then use the first one */
                 if (pls->poolst < pls->len) {
                         shuffle_elements(pls, 1);
-                        *index = pls->pidx[pls->poolst-1];
-                        *oid = g_strdup(pls->vidx[*index]);
+                        *index = pls_pidx(pls, pls->poolst-1);
+                        *oid = g_strdup(pls_oid(pls, *index));
                         return TRUE;
                 } else if (pls->repeat) {
-                        *index = pls->pidx[0];
-                        *oid = g_strdup(pls->vidx[*index]);
+                        *index = pls_pidx(pls, 0);
+                        *oid = g_strdup(pls_oid(pls, *index));
                         return TRUE;
                 } else {
                         /* No more elements */
@@ -587,11 +1040,11 @@ gboolean pls_get_prev(Pls *pls, guint *index, gchar **oid)
                  * last */
                 if (*index > 0) {
                         (*index)--;
-                        *oid = g_strdup(pls->vidx[*index]);
+                        *oid = g_strdup(pls_oid(pls, *index));
                         return TRUE;
                 } else if (pls->repeat) {
                         *index = pls->len-1;
-                        *oid = g_strdup(pls->vidx[*index]);
+                        *oid = g_strdup(pls_oid(pls, *index));
                         return TRUE;
                 } else {
                         /* No prev */
@@ -599,15 +1052,14 @@ gboolean pls_get_prev(Pls *pls, guint *index, gchar **oid)
                 }
         } else {
                 /* Is the element unshuffled? If so, shuffle it and continue */
-                if (pls->iidx[*index] >= pls->poolst) {
-                        swap_elements(pls, pls->poolst, pls->iidx[*index]);
-                        pls->poolst++;
+                if (pls_iidx(pls, *index) >= pls->poolst) {
+                        pick_element(pls, pls_iidx(pls, *index));
                 }
 
                 /* Is there a previous element? */
-                if (pls->iidx[*index] > 0) {
-                        *index=pls->pidx[pls->iidx[*index]-1];
-                        *oid = g_strdup(pls->vidx[*index]);
+                if (pls_iidx(pls, *index) > 0) {
+                        *index=pls_pidx(pls, pls_iidx(pls, *index)-1);
+                        *oid = g_strdup(pls_oid(pls, *index));
                         return TRUE;
                 }
 
@@ -633,6 +1085,7 @@ gboolean pls_is_shuffled(Pls *pls)
 void pls_set_repeat(Pls *pls, gboolean repeat)
 {
 	pls->repeat = repeat;
+	journal_op(pls, JOP_REPEAT, repeat, 0, NULL, 0);
 	i_am_dirty(pls);
 }
 
@@ -646,9 +1099,6 @@ void pls_set_use_count(Pls *pls, guint use_count)
 /* Moves a clip from "from" to "to" */
 gboolean pls_move(Pls *pls, guint from, guint to)
 {
-        gchar *aoid;
-        guint mdest, msrc, mlen;
-
         if (from == to)
                 return TRUE;
         /* XXX: this could clamp at pls->len... */
@@ -666,22 +1116,12 @@ gboolean pls_move(Pls *pls, guint from, guint to)
  * 4 4 e   4 4 e
  *
  *    1 -> 3
+ *
+ * So only the object id tree is touched.
  */
-        if (from < to) {
-                mdest = from;
-                msrc = from + 1;
-                mlen = to - from;
-        } else {
-                mdest = to + 1;
-                msrc = to;
-                mlen = from - to;
-        }
-
-        aoid = pls->vidx[from];
-        g_memmove(&pls->vidx[mdest], &pls->vidx[msrc],
-                  mlen * sizeof(pls->vidx[0]));
-        pls->vidx[to] = aoid;
+        treap_paste(&pls->oids, to, treap_cut(&pls->oids, from));
 
+	journal_op(pls, JOP_MOVE, from, to, NULL, 0);
 	i_am_dirty(pls);
 	return TRUE;
 }
@@ -697,76 +1137,123 @@ gint pls_cmpids(gconstpointer a, gconstpointer b, gpointer unused)
 		return 1;
 }
 
-/* Playlists are saved in flat text files.  First there is a five line header,
- * consisting of:
+/* Playlists are saved in binary files (version 3), laid out so that
+ * pls_load() can map them and intern the object ids straight from the
+ * mapping:
+ *
+ * header: a PlsHeader, the magic being "V3\n"
+ * name: @namelen bytes, including the terminating '\0', padded to
+ *       a multiple of 4 bytes
+ * pidx: @len 32-bit playing indexes, equivalent to pidx[n] of the in-core
+ *       Pls structure (the identity if the playlist is not shuffled)
+ * offsets: @len 32-bit offsets of the object ids in the string table
+ * string table: @strtablen bytes of '\0'-terminated object ids
+ *
+ * Edits made after a snapshot are appended to a journal (see pls_sync()) in
+ * $fn.journal, and replayed by pls_load().
+ *
+ * Earlier versions were flat text files, which pls_load() still accepts, so
+ * that they are migrated the next time the playlist is saved.  They start
+ * with a header of one field per line:
  *
- * version: "V" + an integer (last version is 2)
+ * version: "V" + an integer (1 or 2)
  * id: integer > 0
  * name: string, everything until newline
  * repeat: integer, 0 or 1
  * shuffle: integer, 0 or 1
  * length: integer > 0
- * pool start: integer > 0 && <= length
+ * pool start: integer > 0 && <= length (only in version 2)
  *
  * Then items follow, one per line:
  *
  * playing index,uuid
  *
- * where pidx is a non-negative integer, equivalent to pidx[n] of the in-core
- * Pls structure, and uuid is a string lasting till the end of the line.
+ * where pidx is a non-negative integer, and uuid is a string lasting till the
+ * end of the line.
  */
 gboolean pls_save(Pls *pls, const gchar *fn)
 {
+	static const gchar zeros[4];
+	PlsHeader hdr;
 	FILE *f;
 	guint i;
-	gchar *tmpf;
+	guint32 *offs, pidx, slen, pad;
+	gchar *tmpf, *jfn;
 	gboolean isok, tmpok;
+	glong size;
+	PlsNode *n;
 
 	/* First write the playlist into a temporary file, then move it over
 	 * the requested filename. */
 	tmpok = isok = FALSE;
+	offs = NULL;
 	tmpf = g_strdup_printf("%s.tmp", fn);
 	if (!(f = fopen(tmpf, "w+"))) {
 		goto out1;
         }
 
-	if (fprintf(f,
-		    "V" APLAYLIST_VERSION "\n"
-		    "%u\n"
-		    "%s\n"
-		    "%d\n"
-                    "%d\n"
-		    "%u\n"
-                    "%u\n",
-		    pls->id,
-		    pls->name,
-		    pls->repeat,
-		    pls->shuffled,
-		    pls->len,
-                    pls->poolst) < 0) {
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, PLS_MAGIC, sizeof(hdr.magic));
+	hdr.byteorder = PLS_BYTEORDER;
+	hdr.id = pls->id;
+	hdr.repeat = pls->repeat;
+	hdr.shuffled = pls->shuffled;
+	hdr.len = pls->len;
+	hdr.poolst = pls->poolst;
+	hdr.namelen = strlen(pls->name) + 1;
+	hdr.generation = pls->generation + 1;
+
+	/* Lay out the string table. */
+	offs = g_new(guint32, pls->len);
+	for (i = 0, n = treap_select(pls->oids, 0); n;
+	     ++i, n = treap_next(n)) {
+		offs[i] = hdr.strtablen;
+		hdr.strtablen += strlen(PLS_OID(n)->oid) + 1;
+	}
+
+	pad = PLS_ALIGN(hdr.namelen) - hdr.namelen;
+	if (fwrite(&hdr, sizeof(hdr), 1, f) != 1 ||
+	    fwrite(pls->name, 1, hdr.namelen, f) != hdr.namelen ||
+	    fwrite(zeros, 1, pad, f) != pad) {
 		goto out2;
-        }
+	}
+
+	n = treap_select(pls->pslots, 0);
+	for (i = 0; i < pls->len; ++i) {
+		if (pls->shuffled) {
+			pidx = treap_rank(&PLS_SLOT_P(n)->v);
+			n = treap_next(n);
+		} else {
+			pidx = i;
+		}
+		if (fwrite(&pidx, sizeof(pidx), 1, f) != 1) {
+			goto out2;
+		}
+	}
+
+	if (pls->len &&
+	    fwrite(offs, sizeof(*offs), pls->len, f) != pls->len) {
+		goto out2;
+	}
+
+	for (i = 0, n = treap_select(pls->oids, 0); n;
+	     ++i, n = treap_next(n)) {
+		slen = (i + 1 < pls->len ? offs[i + 1] : hdr.strtablen)
+			- offs[i];
+		if (fwrite(PLS_OID(n)->oid, 1, slen, f) != slen) {
+			goto out2;
+		}
+	}
 
-        if (pls->shuffled) {
-                for (i = 0; i < pls->len; ++i) {
-                        if (fprintf(f, "%u,%s\n",
-                                    pls->pidx[i], pls->vidx[i]) < 0) {
-                                goto out2;
-                        }
-                }
-        } else {
-                for (i = 0; i < pls->len; ++i) {
-                        if (fprintf(f, "%u,%s\n", i, pls->vidx[i]) < 0) {
-                                goto out2;
-                        }
-                }
-        }
 	/* Try to minimize data loss. */
 	fflush(f);
 	fsync(fileno(f));
+	size = ftell(f);
 	if (fclose(f) != 0) {
+		f = NULL;
 		goto out2;
         }
+	f = NULL;
 
 	/* tmpok == .tmp file written */
 	tmpok = TRUE;
@@ -780,16 +1267,120 @@ gboolean pls_save(Pls *pls, const gchar *fn)
 	 * directory... See fsync(2). */
 	isok = TRUE;
 
-out2:	if (!tmpok) {
+	/* The journal is obsolete now.  Should unlinking fail, its generation
+	 * still tells it apart from the new snapshot. */
+	pls->generation = hdr.generation;
+	pls->ssize = size;
+	pls->jsize = 0;
+	pls->compact = FALSE;
+	if (pls->journal) {
+		g_byte_array_set_size(pls->journal, 0);
+	}
+	jfn = g_strconcat(fn, PLS_JOURNAL_SUFFIX, NULL);
+	if (unlink(jfn) == -1 && errno != ENOENT) {
+		g_warning("unlink: %s", g_strerror(errno));
+	}
+	g_free(jfn);
+
+out2:	if (f) {
+		fclose(f);
+	}
+	if (!tmpok) {
 		if (unlink(tmpf) == -1) {
 			g_warning("unlink: %s", g_strerror(errno));
                 }
 	}
 
-out1:	g_free(tmpf);
+out1:	g_free(offs);
+	g_free(tmpf);
 	return isok;
 }
 
+/* Writes $len bytes of $buf to $fd, retrying on short writes. */
+static gboolean write_all(gint fd, const void *buf, gsize len)
+{
+	const gchar *p;
+	gssize n;
+
+	for (p = buf; len > 0; p += n, len -= n) {
+		n = write(fd, p, len);
+		if (n == -1) {
+			if (errno == EINTR) {
+				n = 0;
+				continue;
+			}
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+/* Persists the edits of $pls since it was last saved to $fn.  Normally the
+ * pending journal records are appended to $fn.journal, which costs in
+ * proportion to the edits, not to the playlist.  A full snapshot is written
+ * by pls_save() instead if there is no snapshot to journal against, or the
+ * journal has grown beyond @Journal_ratio percent of the snapshot. */
+gboolean pls_sync(Pls *pls, const gchar *fn)
+{
+	JournalHeader hdr;
+	gchar *jfn;
+	gsize pending, written;
+	gboolean isok;
+	gint fd;
+
+	pending = pls->journal ? pls->journal->len : 0;
+	if (pls->compact ||
+	    pls->jsize + pending > MAX(JOURNAL_MIN,
+				       pls->ssize / 100 * Journal_ratio)) {
+		return pls_save(pls, fn);
+	}
+	if (!pending) {
+		return TRUE;
+	}
+
+	isok = FALSE;
+	written = 0;
+	jfn = g_strconcat(fn, PLS_JOURNAL_SUFFIX, NULL);
+	if (pls->jsize == 0) {
+		/* Start a new journal for the current snapshot. */
+		fd = open(jfn, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+		if (fd == -1) {
+			goto out1;
+		}
+		memcpy(hdr.magic, JOURNAL_MAGIC, sizeof(hdr.magic));
+		hdr.byteorder = PLS_BYTEORDER;
+		hdr.generation = pls->generation;
+		if (!write_all(fd, &hdr, sizeof(hdr))) {
+			goto out2;
+		}
+		written = sizeof(hdr);
+	} else {
+		fd = open(jfn, O_WRONLY | O_APPEND);
+		if (fd == -1) {
+			goto out1;
+		}
+	}
+
+	if (!write_all(fd, pls->journal->data, pending) || fsync(fd) == -1) {
+		goto out2;
+	}
+
+	pls->jsize += written + pending;
+	g_byte_array_set_size(pls->journal, 0);
+	isok = TRUE;
+
+out2:	close(fd);
+out1:	g_free(jfn);
+	/* The journal may have a torn tail now; start over with a snapshot,
+	 * which makes it obsolete. */
+	if (!isok) {
+		g_warning("appending to the journal of playlist %u failed: %s",
+			  pls->id, g_strerror(errno));
+		return pls_save(pls, fn);
+	}
+	return TRUE;
+}
+
 /* Similar to fgets(), but chops the optional trailing newline. */
 static char *fgetsnl(char *buf, int size, FILE *f)
 {
@@ -805,6 +1396,216 @@ static char *fgetsnl(char *buf, int size, FILE *f)
 	return b;
 }
 
+/* Loads a binary (V3) playlist from $fn.  The file is mapped read-only only
+ * for the duration of loading, the object ids are interned right from it. */
+static Pls *pls_load_binary(const gchar *fn)
+{
+	const PlsHeader *hdr;
+	const guint32 *pidx, *offs;
+	const gchar *name, *strtab;
+	struct stat sb;
+	guint64 need;
+	const gchar **oids;
+	gchar *map;
+	Pls *p;
+	gint fd;
+	guint i;
+
+	if ((fd = open(fn, O_RDONLY)) == -1) {
+		return NULL;
+	}
+	map = MAP_FAILED;
+	if (fstat(fd, &sb) == 0 && sb.st_size >= sizeof(*hdr)) {
+		map = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	}
+	close(fd);
+	if (map == MAP_FAILED) {
+		return NULL;
+	}
+
+	hdr = (const PlsHeader *)map;
+	if (memcmp(hdr->magic, PLS_MAGIC, sizeof(hdr->magic)) ||
+	    hdr->byteorder != PLS_BYTEORDER ||
+	    hdr->poolst > hdr->len ||
+	    hdr->namelen < 2 ||
+	    (hdr->len && !hdr->strtablen)) {
+		goto out;
+	}
+
+	/* Make sure every part lies within the file. */
+	need = sizeof(*hdr) + PLS_ALIGN((guint64)hdr->namelen) +
+		2 * sizeof(guint32) * (guint64)hdr->len + hdr->strtablen;
+	if (need > sb.st_size) {
+		goto out;
+	}
+
+	name = map + sizeof(*hdr);
+	pidx = (const guint32 *)(name + PLS_ALIGN(hdr->namelen));
+	offs = pidx + hdr->len;
+	strtab = (const gchar *)(offs + hdr->len);
+	if (name[hdr->namelen - 1] != '\0' ||
+	    (hdr->strtablen && strtab[hdr->strtablen - 1] != '\0')) {
+		goto out;
+	}
+
+	/* Same sanity checks as for the text formats. */
+	for (i = 0; i < hdr->len; ++i) {
+		if (offs[i] >= hdr->strtablen || !strtab[offs[i]]) {
+			goto out;
+		}
+	}
+
+	p = pls_new(hdr->id, name);
+	if (!p) {
+		goto out;
+	}
+	oids = g_new(const gchar *, hdr->len);
+	for (i = 0; i < hdr->len; ++i) {
+		oids[i] = oidpool_intern(&strtab[offs[i]]);
+	}
+	p->repeat = hdr->repeat != 0;
+	p->shuffled = hdr->shuffled != 0;
+	p->generation = hdr->generation;
+	p->ssize = sb.st_size;
+	set_oids(p, oids, hdr->len);
+	g_free(oids);
+
+	if (p->shuffled && !pls_set_order(p, pidx, hdr->poolst)) {
+		pls_free(p);
+		p = NULL;
+	} else {
+		p->compact = FALSE;
+	}
+	munmap(map, sb.st_size);
+	return p;
+
+out:	munmap(map, sb.st_size);
+	return NULL;
+}
+
+/* Collects $n '\0'-terminated strings from $buf of $size bytes into $strs.
+ * Returns FALSE if they don't fit. */
+static gboolean journal_strings(const gchar *buf, gsize size,
+				const gchar **strs, guint n)
+{
+	const gchar *end;
+	guint i;
+
+	for (i = 0; i < n; ++i) {
+		if (!(end = memchr(buf, '\0', size))) {
+			return FALSE;
+		}
+		strs[i] = buf;
+		size -= end + 1 - buf;
+		buf = end + 1;
+	}
+	return TRUE;
+}
+
+/* Applies the journal records in $buf to $pls.  A truncated last record
+ * (from a crash while appending) is ignored.  Returns FALSE if the journal
+ * does not match the playlist. */
+static gboolean journal_replay(Pls *pls, const gchar *buf, gsize len)
+{
+	JournalRecord rec;
+	const gchar **strs;
+	const gchar *args;
+	gboolean isok;
+
+	isok = TRUE;
+	while (isok && len >= sizeof(rec)) {
+		memcpy(&rec, buf, sizeof(rec));
+		if (rec.size > len - sizeof(rec)) {
+			break;
+		}
+		args = buf + sizeof(rec);
+
+		switch (rec.op) {
+		case JOP_INSERT:
+			/* Every object id takes at least two bytes. */
+			if (rec.b > rec.size / 2) {
+				isok = FALSE;
+				break;
+			}
+			strs = g_new(const gchar *, rec.b);
+			isok = journal_strings(args, rec.size, strs, rec.b) &&
+				pls_inserts(pls, rec.a, strs, rec.b);
+			g_free(strs);
+			break;
+		case JOP_REMOVE:
+			isok = pls_remove(pls, rec.a);
+			break;
+		case JOP_MOVE:
+			isok = pls_move(pls, rec.a, rec.b);
+			break;
+		case JOP_CLEAR:
+			pls_clear(pls);
+			break;
+		case JOP_SHUFFLE:
+			pls_shuffle(pls);
+			break;
+		case JOP_UNSHUFFLE:
+			pls_unshuffle(pls);
+			break;
+		case JOP_PICK:
+			isok = pls->shuffled && pls->poolst <= rec.a &&
+				rec.a < pls->len;
+			if (isok) {
+				pick_element(pls, rec.a);
+			}
+			break;
+		case JOP_REPEAT:
+			pls_set_repeat(pls, rec.a != 0);
+			break;
+		case JOP_NAME:
+			isok = journal_strings(args, rec.size, &args, 1) &&
+				pls_set_name(pls, args);
+			break;
+		default:
+			isok = FALSE;
+			break;
+		}
+
+		buf += sizeof(rec) + rec.size;
+		len -= sizeof(rec) + rec.size;
+	}
+	return isok;
+}
+
+/* Replays $fn.journal on $pls, freshly loaded from the snapshot $fn. */
+static void journal_load(Pls *pls, const gchar *fn)
+{
+	JournalHeader hdr;
+	gchar *jfn, *buf;
+	gsize len;
+
+	jfn = g_strconcat(fn, PLS_JOURNAL_SUFFIX, NULL);
+	buf = NULL;
+	if (!g_file_get_contents(jfn, &buf, &len, NULL) ||
+	    len < sizeof(hdr)) {
+		goto out;
+	}
+	memcpy(&hdr, buf, sizeof(hdr));
+	if (memcmp(hdr.magic, JOURNAL_MAGIC, sizeof(hdr.magic)) ||
+	    hdr.byteorder != PLS_BYTEORDER ||
+	    hdr.generation != pls->generation) {
+		goto out;
+	}
+
+	/* Don't journal the replayed operations again. */
+	pls->compact = TRUE;
+	if (journal_replay(pls, buf + sizeof(hdr), len - sizeof(hdr))) {
+		pls->compact = FALSE;
+		pls->jsize = len;
+	} else {
+		g_warning("journal of playlist %u is inconsistent, "
+			  "replayed partially", pls->id);
+	}
+
+out:	g_free(buf);
+	g_free(jfn);
+}
+
 Pls *pls_load(const gchar *fn)
 {
 	/* @buf makes this non-reentrant.  We don't allow more than 2k long
@@ -815,6 +1616,8 @@ Pls *pls_load(const gchar *fn)
 	gint version, id, repeat, shuffled, len, poolst;
 	gchar *name;
 	guint i;
+	GPtrArray *oids;
+	GArray *pidxs;
 
 	p = NULL;
 	name = NULL;
@@ -832,9 +1635,16 @@ Pls *pls_load(const gchar *fn)
 		goto out1;
         }
 
-	/* Latest version is 2, though this function is able to manage v1 too.
-	 * If format changes in the future, you'll need to change this code, and
-	 * care about backward compatibility. */
+	/* Latest version is 3, which is binary.  Text versions 1 and 2 are
+	 * still read for migration.  If format changes in the future, you'll
+	 * need to change this code, and care about backward compatibility. */
+	if (version == 3) {
+		fclose(f);
+		if ((p = pls_load_binary(fn))) {
+			journal_load(p, fn);
+		}
+		return p;
+	}
 	if (version != 1 && version != 2) {
 		goto out1;
         }
@@ -889,8 +1699,8 @@ Pls *pls_load(const gchar *fn)
 	p = pls_new(id, name);
 	p->repeat = repeat;
 	p->shuffled = shuffled;
-        p->poolst = poolst;
-	maybe_realloc(p, len);
+	oids = g_ptr_array_new();
+	pidxs = g_array_new(FALSE, FALSE, sizeof(guint));
 
         /* Read entries */
         for (i = 0; i < len; ++i) {
@@ -905,23 +1715,29 @@ Pls *pls_load(const gchar *fn)
                         if (oid) {
                                 free(oid);
                         }
+                        g_ptr_array_foreach(oids, (GFunc)oidpool_unref, NULL);
 
                         pls_free(p);
                         p = NULL;
-                        goto out2;
+                        goto out3;
                 }
 
-                p->vidx[i] = oid;
-
-                if (p->shuffled) {
-                        p->pidx[i] = pidx;
-                        p->iidx[pidx] = i;
-                }
+                g_ptr_array_add(oids, (gpointer)oidpool_intern(oid));
+                free(oid);
+                g_array_append_val(pidxs, pidx);
         }
 
 	/* We don't really want to detect if the file has more items than
 	 * $len... */
-	p->len = i;
+	set_oids(p, (const gchar **)oids->pdata, oids->len);
+	if (p->shuffled &&
+	    !pls_set_order(p, (guint *)pidxs->data, poolst)) {
+		pls_free(p);
+		p = NULL;
+	}
+
+out3:	g_ptr_array_free(oids, TRUE);
+	g_array_free(pidxs, TRUE);
 
 out2:   free(name);
 
@@ -32,9 +32,30 @@
 /* From aplaylist.c: */
 
 extern guint Settle_time;
+extern guint Journal_ratio;
+extern guint Node_updates;
+
+/* Playlist $fn is journaled in $fn PLS_JOURNAL_SUFFIX. */
+#define PLS_JOURNAL_SUFFIX	".journal"
+
+/*
+ * Node of the order-statistic trees (implicit treaps) of a playlist, see
+ * aplaylist.c.
+ *
+ * @left, @right, @parent: tree links
+ * @size:        number of nodes in the subtree rooted here
+ * @prio:        random heap priority keeping the tree balanced
+ */
+typedef struct _PlsNode PlsNode;
+struct _PlsNode {
+	PlsNode *left, *right, *parent;
+	guint size;
+	guint32 prio;
+};
 
 /*
- * Array based playlist storage.
+ * Tree based playlist storage.  Insertion, removal, moving and looking up an
+ * element by index (in either order) take O(log n).
  *
  * @id:          playlist identifier
  * @name:        playlist name
@@ -42,22 +63,29 @@ extern guint Settle_time;
  * @shuffled:    playlist is shuffled
  * @use_count:   a reference count for the playlist
  * @len:         length of playlist
- * @alloc:       number of elements allocated (>= len)
  * @poolst:      the first element of the pool (>= len if pool is empty)
- * @vidx:        array of object id:s
- * @pidx:        array containing both shuffled elements and un-shuffled ones
+ * @oids:        tree of object id:s, in visual order (pls_oid()), interned
+ *               in the pool of oidpool.c
+ * @vslots:      tree of the visual positions, in visual order.  Only when
+ *               the playlist is shuffled.
+ * @pslots:      the same positions in playing order, containing both
+ *               shuffled elements and un-shuffled ones
  *               {0..poolst-1}: shuffled elements
  *               {poolst..len-1}: pool with still unshuffled elements
- *               Resolves the query "which element will be played at postion
- *               i-th?"
- * @iidx:        Relates both vidx and pidx. Resolves the query "in which
- *               position will be played element i-th?". That is, it stores
- *               where is placed in pidx each element of vidx. Only makes sense
- *               when playlist is shuffled.
+ *               The rank of a position in @vslots resolves the query "which
+ *               element will be played at position i-th?" (pls_pidx()), its
+ *               rank in @pslots "in which position will be played element
+ *               i-th?" (pls_iidx()).
  * @dirty:       set to 1 if a playlist is modified (cleared manually)
  * @dirty_timer: each time the playlist is dirtied, a timer is started (or
  *               elongated), and when it expires, triggers save_me().  This
  *               variable stores its id.
+ * @generation:  generation of the last snapshot (full save) of the playlist
+ * @ssize:       size of the last snapshot in bytes
+ * @jsize:       size of the journal belonging to the last snapshot
+ * @journal:     journal records not saved yet
+ * @compact:     the next save must write a full snapshot, because there is
+ *               no usable one to journal against
  */
 typedef struct {
 	guint id;
@@ -66,18 +94,23 @@ typedef struct {
 	gboolean shuffled;
 	guint use_count;
 	guint len;
-	guint alloc;
         guint poolst;
-	gchar **vidx;
-	guint *pidx;
-        gint *iidx;
+	PlsNode *oids;
+	PlsNode *vslots;
+	PlsNode *pslots;
 	gboolean dirty;
 	guint dirty_timer;
+	guint32 generation;
+	gsize ssize;
+	gsize jsize;
+	GByteArray *journal;
+	gboolean compact;
 } Pls;
 
 extern gboolean pls_check(Pls *pls);
 extern void pls_dump(Pls *pls, gboolean items);
 extern Pls *pls_new(guint id, const gchar *name);
+extern Pls *pls_dup(Pls *pls, guint id, const gchar *name);
 extern gboolean pls_set_name(Pls *pls, const gchar *name);
 extern void pls_clear(Pls *pls);
 extern void pls_free(Pls *pls);
@@ -90,6 +123,10 @@ extern void pls_shuffle(Pls *pls);
 extern void pls_unshuffle(Pls *pls);
 extern gchar *pls_get_item(Pls *pls, guint idx);
 extern gchar **pls_get_items(Pls *pls, guint fidx, guint lidx);
+extern const gchar *pls_oid(Pls *pls, guint idx);
+extern guint pls_pidx(Pls *pls, guint i);
+extern guint pls_iidx(Pls *pls, guint idx);
+extern gboolean pls_set_order(Pls *pls, const guint *pidx, guint poolst);
 void pls_get_starting(Pls *pls, guint *index, gchar **oid);
 void pls_get_last(Pls *pls, guint *index, gchar **oid);
 gboolean pls_get_next(Pls *pls, guint *index, gchar **oid);
@@ -100,10 +137,34 @@ extern void pls_set_use_count(Pls *pls, guint use_count);
 extern gboolean pls_move(Pls *pls, guint from, guint to);
 extern gint pls_cmpids(gconstpointer a, gconstpointer b, gpointer unused);
 extern gboolean pls_save(Pls *pls, const gchar *fn);
+extern gboolean pls_sync(Pls *pls, const gchar *fn);
 extern Pls *pls_load(const gchar *fn);
 
 extern void init_pl_wrapper(DBusConnection *connection);
 
+/* From oidpool.c: */
+
+/*
+ * Figures of the object id pool.
+ *
+ * @unique:      number of distinct object ids in the pool
+ * @refs:        number of references held by playlists
+ * @bytes:       memory used by the pool
+ * @saved:       memory that playlists would use in addition for copies of
+ *               their own
+ */
+typedef struct {
+	guint unique;
+	guint refs;
+	gsize bytes;
+	gsize saved;
+} OidPoolStats;
+
+extern const gchar *oidpool_intern(const gchar *oid);
+extern const gchar *oidpool_ref(const gchar *oid);
+extern void oidpool_unref(const gchar *oid);
+extern void oidpool_stats(OidPoolStats *stats);
+
 /* From mafw-playlist-daemon.c: */
 extern void save_me(Pls *pls);
 
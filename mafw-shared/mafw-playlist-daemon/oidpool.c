@@ -0,0 +1,118 @@
+/*
+ * This file is a part of MAFW
+ *
+ * Copyright (C) 2007, 2008, 2009 Nokia Corporation, all rights reserved.
+ *
+ * Contact: Visa Smolander <visa.smolander@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+/*
+ * Pool of object ids shared by all playlists.  The same tracker or UPnP
+ * object id tends to appear in many playlists, and often many times within
+ * one, so playlists hold references to interned copies instead of copies of
+ * their own.  Interned object ids are equal if and only if their pointers
+ * are.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+#include <string.h>
+#include <glib.h>
+
+#include "mpd-internal.h"
+
+/* An interned object id, @oid being the string handed out. */
+typedef struct {
+	guint refs;
+	guint len;
+	gchar oid[1];
+} OidEntry;
+
+#define OID_ENTRY(oid)	((OidEntry *)((oid) - G_STRUCT_OFFSET(OidEntry, oid)))
+
+/* oid -> OidEntry */
+static GHashTable *Pool;
+static OidPoolStats Stats;
+
+/* Returns the interned copy of $oid, with a new reference. */
+const gchar *oidpool_intern(const gchar *oid)
+{
+	OidEntry *e;
+
+	if (!Pool) {
+		Pool = g_hash_table_new(g_str_hash, g_str_equal);
+	}
+
+	if ((e = g_hash_table_lookup(Pool, oid))) {
+		e->refs++;
+		Stats.refs++;
+		Stats.saved += e->len + 1;
+		return e->oid;
+	}
+
+	e = g_malloc(G_STRUCT_OFFSET(OidEntry, oid) + strlen(oid) + 1);
+	e->refs = 1;
+	e->len = strlen(oid);
+	memcpy(e->oid, oid, e->len + 1);
+	g_hash_table_insert(Pool, e->oid, e);
+	Stats.unique++;
+	Stats.refs++;
+	Stats.bytes += G_STRUCT_OFFSET(OidEntry, oid) + e->len + 1;
+	return e->oid;
+}
+
+/* Takes a new reference of the interned $oid. */
+const gchar *oidpool_ref(const gchar *oid)
+{
+	OidEntry *e;
+
+	e = OID_ENTRY(oid);
+	e->refs++;
+	Stats.refs++;
+	Stats.saved += e->len + 1;
+	return oid;
+}
+
+/* Drops a reference of the interned $oid, freeing it with the last one. */
+void oidpool_unref(const gchar *oid)
+{
+	OidEntry *e;
+
+	e = OID_ENTRY(oid);
+	g_assert(e->refs > 0);
+	Stats.refs--;
+	if (--e->refs > 0) {
+		Stats.saved -= e->len + 1;
+		return;
+	}
+
+	g_hash_table_remove(Pool, e->oid);
+	Stats.unique--;
+	Stats.bytes -= G_STRUCT_OFFSET(OidEntry, oid) + e->len + 1;
+	g_free(e);
+}
+
+/* Fills $stats with the current figures of the pool. */
+void oidpool_stats(OidPoolStats *stats)
+{
+	*stats = Stats;
+}
+
+/* vi: set noexpandtab ts=8 sw=8 cino=t0,(0: */
@@ -134,7 +134,7 @@ void save_me(Pls *pls)
 		return;
 	fn = g_strdup_printf("%s" G_DIR_SEPARATOR_S "%u",
 			     playlist_dir(), pls->id);
-	if (pls_save(pls, fn))
+	if (pls_sync(pls, fn))
 		pls->dirty = FALSE;
 	g_free(fn);
 }
@@ -156,6 +156,7 @@ static void load_playlists(void)
 {
 	GDir *d;
 	const gchar *fn;
+	OidPoolStats stats;
 
 	d = g_dir_open(playlist_dir(), 0, NULL);
 	if (!d) {
@@ -203,6 +204,9 @@ static void load_playlists(void)
 		Pls *pls;
 		gchar *fullfn;
 
+		/* Journals are replayed by pls_load(). */
+		if (g_str_has_suffix(fn, PLS_JOURNAL_SUFFIX))
+			continue;
 		fullfn = g_build_filename(playlist_dir(), fn, NULL);
 		pls = pls_load(fullfn);
 		g_free(fullfn);
@@ -218,6 +222,11 @@ static void load_playlists(void)
 	}
 	initialize = FALSE;
 	g_dir_close(d);
+
+	oidpool_stats(&stats);
+	g_info("%u object ids (%u references) take %" G_GSIZE_FORMAT
+	       " bytes, saving %" G_GSIZE_FORMAT " bytes",
+	       stats.unique, stats.refs, stats.bytes, stats.saved);
 }
 
 static void signal_playlist_created(DBusConnection *con, guint new_id)
@@ -631,6 +640,15 @@ static DBusHandlerResult request(DBusConnection *con, DBusMessage *req,
                                                 "error while deleting '%s': %s",
                                                 fn, g_strerror(errno));
 				g_free(fn);
+				fn = g_strdup_printf("%s"
+                                                     G_DIR_SEPARATOR_S "%u"
+						     PLS_JOURNAL_SUFFIX,
+						     playlist_dir(), pls->id);
+				if (g_unlink(fn) == -1 && errno != ENOENT)
+					g_warning(
+                                                "error while deleting '%s': %s",
+                                                fn, g_strerror(errno));
+				g_free(fn);
 				g_assert(g_tree_remove(Playlists_by_name,
                                                        pls->name));
 				g_assert(g_tree_remove(
@@ -646,7 +664,6 @@ static DBusHandlerResult request(DBusConnection *con, DBusMessage *req,
 	} else if (!strcmp(member, MAFW_PLAYLIST_METHOD_DUP_PLAYLIST)) {
                 const gchar *new_name = NULL;
                 Pls *pls, *new_pls;
-                int i;
 		guint src_id;
 
                 mafw_dbus_parse(req, DBUS_TYPE_UINT32, &src_id,
@@ -679,33 +696,7 @@ static DBusHandlerResult request(DBusConnection *con, DBusMessage *req,
                         goto out;
 		 }
 		/* copy the plst*/
-                new_pls = pls_new(Last_id++, new_name);
-                new_pls->shuffled = pls->shuffled;
-                new_pls->alloc = pls->alloc ;
-                new_pls->len = pls->len ;
-		new_pls->poolst = new_pls->poolst;
-                new_pls->vidx = g_realloc(new_pls->vidx, new_pls->alloc *
-                                          sizeof(*new_pls->vidx));
-                for (i = 0; i < pls->len; ++i) {
-                         new_pls->vidx[i] = g_strdup(pls->vidx[i]);
-                }
-
-                if (new_pls->shuffled) {
-                        new_pls->pidx =
-                                g_realloc(new_pls->pidx,
-                                          new_pls->alloc*sizeof(*new_pls->pidx));
-                        new_pls->iidx =
-                                g_realloc(new_pls->iidx,
-                                          new_pls->alloc*sizeof(*new_pls->iidx));
-
-                        for (i = 0; i < pls->len; ++i) {
-                                new_pls->pidx[i] = pls->pidx[i];
-                                new_pls->iidx[i] = pls->iidx[i];
-                        }
-
-                }
-
-                pls_set_repeat(new_pls, pls->repeat);
+                new_pls = pls_dup(pls, Last_id++, new_name);
                 g_tree_insert(Playlists, GUINT_TO_POINTER(new_pls->id),
 				new_pls);
                 g_tree_insert(Playlists_by_name, g_strdup(new_pls->name),
@@ -165,6 +165,8 @@ static GQueue Expected_messages = G_QUEUE_INIT;
 static GQueue Replies = G_QUEUE_INIT;
 /* Incoming messages. */
 static GQueue Incoming_messages = G_QUEUE_INIT;
+/* What dbus_connection_get_outgoing_size() returns. */
+static long Outgoing_size;
 
 /* The handler function, its data and free func,
  * as set by dbus_connection_add_filter. */
@@ -245,6 +247,16 @@ void mockbus_reset(void)
 	stored_notify.func = NULL;
 	stored_notify.udata = NULL;
 	stored_notify.free_udata = NULL;
+	Outgoing_size = 0;
+}
+
+/*
+ * Sets what dbus_connection_get_outgoing_size() returns, to pretend that
+ * the peer is slow to read our messages.
+ */
+void mockbus_outgoing_size(long size)
+{
+	Outgoing_size = size;
 }
 
 /*
@@ -715,6 +727,13 @@ dbus_bool_t dbus_connection_send(DBusConnection *connection,
 	return TRUE;
 }
 
+long dbus_connection_get_outgoing_size(DBusConnection *connection)
+{
+	fail_unless(connection == Mockbus_conn || connection == Mockbus_bus,
+		    "MOCKBUS: invalid connection");
+	return Outgoing_size;
+}
+
 /* TODO mock all pending call funcs too */
 dbus_bool_t dbus_pending_call_get_completed(DBusPendingCall *pending)
 {
@@ -39,6 +39,7 @@ extern gboolean mockbus_deliver(DBusConnection *conn);
 extern void mockbus_finish(void);
 extern void mockbus_error(GQuark domain, guint code, const gchar *message);
 extern void mockbus_send_stored_reply(void);
+extern void mockbus_outgoing_size(long size);
 
 /*
  * Similar to mafw_dbus_reply().
@@ -24,6 +24,7 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <checkmore.h>
 #include "mafw-playlist-daemon/mpd-internal.h"
 
@@ -69,13 +70,16 @@ static Pls *mkpls(struct item items[])
         }
 
         if (shuffled) {
+                guint *pidx;
+
                 pls_shuffle(p);
 
+                pidx = g_new(guint, p->len);
                 for (i = 0; items[i].oid; ++i) {
-                        p->pidx[i] = items[i].pidx;
-                        p->iidx[items[i].pidx] = i;
+                        pidx[i] = items[i].pidx;
                 }
-                p->poolst = i;
+                fail_unless(pls_set_order(p, pidx, i));
+                g_free(pidx);
         }
 
 	return p;
@@ -94,18 +98,18 @@ static void assert_pls(Pls *pls, struct item items[])
 			break;
                 }
                 /* Check oid */
-		fail_if(strcmp(pls->vidx[i], items[i].oid),
+		fail_if(strcmp(pls_oid(pls, i), items[i].oid),
 			"oid mismatch at %u. '%s' != '%s'",
-			i, items[i].oid, pls->vidx[i]);
+			i, items[i].oid, pls_oid(pls, i));
 		/* -1 means, that should not be checked, as it is random */
 		if (items[i].pidx != -1) {
                         if (pls->shuffled) {
-                                fail_unless(items[i].pidx == pls->pidx[i],
+                                fail_unless(items[i].pidx == pls_pidx(pls, i),
                                             "pidx mismatch at %u: actual %u expected %u.",
-                                            i, pls->pidx[i], items[i].pidx);
-                                fail_unless(pls->iidx[pls->pidx[i]] == i,
+                                            i, pls_pidx(pls, i), items[i].pidx);
+                                fail_unless(pls_iidx(pls, pls_pidx(pls, i)) == i,
                                             "iidx mismatch at %u: actual %u expected %u.",
-                                            pls->pidx[i], pls->iidx[pls->pidx[i]], i);
+                                            pls_pidx(pls, i), pls_iidx(pls, pls_pidx(pls, i)), i);
                         } else {
                                 fail_unless(items[i].pidx == i,
                                             "pidx mismatch at %u: actual %u expected %u.",
@@ -128,12 +132,12 @@ static void assert_pls(Pls *pls, struct item items[])
                 if (pls->shuffled) {
                         for (; i < pls->len; ++i) {
                                 fprintf(stderr, "%u %u '%s'\n",
-                                        i, pls->pidx[i], pls->vidx[i]);
+                                        i, pls_pidx(pls, i), pls_oid(pls, i));
                         }
                 } else {
                         for (; i < pls->len; ++i) {
                                 fprintf(stderr, "%u %u '%s'\n",
-                                        i, i, pls->vidx[i]);
+                                        i, i, pls_oid(pls, i));
                         }
                 }
 		fail("expected less elements");
@@ -286,9 +290,9 @@ START_TEST(test_insert)
 	for (i=0; i<4; i++)
 	{
 		/* if it points to the first item, it should not be checked */
-		if (p->pidx[i] != 0)
+		if (pls_pidx(p, i) != 0)
 		{
-			fail_if(p->pidx[i] != index_table[j]);
+			fail_if(pls_pidx(p, i) != index_table[j]);
 			j++;
 		}
 	}
@@ -296,7 +300,7 @@ START_TEST(test_insert)
 	/* Get the new order */
 	for (i=0; i<4; i++)
 	{
-		index_table[i] = p->pidx[i];
+		index_table[i] = pls_pidx(p, i);
 	}
 
 	fail_unless(pls_insert(p, 4, "the last"));
@@ -309,9 +313,9 @@ START_TEST(test_insert)
 	j = 0;
 	for (i=0; i<5; i++)
 	{
-		if (p->pidx[i] != 4)
+		if (pls_pidx(p, i) != 4)
 		{
-			fail_if(p->pidx[i] != index_table[j]);
+			fail_if(pls_pidx(p, i) != index_table[j]);
 			j++;
 		}
 	}
@@ -625,12 +629,248 @@ START_TEST(test_save)
 }
 END_TEST
 
+/* Round-trip a shuffled playlist through the binary format, and see that the
+ * loaded one can be edited. */
+START_TEST(test_save_shuffled)
+{
+	Pls *p1, *p2;
+	guint i, idx;
+	gchar name[16], *oid;
+
+	unlink("tale.mp");
+	p1 = pls_new(45, "shuffled tale");
+	for (i = 0; i < 30; ++i) {
+		sprintf(name, "item_%02u", i);
+		pls_append(p1, name);
+	}
+	pls_set_repeat(p1, TRUE);
+	pls_shuffle(p1);
+	/* Play a few, so that the pool start is somewhere in the middle. */
+	pls_get_starting(p1, &idx, &oid);
+	g_free(oid);
+	for (i = 0; i < 10; ++i) {
+		fail_unless(pls_get_next(p1, &idx, &oid));
+		g_free(oid);
+	}
+	fail_unless(pls_save(p1, "tale.mp"));
+	p2 = pls_load("tale.mp");
+	fail_if(p2 == NULL);
+	fail_unless(p2->repeat == p1->repeat);
+	fail_unless(p2->shuffled == p1->shuffled);
+	fail_unless(p2->poolst == p1->poolst);
+	fail_unless(p2->len == p1->len);
+	for (i = 0; i < p1->len; ++i) {
+		fail_if(strcmp(pls_oid(p2, i), pls_oid(p1, i)));
+		fail_unless(pls_pidx(p2, i) == pls_pidx(p1, i));
+	}
+	fail_unless(pls_check(p2));
+
+	/* A loaded playlist can be edited and saved over its own file. */
+	fail_unless(pls_remove(p2, 3));
+	fail_unless(pls_insert(p2, 0, "fresh"));
+	fail_unless(pls_save(p2, "tale.mp"));
+	fail_if(strcmp(pls_oid(p2, 0), "fresh"));
+	fail_if(strcmp(pls_oid(p2, 1), "item_00"));
+	fail_unless(pls_check(p2));
+	pls_free(p2);
+
+	p2 = pls_load("tale.mp");
+	fail_if(p2 == NULL);
+	fail_unless(p2->len == 30);
+	fail_if(strcmp(pls_oid(p2, 0), "fresh"));
+	fail_if(strcmp(pls_oid(p2, 4), "item_04"));
+	pls_free(p1);
+	pls_free(p2);
+}
+END_TEST
+
+/* Text playlists of earlier versions are still loaded. */
+START_TEST(test_load_v2)
+{
+	Pls *p;
+	gchar *buf;
+
+	g_file_set_contents("tale.mp",
+			    "V2\n"
+			    "123\n"
+			    "old one\n"
+			    "1\n"
+			    "1\n"
+			    "3\n"
+			    "1\n"
+			    "2,alma\n"
+			    "0,korte\n"
+			    "1,szilva\n"
+			    , -1, NULL);
+	p = pls_load("tale.mp");
+	fail_if(p == NULL);
+	fail_unless(p->id == 123);
+	fail_if(strcmp(p->name, "old one"));
+	fail_unless(p->shuffled);
+	fail_unless(p->poolst == 1);
+	assert_pls(p, APLS({2, "alma"}, {0, "korte"}, {1, "szilva"}));
+
+	/* And migrated to the binary format when saved. */
+	fail_unless(pls_save(p, "tale.mp"));
+	pls_free(p);
+	fail_unless(g_file_get_contents("tale.mp", &buf, NULL, NULL));
+	fail_unless(g_str_has_prefix(buf, "V3\n"));
+	g_free(buf);
+	p = pls_load("tale.mp");
+	fail_if(p == NULL);
+	fail_unless(p->poolst == 1);
+	assert_pls(p, APLS({2, "alma"}, {0, "korte"}, {1, "szilva"}));
+	pls_free(p);
+}
+END_TEST
+
+/* Edits after a snapshot go to the journal, and are replayed when loading. */
+START_TEST(test_journal)
+{
+	Pls *p1, *p2;
+	struct stat sb;
+	guint i, idx;
+	gchar name[16], *oid;
+	off_t snapshot;
+
+	unlink("tale.mp");
+	unlink("tale.mp" PLS_JOURNAL_SUFFIX);
+	p1 = pls_new(46, "journaled tale");
+	for (i = 0; i < 200; ++i) {
+		sprintf(name, "item_%03u", i);
+		pls_append(p1, name);
+	}
+	/* The first save is always a snapshot. */
+	fail_unless(pls_sync(p1, "tale.mp"));
+	fail_unless(stat("tale.mp" PLS_JOURNAL_SUFFIX, &sb) == -1);
+	fail_unless(stat("tale.mp", &sb) == 0);
+	snapshot = sb.st_size;
+
+	pls_insert(p1, 5, "inserted");
+	pls_remove(p1, 0);
+	pls_move(p1, 10, 2);
+	pls_set_repeat(p1, TRUE);
+	pls_set_name(p1, "renamed tale");
+	/* Renderers using the playlist are not persistent. */
+	pls_set_use_count(p1, 2);
+	pls_shuffle(p1);
+	pls_get_starting(p1, &idx, &oid);
+	g_free(oid);
+	for (i = 0; i < 5; ++i) {
+		fail_unless(pls_get_next(p1, &idx, &oid));
+		g_free(oid);
+	}
+	fail_unless(pls_sync(p1, "tale.mp"));
+	/* The snapshot is left alone. */
+	fail_unless(stat("tale.mp", &sb) == 0);
+	fail_unless(sb.st_size == snapshot);
+	fail_unless(stat("tale.mp" PLS_JOURNAL_SUFFIX, &sb) == 0);
+
+	p2 = pls_load("tale.mp");
+	fail_if(p2 == NULL);
+	fail_if(strcmp(p2->name, "renamed tale"));
+	fail_unless(p2->repeat);
+	fail_unless(p2->use_count == 0);
+	fail_unless(p2->shuffled);
+	fail_unless(p2->poolst == p1->poolst);
+	fail_unless(p2->len == p1->len);
+	for (i = 0; i < p1->len; ++i) {
+		fail_if(strcmp(pls_oid(p2, i), pls_oid(p1, i)));
+		fail_unless(pls_pidx(p2, i) == pls_pidx(p1, i));
+	}
+	fail_unless(pls_check(p2));
+	pls_free(p2);
+
+	/* Once the journal outgrows the snapshot, it is compacted. */
+	for (i = 0; i < 400; ++i) {
+		pls_move(p1, 0, p1->len - 1);
+	}
+	fail_unless(pls_sync(p1, "tale.mp"));
+	fail_unless(stat("tale.mp" PLS_JOURNAL_SUFFIX, &sb) == -1);
+	p2 = pls_load("tale.mp");
+	fail_if(p2 == NULL);
+	for (i = 0; i < p1->len; ++i) {
+		fail_if(strcmp(pls_oid(p2, i), pls_oid(p1, i)));
+	}
+	pls_free(p2);
+	pls_free(p1);
+}
+END_TEST
+
+/* A journal left over from an earlier snapshot is ignored. */
+START_TEST(test_journal_stale)
+{
+	Pls *p;
+
+	unlink("tale.mp" PLS_JOURNAL_SUFFIX);
+	p = pls_new(47, "stale");
+	pls_append(p, "alma");
+	fail_unless(pls_sync(p, "tale.mp"));
+	pls_append(p, "korte");
+	fail_unless(pls_sync(p, "tale.mp"));
+	rename("tale.mp" PLS_JOURNAL_SUFFIX, "stale" PLS_JOURNAL_SUFFIX);
+	fail_unless(pls_save(p, "tale.mp"));
+	pls_free(p);
+	rename("stale" PLS_JOURNAL_SUFFIX, "tale.mp" PLS_JOURNAL_SUFFIX);
+
+	p = pls_load("tale.mp");
+	fail_if(p == NULL);
+	assert_pls(p, APLS({0, "alma"}, {1, "korte"}));
+	pls_free(p);
+	unlink("tale.mp" PLS_JOURNAL_SUFFIX);
+}
+END_TEST
+
+START_TEST(test_oidpool)
+{
+	OidPoolStats st0, st1;
+	Pls *p1, *p2;
+
+	oidpool_stats(&st0);
+	p1 = pls_new(48, "pool1");
+	p2 = pls_new(49, "pool2");
+	pls_append(p1, "alma");
+	pls_append(p1, "korte");
+	pls_append(p1, "alma");
+	pls_append(p2, "korte");
+
+	/* Equal object ids share storage. */
+	fail_unless(pls_oid(p1, 0) == pls_oid(p1, 2));
+	fail_unless(pls_oid(p1, 1) == pls_oid(p2, 0));
+	fail_if(pls_oid(p1, 0) == pls_oid(p1, 1));
+	oidpool_stats(&st1);
+	fail_unless(st1.unique == st0.unique + 2);
+	fail_unless(st1.refs == st0.refs + 4);
+	fail_unless(st1.saved == st0.saved + sizeof("alma") + sizeof("korte"));
+
+	/* And survive as long as anybody refers to them. */
+	pls_free(p1);
+	assert_pls(p2, APLS({0, "korte"}));
+	oidpool_stats(&st1);
+	fail_unless(st1.unique == st0.unique + 1);
+	fail_unless(st1.refs == st0.refs + 1);
+	fail_unless(st1.saved == st0.saved);
+
+	fail_unless(pls_save(p2, "pool.mp"));
+	p1 = pls_load("pool.mp");
+	fail_if(p1 == NULL);
+	fail_unless(pls_oid(p1, 0) == pls_oid(p2, 0));
+	pls_free(p1);
+	pls_free(p2);
+	oidpool_stats(&st1);
+	fail_unless(st1.unique == st0.unique);
+	fail_unless(st1.refs == st0.refs);
+	fail_unless(st1.bytes == st0.bytes);
+	unlink("pool.mp");
+}
+END_TEST
+
 START_TEST(stress_persist)
 {
 #ifndef __ARMEL__
 	GTimeVal t0, t1;
 	gchar name[64];
-	Pls *p1;
+	Pls *p1, *p2;
 	guint i;
 	gulong usec;
 
@@ -648,11 +888,66 @@ START_TEST(stress_persist)
 	usec =  (t1.tv_sec * G_USEC_PER_SEC + t1.tv_usec) -
 		(t0.tv_sec * G_USEC_PER_SEC + t0.tv_usec);
 	fail_unless(usec < (20*150*1000));
+	p2 = pls_load("p1.mp");
+	fail_if(p2 == NULL);
+	fail_unless(p2->len == 20000);
+	fail_if(strcmp(pls_oid(p2, 19999), pls_oid(p1, 19999)));
+	pls_free(p2);
 	pls_free(p1);
 #endif
 }
 END_TEST
 
+/* Does $rounds random edits on a shuffled playlist of $len elements and
+ * returns the number of tree nodes they touched. */
+static guint edit_cost(guint len, guint rounds)
+{
+	gchar name[64], *oid;
+	Pls *p1;
+	guint i, idx, updates;
+
+	p1 = pls_new(667, "secondborn");
+	for (i = 0; i < len; ++i) {
+		sprintf(name, "alonguuid::some/long/item_%02u", i);
+		pls_append(p1, name);
+	}
+	pls_shuffle(p1);
+	pls_get_starting(p1, &idx, &oid);
+	g_free(oid);
+	updates = Node_updates;
+	for (i = 0; i < rounds; ++i) {
+		fail_unless(pls_insert(p1, g_random_int_range(0, p1->len),
+				       "inserted"));
+		fail_unless(pls_move(p1, g_random_int_range(0, p1->len),
+				     g_random_int_range(0, p1->len)));
+		fail_unless(pls_remove(p1, g_random_int_range(0, p1->len)));
+		fail_unless(pls_get_next(p1, &idx, &oid));
+		g_free(oid);
+	}
+	updates = Node_updates - updates;
+	fail_unless(p1->len == len);
+	fail_unless(pls_check(p1));
+	pls_free(p1);
+	return updates;
+}
+
+/* Edits in the middle of a long shuffled playlist shouldn't cost in proportion
+ * to its length: ten times the elements should cost well under ten times the
+ * work (it's about 1.3 times, log(20000)/log(2000), expected). */
+START_TEST(stress_edit)
+{
+#ifndef __ARMEL__
+	guint small, large;
+
+	small = edit_cost(2000, 1000);
+	large = edit_cost(20000, 1000);
+	fail_unless(large < 3 * small,
+		    "edits cost %u on 2000 elements, %u on 20000",
+		    small, large);
+#endif
+}
+END_TEST
+
 /* Feed junk to pls_load(). */
 START_TEST(fuzz_load)
 {
@@ -747,6 +1042,20 @@ START_TEST(fuzz_load)
 	 * $len says. */
 	fail_unless((p = pls_load("junk")) != NULL);
 	pls_free(p);
+	g_file_set_contents("junk",
+			    "V3\n"
+			    "a text file claiming to be binary\n"
+			    , -1, NULL);
+	fail_if(pls_load("junk") != NULL);
+
+	/* Truncated binary playlist. */
+	p = pls_new(7, "truncated");
+	pls_append(p, "alma");
+	pls_append(p, "korte");
+	fail_unless(pls_save(p, "junk"));
+	pls_free(p);
+	truncate("junk", 60);
+	fail_if(pls_load("junk") != NULL);
 	unlink("junk");
 }
 END_TEST
@@ -928,7 +1237,13 @@ int main(void)
 	if (1) tcase_add_test(tc, test_create);
 	if (1) tcase_add_test(tc, test_dirty);
 	if (1) tcase_add_test(tc, test_save);
+	if (1) tcase_add_test(tc, test_save_shuffled);
+	if (1) tcase_add_test(tc, test_load_v2);
+	if (1) tcase_add_test(tc, test_journal);
+	if (1) tcase_add_test(tc, test_journal_stale);
+	if (1) tcase_add_test(tc, test_oidpool);
 	if (1) tcase_add_test(tc, stress_persist);
+	if (1) tcase_add_test(tc, stress_edit);
 	if (1) tcase_add_test(tc, fuzz_load);
 	/* The following two tests take longer time. */
 	if (1) tcase_add_test(tc, test_dirty_timer);
@@ -69,10 +69,19 @@
 
 static GMainLoop *Mainloop;
 
+static void discovery_complete(MafwRegistry *reg,
+			       const MafwSharedDiscoveryStats *stats,
+			       MafwSharedDiscoveryStats *result)
+{
+	*result = *stats;
+	g_main_loop_quit(Mainloop);
+}
+
 START_TEST(test_construct_nonempty)
 {
 	MafwRegistry *reg;
 	gpointer extension;
+	MafwSharedDiscoveryStats stats = { 0 };
 	const gchar *extensions[] = {FAKE_RENDERER_SERVICE,
 				FAKE_SOURCE_SERVICE,
 				NULL};
@@ -103,6 +112,58 @@ START_TEST(test_construct_nonempty)
 	fail_if(strcmp("fake", mafw_extension_get_plugin(extension)));
 	fail_if(strcmp(FAKE_SOURCE_NAME, mafw_extension_get_uuid(extension)));
 	fail_if(strcmp(FAKE_NAME, mafw_extension_get_name(extension)));
+
+	/* Completion is reported from the main loop. */
+	g_signal_connect(reg, "discovery-complete",
+			 G_CALLBACK(discovery_complete), &stats);
+	g_main_loop_run(Mainloop);
+	fail_if(stats.nnames != 2);
+	fail_if(stats.nextensions != 2);
+	fail_if(stats.total_time < stats.list_time);
+
+	mafw_shared_deinit();
+	g_object_unref(reg);
+	mockbus_finish();
+}
+END_TEST
+
+/* An extension disappearing while its proxy is being attached must not
+ * hold up the completion of the discovery. */
+START_TEST(test_vanish_during_discovery)
+{
+	MafwRegistry *reg;
+	MafwSharedDiscoveryStats stats = { 0 };
+	const gchar *extensions[] = {FAKE_RENDERER_SERVICE, NULL};
+
+	mock_services(extensions);
+	/* list_properties is left unanswered */
+	mockbus_expect(mafw_dbus_method_full(FAKE_RENDERER_SERVICE,
+					     FAKE_RENDERER_OBJECT,
+					     MAFW_EXTENSION_INTERFACE,
+					     MAFW_EXTENSION_METHOD_GET_NAME));
+	mockbus_reply(MAFW_DBUS_STRING(FAKE_NAME));
+	mockbus_expect(mafw_dbus_method_full(FAKE_RENDERER_SERVICE,
+					     FAKE_RENDERER_OBJECT,
+					     MAFW_EXTENSION_INTERFACE,
+					     MAFW_EXTENSION_METHOD_LIST_PROPERTIES));
+
+	mafw_shared_deinit();
+	reg = g_object_new(MAFW_TYPE_REGISTRY, NULL);
+	fail_unless(mafw_shared_init(reg, NULL));
+	fail_if(g_list_length(mafw_registry_get_renderers(reg)) != 0);
+
+	g_signal_connect(reg, "discovery-complete",
+			 G_CALLBACK(discovery_complete), &stats);
+	mock_disappearing_extension(FAKE_RENDERER_SERVICE, TRUE);
+	g_timeout_add(3000, (GSourceFunc)g_main_loop_quit, Mainloop);
+	g_main_loop_run(Mainloop);
+	fail_if(stats.nnames != 1, "discovery-complete was not emitted");
+
+	/* Answer the call still pending, for a clean mockbus_finish(). */
+	mockbus_reply(MAFW_DBUS_STRVZ(NULL),
+		      MAFW_DBUS_C_ARRAY(UINT32, guint));
+	mockbus_send_stored_reply();
+
 	mafw_shared_deinit();
 	g_object_unref(reg);
 	mockbus_finish();
@@ -214,6 +275,7 @@ int main(void)
 	suite_add_tcase(suite, tc);
 if (1)	tcase_add_test(tc, test_construct_nonempty);
 if (1)	tcase_add_test(tc, test_registration);
+if (1)	tcase_add_test(tc, test_vanish_during_discovery);
 	tcase_add_checked_fixture(tc, setup, teardown);
 
 	return checkmore_run(srunner_create(suite), FALSE);
@@ -333,6 +333,78 @@ START_TEST(test_get_size)
 }
 END_TEST
 
+START_TEST(test_cache)
+{
+	gchar *item, **items;
+	guint i;
+
+	mafw_proxy_playlist_set_cache_window(MAFW_PROXY_PLAYLIST(g_playlist),
+					     3);
+	for (i = 0; i < PLS_SIZE; i++)
+		mafw_playlist_append_item(g_playlist, Contents[i], NULL);
+	fail_if(mafw_playlist_get_size(g_playlist, NULL) != PLS_SIZE);
+
+	/* Read it forward and backward, crossing the windows. */
+	for (i = 0; i < PLS_SIZE; i++) {
+		item = mafw_playlist_get_item(g_playlist, i, NULL);
+		fail_if(strcmp(item, Contents[i]));
+		g_free(item);
+	}
+	fail_if(mafw_playlist_get_item(g_playlist, PLS_SIZE, NULL) != NULL);
+	for (i = PLS_SIZE; i > 0; i--) {
+		item = mafw_playlist_get_item(g_playlist, i - 1, NULL);
+		fail_if(strcmp(item, Contents[i - 1]));
+		g_free(item);
+	}
+
+	/* Ranges, including one clipped at the end. */
+	items = mafw_playlist_get_items(g_playlist, 1, 3, NULL);
+	fail_if(g_strv_length(items) != 3);
+	fail_if(strcmp(items[0], Contents[1]) || strcmp(items[2], Contents[3]));
+	g_strfreev(items);
+	items = mafw_playlist_get_items(g_playlist, PLS_SIZE - 2, PLS_SIZE + 5,
+					NULL);
+	fail_if(g_strv_length(items) != 2);
+	fail_if(strcmp(items[1], Contents[PLS_SIZE - 1]));
+	g_strfreev(items);
+
+	/* The cache must follow our changes. */
+	mafw_playlist_remove_item(g_playlist, 2, NULL);
+	fail_if(mafw_playlist_get_size(g_playlist, NULL) != PLS_SIZE - 1);
+	item = mafw_playlist_get_item(g_playlist, 2, NULL);
+	fail_if(strcmp(item, Contents[3]));
+	g_free(item);
+
+	mafw_playlist_move_item(g_playlist, 0, 4, NULL);
+	item = mafw_playlist_get_item(g_playlist, 0, NULL);
+	fail_if(strcmp(item, Contents[1]));
+	g_free(item);
+	item = mafw_playlist_get_item(g_playlist, 4, NULL);
+	fail_if(strcmp(item, Contents[0]));
+	g_free(item);
+
+	mafw_playlist_insert_item(g_playlist, 1, "item 1", NULL);
+	item = mafw_playlist_get_item(g_playlist, 1, NULL);
+	fail_if(strcmp(item, "item 1"));
+	g_free(item);
+
+	/* The signals of our changes come later and must not confuse it. */
+	while (g_main_context_iteration(NULL, FALSE))
+		/* NOP */;
+	item = mafw_playlist_get_item(g_playlist, 1, NULL);
+	fail_if(strcmp(item, "item 1"));
+	g_free(item);
+	fail_if(mafw_playlist_get_size(g_playlist, NULL) != PLS_SIZE);
+
+	mafw_playlist_clear(g_playlist, NULL);
+	fail_if(mafw_playlist_get_size(g_playlist, NULL) != 0);
+	fail_if(mafw_playlist_get_item(g_playlist, 0, NULL) != NULL);
+
+	mafw_proxy_playlist_set_cache_window(MAFW_PROXY_PLAYLIST(g_playlist),
+					     0);
+}
+END_TEST
+
 START_TEST(test_iterator)
 {
 	guint new_idx = 2;
@@ -1211,6 +1283,7 @@ int main(void)
 	tcase_add_test(tc, test_clear);
 	tcase_add_test(tc, test_set_get_name);
 	tcase_add_test(tc, test_get_size);
+	tcase_add_test(tc, test_cache);
 	tcase_add_test(tc, test_remove_items);
 	tcase_add_test(tc, test_move_item);
 	tcase_add_test(tc, test_set_get_repeat);
@@ -335,6 +335,124 @@ START_TEST(test_metadatas)
 }
 END_TEST
 
+static void count_metadata_result(MafwSource *self, const gchar *object_id,
+				  GHashTable *md, gpointer user_data,
+				  const GError *error)
+{
+	fail_if(error != NULL);
+	fail_unless(md != NULL);
+	fail_unless(mafw_metadata_first(md, "title") != NULL);
+	(*(gint *)user_data)++;
+}
+
+static void count_metadatas_result(MafwSource *self, GHashTable *metadatas,
+				   gpointer user_data, const GError *error)
+{
+	fail_if(error != NULL);
+	fail_unless(metadatas != NULL);
+	fail_unless(g_hash_table_size(metadatas) == 3);
+	fail_unless(g_hash_table_lookup(metadatas, "testobject") != NULL);
+	fail_unless(g_hash_table_lookup(metadatas, "testobject1") != NULL);
+	fail_unless(g_hash_table_lookup(metadatas, "testobject2") != NULL);
+	(*(gint *)user_data)++;
+}
+
+START_TEST(test_metadata_cache)
+{
+	MafwProxySource *sp;
+	GHashTable *metadata;
+	DBusMessage *req;
+	const gchar *objlist[] = {"testobject", "testobject1", "testobject2",
+					NULL};
+	gint called;
+	guint hits, misses;
+
+	mockbus_reset();
+	mock_empty_props(MAFW_DBUS_DESTINATION, MAFW_DBUS_PATH);
+
+	sp = MAFW_PROXY_SOURCE(mafw_proxy_source_new(SOURCE_UUID, "fake",
+				mafw_registry_get_instance()));
+	mafw_proxy_source_set_metadata_cache_size(sp, 8);
+	metadata = mockbus_mkmeta("title", "Less than you", NULL);
+
+	/* The first request goes to the source... */
+	mockbus_expect(mafw_dbus_method(MAFW_SOURCE_METHOD_GET_METADATA,
+			       MAFW_DBUS_STRING("testobject"),
+			       MAFW_DBUS_C_STRVZ("album", "title")));
+	mockbus_reply(MAFW_DBUS_METADATA(metadata));
+	called = 0;
+	mafw_source_get_metadata(MAFW_SOURCE(sp), "testobject",
+				 MAFW_SOURCE_LIST("album", "title"),
+				 count_metadata_result, &called);
+	fail_unless(called == 1);
+
+	/* ...the same keys in any order come from the cache, but still
+	 * asynchronously. */
+	mafw_source_get_metadata(MAFW_SOURCE(sp), "testobject",
+				 MAFW_SOURCE_LIST("title", "album"),
+				 count_metadata_result, &called);
+	fail_unless(called == 1);
+	while (called < 2)
+		g_main_context_iteration(NULL, TRUE);
+
+	/* Only the objects not in the cache are asked for. */
+	mockbus_expect(req =
+		mafw_dbus_method(MAFW_SOURCE_METHOD_GET_METADATAS,
+				 MAFW_DBUS_C_STRVZ("testobject1",
+						   "testobject2"),
+				 MAFW_DBUS_C_STRVZ("album", "title")));
+	mockbus_reply_msg(mdatas_repl(req, objlist + 1, metadata, FALSE));
+	called = 0;
+	mafw_source_get_metadatas(MAFW_SOURCE(sp), objlist,
+				  MAFW_SOURCE_LIST("album", "title"),
+				  count_metadatas_result, &called);
+	fail_unless(called == 1);
+
+	mafw_source_get_metadatas(MAFW_SOURCE(sp), objlist,
+				  MAFW_SOURCE_LIST("album", "title"),
+				  count_metadatas_result, &called);
+	while (called < 2)
+		g_main_context_iteration(NULL, TRUE);
+
+	/* metadata-changed drops the object... */
+	mockbus_incoming(mafw_dbus_signal(MAFW_SOURCE_SIGNAL_METADATA_CHANGED,
+					  MAFW_DBUS_STRING("testobject1")));
+	mockbus_deliver(NULL);
+	mockbus_expect(req =
+		mafw_dbus_method(MAFW_SOURCE_METHOD_GET_METADATAS,
+				 MAFW_DBUS_C_STRVZ("testobject1"),
+				 MAFW_DBUS_C_STRVZ("album", "title")));
+	mockbus_reply_msg(mdatas_repl(req, objlist + 1, metadata, FALSE));
+	mafw_source_get_metadatas(MAFW_SOURCE(sp), objlist,
+				  MAFW_SOURCE_LIST("album", "title"),
+				  count_metadatas_result, &called);
+	fail_unless(called == 3);
+
+	/* ...container-changed everything. */
+	mockbus_incoming(mafw_dbus_signal(MAFW_SOURCE_SIGNAL_CONTAINER_CHANGED,
+					  MAFW_DBUS_STRING("testcontainer")));
+	mockbus_deliver(NULL);
+	mockbus_expect(mafw_dbus_method(MAFW_SOURCE_METHOD_GET_METADATA,
+			       MAFW_DBUS_STRING("testobject"),
+			       MAFW_DBUS_C_STRVZ("album", "title")));
+	mockbus_reply(MAFW_DBUS_METADATA(metadata));
+	called = 0;
+	mafw_source_get_metadata(MAFW_SOURCE(sp), "testobject",
+				 MAFW_SOURCE_LIST("album", "title"),
+				 count_metadata_result, &called);
+	fail_unless(called == 1);
+
+	mafw_proxy_source_get_metadata_cache_stats(sp, &hits, &misses);
+	fail_unless(hits == 7, "hits: %u", hits);
+	fail_unless(misses == 5, "misses: %u", misses);
+
+	mafw_metadata_release(metadata);
+	mafw_registry_remove_extension(mafw_registry_get_instance(),
+                                        (gpointer)sp);
+	mockbus_finish();
+}
+END_TEST
+
 START_TEST(test_browse)
 {
 	MafwProxySource *sp = NULL;
@@ -936,6 +1054,7 @@ static Suite *mafw_proxy_source_suite_new(void)
 					      test_cancel_browse_invalid), 5);
 	checkmore_add_tcase(suite, "Metadata", test_metadata);
 	checkmore_add_tcase(suite, "Metadatas", test_metadatas);
+	checkmore_add_tcase(suite, "Metadata cache", test_metadata_cache);
 	checkmore_add_tcase(suite, "Create object",  test_object_creation);
 	checkmore_add_tcase(suite, "Destroy object", test_object_destruction);
 	checkmore_add_tcase(suite, "Set metadata", test_set_metadata);
@@ -78,6 +78,7 @@ START_TEST(test_rendererwrapper)
 	MafwRegistry *reg;
 	DBusMessage *c, *listpl;
 	GValueArray *value;
+	GHashTable *mdata;
 	GValue v = {0};
 	gpointer pl = mafw_proxy_playlist_new(3);
 
@@ -125,6 +126,15 @@ START_TEST(test_rendererwrapper)
 	g_signal_emit_by_name(G_OBJECT(renderer), "metadata_changed", "date",
 				value);
 
+	/* A batch goes out as a single signal, not one per key. */
+	mdata = mockbus_mkmeta(MAFW_METADATA_KEY_TITLE, "foo",
+			       MAFW_METADATA_KEY_ARTIST, "bar",
+			       NULL);
+	mockbus_expect(mafw_dbus_signal(MAFW_RENDERER_SIGNAL_METADATAS_CHANGED,
+					  MAFW_DBUS_METADATA(mdata)));
+	g_signal_emit_by_name(G_OBJECT(renderer), "metadatas-changed", mdata);
+	mafw_metadata_release(mdata);
+
 
 	renderer->get_stat_pl = pl;
 	mockbus_incoming(c = mafw_dbus_method(MAFW_RENDERER_METHOD_GET_STATUS));
@@ -94,6 +94,7 @@ START_TEST(test_source_wrapper)
 	DBusMessageIter iter_array, iter_msg;
 	gint i;
 	const gchar *objlist[] = {"testobject", "testobject1", NULL};
+	GValue v = { 0 };
 
 	metadata = mockbus_mkmeta("title", "Easy", NULL);
 
@@ -127,6 +128,7 @@ START_TEST(test_source_wrapper)
 	mockbus_deliver(NULL);
 	fail_unless(source->browse_called == 1);
 
+	/* Small results are batched into one message. */
 	source->repeat_browse = 25;
 	mockbus_incoming(c = mafw_dbus_method(MAFW_SOURCE_METHOD_BROWSE,
 				      MAFW_DBUS_STRING("testobject"),
@@ -141,9 +143,7 @@ START_TEST(test_source_wrapper)
 		replmsg = append_browse_res(replmsg, &iter_msg, &iter_array,
                                             1408, -1, 0,
                                             "testobject", metadata, "", 0, "");
-	dbus_message_iter_close_container(&iter_msg, &iter_array);
-	mockbus_expect(replmsg);
-	replmsg = append_browse_res(NULL, &iter_msg, &iter_array, 1408, 0, 0,
+	replmsg = append_browse_res(replmsg, &iter_msg, &iter_array, 1408, 0, 0,
                                     "", metadata, "", 0, "");
 	dbus_message_iter_close_container(&iter_msg, &iter_array);
 	mockbus_expect(replmsg);
@@ -152,7 +152,25 @@ START_TEST(test_source_wrapper)
 	mockbus_deliver(NULL);
 	fail_unless(source->browse_called == 2);
 
-	source->repeat_browse = 830;
+	/* Without a byte budget every result goes in its own message. */
+	g_value_init(&v, G_TYPE_UINT);
+	g_value_set_uint(&v, 0);
+	mockbus_incoming(c =
+		mafw_dbus_method_full(MAFW_DBUS_DESTINATION, MAFW_DBUS_PATH,
+				      MAFW_EXTENSION_INTERFACE,
+				      MAFW_EXTENSION_METHOD_SET_PROPERTY,
+				      MAFW_DBUS_STRING(
+					MAFW_WRAPPER_PROPERTY_BROWSE_BATCH_BYTES),
+				      MAFW_DBUS_GVALUE(&v)));
+	mockbus_expect(mafw_dbus_signal_full(NULL, MAFW_DBUS_PATH,
+				MAFW_EXTENSION_INTERFACE,
+				MAFW_EXTENSION_SIGNAL_PROPERTY_CHANGED,
+				MAFW_DBUS_STRING(
+					MAFW_WRAPPER_PROPERTY_BROWSE_BATCH_BYTES),
+				MAFW_DBUS_GVALUE(&v)));
+	mockbus_deliver(NULL);
+
+	source->repeat_browse = 5;
 	mockbus_incoming(c = mafw_dbus_method(MAFW_SOURCE_METHOD_BROWSE,
 				      MAFW_DBUS_STRING("testobject"),
 				      MAFW_DBUS_BOOLEAN(FALSE),
@@ -161,34 +179,61 @@ START_TEST(test_source_wrapper)
 				      MAFW_DBUS_C_STRVZ("title", "artist"),
 				      MAFW_DBUS_UINT32(0),
 				      MAFW_DBUS_UINT32(11)));
-	replmsg = NULL;
-	for (i=0; i<25; i++)
-		replmsg = append_browse_res(replmsg, &iter_msg, &iter_array,
-                                            1408, -1, 0,
-                                            "testobject", metadata, "", 0, "");
-	dbus_message_iter_close_container(&iter_msg, &iter_array);
-	mockbus_expect(replmsg);
-	replmsg = NULL;
-	for (i=0; i<75; i++)
-		replmsg = append_browse_res(replmsg, &iter_msg, &iter_array,
-                                            1408, -1, 0,
-                                            "testobject", metadata, "", 0, "");
-	dbus_message_iter_close_container(&iter_msg, &iter_array);
-	mockbus_expect(replmsg);
-	replmsg = NULL;
-	for (i=0; i<225; i++)
-		replmsg = append_browse_res(replmsg, &iter_msg, &iter_array,
-                                            1408, -1, 0,
-                                            "testobject", metadata, "", 0, "");
-	dbus_message_iter_close_container(&iter_msg, &iter_array);
-	mockbus_expect(replmsg);
-	replmsg = NULL;
-	for (i=0; i<500; i++)
-		replmsg = append_browse_res(replmsg, &iter_msg, &iter_array,
+	for (i=0; i<5; i++) {
+		replmsg = append_browse_res(NULL, &iter_msg, &iter_array,
                                             1408, -1, 0,
                                             "testobject", metadata, "", 0, "");
+		dbus_message_iter_close_container(&iter_msg, &iter_array);
+		mockbus_expect(replmsg);
+	}
+	replmsg = append_browse_res(NULL, &iter_msg, &iter_array, 1408, 0, 0,
+				"", metadata, "", 0, "");
 	dbus_message_iter_close_container(&iter_msg, &iter_array);
 	mockbus_expect(replmsg);
+	mockbus_expect(mafw_dbus_reply(c, MAFW_DBUS_UINT32(1408)));
+
+	mockbus_deliver(NULL);
+	fail_unless(source->browse_called == 3);
+
+	/* A congested bus connection gets fewer, bigger messages. */
+	g_value_set_uint(&v, 4096);
+	mockbus_incoming(c =
+		mafw_dbus_method_full(MAFW_DBUS_DESTINATION, MAFW_DBUS_PATH,
+				      MAFW_EXTENSION_INTERFACE,
+				      MAFW_EXTENSION_METHOD_SET_PROPERTY,
+				      MAFW_DBUS_STRING(
+					MAFW_WRAPPER_PROPERTY_BROWSE_BATCH_BYTES),
+				      MAFW_DBUS_GVALUE(&v)));
+	mockbus_expect(mafw_dbus_signal_full(NULL, MAFW_DBUS_PATH,
+				MAFW_EXTENSION_INTERFACE,
+				MAFW_EXTENSION_SIGNAL_PROPERTY_CHANGED,
+				MAFW_DBUS_STRING(
+					MAFW_WRAPPER_PROPERTY_BROWSE_BATCH_BYTES),
+				MAFW_DBUS_GVALUE(&v)));
+	mockbus_deliver(NULL);
+
+	mockbus_incoming(c =
+		mafw_dbus_method_full(MAFW_DBUS_DESTINATION, MAFW_DBUS_PATH,
+				      MAFW_EXTENSION_INTERFACE,
+				      MAFW_EXTENSION_METHOD_GET_PROPERTY,
+				      MAFW_DBUS_STRING(
+					MAFW_WRAPPER_PROPERTY_BROWSE_BATCH_BYTES)));
+	mockbus_expect(mafw_dbus_reply(c,
+				MAFW_DBUS_STRING(
+					MAFW_WRAPPER_PROPERTY_BROWSE_BATCH_BYTES),
+				MAFW_DBUS_GVALUE(&v)));
+	mockbus_deliver(NULL);
+
+	mockbus_outgoing_size(1 << 20);
+	source->repeat_browse = 5;
+	mockbus_incoming(c = mafw_dbus_method(MAFW_SOURCE_METHOD_BROWSE,
+				      MAFW_DBUS_STRING("testobject"),
+				      MAFW_DBUS_BOOLEAN(FALSE),
+				      MAFW_DBUS_STRING("!(rating=sucks)"),
+				      MAFW_DBUS_STRING("-year"),
+				      MAFW_DBUS_C_STRVZ("title", "artist"),
+				      MAFW_DBUS_UINT32(0),
+				      MAFW_DBUS_UINT32(11)));
 	replmsg = NULL;
 	for (i=0; i<5; i++)
 		replmsg = append_browse_res(replmsg, &iter_msg, &iter_array,
@@ -198,13 +243,14 @@ START_TEST(test_source_wrapper)
 				"", metadata, "", 0, "");
 	dbus_message_iter_close_container(&iter_msg, &iter_array);
 	mockbus_expect(replmsg);
-
 	mockbus_expect(mafw_dbus_reply(c, MAFW_DBUS_UINT32(1408)));
 
 	mockbus_deliver(NULL);
-	fail_unless(source->browse_called == 3);
+	fail_unless(source->browse_called == 4);
+	g_value_unset(&v);
 
-	/* Cancel browse */
+	/* Cancel browse; results held back for the slow client are
+	 * dropped. */
 	source->repeat_browse = 25;
 	source->dont_send_last = TRUE;
 	mockbus_incoming(c = mafw_dbus_method(MAFW_SOURCE_METHOD_BROWSE,
@@ -215,13 +261,6 @@ START_TEST(test_source_wrapper)
 				      MAFW_DBUS_C_STRVZ("title", "artist"),
 				      MAFW_DBUS_UINT32(0),
 				      MAFW_DBUS_UINT32(11)));
-	replmsg = NULL;
-	for (i=0; i<25; i++)
-		replmsg = append_browse_res(replmsg, &iter_msg, &iter_array,
-                                            1408, -1, 0,
-                                            "testobject", metadata, "", 0, "");
-	dbus_message_iter_close_container(&iter_msg, &iter_array);
-	mockbus_expect(replmsg);
 	mockbus_expect(mafw_dbus_reply(c, MAFW_DBUS_UINT32(1408)));
 	mockbus_incoming(c = mafw_dbus_method(MAFW_SOURCE_METHOD_CANCEL_BROWSE,
 					      MAFW_DBUS_UINT32(1408)));
@@ -232,6 +271,7 @@ START_TEST(test_source_wrapper)
 
 	g_timeout_add(100, quit_mainloop_on_tout, NULL);
 	g_main_loop_run(Loop);
+	mockbus_outgoing_size(0);
 
 	mockbus_incoming(c = mafw_dbus_method(MAFW_SOURCE_METHOD_CANCEL_BROWSE,
 					      MAFW_DBUS_UINT32(31337)));
@@ -31,25 +31,169 @@
 #include <hildon-albumart-factory.h>
 #include <gio/gio.h>
 
+/* Files known to exist in a directory holding album-arts or
+ * thumbnails.  The directory is read once, then kept up to date by
+ * monitoring it, so that browsing thousands of items doesn't stat()
+ * every album-art and thumbnail on the main loop. */
+typedef struct {
+        gchar *path;
+        GFileMonitor *monitor;
+        /* Set of file basenames */
+        GHashTable *files;
+} DirCache;
+
+/* ---------------------------- Globals -------------------------- */
+
+/* Directory path -> DirCache, or NULL if it can't be monitored */
+static GHashTable *dir_caches = NULL;
+
+/* ------------------------- Private API ------------------------- */
+
+static void _dir_cache_changed(GFileMonitor *monitor,
+                               GFile *file,
+                               GFile *other_file,
+                               GFileMonitorEvent event_type,
+                               DirCache *dc)
+{
+        gchar *path;
+        gchar *basename;
+
+        path = g_file_get_path(file);
+        if (!path) {
+                return;
+        }
+
+        if (!strcmp(path, dc->path)) {
+                /* The directory itself; if it's gone, so are the
+                 * files. */
+                if (event_type == G_FILE_MONITOR_EVENT_DELETED) {
+                        g_hash_table_remove_all(dc->files);
+                }
+        } else if (event_type == G_FILE_MONITOR_EVENT_CREATED) {
+                g_hash_table_replace(dc->files,
+                                     g_path_get_basename(path),
+                                     GINT_TO_POINTER(TRUE));
+        } else if (event_type == G_FILE_MONITOR_EVENT_DELETED) {
+                basename = g_path_get_basename(path);
+                g_hash_table_remove(dc->files, basename);
+                g_free(basename);
+        }
+        g_free(path);
+}
+
+static DirCache *_dir_cache_new(const gchar *dirname)
+{
+        DirCache *dc;
+        GFile *dir;
+        GDir *gdir;
+        const gchar *name;
+
+        dir = g_file_new_for_path(dirname);
+        dc = g_new0(DirCache, 1);
+        dc->monitor = g_file_monitor_directory(dir, G_FILE_MONITOR_NONE,
+                                               NULL, NULL);
+        g_object_unref(dir);
+        if (!dc->monitor) {
+                g_free(dc);
+                return NULL;
+        }
+        dc->path = g_strdup(dirname);
+        dc->files = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                          g_free, NULL);
+        g_signal_connect(dc->monitor, "changed",
+                         G_CALLBACK(_dir_cache_changed), dc);
+
+        /* Read the directory after starting to monitor it, so that no
+         * change is lost.  It may not exist yet. */
+        gdir = g_dir_open(dirname, 0, NULL);
+        if (gdir) {
+                while ((name = g_dir_read_name(gdir)) != NULL) {
+                        g_hash_table_replace(dc->files, g_strdup(name),
+                                             GINT_TO_POINTER(TRUE));
+                }
+                g_dir_close(gdir);
+        }
+
+        return dc;
+}
+
+static void _dir_cache_free(DirCache *dc)
+{
+        if (!dc) {
+                return;
+        }
+
+        g_signal_handlers_disconnect_by_func(dc->monitor,
+                                             _dir_cache_changed, dc);
+        g_file_monitor_cancel(dc->monitor);
+        g_object_unref(dc->monitor);
+        g_hash_table_unref(dc->files);
+        g_free(dc->path);
+        g_free(dc);
+}
+
+/* Tells whether the file at @path exists, without touching the
+ * filesystem if its directory is monitored already. */
+static gboolean _file_exists(const gchar *path)
+{
+        gchar *dirname, *basename;
+        gpointer dc;
+        gboolean exists;
+
+        if (!dir_caches) {
+                dir_caches = g_hash_table_new_full(
+                        g_str_hash, g_str_equal, g_free,
+                        (GDestroyNotify) _dir_cache_free);
+        }
+
+        dirname = g_path_get_dirname(path);
+        if (!g_hash_table_lookup_extended(dir_caches, dirname, NULL, &dc)) {
+                dc = _dir_cache_new(dirname);
+                g_hash_table_insert(dir_caches, dirname, dc);
+        } else {
+                g_free(dirname);
+        }
+
+        if (dc) {
+                basename = g_path_get_basename(path);
+                exists = g_hash_table_lookup(((DirCache *) dc)->files,
+                                             basename) != NULL;
+                g_free(basename);
+        } else {
+                exists = g_file_test(path, G_FILE_TEST_EXISTS);
+        }
+
+        return exists;
+}
 
 /* ------------------------- Public API ------------------------- */
 
+/* Stops monitoring the album-art and thumbnail directories and forgets
+ * what they hold.  They are read again when next needed. */
+void albumart_deinit(void)
+{
+        if (dir_caches) {
+                g_hash_table_destroy(dir_caches);
+                dir_caches = NULL;
+        }
+}
+
 gchar *albumart_get_thumbnail_uri(const gchar *orig_file_uri,
 				  enum thumbnail_size size)
 {
         gchar *file_uri;
-        GFile *file;
+        gchar *file_path;
 
         if (size == THUMBNAIL_CROPPED) {
                 file_uri = hildon_thumbnail_get_uri(orig_file_uri,
                                                     128, 128, TRUE);
                 /* Check if file doesn't exist */
-                file = g_file_new_for_uri(file_uri);
-                if (!g_file_query_exists(file, NULL)) {
+                file_path = g_filename_from_uri(file_uri, NULL, NULL);
+                if (!file_path || !_file_exists(file_path)) {
                         g_free(file_uri);
                         file_uri = NULL;
                 }
-                g_object_unref(file);
+                g_free(file_path);
         } else {
                 /* Get the original album art */
                 file_uri = albumart_get_album_art_uri(orig_file_uri);
@@ -63,7 +207,6 @@ gchar *albumart_get_album_art_uri(const gchar *album)
 	gchar *file_uri;
         gchar *file_path;
 	gchar *album_key;
-        GFile *file;
 
 	if (util_tracker_value_is_unknown(album)) {
                 return NULL;
@@ -73,16 +216,14 @@ gchar *albumart_get_album_art_uri(const gchar *album)
 
 	/* Get the path to the album-art */
 	file_path = hildon_albumart_get_path(NULL, album_key, "album");
-        file_uri = g_filename_to_uri(file_path, NULL, NULL);
-        g_free(file_path);
 
         /* Check if file exists */
-        file = g_file_new_for_uri(file_uri);
-        if (!g_file_query_exists(file, NULL)) {
-                g_free(file_uri);
+        if (_file_exists(file_path)) {
+                file_uri = g_filename_to_uri(file_path, NULL, NULL);
+        } else {
                 file_uri = NULL;
         }
-	g_object_unref(file);
+        g_free(file_path);
 	g_free(album_key);
 
 	return file_uri;
@@ -43,4 +43,6 @@ gchar *albumart_get_thumbnail_uri(const gchar *orig_file_uri,
 gboolean albumart_key_is_album_art(const gchar *key);
 gboolean albumart_key_is_thumbnail(const gchar *key);
 
+void albumart_deinit(void);
+
 #endif
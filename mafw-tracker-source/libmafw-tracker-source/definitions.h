@@ -185,6 +185,10 @@
 #define MUSIC_OBJECT_ID      MAFW_TRACKER_SOURCE_UUID "::music"
 #define PLAYLISTS_OBJECT_ID  MAFW_TRACKER_SOURCE_UUID "::music/playlists"
 
+/* Default browse result emission policy */
+#define BROWSE_BATCH_SIZE 50
+#define BROWSE_BATCH_TIME 10
+
 /* Private data of MAFW_TRACKER_SOURCE */
 struct _MafwTrackerSourcePrivate {
         /* A List of pending browse operations */
@@ -197,6 +201,11 @@ struct _MafwTrackerSourcePrivate {
         gint remaining_items;
         /* Remaining time (in seconds) to finish the update */
         gint remaining_time;
+        /* Maximum number of browse results emitted per dispatch */
+        guint browse_batch_size;
+        /* Maximum time (in milliseconds) spent emitting browse results
+           per dispatch */
+        guint browse_batch_time;
 };
 
 #endif				/* _MAFW_TRACKER_SOURCE_DEFINITIONS_H_ */
@@ -85,6 +85,16 @@ struct _browse_closure {
 	GList *current_metadata_value;
 	guint current_index;
 	guint remaining_count;
+	/* Browse results, moved out of the lists above when emission
+	   starts */
+	gchar **result_ids;
+	GHashTable **result_metadata;
+	guint nresults;
+	/* Emission policy: results and milliseconds per dispatch (0 means
+	   no limit), and the timer measuring the current dispatch */
+	guint batch_size;
+	guint batch_time;
+	GTimer *batch_timer;
 };
 
 typedef gboolean (*_BrowseFunc)(struct _browse_closure *bc,
@@ -110,8 +120,7 @@ static gint _get_next_browse_id(MafwTrackerSource * self)
 static gboolean _emit_browse_results_idle(gpointer data)
 {
 	struct _browse_closure *bc;
-	gchar *current_id;
-	GHashTable *current_metadata_value;
+	guint emitted;
 
 	bc = (struct _browse_closure *) data;
 
@@ -120,35 +129,53 @@ static gboolean _emit_browse_results_idle(gpointer data)
 		return FALSE;
 	}
 
-	/* Otherwise, continue... */
-	current_id = (bc->current_id) ?
-		bc->current_id->data : NULL;
-	current_metadata_value = (bc->current_metadata_value) ?
-		bc->current_metadata_value->data : NULL;
-
-	/* Emit one result */
-	bc->callback(bc->source,
-		     bc->browse_id,
-		     bc->remaining_count,
-		     bc->current_index,
-		     current_id,
-		     current_metadata_value,
-		     bc->user_data,
-		     NULL);
-
-	/* Advance helper pointers to the next item to be emitted */
-	bc->current_id = g_list_next(bc->current_id);
-	bc->current_metadata_value = g_list_next(bc->current_metadata_value);
-	bc->current_index++;
-	bc->remaining_count--;
+	/* Nothing was found: tell it with a single NULL result */
+	if (bc->nresults == 0) {
+		bc->callback(bc->source, bc->browse_id, 0, 0, NULL, NULL,
+			     bc->user_data, NULL);
+#ifndef G_DEBUG_DISABLE
+		perf_elapsed_time_checkpoint("Results dispatched to UI");
+#endif
+		return FALSE;
+	}
+
+	/* Otherwise, emit as many results as the batch policy lets us */
+	g_timer_start(bc->batch_timer);
+	for (emitted = 0; bc->current_index < bc->nresults;) {
+		bc->callback(bc->source,
+			     bc->browse_id,
+			     bc->remaining_count,
+			     bc->current_index,
+			     bc->result_ids[bc->current_index],
+			     bc->result_metadata[bc->current_index],
+			     bc->user_data,
+			     NULL);
+		bc->current_index++;
+		bc->remaining_count--;
+		emitted++;
+
+		/* The callback may have cancelled the operation */
+		if (bc->cancelled == TRUE) {
+			return FALSE;
+		}
+		if (bc->batch_size && emitted >= bc->batch_size) {
+			break;
+		}
+		if (bc->batch_time &&
+		    g_timer_elapsed(bc->batch_timer, NULL) * 1000 >=
+		    bc->batch_time) {
+			break;
+		}
+	}
 
 	/* Do we have to emit more results? */
 #ifndef G_DEBUG_DISABLE
-	if (bc->current_id == NULL) {
+	perf_elapsed_time_checkpoint("Batch dispatched to UI");
+	if (bc->current_index == bc->nresults) {
 		perf_elapsed_time_checkpoint("Results dispatched to UI");
 	}
 #endif
-	return (bc->current_id != NULL);
+	return (bc->current_index < bc->nresults);
 }
 
 static inline void _register_pending_browse_operation(
@@ -170,6 +197,7 @@ static void _browse_closure_free(gpointer data)
 {
 	struct _browse_closure *bc;
 	GList *iter;
+	guint i;
 
 	bc = (struct _browse_closure *) data;
 
@@ -185,6 +213,17 @@ static void _browse_closure_free(gpointer data)
 		mafw_metadata_release(iter->data);
 	g_list_free(bc->metadata_values);
 
+	/* Free the results prepared for emission */
+	for (i = 0; i < bc->nresults; i++) {
+		g_free(bc->result_ids[i]);
+		if (bc->result_metadata[i])
+			mafw_metadata_release(bc->result_metadata[i]);
+	}
+	g_free(bc->result_ids);
+	g_free(bc->result_metadata);
+	if (bc->batch_timer)
+		g_timer_destroy(bc->batch_timer);
+
 	/* Free pls_(local)_uris field */
 	g_list_foreach(bc->pls_uris, (GFunc) g_free, NULL);
 	g_list_free(bc->pls_uris);
@@ -212,18 +251,42 @@ static void _browse_closure_free(gpointer data)
 
 static void _emit_browse_results(struct _browse_closure *bc)
 {
-	gint remaining;
+	MafwTrackerSourcePrivate *priv;
+	GList *id, *metadata;
+	guint i;
+
+	priv = MAFW_TRACKER_SOURCE(bc->source)->priv;
+
+	/* Move the results into arrays, so emission needs neither list
+	   walks nor g_list_length() */
+	bc->nresults = g_list_length(bc->ids);
+	bc->result_ids = g_new(gchar *, bc->nresults);
+	bc->result_metadata = g_new0(GHashTable *, bc->nresults);
+	id = bc->ids;
+	metadata = bc->metadata_values;
+	for (i = 0; i < bc->nresults; i++) {
+		bc->result_ids[i] = id->data;
+		id = g_list_next(id);
+		if (metadata) {
+			bc->result_metadata[i] = metadata->data;
+			metadata = g_list_next(metadata);
+		}
+	}
+	g_list_free(bc->ids);
+	bc->ids = NULL;
+	for (; metadata; metadata = g_list_next(metadata))
+		mafw_metadata_release(metadata->data);
+	g_list_free(bc->metadata_values);
+	bc->metadata_values = NULL;
 
 	/* Prepara extra info needed for emission */
-	bc->current_id = bc->ids;
-	bc->current_metadata_value = bc->metadata_values;
+	bc->current_id = NULL;
+	bc->current_metadata_value = NULL;
 	bc->current_index = 0;
-	remaining = g_list_length(bc->ids) - 1;
-	if (remaining < 0) {
-		bc->remaining_count = 0;
-	} else {
-		bc->remaining_count = remaining;
-	}
+	bc->remaining_count = bc->nresults ? bc->nresults - 1 : 0;
+	bc->batch_size = priv->browse_batch_size;
+	bc->batch_time = priv->browse_batch_time;
+	bc->batch_timer = g_timer_new();
 
 #ifndef G_DEBUG_DISABLE
 	perf_elapsed_time_checkpoint("Ready to emit");
@@ -35,6 +35,7 @@
 #include "tracker-iface.h"
 #include "util.h"
 #include "definitions.h"
+#include "album-art.h"
 
 #undef G_LOG_DOMAIN
 #define G_LOG_DOMAIN "mafw-tracker-source"
@@ -238,11 +239,74 @@ static void _destroy_object_tracker_cb(MafwResult *clips, GError *error,
 	}
 }
 
+/*____________________________ Extension properties ______________________*/
+
+static void mafw_tracker_source_get_property(MafwExtension *self,
+					     const gchar *key,
+					     MafwExtensionPropertyCallback cb,
+					     gpointer user_data)
+{
+	MafwTrackerSourcePrivate *priv;
+	GValue *value = NULL;
+	GError *error = NULL;
+
+	g_return_if_fail(MAFW_IS_TRACKER_SOURCE(self));
+	g_return_if_fail(cb != NULL);
+	g_return_if_fail(key != NULL);
+
+	priv = MAFW_TRACKER_SOURCE(self)->priv;
+	if (!strcmp(key, MAFW_PROPERTY_TRACKER_SOURCE_BROWSE_BATCH_SIZE)) {
+		value = g_new0(GValue, 1);
+		g_value_init(value, G_TYPE_UINT);
+		g_value_set_uint(value, priv->browse_batch_size);
+	} else if (!strcmp(key,
+			   MAFW_PROPERTY_TRACKER_SOURCE_BROWSE_BATCH_TIME)) {
+		value = g_new0(GValue, 1);
+		g_value_init(value, G_TYPE_UINT);
+		g_value_set_uint(value, priv->browse_batch_time);
+	} else {
+		g_set_error(&error, MAFW_EXTENSION_ERROR,
+			    MAFW_EXTENSION_ERROR_GET_PROPERTY,
+			    "Unknown property: %s", key);
+	}
+
+	cb(self, key, value, user_data, error);
+}
+
+static void mafw_tracker_source_set_property(MafwExtension *self,
+					     const gchar *key,
+					     const GValue *value)
+{
+	MafwTrackerSourcePrivate *priv;
+
+	g_return_if_fail(MAFW_IS_TRACKER_SOURCE(self));
+	g_return_if_fail(key != NULL);
+
+	priv = MAFW_TRACKER_SOURCE(self)->priv;
+	if (!strcmp(key, MAFW_PROPERTY_TRACKER_SOURCE_BROWSE_BATCH_SIZE)) {
+		priv->browse_batch_size = g_value_get_uint(value);
+	} else if (!strcmp(key,
+			   MAFW_PROPERTY_TRACKER_SOURCE_BROWSE_BATCH_TIME)) {
+		priv->browse_batch_time = g_value_get_uint(value);
+	} else {
+		return;
+	}
+
+	mafw_extension_emit_property_changed(self, key, value);
+}
 
 /*_________________________ Tracker Source GObject ________________________*/
 
 G_DEFINE_TYPE(MafwTrackerSource, mafw_tracker_source, MAFW_TYPE_SOURCE);
 
+static void mafw_tracker_source_finalize(GObject *object)
+{
+        /* Drop the album-art directory monitors */
+        albumart_deinit();
+
+        G_OBJECT_CLASS(mafw_tracker_source_parent_class)->finalize(object);
+}
+
 /*
  * Class initialization
  */
@@ -250,6 +314,8 @@ static void mafw_tracker_source_class_init(MafwTrackerSourceClass * klass)
 {
 	MafwSourceClass *source_class = MAFW_SOURCE_CLASS(klass);
 
+	G_OBJECT_CLASS(klass)->finalize = mafw_tracker_source_finalize;
+
 	source_class->browse = mafw_tracker_source_browse;
         source_class->cancel_browse = mafw_tracker_source_cancel_browse;
         source_class->get_update_progress =
@@ -259,6 +325,11 @@ static void mafw_tracker_source_class_init(MafwTrackerSourceClass * klass)
 	source_class->destroy_object = mafw_tracker_source_destroy_object;
         source_class->set_metadata = mafw_tracker_source_set_metadata;
 
+	MAFW_EXTENSION_CLASS(klass)->get_extension_property =
+		(gpointer) mafw_tracker_source_get_property;
+	MAFW_EXTENSION_CLASS(klass)->set_extension_property =
+		(gpointer) mafw_tracker_source_set_property;
+
 	klass->browse_id_counter = 0;
 
 	g_type_class_add_private(klass, sizeof(MafwTrackerSourcePrivate));
@@ -277,6 +348,16 @@ static void mafw_tracker_source_init(MafwTrackerSource * source_tracker)
 
         /* Initialize last progress; assume that tracker isn't indexing */
         source_tracker->priv->last_progress = 100;
+
+        /* Emit browse results in batches */
+        source_tracker->priv->browse_batch_size = BROWSE_BATCH_SIZE;
+        source_tracker->priv->browse_batch_time = BROWSE_BATCH_TIME;
+        mafw_extension_add_property(
+                MAFW_EXTENSION(source_tracker),
+                MAFW_PROPERTY_TRACKER_SOURCE_BROWSE_BATCH_SIZE, G_TYPE_UINT);
+        mafw_extension_add_property(
+                MAFW_EXTENSION(source_tracker),
+                MAFW_PROPERTY_TRACKER_SOURCE_BROWSE_BATCH_TIME, G_TYPE_UINT);
 }
 
 /**
@@ -56,6 +56,13 @@ G_BEGIN_DECLS
 /* Tracker source UUID */
 #define MAFW_TRACKER_SOURCE_UUID "localtagfs"
 
+/* Maximum number of browse results emitted per main loop dispatch
+   (0: no limit) */
+#define MAFW_PROPERTY_TRACKER_SOURCE_BROWSE_BATCH_SIZE "browse-batch-size"
+/* Maximum time, in milliseconds, spent emitting browse results per
+   main loop dispatch (0: no limit) */
+#define MAFW_PROPERTY_TRACKER_SOURCE_BROWSE_BATCH_TIME "browse-batch-time"
+
 typedef struct _MafwTrackerSource MafwTrackerSource;
 typedef struct _MafwTrackerSourceClass MafwTrackerSourceClass;
 
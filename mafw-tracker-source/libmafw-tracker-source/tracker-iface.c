@@ -46,6 +46,9 @@
 #define AGGREGATED_TYPE_COUNT  "COUNT"
 #define AGGREGATED_TYPE_SUM    "SUM"
 
+/* Maximum number of unique value query results to remember */
+#define UNIQUE_CACHE_MAX_ENTRIES 64
+
 /* ------------------------ Internal types ----------------------- */
 
 /* Stores information needed to invoke MAFW's callback after getting
@@ -57,6 +60,13 @@ struct _mafw_query_closure {
 	gpointer user_data;
         /* Cache to store keys and values */
         TrackerCache *cache;
+        /* Key of the query in the unique values cache, if the results
+         * are to be stored there */
+        gchar *unique_key;
+        /* Value of unique_cache_generation when the query was sent */
+        guint unique_generation;
+        /* Results found in the unique values cache */
+        GPtrArray *unique_results;
 };
 
 struct _mafw_metadata_closure {
@@ -83,8 +93,51 @@ struct _mafw_metadata_closure {
 static TrackerClient *tc = NULL;
 static InfoKeyTable *info_keys = NULL;
 
+/* Results of the unique value queries (artists, albums, genres).
+ * Maps the parameters of the query to a copy of what tracker returned.
+ * Browsing back and forth in the music hierarchy repeats the same
+ * queries, and the library rarely changes in the meantime. */
+static GHashTable *unique_cache = NULL;
+/* Incremented on every invalidation, so that replies to queries sent
+ * before it are not stored. */
+static guint unique_cache_generation = 0;
+
 /* ------------------------- Private API ------------------------- */
 
+static void _free_tracker_results(GPtrArray *results)
+{
+        if (results) {
+                g_ptr_array_foreach(results, (GFunc) g_strfreev, NULL);
+                g_ptr_array_free(results, TRUE);
+        }
+}
+
+static GPtrArray *_copy_tracker_results(const GPtrArray *results)
+{
+        GPtrArray *copy;
+        gint i;
+
+        if (!results) {
+                return NULL;
+        }
+
+        copy = g_ptr_array_sized_new(results->len);
+        for (i = 0; i < results->len; i++) {
+                g_ptr_array_add(copy,
+                                g_strdupv(g_ptr_array_index(results, i)));
+        }
+
+        return copy;
+}
+
+static void _unique_cache_invalidate(void)
+{
+        unique_cache_generation++;
+        if (unique_cache) {
+                g_hash_table_remove_all(unique_cache);
+        }
+}
+
 static void _stats_changed_handler(DBusGProxy *proxy,
 				   GPtrArray *change_set,
 				   gpointer user_data)
@@ -108,6 +161,7 @@ static void _stats_changed_handler(DBusGProxy *proxy,
                 }
 
 		if (strcmp(service_type, "Music") == 0) {
+                        _unique_cache_invalidate();
 			g_signal_emit_by_name(source,
 					      "container-changed",
 					      MUSIC_OBJECT_ID);
@@ -137,6 +191,9 @@ static void _index_state_changed_handler(DBusGProxy *proxy,
 
         source = MAFW_TRACKER_SOURCE(user_data);
 
+        /* Whatever tracker has (re)indexed may change the categories */
+        _unique_cache_invalidate();
+
         if (source->priv->last_progress != 100 &&
             strcmp(state, "Idle") == 0) {
                 /* Indexing has finished */
@@ -303,6 +360,20 @@ static void _tracker_unique_values_cb(GPtrArray *tracker_result,
                         tracker_cache_build_metadata(mc->cache, NULL);
                 mafw_result->ids = _build_objectids_from_unique_key(mc->cache);
 
+                /* Remember the results unless they may be stale */
+                if (mc->unique_key &&
+                    mc->unique_generation == unique_cache_generation) {
+                        if (g_hash_table_size(unique_cache) >=
+                            UNIQUE_CACHE_MAX_ENTRIES) {
+                                g_hash_table_remove_all(unique_cache);
+                        }
+                        g_hash_table_insert(
+                                unique_cache,
+                                mc->unique_key,
+                                _copy_tracker_results(tracker_result));
+                        mc->unique_key = NULL;
+                }
+
                 /* Invoke callback */
                 mc->callback(mafw_result, NULL, mc->user_data);
         } else {
@@ -311,9 +382,45 @@ static void _tracker_unique_values_cb(GPtrArray *tracker_result,
         }
 
         tracker_cache_free(mc->cache);
+        g_free(mc->unique_key);
         g_free(mc);
 }
 
+static gboolean _run_tracker_unique_values_cb(gpointer data)
+{
+        struct _mafw_query_closure *mc;
+
+        mc = (struct _mafw_query_closure *) data;
+        /* The TrackerCache takes the results */
+        _tracker_unique_values_cb(mc->unique_results, NULL, mc);
+
+        return FALSE;
+}
+
+/* Builds the key of a unique values query in the cache.  It holds
+ * every parameter the query is made of. */
+static gchar *_build_unique_cache_key(gchar **keys,
+                                      gchar **aggregated_keys,
+                                      gchar **aggregated_types,
+                                      const gchar *filter,
+                                      guint offset,
+                                      guint count)
+{
+        gchar *ukeys, *akeys, *atypes, *key;
+
+        ukeys = g_strjoinv(",", keys);
+        akeys = g_strjoinv(",", aggregated_keys);
+        atypes = g_strjoinv(",", aggregated_types);
+        key = g_strdup_printf("%s\n%s\n%s\n%u\n%u\n%s",
+                              ukeys, akeys, atypes, offset, count,
+                              filter ? filter : "");
+        g_free(ukeys);
+        g_free(akeys);
+        g_free(atypes);
+
+        return key;
+}
+
 static void _do_tracker_get_unique_values(gchar **keys,
                                           gchar **aggregated_keys,
                                           gchar **aggregated_types,
@@ -323,9 +430,33 @@ static void _do_tracker_get_unique_values(gchar **keys,
                                           struct _mafw_query_closure *mc)
 {
         gchar *filter = NULL;
+        gchar *key;
+        gpointer results;
 
         filter = util_build_complex_rdf_filter(filters, NULL);
 
+        if (!unique_cache) {
+                unique_cache = g_hash_table_new_full(
+                        g_str_hash, g_str_equal, g_free,
+                        (GDestroyNotify) _free_tracker_results);
+        }
+
+        key = _build_unique_cache_key(keys, aggregated_keys,
+                                      aggregated_types, filter,
+                                      offset, count);
+        if (g_hash_table_lookup_extended(unique_cache, key, NULL,
+                                         &results)) {
+                /* Keep the callback asynchronous, as it'd be with
+                 * tracker */
+                mc->unique_results = _copy_tracker_results(results);
+                g_idle_add(_run_tracker_unique_values_cb, mc);
+                g_free(key);
+                g_free(filter);
+                return;
+        }
+        mc->unique_key = key;
+        mc->unique_generation = unique_cache_generation;
+
 #ifndef G_DEBUG_DISABLE
 	perf_elapsed_time_checkpoint("Ready to query Tracker");
 #endif
@@ -573,6 +704,11 @@ void ti_deinit()
 {
 	tracker_disconnect(tc);
 	tc = NULL;
+
+        if (unique_cache) {
+                g_hash_table_destroy(unique_cache);
+                unique_cache = NULL;
+        }
 }
 
 void ti_get_videos(gchar **keys,
@@ -1809,9 +1945,14 @@ ti_set_metadata(const gchar *uri, GHashTable *metadata, CategoryType category, g
 			}
 
 			g_error_free(error);
-		} else if (updated) {
-			/* We successfully updated some keys at least */
-			*updated = TRUE;
+		} else {
+                        /* Artists, albums or genres may have changed */
+                        _unique_cache_invalidate();
+                        if (updated) {
+                                /* We successfully updated some keys
+                                 * at least */
+                                *updated = TRUE;
+                        }
 		}
 	}
 
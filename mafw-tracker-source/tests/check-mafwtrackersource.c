@@ -33,6 +33,7 @@
 #include <gio/gio.h>
 #include "mafw-tracker-source.h"
 #include "tracker-iface.h"
+#include "album-art.h"
 
 #define UNKNOWN_ARTIST_VALUE "(Unknown artist)"
 #define UNKNOWN_ALBUM_VALUE  "(Unknown album)"
@@ -63,6 +64,8 @@ static GList *g_metadata_results = NULL;
 static GList *g_destroy_results = NULL;
 static GList *g_set_metadata_failed_keys = NULL;
 static gchar *RUNNING_CASE = NULL;
+static gint g_unique_queries = 0;
+static gchar *g_art_dir = NULL;
 
 typedef struct {
 	guint browse_id;
@@ -84,6 +87,9 @@ typedef enum {
         SERVICE_PLAYLISTS = 19
 } ServiceType;
 
+gchar *hildon_albumart_get_path(const gchar *artist, const gchar *album,
+				const gchar *type);
+
 typedef void (*TrackerGPtrArrayReply) (GPtrArray *result, GError *error, gpointer user_data);
 typedef void (*TrackerArrayReply) (char **result, GError *error, gpointer user_data);
 
@@ -471,6 +477,55 @@ START_TEST(test_browse_music_artists)
 }
 END_TEST
 
+/* Browse localtagfs::music/artists twice */
+START_TEST(test_browse_music_artists_cached)
+{
+	const gchar *const *metadata = NULL;
+	GMainLoop *loop = NULL;
+	GMainContext *context = NULL;
+
+        RUNNING_CASE = "test_browse_music_artists";
+        g_unique_queries = 0;
+        loop = g_main_loop_new(NULL, FALSE);
+	context = g_main_loop_get_context(loop);
+
+	metadata = MAFW_SOURCE_LIST(
+		MAFW_METADATA_KEY_MIME,
+		MAFW_METADATA_KEY_ARTIST,
+		MAFW_METADATA_KEY_ALBUM,
+		MAFW_METADATA_KEY_TITLE);
+
+	mafw_source_browse(g_tracker_source, MAFW_TRACKER_SOURCE_UUID "::music/artists",
+                            FALSE, NULL, NULL, metadata, 0, 50,
+                            browse_result_cb, NULL);
+	while (g_main_context_pending(context))
+		g_main_context_iteration(context, TRUE);
+        fail_if(g_list_length(g_browse_results) != 6,
+                "Browse of artists category returned %d items instead of 6",
+                g_list_length(g_browse_results));
+        fail_if(g_unique_queries != 1);
+        clear_browse_results();
+
+        /* Tracker doesn't answer in "no_case", the results must come
+         * from the cache. */
+        RUNNING_CASE = "no_case";
+	mafw_source_browse(g_tracker_source, MAFW_TRACKER_SOURCE_UUID "::music/artists",
+                            FALSE, NULL, NULL, metadata, 0, 50,
+                            browse_result_cb, NULL);
+	while (g_main_context_pending(context))
+		g_main_context_iteration(context, TRUE);
+	fail_if(g_browse_called == FALSE,
+		"No browse_result signal received");
+        fail_if(g_list_length(g_browse_results) != 6,
+                "Cached browse of artists returned %d items instead of 6",
+                g_list_length(g_browse_results));
+        fail_if(g_unique_queries != 1);
+
+        clear_browse_results();
+	g_main_loop_unref(loop);
+}
+END_TEST
+
 /* Browse localtagfs::music/artists/Artist%201 */
 START_TEST(test_browse_music_artists_artist1)
 {
@@ -1201,6 +1256,11 @@ START_TEST(test_browse_cancel)
 		MAFW_METADATA_KEY_ALBUM,
 		MAFW_METADATA_KEY_TITLE);
 
+        /* Emit one result per main loop iteration */
+        mafw_extension_set_property_uint(
+                MAFW_EXTENSION(g_tracker_source),
+                MAFW_PROPERTY_TRACKER_SOURCE_BROWSE_BATCH_SIZE, 1);
+
         /* Retrieve clips */
 	browse_id = mafw_source_browse(g_tracker_source, MAFW_TRACKER_SOURCE_UUID "::music/songs",
                                         FALSE, NULL, NULL, metadata, 0, 50,
@@ -1234,6 +1294,75 @@ START_TEST(test_browse_cancel)
 }
 END_TEST
 
+static void
+browse_cancel_result_cb(MafwSource * source, guint browse_id, gint remaining,
+			guint index, const gchar * objectid,
+			GHashTable * metadata, gpointer user_data,
+			const GError *error)
+{
+	browse_result_cb(source, browse_id, remaining, index, objectid,
+			 metadata, user_data, error);
+	if (index == 4)
+		mafw_source_cancel_browse(source, browse_id, NULL);
+}
+
+/* Browse localtagfs::music/songs in batches, cancelling in the middle of
+ * one */
+START_TEST(test_browse_batch)
+{
+	const gchar *const *metadata = NULL;
+	GMainLoop *loop = NULL;
+	GMainContext *context = NULL;
+	GList *iter;
+	guint index;
+
+        RUNNING_CASE = "test_browse_music_songs";
+        loop = g_main_loop_new(NULL, FALSE);
+	context = g_main_loop_get_context(loop);
+
+	metadata = MAFW_SOURCE_LIST(
+		MAFW_METADATA_KEY_MIME,
+		MAFW_METADATA_KEY_TITLE);
+
+        mafw_extension_set_property_uint(
+                MAFW_EXTENSION(g_tracker_source),
+                MAFW_PROPERTY_TRACKER_SOURCE_BROWSE_BATCH_SIZE, 3);
+        mafw_extension_set_property_uint(
+                MAFW_EXTENSION(g_tracker_source),
+                MAFW_PROPERTY_TRACKER_SOURCE_BROWSE_BATCH_TIME, 0);
+
+	/* All the results arrive, in order */
+	mafw_source_browse(g_tracker_source, MAFW_TRACKER_SOURCE_UUID "::music/songs",
+                            FALSE, NULL, NULL, metadata, 0, 50,
+                            browse_result_cb, NULL);
+	while (g_main_context_pending(context))
+		g_main_context_iteration(context, TRUE);
+
+        fail_if(g_list_length(g_browse_results) != 14,
+                "Batched browse returned %d items instead of 14",
+                g_list_length(g_browse_results));
+	for (iter = g_browse_results, index = 0; iter;
+	     iter = g_list_next(iter), index++)
+		fail_if(((BrowseResult *) iter->data)->index != index);
+        clear_browse_results();
+
+	/* Nothing is emitted after a cancel in the middle of a batch */
+        RUNNING_CASE = "test_browse_music_songs";
+	mafw_source_browse(g_tracker_source, MAFW_TRACKER_SOURCE_UUID "::music/songs",
+                            FALSE, NULL, NULL, metadata, 0, 50,
+                            browse_cancel_result_cb, NULL);
+	while (g_main_context_pending(context))
+		g_main_context_iteration(context, TRUE);
+
+        fail_if(g_list_length(g_browse_results) != 5,
+                "Canceled batched browse returned %d items instead of 5",
+                g_list_length(g_browse_results));
+
+        clear_browse_results();
+	g_main_loop_unref(loop);
+}
+END_TEST
+
 /* This tests recursive browse */
 START_TEST(test_browse_recursive)
 {
@@ -3217,6 +3346,69 @@ START_TEST(test_destroy_failed)
 }
 END_TEST
 
+/* Waits until the album-art of @album is looked up as @exists, which
+ * may take a while since the cache learns of changes from a monitor. */
+static gboolean wait_for_album_art(const gchar *album, gboolean exists)
+{
+	gchar *uri;
+	gboolean found;
+	gint i;
+
+	for (i = 0; i < 500; i++) {
+		uri = albumart_get_album_art_uri(album);
+		found = uri != NULL;
+		g_free(uri);
+		if (found == exists)
+			return TRUE;
+		while (g_main_context_pending(NULL))
+			g_main_context_iteration(NULL, TRUE);
+		g_usleep(10000);
+	}
+	return FALSE;
+}
+
+START_TEST(test_album_art_cache)
+{
+	gchar *path, *uri;
+
+	g_type_init();
+	g_art_dir = g_build_filename(g_get_tmp_dir(),
+				     "mafw-tracker-art-XXXXXX", NULL);
+	fail_if(mkdtemp(g_art_dir) == NULL);
+	path = hildon_albumart_get_path(NULL, "Album 1", "album");
+
+	/* The directory is read at the first lookup... */
+	uri = albumart_get_album_art_uri("Album 1");
+	fail_if(uri != NULL, "Album-art found before it's created");
+
+	/* ...and followed afterwards. */
+	fail_unless(g_file_set_contents(path, "", 0, NULL));
+	fail_unless(wait_for_album_art("Album 1", TRUE),
+		    "New album-art not noticed");
+	uri = albumart_get_album_art_uri("Album 1");
+	fail_if(uri == NULL || !g_str_has_suffix(uri, "/Album%201"));
+	g_free(uri);
+
+	unlink(path);
+	fail_unless(wait_for_album_art("Album 1", FALSE),
+		    "Deleted album-art still found");
+
+	/* The directory is read again after a deinit. */
+	albumart_deinit();
+	fail_unless(g_file_set_contents(path, "", 0, NULL));
+	uri = albumart_get_album_art_uri("Album 1");
+	fail_if(uri == NULL, "Album-art not found after deinit");
+	g_free(uri);
+	albumart_deinit();
+
+	unlink(path);
+	rmdir(g_art_dir);
+	g_free(path);
+	g_free(g_art_dir);
+	g_art_dir = NULL;
+}
+END_TEST
+
 /* ---------------------------------------------------- */
 /*                  Suite creation                      */
 /* ---------------------------------------------------- */
@@ -3235,6 +3427,7 @@ SRunner * configure_tests(void)
 	TCase *tc_get_metadatas = tcase_create("GetMetadatas");
 	TCase *tc_set_metadata = tcase_create("SetMetadata");
 	TCase *tc_destroy = tcase_create("DestroyObject");
+	TCase *tc_album_art = tcase_create("AlbumArt");
 
 	/* Create unit tests for test case "Browse" */
 	tcase_add_checked_fixture(tc_browse, fx_setup_dummy_tracker_source,
@@ -3243,6 +3436,7 @@ SRunner * configure_tests(void)
 	if (1) tcase_add_test(tc_browse, test_browse_root);
 	if (1) tcase_add_test(tc_browse, test_browse_music);
 	if (1) tcase_add_test(tc_browse, test_browse_music_artists);
+	if (1) tcase_add_test(tc_browse, test_browse_music_artists_cached);
 	if (1) tcase_add_test(tc_browse, test_browse_music_artists_artist1);
 	if (1) tcase_add_test(tc_browse, test_browse_music_artists_unknown);
 	if (1) tcase_add_test(tc_browse, test_browse_music_artists_unknown_unknown);
@@ -3262,6 +3456,7 @@ SRunner * configure_tests(void)
 	if (1) tcase_add_test(tc_browse, test_browse_offset);
 	if (1) tcase_add_test(tc_browse, test_browse_invalid);
 	if (1) tcase_add_test(tc_browse, test_browse_cancel);
+	if (1) tcase_add_test(tc_browse, test_browse_batch);
 	if (1) tcase_add_test(tc_browse, test_browse_recursive);
 	if (1) tcase_add_test(tc_browse, test_browse_filter);
 /* 	if (1) tcase_add_test(tc_browse, test_browse_sort); */
@@ -3317,12 +3512,18 @@ SRunner * configure_tests(void)
 
 	suite_add_tcase(s, tc_destroy);
 
+	/* Create unit tests for test case "AlbumArt" */
+	if (1) tcase_add_test(tc_album_art, test_album_art_cache);
+
+	suite_add_tcase(s, tc_album_art);
+
 	/*Valgrind may require more time to run*/
 	tcase_set_timeout(tc_browse, 60);
 	tcase_set_timeout(tc_get_metadata, 60);
 	tcase_set_timeout(tc_get_metadatas, 60);
 	tcase_set_timeout(tc_set_metadata, 60);
 	tcase_set_timeout(tc_destroy, 60);
+	tcase_set_timeout(tc_album_art, 60);
 
 	/* Create srunner object with the test suite */
 	sr = srunner_create(s);
@@ -4172,6 +4373,7 @@ void tracker_metadata_get_unique_values_with_aggregates_async(TrackerClient *cli
                                                               TrackerGPtrArrayReply callback,
                                                               gpointer user_data)
 {
+        g_unique_queries++;
         if (_check_query_case(query) &&
             _check_aggregates_case(aggregates) &&
             _check_aggregate_fields_case(aggregate_fields)) {
@@ -4291,6 +4493,20 @@ tracker_disconnect(TrackerClient *client)
 }
 
 
+/* ---------------------------------------------------- */
+/*                   HILDON MOCKUP                      */
+/* ---------------------------------------------------- */
+
+gchar *
+hildon_albumart_get_path(const gchar *artist, const gchar *album,
+			 const gchar *type)
+{
+	/* Keep album-arts where test_album_art_cache() expects them, and
+	 * away from the real ones otherwise. */
+	return g_build_filename(g_art_dir ? g_art_dir : "/nonexistent",
+				album, NULL);
+}
+
 /* ---------------------------------------------------- */
 /*                      GIO MOCKUP                      */
 /* ---------------------------------------------------- */
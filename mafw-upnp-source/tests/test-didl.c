@@ -223,6 +223,94 @@ START_TEST(test_didl_container)
 }
 END_TEST
 
+static gchar* DIDL_LISTING = \
+	"<?xml version=\"1.0\"?>" \
+	"<DIDL-Lite xmlns:dc=\"http://purl.org/dc/elements/1.1/\" xmlns:upnp=\"urn:schemas-upnp-org:metadata-1-0/upnp/\" xmlns=\"urn:schemas-upnp-org:metadata-1-0/DIDL-Lite/\">" \
+	 "<container id=\"1\" parentID=\"0\" childCount=\"2\" restricted=\"1\">" \
+	  "<dc:title>First</dc:title>" \
+	  "<upnp:class>object.container</upnp:class>" \
+	 "</container>" \
+	 "<item id=\"2\" parentID=\"0\" restricted=\"1\">" \
+	  "<dc:title>Second &amp; Third</dc:title>" \
+	  "<res protocolInfo=\"http-get:*:audio/mpeg:*\">http://foo.bar.com:31337/2.mp3</res>" \
+	  "<upnp:class>object.item.audioItem.musicTrack</upnp:class>" \
+	 "</item>" \
+	 "<item id=\"3\" parentID=\"0\" restricted=\"1\">" \
+	  "<dc:title>Fourth</dc:title>" \
+	  "<upnp:class>object.item.audioItem.musicTrack</upnp:class>" \
+	 "</item>" \
+	"</DIDL-Lite>";
+
+static gboolean Incremental_cancelled;
+
+static void test_didl_incremental_cb(GUPnPDIDLLiteParser* parser,
+				     GUPnPDIDLLiteObject* didlobject,
+				     GString *objects)
+{
+	if (objects->len > 0)
+		g_string_append_c(objects, '|');
+	g_string_append(objects, gupnp_didl_lite_object_get_id(didlobject));
+	g_string_append_c(objects, ':');
+	g_string_append(objects, gupnp_didl_lite_object_get_title(didlobject));
+}
+
+static void test_didl_incremental_cancel_cb(GUPnPDIDLLiteParser* parser,
+					    GUPnPDIDLLiteObject* didlobject,
+					    GString *objects)
+{
+	test_didl_incremental_cb(parser, didlobject, objects);
+	Incremental_cancelled = TRUE;
+}
+
+START_TEST(test_didl_incremental)
+{
+	GUPnPDIDLLiteParser* parser;
+	GString *objects;
+	GError *error = NULL;
+	gulong id;
+
+        g_type_init();
+	g_thread_init(NULL);
+
+	parser = gupnp_didl_lite_parser_new();
+	objects = g_string_new(NULL);
+
+	/* Every object, in document order */
+	id = g_signal_connect(parser, "object-available",
+			      (GCallback)test_didl_incremental_cb, objects);
+	fail_unless(didl_parse_incremental(parser, DIDL_LISTING, NULL,
+					   &error) == TRUE);
+	fail_if(error != NULL);
+	fail_if(strcmp(objects->str,
+		       "1:First|2:Second & Third|3:Fourth") != 0,
+		"Wrong objects: %s", objects->str);
+
+	/* The same for a document of a single object */
+	g_string_truncate(objects, 0);
+	fail_unless(didl_parse_incremental(parser, DIDL_CONTAINER, NULL,
+					   &error) == TRUE);
+	fail_if(strcmp(objects->str, "18131:Velcra") != 0,
+		"Wrong objects: %s", objects->str);
+	g_signal_handler_disconnect(parser, id);
+
+	/* Nothing after cancelling */
+	g_string_truncate(objects, 0);
+	Incremental_cancelled = FALSE;
+	id = g_signal_connect(parser, "object-available",
+			      (GCallback)test_didl_incremental_cancel_cb,
+			      objects);
+	fail_unless(didl_parse_incremental(parser, DIDL_LISTING,
+					   &Incremental_cancelled,
+					   &error) == TRUE);
+	fail_if(strcmp(objects->str, "1:First") != 0,
+		"Wrong objects: %s", objects->str);
+	g_signal_handler_disconnect(parser, id);
+
+	g_string_free(objects, TRUE);
+	g_object_unref(parser);
+}
+END_TEST
+
 int main(void)
 {
 	SRunner* sr;
@@ -236,6 +324,7 @@ int main(void)
 	suite_add_tcase(suite, tc);
 	tcase_add_test(tc, test_didl_item);
 	tcase_add_test(tc, test_didl_container);
+	tcase_add_test(tc, test_didl_incremental);
 
 	sr = srunner_create(suite);
 	srunner_run_all(sr, CK_NORMAL);
@@ -450,6 +450,12 @@ struct _MafwUPnPSourcePrivate {
 
 	/* browse_id => GUPnPServiceProxyAction associations for ->cancel(). */
 	GTree *browses;
+
+	/* Number of items to request per browse page */
+	guint requested_count;
+
+	/* Last evented SystemUpdateID of the server */
+	gint64 system_update_id;
 };
 
 static gboolean return_null_action;
@@ -561,6 +567,196 @@ START_TEST(test_basic_browse)
 END_TEST
 
 
+/* Browse actions left pending by gupnp_service_proxy_begin_action() */
+typedef struct {
+	GUPnPServiceProxyActionCallback cb;
+	gpointer user_data;
+	guint start;
+	guint count;
+} PendingAction;
+
+static gboolean queue_actions;
+static GList *pending_actions;
+static guint pipeline_total;
+static guint pipeline_results;
+static gboolean pipeline_eof;
+
+static void complete_action(guint n)
+{
+	PendingAction *pending;
+
+	pending = g_list_nth_data(pending_actions, n);
+	fail_if(pending == NULL, "No pending action %u", n);
+	pending_actions = g_list_remove(pending_actions, pending);
+	pending->cb(NULL, (GUPnPServiceProxyAction *)pending,
+		    pending->user_data);
+	g_free(pending);
+}
+
+static void pipeline_browse_cb(MafwSource *source, guint browse_id,
+			       gint remaining, guint index,
+			       const gchar *objectid, GHashTable *metadata,
+			       gpointer user_data, const GError *error)
+{
+	gchar *expected;
+
+	fail_if(error != NULL);
+	if (objectid == NULL)
+	{
+		pipeline_eof = TRUE;
+		return;
+	}
+
+	/* Results must arrive in order, whichever page came first. */
+	expected = g_strdup_printf("uuid::%u", pipeline_results);
+	fail_if(index != pipeline_results, "Wrong index: %u vs. %u",
+		index, pipeline_results);
+	fail_if(strcmp(objectid, expected), "Wrong object: `%s' vs. `%s'",
+		objectid, expected);
+	fail_if(remaining != pipeline_total - index - 1);
+	g_free(expected);
+
+	pipeline_results++;
+}
+
+START_TEST(test_pipelined_browse)
+{
+	MafwSource *source = NULL;
+	PendingAction *pending;
+	guint browse_id = 0;
+
+	mafw_upnp_source_plugin_initialize(
+		MAFW_REGISTRY(mafw_registry_get_instance()));
+
+	source = MAFW_SOURCE(mafw_upnp_source_new("name", "uuid"));
+
+	fail_if(NULL == source, "Could not create source");
+
+	queue_actions = TRUE;
+	pipeline_total = 5000;
+	pipeline_results = 0;
+	pipeline_eof = FALSE;
+	MAFW_UPNP_SOURCE(source)->priv->requested_count = 10;
+
+	browse_id = mafw_source_browse(source,
+				       "uuid::0", FALSE,
+				       NULL, NULL, MAFW_SOURCE_ALL_KEYS,
+				       0, 0,
+				       pipeline_browse_cb, NULL);
+	fail_if(browse_id == MAFW_SOURCE_INVALID_BROWSE_ID);
+
+	/* The size of the container is unknown until the first reply. */
+	fail_if(g_list_length(pending_actions) != 1);
+	complete_action(0);
+	fail_if(pipeline_results != 10, "Results: %u", pipeline_results);
+
+	/* The rest is requested several pages at a time, and the page size
+	 * has grown since the server replied quickly. */
+	fail_if(g_list_length(pending_actions) != 3);
+	pending = pending_actions->data;
+	fail_if(pending->start != 10);
+	fail_if(pending->count <= 10);
+
+	/* Later pages are held back until the earlier ones arrive. */
+	complete_action(2);
+	complete_action(1);
+	fail_if(pipeline_results != 10, "Results: %u", pipeline_results);
+	complete_action(0);
+	fail_if(pipeline_results <= 10);
+
+	/* The pipeline continues right after the emitted results. */
+	fail_if(pending_actions == NULL);
+	pending = pending_actions->data;
+	fail_if(pending->start != pipeline_results);
+
+	/* Cancelling drops all outstanding actions. */
+	fail_unless(mafw_source_cancel_browse(source, browse_id, NULL));
+	fail_unless(pipeline_eof);
+	fail_if(pending_actions != NULL);
+	queue_actions = FALSE;
+
+	mafw_upnp_source_plugin_deinitialize();
+	g_object_unref(source);
+}
+END_TEST
+
+START_TEST(test_cached_browse)
+{
+	GValue value = { 0 };
+	MafwSource *source = NULL;
+	guint browse_id = 0;
+
+	mafw_upnp_source_plugin_initialize(
+		MAFW_REGISTRY(mafw_registry_get_instance()));
+
+	source = MAFW_SOURCE(mafw_upnp_source_new("name", "uuid"));
+
+	fail_if(NULL == source, "Could not create source");
+
+	/* Nothing is cached until the server has evented its state. */
+	g_value_init(&value, G_TYPE_UINT);
+	g_value_set_uint(&value, 7);
+	mafw_upnp_source_notify_callback((GUPnPServiceProxy*) 0xEFFAFFAA,
+					 "SystemUpdateID", &value, source);
+	g_value_unset(&value);
+	fail_if(MAFW_UPNP_SOURCE(source)->priv->system_update_id != 7);
+
+	need_browse_results = TRUE;
+	browse_called = 0;
+	browse_id = mafw_source_browse(source,
+				       "uuid::cached", FALSE,
+				       NULL, NULL, MAFW_SOURCE_ALL_KEYS,
+				       0, 0,
+				       browse_cb, NULL);
+	fail_if(browse_id == MAFW_SOURCE_INVALID_BROWSE_ID);
+	fail_if(browse_called != 3, "Called: %d", browse_called);
+
+	/* The server is not asked again while nothing has changed. */
+	return_null_action = TRUE;
+	browse_called = 0;
+	browse_id = mafw_source_browse(source,
+				       "uuid::cached", FALSE,
+				       NULL, NULL, MAFW_SOURCE_ALL_KEYS,
+				       1, 0,
+				       browse_cb, NULL);
+	fail_if(browse_id == MAFW_SOURCE_INVALID_BROWSE_ID);
+	fail_if(browse_called != 0);
+	checkmore_spin_loop(-1);
+	fail_if(browse_called != 2, "Called: %d", browse_called);
+
+	/* Cancelling a browse answered from the cache */
+	browse_id = mafw_source_browse(source,
+				       "uuid::cached", FALSE,
+				       NULL, NULL, MAFW_SOURCE_ALL_KEYS,
+				       0, 0,
+				       browse_cb, NULL);
+	fail_if(browse_id == MAFW_SOURCE_INVALID_BROWSE_ID);
+	need_browse_results = FALSE;
+	fail_unless(mafw_source_cancel_browse(source, browse_id, NULL));
+	fail_if(mafw_source_cancel_browse(source, browse_id, NULL));
+
+	/* A change of the container invalidates its listing. */
+	g_value_init(&value, G_TYPE_STRING);
+	g_value_set_string(&value, "cached,8");
+	mafw_upnp_source_notify_callback((GUPnPServiceProxy*) 0xEFFAFFAA,
+					 "ContainerUpdateIDs", &value, source);
+	g_value_unset(&value);
+
+	browse_called = 0;
+	browse_id = mafw_source_browse(source,
+				       "uuid::cached", FALSE,
+				       NULL, NULL, MAFW_SOURCE_ALL_KEYS,
+				       0, 0,
+				       browse_cb, NULL);
+	fail_if(browse_id != MAFW_SOURCE_INVALID_BROWSE_ID);
+	fail_if(browse_called != 1);
+	return_null_action = FALSE;
+
+	mafw_upnp_source_plugin_deinitialize();
+	g_object_unref(source);
+}
+END_TEST
+
 START_TEST(test_browse_with_filter)
 {
 	const gchar *const fields[] = {
@@ -686,6 +882,9 @@ int main(void)
 	g_type_init();
 	g_thread_init(NULL);
 
+	unlink("test-upnpsource.db");
+	g_setenv("MAFW_DB", "test-upnpsource.db", TRUE);
+
 	checkmore_wants_dbus();
 	suite = suite_create("MafwUPnPSource");
 
@@ -700,6 +899,8 @@ if (1)	tcase_add_test(tc, test_plugin);
 if(1)	tcase_add_test(tc, test_browse_with_filter);
 if(1)	tcase_add_test(tc, test_basic_browse_null_metadata);
 if(1)	tcase_add_test(tc, test_basic_browse);
+if(1)	tcase_add_test(tc, test_pipelined_browse);
+if(1)	tcase_add_test(tc, test_cached_browse);
 
 	/* Metadata tests */
 	tc = tcase_create("Get metadata");
@@ -772,6 +973,18 @@ GUPnPServiceProxyAction *gupnp_service_proxy_begin_action(
 
 	va_end(list);
 
+	if (queue_actions)
+	{
+		PendingAction *pending = g_new0(PendingAction, 1);
+
+		pending->cb = callback;
+		pending->user_data = user_data;
+		pending->start = results.skip_count;
+		pending->count = results.item_count;
+		pending_actions = g_list_append(pending_actions, pending);
+		return (GUPnPServiceProxyAction *) pending;
+	}
+
         return (GUPnPServiceProxyAction *) 0x1234;
 }
 
@@ -787,6 +1000,13 @@ static gchar* DIDL_ITEM = \
 	  "<foo>bar</foo>" \
 	 "</item>" \
 	"</DIDL-Lite>";
+static gchar* PIPELINE_DIDL_HEADER = \
+	"<DIDL-Lite xmlns:dc=\"http://purl.org/dc/elements/1.1/\" xmlns:upnp=\"urn:schemas-upnp-org:metadata-1-0/upnp/\" xmlns=\"urn:schemas-upnp-org:metadata-1-0/DIDL-Lite/\">";
+static gchar* PIPELINE_DIDL_ITEM = \
+	 "<item id=\"%u\" parentID=\"0\" restricted=\"1\">" \
+	  "<dc:title>Item %u</dc:title>" \
+	  "<upnp:class>object.item.audioItem.musicTrack</upnp:class>" \
+	 "</item>";
 static gchar* FAKE_DIDL_ITEM = \
 	"<DIDL-Lite xmlns:dc=\"http://purl.org/dc/elements/1.1/\" xmlns:upnp=\"urn:schemas-upnp-org:metadata-1-0/upnp/\" xmlns=\"urn:schemas-upnp-org:metadata-1-0/DIDL-Lite/\">" \
 	 "And here comes the problem.....";
@@ -798,6 +1018,7 @@ gboolean gupnp_service_proxy_end_action(GUPnPServiceProxy *proxy,
 	va_list list;
 	gchar *next;
 	gpointer *data;
+	guint *count;
 
 	if (end_action_return_false)
 	{
@@ -807,6 +1028,40 @@ gboolean gupnp_service_proxy_end_action(GUPnPServiceProxy *proxy,
 		return FALSE;
 	}
 
+	if (queue_actions)
+	{
+		PendingAction *pending = (PendingAction *)action;
+		GString *didl;
+		guint i;
+
+		/* Return exactly the requested page of the container */
+		didl = g_string_new(PIPELINE_DIDL_HEADER);
+		for (i = 0; i < pending->count; i++)
+			g_string_append_printf(didl, PIPELINE_DIDL_ITEM,
+					       pending->start + i,
+					       pending->start + i);
+		g_string_append(didl, "</DIDL-Lite>");
+
+		va_start(list, error);
+		(gchar *)va_arg(list, gchar*);
+		(gint)va_arg(list, gint);
+		data = va_arg(list, gpointer*);
+		*data = g_string_free(didl, FALSE);
+
+		(gchar *)va_arg(list, gchar*);
+		(gint)va_arg(list, gint);
+		count = va_arg(list, guint*);
+		*count = pending->count;
+
+		(gchar *)va_arg(list, gchar*);
+		(gint)va_arg(list, gint);
+		count = va_arg(list, guint*);
+		*count = pipeline_total;
+		va_end(list);
+
+		return TRUE;
+	}
+
 	va_start(list, error);
 	(gchar *)va_arg(list, gchar*);
 	(gint)va_arg(list, gint);
@@ -816,13 +1071,13 @@ gboolean gupnp_service_proxy_end_action(GUPnPServiceProxy *proxy,
 	if ((gchar *)va_arg(list, gchar*))
 	{
 		(gint)va_arg(list, gint);
-		data = va_arg(list, gpointer*);
-		*data = (gpointer)3;
+		count = va_arg(list, guint*);
+		*count = 3;
 		
 		(gchar *)va_arg(list, gchar*);
 		(gint)va_arg(list, gint);
-		data = va_arg(list, gpointer*);
-		*data = (gpointer)3;
+		count = va_arg(list, guint*);
+		*count = 3;
 	}
 
 	return TRUE;
@@ -831,7 +1086,11 @@ gboolean gupnp_service_proxy_end_action(GUPnPServiceProxy *proxy,
 void gupnp_service_proxy_cancel_action (GUPnPServiceProxy *proxy,
 					GUPnPServiceProxyAction *action)
 {
-	return;
+	if (queue_actions)
+	{
+		pending_actions = g_list_remove(pending_actions, action);
+		g_free(action);
+	}
 }
 
 void gssdp_resource_browser_set_active(GSSDPResourceBrowser *resource_browser,
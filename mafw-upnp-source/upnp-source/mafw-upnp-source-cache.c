@@ -0,0 +1,374 @@
+/*
+ * This file is a part of MAFW
+ *
+ * Copyright (C) 2007, 2008, 2009 Nokia Corporation, all rights reserved.
+ *
+ * Contact: Visa Smolander <visa.smolander@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include <time.h>
+#include <glib.h>
+#include <libmafw/mafw-db.h>
+
+#include "mafw-upnp-source-cache.h"
+
+/*
+ * Container listings are cached in the MAFW database:
+ *
+ * TABLE upnpcache: one row per cached listing
+ * * id			integer		the listing
+ * * udn, container	string		the browsed container of the server
+ * * query		string		search & sort criteria, metadata keys
+ * * systemupdateid	integer		SystemUpdateID when browsed, or -1
+ * * updateid		integer		UpdateID of the container
+ * * total		integer		number of items in the listing
+ * * size		integer		bytes taken by the items
+ * * used		integer		time of last use, for LRU eviction
+ *
+ * TABLE upnpcacheitems: the items of the listings
+ * * listing, idx	integer		listing id and index of the item
+ * * objectid		string
+ * * metadata		blob		serialized with mafw_metadata_freeze()
+ */
+#define CACHE_TABLE		"upnpcache"
+#define CACHE_ITEMS_TABLE	"upnpcacheitems"
+
+static void cache_init(void)
+{
+	static gboolean initialized = FALSE;
+
+	if (initialized)
+		return;
+	initialized = TRUE;
+
+	mafw_db_exec(
+		"CREATE TABLE IF NOT EXISTS " CACHE_TABLE "(\n"
+		"id		INTEGER		PRIMARY KEY,\n"
+		"udn		TEXT		NOT NULL,\n"
+		"container	TEXT		NOT NULL,\n"
+		"query		TEXT		NOT NULL,\n"
+		"systemupdateid	INTEGER		NOT NULL,\n"
+		"updateid	INTEGER		NOT NULL,\n"
+		"total		INTEGER		NOT NULL,\n"
+		"size		INTEGER		NOT NULL,\n"
+		"used		INTEGER		NOT NULL,\n"
+		"UNIQUE(udn, container, query))");
+	mafw_db_exec(
+		"CREATE TABLE IF NOT EXISTS " CACHE_ITEMS_TABLE "(\n"
+		"listing	INTEGER		NOT NULL,\n"
+		"idx		INTEGER		NOT NULL,\n"
+		"objectid	TEXT		NOT NULL,\n"
+		"metadata	BLOB,\n"
+		"PRIMARY KEY(listing, idx))");
+}
+
+/* Deletes $listing and its items.  Must be called in a transaction. */
+static void delete_listing(gint64 listing)
+{
+	sqlite3_stmt *stmt;
+
+	stmt = mafw_db_prepare_cached("DELETE FROM " CACHE_ITEMS_TABLE
+				      " WHERE listing = :listing");
+	mafw_db_bind_int64(stmt, 0, listing);
+	mafw_db_delete(stmt);
+	sqlite3_reset(stmt);
+
+	stmt = mafw_db_prepare_cached("DELETE FROM " CACHE_TABLE
+				      " WHERE id = :listing");
+	mafw_db_bind_int64(stmt, 0, listing);
+	mafw_db_delete(stmt);
+	sqlite3_reset(stmt);
+}
+
+/**
+ * cache_lookup:
+ * @udn:       UUID of the server
+ * @container: The browsed container
+ * @query:     The search & sort criteria and metadata keys of the browse
+ * @system_update_id: Returns the SystemUpdateID of the server when the
+ *             listing was cached, or -1 if it was not known
+ * @update_id: Returns the UpdateID of the container when it was cached
+ * @total:     Returns the number of items in the listing
+ *
+ * Looks up a cached container listing. The caller decides whether it is
+ * still valid, and either cache_touch()es or cache_remove()s it.
+ *
+ * Returns: The listing, or 0 if not found.
+ */
+gint64 cache_lookup(const gchar* udn, const gchar* container,
+		    const gchar* query, gint64* system_update_id,
+		    guint* update_id, guint* total)
+{
+	sqlite3_stmt *stmt;
+	gint64 listing;
+
+	cache_init();
+
+	stmt = mafw_db_prepare_cached("SELECT id, systemupdateid, updateid, "
+				      "total FROM " CACHE_TABLE " "
+				      "WHERE udn = :udn "
+				      "AND container = :container "
+				      "AND query = :query");
+	mafw_db_bind_text(stmt, 0, udn);
+	mafw_db_bind_text(stmt, 1, container);
+	mafw_db_bind_text(stmt, 2, query);
+
+	if (mafw_db_select(stmt, FALSE) == SQLITE_ROW)
+	{
+		listing = sqlite3_column_int64(stmt, 0);
+		*system_update_id = sqlite3_column_int64(stmt, 1);
+		*update_id = sqlite3_column_int64(stmt, 2);
+		*total = sqlite3_column_int64(stmt, 3);
+	}
+	else
+	{
+		listing = 0;
+	}
+	sqlite3_reset(stmt);
+
+	return listing;
+}
+
+/**
+ * cache_touch:
+ * @listing: A listing returned by cache_lookup()
+ *
+ * Marks @listing as the most recently used one.
+ */
+void cache_touch(gint64 listing)
+{
+	sqlite3_stmt *stmt;
+
+	stmt = mafw_db_prepare_cached("UPDATE " CACHE_TABLE " "
+				      "SET used = :used WHERE id = :listing");
+	mafw_db_bind_int64(stmt, 0, time(NULL));
+	mafw_db_bind_int64(stmt, 1, listing);
+	mafw_db_change(stmt, FALSE);
+	sqlite3_reset(stmt);
+}
+
+/**
+ * cache_remove:
+ * @listing: A listing returned by cache_lookup()
+ *
+ * Removes a listing found to be out of date.
+ */
+void cache_remove(gint64 listing)
+{
+	if (!mafw_db_begin())
+		return;
+	delete_listing(listing);
+	if (!mafw_db_commit())
+		mafw_db_rollback();
+}
+
+/**
+ * cache_items:
+ * @listing: A listing returned by cache_lookup()
+ * @skip:    Number of items to skip from the beginning
+ * @count:   Number of items to return
+ *
+ * Returns: A statement yielding the object ID and the serialized metadata
+ * of the items, in order. The caller must sqlite3_reset() it.
+ */
+sqlite3_stmt* cache_items(gint64 listing, guint skip, guint count)
+{
+	sqlite3_stmt *stmt;
+
+	stmt = mafw_db_prepare_cached("SELECT objectid, metadata "
+				      "FROM " CACHE_ITEMS_TABLE " "
+				      "WHERE listing = :listing "
+				      "AND idx >= :skip "
+				      "ORDER BY idx LIMIT :count");
+	mafw_db_bind_int64(stmt, 0, listing);
+	mafw_db_bind_int(stmt, 1, skip);
+	mafw_db_bind_int(stmt, 2, count);
+
+	return stmt;
+}
+
+/* Evicts the least recently used listings, but $keep, until
+ * the cache fits in CACHE_BUDGET.  Must be called in a transaction. */
+static void evict(gint64 keep)
+{
+	sqlite3_stmt *stmt;
+	gint64 size, listing;
+
+	stmt = mafw_db_prepare_cached("SELECT TOTAL(size) FROM "
+				      CACHE_TABLE);
+	mafw_db_select(stmt, TRUE);
+	size = sqlite3_column_int64(stmt, 0);
+	sqlite3_reset(stmt);
+
+	while (size > CACHE_BUDGET)
+	{
+		stmt = mafw_db_prepare_cached("SELECT id, size FROM "
+					      CACHE_TABLE " WHERE id != :keep "
+					      "ORDER BY used, id LIMIT 1");
+		mafw_db_bind_int64(stmt, 0, keep);
+		if (mafw_db_select(stmt, FALSE) != SQLITE_ROW)
+		{
+			sqlite3_reset(stmt);
+			break;
+		}
+		listing = sqlite3_column_int64(stmt, 0);
+		size -= sqlite3_column_int64(stmt, 1);
+		sqlite3_reset(stmt);
+
+		g_debug("Evicting cached listing %" G_GINT64_FORMAT, listing);
+		delete_listing(listing);
+	}
+}
+
+/**
+ * cache_store:
+ * @udn:       UUID of the server
+ * @container: The browsed container
+ * @query:     The search & sort criteria and metadata keys of the browse
+ * @system_update_id: SystemUpdateID of the server when the browse began,
+ *             or -1 if it was not known
+ * @update_id: UpdateID of the container
+ * @objectids: The object IDs of all items in the container, in order
+ * @metadata:  The serialized metadata (#GByteArray) of the items
+ * @size:      Total size of the object IDs and metadata
+ *
+ * Caches the complete listing of a container, replacing any earlier
+ * listing with the same @query, and evicts the least recently used
+ * listings if the cache grows beyond %CACHE_BUDGET.
+ */
+void cache_store(const gchar* udn, const gchar* container, const gchar* query,
+		 gint64 system_update_id, guint update_id,
+		 GPtrArray* objectids, GPtrArray* metadata, gsize size)
+{
+	sqlite3_stmt *stmt;
+	gint64 listing, old, old_system_update_id;
+	guint old_update_id, old_total;
+	guint i;
+
+	g_assert(objectids->len == metadata->len);
+
+	if (size > CACHE_BUDGET)
+		return;
+
+	old = cache_lookup(udn, container, query, &old_system_update_id,
+			   &old_update_id, &old_total);
+
+	if (!mafw_db_begin())
+		return;
+
+	if (old != 0)
+		delete_listing(old);
+
+	stmt = mafw_db_prepare_cached("INSERT INTO " CACHE_TABLE "("
+				      "udn, container, query, "
+				      "systemupdateid, updateid, "
+				      "total, size, used) "
+				      "VALUES(:udn, :container, :query, "
+				      ":systemupdateid, :updateid, "
+				      ":total, :size, :used)");
+	mafw_db_bind_text(stmt, 0, udn);
+	mafw_db_bind_text(stmt, 1, container);
+	mafw_db_bind_text(stmt, 2, query);
+	mafw_db_bind_int64(stmt, 3, system_update_id);
+	mafw_db_bind_int64(stmt, 4, update_id);
+	mafw_db_bind_int64(stmt, 5, objectids->len);
+	mafw_db_bind_int64(stmt, 6, size);
+	mafw_db_bind_int64(stmt, 7, time(NULL));
+	if (mafw_db_change(stmt, FALSE) != SQLITE_DONE)
+	{
+		sqlite3_reset(stmt);
+		goto err;
+	}
+	sqlite3_reset(stmt);
+	listing = sqlite3_last_insert_rowid(mafw_db_get());
+
+	stmt = mafw_db_prepare_cached("INSERT INTO " CACHE_ITEMS_TABLE "("
+				      "listing, idx, objectid, metadata) "
+				      "VALUES(:listing, :idx, :objectid, "
+				      ":metadata)");
+	for (i = 0; i < objectids->len; i++)
+	{
+		GByteArray *md = g_ptr_array_index(metadata, i);
+
+		mafw_db_bind_int64(stmt, 0, listing);
+		mafw_db_bind_int(stmt, 1, i);
+		mafw_db_bind_text(stmt, 2, g_ptr_array_index(objectids, i));
+		mafw_db_bind_blob(stmt, 3, md->data, md->len);
+		if (mafw_db_change(stmt, FALSE) != SQLITE_DONE)
+		{
+			sqlite3_reset(stmt);
+			goto err;
+		}
+		sqlite3_reset(stmt);
+	}
+
+	evict(listing);
+
+	if (!mafw_db_commit())
+		goto err;
+	return;
+
+err:
+	g_warning("Could not cache the listing of %s", container);
+	mafw_db_rollback();
+}
+
+/**
+ * cache_invalidate:
+ * @udn:       UUID of the server
+ * @container: A container of the server that has changed
+ * @update_id: The new UpdateID of @container
+ *
+ * Removes the listings of @container that are older than @update_id.
+ */
+void cache_invalidate(const gchar* udn, const gchar* container,
+		      guint update_id)
+{
+	sqlite3_stmt *stmt;
+	GArray *listings;
+	gint64 listing;
+	guint i;
+
+	cache_init();
+
+	listings = g_array_new(FALSE, FALSE, sizeof(gint64));
+	stmt = mafw_db_prepare_cached("SELECT id FROM " CACHE_TABLE " "
+				      "WHERE udn = :udn "
+				      "AND container = :container "
+				      "AND updateid != :updateid");
+	mafw_db_bind_text(stmt, 0, udn);
+	mafw_db_bind_text(stmt, 1, container);
+	mafw_db_bind_int64(stmt, 2, update_id);
+	while (mafw_db_select(stmt, FALSE) == SQLITE_ROW)
+	{
+		listing = sqlite3_column_int64(stmt, 0);
+		g_array_append_val(listings, listing);
+	}
+	sqlite3_reset(stmt);
+
+	if (listings->len > 0 && mafw_db_begin())
+	{
+		for (i = 0; i < listings->len; i++)
+			delete_listing(g_array_index(listings, gint64, i));
+		if (!mafw_db_commit())
+			mafw_db_rollback();
+	}
+
+	g_array_free(listings, TRUE);
+}
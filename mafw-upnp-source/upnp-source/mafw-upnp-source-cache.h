@@ -0,0 +1,48 @@
+/*
+ * This file is a part of MAFW
+ *
+ * Copyright (C) 2007, 2008, 2009 Nokia Corporation, all rights reserved.
+ *
+ * Contact: Visa Smolander <visa.smolander@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+
+#ifndef MAFW_UPNP_SOURCE_CACHE_H
+#define MAFW_UPNP_SOURCE_CACHE_H
+
+#include <glib.h>
+#include <sqlite3.h>
+
+/** Maximum size of all cached container listings (bytes) */
+#define CACHE_BUDGET (4 * 1024 * 1024)
+
+gint64 cache_lookup(const gchar* udn, const gchar* container,
+		    const gchar* query, gint64* system_update_id,
+		    guint* update_id, guint* total);
+void cache_touch(gint64 listing);
+void cache_remove(gint64 listing);
+sqlite3_stmt* cache_items(gint64 listing, guint skip, guint count);
+
+void cache_store(const gchar* udn, const gchar* container, const gchar* query,
+		 gint64 system_update_id, guint update_id,
+		 GPtrArray* objectids, GPtrArray* metadata, gsize size);
+void cache_invalidate(const gchar* udn, const gchar* container,
+		      guint update_id);
+
+#endif
@@ -27,6 +27,7 @@
 #include <libmafw/mafw.h>
 #include <libgupnp/gupnp.h>
 #include <libgupnp-av/gupnp-av.h>
+#include <libxml/xmlreader.h>
 
 #include "mafw-upnp-source-didl.h"
 #include "mafw-upnp-source-util.h"
@@ -274,3 +275,104 @@ gchar* didl_fallback(GUPnPDIDLLiteObject* didl_object,
 	
 	return val;
 }
+
+/*----------------------------------------------------------------------------
+  Incremental parsing
+  ----------------------------------------------------------------------------*/
+
+/**
+ * didl_parse_incremental:
+ * @parser:    A #GUPnPDIDLLiteParser to emit the objects with
+ * @didl:      A DIDL-Lite document
+ * @cancelled: Location of a flag that stops the parsing when set, or %NULL
+ * @error:     Return location for a parsing error
+ *
+ * Parses @didl like gupnp_didl_lite_parser_parse_didl(), but without building
+ * the tree of the whole document first.  The objects are read one by one
+ * with an #xmlTextReader and @parser emits "object-available" for each of
+ * them as soon as it has been read, so only one object is held in memory
+ * at a time and the first results get out before the last are parsed.
+ *
+ * Returns: %TRUE on success, %FALSE if @didl could not be parsed.
+ */
+gboolean didl_parse_incremental(GUPnPDIDLLiteParser *parser, const gchar *didl,
+				const gboolean *cancelled, GError **error)
+{
+	xmlTextReaderPtr reader;
+	const gchar *root, *root_end;
+	GString *doc;
+	gsize root_len;
+	guint parsed = 0;
+	gboolean retval = TRUE;
+	gint ret;
+
+	/* Every object is handed to @parser as a document of its own, under
+	   a copy of the root element, to keep the namespace declarations of
+	   @didl in scope.  Leave anything unusual to the full parser. */
+	root = strstr(didl, "<DIDL-Lite");
+	root_end = root ? strchr(root, '>') : NULL;
+	if (root_end == NULL || root_end[-1] == '/')
+		return gupnp_didl_lite_parser_parse_didl(parser, didl, error);
+
+	reader = xmlReaderForMemory(didl, strlen(didl), NULL, NULL,
+				    XML_PARSE_NONET);
+	if (reader == NULL)
+		return gupnp_didl_lite_parser_parse_didl(parser, didl, error);
+
+	doc = g_string_new_len(root, root_end - root + 1);
+	root_len = doc->len;
+
+	ret = xmlTextReaderRead(reader);
+	while (ret == 1 && (cancelled == NULL || *cancelled == FALSE))
+	{
+		xmlChar *object;
+
+		if (xmlTextReaderNodeType(reader) != XML_READER_TYPE_ELEMENT ||
+		    xmlTextReaderDepth(reader) != 1)
+		{
+			ret = xmlTextReaderRead(reader);
+			continue;
+		}
+
+		/* Serializes the subtree of the object, reading it in */
+		object = xmlTextReaderReadOuterXml(reader);
+		if (object == NULL)
+		{
+			ret = -1;
+			break;
+		}
+
+		g_string_truncate(doc, root_len);
+		g_string_append(doc, (const gchar *)object);
+		g_string_append(doc, "</DIDL-Lite>");
+		xmlFree(object);
+
+		if (!gupnp_didl_lite_parser_parse_didl(parser, doc->str, error))
+		{
+			retval = FALSE;
+			break;
+		}
+		parsed++;
+
+		/* Skip to the next object, its subtree is done with */
+		ret = xmlTextReaderNext(reader);
+	}
+
+	g_string_free(doc, TRUE);
+	xmlFreeTextReader(reader);
+
+	if (retval && ret < 0)
+	{
+		/* The full parser recovers from the errors some servers make
+		   in their DIDL-Lite, as long as nothing has been emitted
+		   yet it can have a go at it. */
+		if (parsed == 0)
+			return gupnp_didl_lite_parser_parse_didl(parser, didl,
+								 error);
+		g_set_error(error, GUPNP_XML_ERROR, GUPNP_XML_ERROR_PARSE,
+			    "Could not parse DIDL-Lite XML");
+		retval = FALSE;
+	}
+
+	return retval;
+}
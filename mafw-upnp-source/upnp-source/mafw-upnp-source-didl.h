@@ -63,5 +63,11 @@ void didl_get_mimetype(GHashTable *metadata, gboolean is_container,
 gchar* didl_fallback(GUPnPDIDLLiteObject* didl_object,
 			GUPnPDIDLLiteResource* first_res, gint id, gint* type);
 
+/*----------------------------------------------------------------------------
+  Incremental parsing
+  ----------------------------------------------------------------------------*/
+gboolean didl_parse_incremental(GUPnPDIDLLiteParser *parser, const gchar *didl,
+				const gboolean *cancelled, GError **error);
+
 
 #endif /* MAFW_UPNP_SOURCE_DIDL_H */
@@ -25,11 +25,14 @@
 #include "config.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <glib.h>
 #include <string.h>
 #include <gmodule.h>
 
 #include <libmafw/mafw.h>
+#include <libmafw/mafw-db.h>
+#include <libmafw/mafw-metadata-serializer.h>
 #include <libgupnp/gupnp.h>
 #include <libgupnp-av/gupnp-av.h>
 #include <libxml/debugXML.h>
@@ -37,6 +40,7 @@
 #include "mafw-upnp-source.h"
 #include "mafw-upnp-source-didl.h"
 #include "mafw-upnp-source-util.h"
+#include "mafw-upnp-source-cache.h"
 
 #define MAFW_UPNP_SOURCE_PLUGIN_NAME "MAFW-UPnP-Source"
 
@@ -177,9 +181,25 @@ GObject* mafw_upnp_control_source_new(void)
 	return object;
 }
 
-/** Maximum number of items requested at a time */
+/** Number of items requested at a time until the server has been measured */
 #define DEFAULT_REQUESTED_COUNT 500
 
+/** Limits of the adaptive number of items requested at a time */
+#define MIN_REQUESTED_COUNT 50
+#define MAX_REQUESTED_COUNT 2000
+
+/** Round trip time a single browse page should take (ms) */
+#define TARGET_PAGE_TIME 500
+
+/** Maximum DIDL-Lite size of a single browse page (bytes) */
+#define MAX_PAGE_SIZE (512 * 1024)
+
+/** Maximum number of outstanding browse actions per browse operation */
+#define BROWSE_PIPELINE_DEPTH 3
+
+/** Number of cached items emitted per main loop iteration */
+#define CACHE_BATCH_SIZE 100
+
 #ifndef CONTENT_DIR_NO_VERSION
 #define CONTENT_DIR_NO_VERSION "urn:schemas-upnp-org:service:ContentDirectory"
 #endif
@@ -231,7 +251,9 @@ static void mafw_upnp_source_device_proxy_unavailable(GUPnPControlPoint* cp,
 
 /* Browse */
 static GUPnPServiceProxyAction* mafw_upnp_source_browse_internal(BrowseArgs*
-								  args);
+								  args,
+								  guint count);
+static void mafw_upnp_source_browse_dispatch(BrowseArgs* args);
 static guint mafw_upnp_source_browse(MafwSource *source,
 				     const gchar *object_id,
 				     gboolean recursive,
@@ -421,6 +443,20 @@ struct _MafwUPnPSourcePrivate {
 
 	/* browse_id => GUPnPServiceProxyAction associations for ->cancel(). */
 	GTree *browses;
+
+	/* Number of items to request per browse page, adapted to the
+	   measured latency and DIDL-Lite size of this server. */
+	guint requested_count;
+
+	/* Most items the server returns per action, 0 until it has
+	   returned fewer than requested with more matches remaining */
+	guint max_returned;
+
+	/* Last evented SystemUpdateID of the server, -1 until known */
+	gint64 system_update_id;
+
+	/* Container ID => last evented UpdateID of the container */
+	GHashTable *container_update_ids;
 };
 
 static void mafw_upnp_source_init(MafwUPnPSource *self)
@@ -432,6 +468,11 @@ static void mafw_upnp_source_init(MafwUPnPSource *self)
 	priv->browses = g_tree_new_full(
 		(GCompareDataFunc) util_compare_uint,
 		NULL, NULL, NULL);
+	priv->requested_count = DEFAULT_REQUESTED_COUNT;
+	priv->system_update_id = -1;
+	priv->container_update_ids = g_hash_table_new_full(g_str_hash,
+							   g_str_equal,
+							   g_free, NULL);
 }
 
 static void mafw_upnp_source_class_init(MafwUPnPSourceClass *klass)
@@ -477,6 +518,7 @@ static void mafw_upnp_source_dispose(GObject *object)
 	/* Get rid of browse IDs. No need to cancel the actions since
 	   GUPnP does it for us. */
 	g_tree_destroy(priv->browses);
+	g_hash_table_destroy(priv->container_update_ids);
 
 	if (priv->device != NULL) {
 		g_object_unref(priv->device);
@@ -514,9 +556,11 @@ void mafw_upnp_source_notify_callback(GUPnPServiceProxy* service,
 				       gpointer user_data)
 {
 	MafwExtension* self;
+	MafwUPnPSourcePrivate* priv;
 
 	self = MAFW_EXTENSION(user_data);
 	g_assert(self != NULL);
+	priv = MAFW_UPNP_SOURCE(self)->priv;
 
 	g_assert(service != NULL);
 	g_assert(variable != NULL);
@@ -528,6 +572,8 @@ void mafw_upnp_source_notify_callback(GUPnPServiceProxy* service,
 	{
 		gchar** ids;
 		gchar* oid;
+		gchar* end;
+		guint update_id;
 		int i;
 
 		/* Send a signal for each changed container object ID */
@@ -540,8 +586,28 @@ void mafw_upnp_source_notify_callback(GUPnPServiceProxy* service,
 			g_free(oid);
 		}
 
+		/* The value consists of container ID, UpdateID pairs.
+		   Forget the cached listings of the changed containers. */
+		for (i = 0; ids[i] != NULL && ids[i + 1] != NULL; i += 2)
+		{
+			update_id = strtoul(ids[i + 1], &end, 10);
+			if (ids[i + 1][0] == '\0' || *end != '\0')
+				continue;
+
+			g_hash_table_insert(priv->container_update_ids,
+					    g_strdup(ids[i]),
+					    GUINT_TO_POINTER(update_id));
+			cache_invalidate(mafw_extension_get_uuid(self),
+					 ids[i], update_id);
+		}
+
 		g_strfreev(ids);
 	}
+	else if (strcmp(variable, SYSTEM_UPDATE_ID) == 0)
+	{
+		/* Cached listings of this version of the server are valid */
+		priv->system_update_id = g_value_get_uint(value);
+	}
 }
 
 /**
@@ -580,6 +646,16 @@ static void mafw_upnp_source_attach_proxy(MafwUPnPSource* self,
 			CONTAINER_UPDATE_IDS,
 			mafw_extension_get_name(MAFW_EXTENSION(self)));
 	}
+	if (gupnp_service_proxy_add_notify(service,
+					   SYSTEM_UPDATE_ID,
+					   G_TYPE_UINT,
+					   mafw_upnp_source_notify_callback,
+					   self) == FALSE)
+	{
+		g_warning("Subscription of %s for CDS [%s] failed",
+			SYSTEM_UPDATE_ID,
+			mafw_extension_get_name(MAFW_EXTENSION(self)));
+	}
 }
 
 static void mafw_upnp_source_device_proxy_available(GUPnPControlPoint* cp,
@@ -770,6 +846,12 @@ static GHashTable *mafw_upnp_source_compile_metadata(guint64 keys,
 	}
 	keys &= ~MUPnPSrc_MKey_DIDL;
 
+	/* The rest of the keys need the resources of the object, which are
+	   the costly part to look up.  Browsing with only the cheap keys
+	   (titles and child counts) is common enough to skip them. */
+	if (keys == 0)
+		return metadata;
+
 	resources = didl_get_supported_resources(didlobject);
 	if (resources)
 		first_res = resources->data;
@@ -1254,9 +1336,6 @@ struct _BrowseArgs
 	/** Original item count (total number of items the user wants) */
 	guint item_count;
 
-	/** Original requested count (number of items requested at a time) */
-	guint requested_count;
-
 	/** User callback function & its user data */
 	MafwSourceBrowseResultCb callback;
 	gpointer user_data;
@@ -1265,8 +1344,12 @@ struct _BrowseArgs
 	  Run-time parameters
 	  -------------------------------------------------------------------*/
 
-	/** The browse/search action associated with these args */
-	GUPnPServiceProxyAction* action;
+	/** Requested pages (BrowsePage*) that have not been emitted yet,
+	    in the order of their starting index */
+	GQueue* pages;
+
+	/** Index of the next page to request, relative to skip_count */
+	guint next_index;
 
 	/** ID of the current browse operation */
 	guint browse_id;
@@ -1274,19 +1357,166 @@ struct _BrowseArgs
 	/** Number of items remaining to be fetched. */
 	guint remaining_count;
 
-	/** Number of items returned by the CDS in response to the request. */
-	guint number_returned;
-
 	/** Total number of items in the container currently browsed. */
 	guint total_matches;
 
 	/** Index of the next emitted item */
 	guint current;
 
+	/** TRUE while mafw_upnp_source_browse_dispatch() is running */
+	gboolean dispatching;
+
+	/** TRUE if the browse operation has been cancelled */
+	gboolean cancelled;
+
+	/** Error the browse was cancelled with, for the final result */
+	GError* error;
+
 	/** Reference count */
 	guint refcount;
+
+	/*-------------------------------------------------------------------
+	  Browse cache
+	  -------------------------------------------------------------------*/
+
+	/** SystemUpdateID of the server when the browse began, or -1 */
+	gint64 system_update_id;
+
+	/** UpdateID of the container when the first page was browsed */
+	guint update_id;
+
+	/** Object IDs and serialized metadata (GByteArray*) of the
+	    items so far, NULL if the listing will not be cached */
+	GPtrArray* cache_ids;
+	GPtrArray* cache_metadata;
+
+	/** Size of the collected listing */
+	gsize cache_size;
+
+	/** The cached listing answering this browse */
+	gint64 cache_listing;
+
+	/** Idle source emitting the cached listing */
+	guint cache_source;
 };
 
+/** A single Browse/Search action of a browse operation */
+typedef struct _BrowsePage
+{
+	/** The browse operation this page belongs to */
+	BrowseArgs* args;
+
+	/** The pending action, NULL once it has completed */
+	GUPnPServiceProxyAction* action;
+
+	/** Index of the first requested item, relative to skip_count */
+	guint start;
+
+	/** Number of requested items */
+	guint count;
+
+	/** Measures the round trip time of the action */
+	GTimer* timer;
+
+	/** TRUE when the reply of the action has been received */
+	gboolean done;
+
+	/** Return value of gupnp_service_proxy_end_action() */
+	gboolean result;
+
+	/** DIDL-Lite result of the action */
+	gchar* didl;
+
+	/** Number of items returned by the CDS in response to the request. */
+	guint number_returned;
+
+	/** UpdateID of the browsed container */
+	guint update_id;
+
+	/** Error from gupnp_service_proxy_end_action() */
+	GError* error;
+} BrowsePage;
+
+static void _free_bary(GByteArray* bary, gpointer udat)
+{
+	g_byte_array_free(bary, TRUE);
+}
+
+/**
+ * Stop collecting the listing of @args for the cache.
+ */
+static void mafw_upnp_source_cache_drop(BrowseArgs* args)
+{
+	if (args->cache_ids == NULL)
+		return;
+
+	g_ptr_array_foreach(args->cache_ids, (GFunc) g_free, NULL);
+	g_ptr_array_free(args->cache_ids, TRUE);
+	g_ptr_array_foreach(args->cache_metadata, (GFunc) _free_bary, NULL);
+	g_ptr_array_free(args->cache_metadata, TRUE);
+	args->cache_ids = args->cache_metadata = NULL;
+}
+
+/**
+ * Add an emitted item to the listing of @args collected for the cache.
+ */
+static void mafw_upnp_source_cache_collect(BrowseArgs* args,
+					   const gchar* objectid,
+					   GHashTable* metadata)
+{
+	GByteArray* bary;
+
+	bary = mafw_metadata_freeze_bary(metadata);
+	args->cache_size += strlen(objectid) + bary->len;
+	if (args->cache_size > CACHE_BUDGET)
+	{
+		/* Too big to be cached */
+		g_byte_array_free(bary, TRUE);
+		mafw_upnp_source_cache_drop(args);
+		return;
+	}
+
+	g_ptr_array_add(args->cache_ids, g_strdup(objectid));
+	g_ptr_array_add(args->cache_metadata, bary);
+}
+
+/**
+ * Return the key of the listings cached for @args, apart from the server
+ * and the container: everything else that affects the result.
+ */
+static gchar* mafw_upnp_source_cache_query(BrowseArgs* args)
+{
+	return g_strjoin("\n",
+			 args->search_criteria ? args->search_criteria : "",
+			 args->sort_criteria ? args->sort_criteria : "",
+			 args->meta_keys_csv ? args->meta_keys_csv : "",
+			 NULL);
+}
+
+/**
+ * Store the listing collected by @args in the cache, if it is complete.
+ */
+static void mafw_upnp_source_cache_store(BrowseArgs* args)
+{
+	gchar* query;
+
+	if (args->cache_ids != NULL && args->cancelled == FALSE &&
+	    args->remaining_count == 0 && args->total_matches > 0 &&
+	    args->cache_ids->len == args->total_matches)
+	{
+		query = mafw_upnp_source_cache_query(args);
+		cache_store(mafw_extension_get_uuid(
+				    MAFW_EXTENSION(args->source)),
+			    args->itemid, query,
+			    args->system_update_id, args->update_id,
+			    args->cache_ids, args->cache_metadata,
+			    args->cache_size);
+		g_free(query);
+	}
+
+	mafw_upnp_source_cache_drop(args);
+}
+
 /**
  * Increase BrowseArgs* reference count. Reference counting is needed because
  * this source sends results back to the user in multiple idle callbacks.
@@ -1328,8 +1558,15 @@ static void browse_args_unref(BrowseArgs* args, GError *err)
 		{
 			args->callback(MAFW_SOURCE(args->source),
 				       args->browse_id, 0, 0, NULL, NULL,
-				       args->user_data, err);
+				       args->user_data,
+				       err != NULL ? err : args->error);
 		}
+		if (args->error != NULL)
+			g_error_free(args->error);
+
+		g_assert(g_queue_is_empty(args->pages));
+		g_queue_free(args->pages);
+		mafw_upnp_source_cache_drop(args);
 
 		g_object_unref(args->source);
 		g_free(args->itemid);
@@ -1340,6 +1577,42 @@ static void browse_args_unref(BrowseArgs* args, GError *err)
 	}
 }
 
+/**
+ * Free a page and drop the reference it holds to its #BrowseArgs.
+ */
+static void browse_page_free(BrowsePage* page)
+{
+	g_assert(page != NULL);
+
+	g_timer_destroy(page->timer);
+	g_free(page->didl);
+	if (page->error != NULL)
+		g_error_free(page->error);
+
+	browse_args_unref(page->args, NULL);
+	g_free(page);
+}
+
+/**
+ * Cancel the outstanding actions of @args and drop all of its pages that
+ * have not been emitted yet. The caller must hold a reference to @args.
+ */
+static void mafw_upnp_source_browse_drop_pages(BrowseArgs* args)
+{
+	BrowsePage* page;
+
+	while ((page = g_queue_pop_head(args->pages)) != NULL)
+	{
+		if (page->action != NULL)
+		{
+			gupnp_service_proxy_cancel_action(
+				args->source->priv->service, page->action);
+		}
+
+		browse_page_free(page);
+	}
+}
+
 /*----------------------------------------------------------------------------
   Browse
   ----------------------------------------------------------------------------*/
@@ -1364,6 +1637,13 @@ static void mafw_upnp_source_browse_result(GUPnPDIDLLiteParser* parser,
 
 	g_assert(args != NULL);
 	g_assert(args->callback != NULL);
+
+	/* The user may cancel the browse operation from the callback */
+	if (args->cancelled == TRUE)
+	{
+		return;
+	}
+
 	g_return_if_fail(args->remaining_count > 0);
 
 	/* Create a MAFW-style object ID for this item node. If an
@@ -1383,6 +1663,8 @@ static void mafw_upnp_source_browse_result(GUPnPDIDLLiteParser* parser,
 	metadata = mafw_upnp_source_compile_metadata(args->mdata_keys,
 						     didlobject,
 						     NULL);
+	if (args->cache_ids != NULL)
+		mafw_upnp_source_cache_collect(args, objectid, metadata);
 
 	/* Calculate remaining count and current item's index. */
 	current = args->current++;
@@ -1403,44 +1685,22 @@ static void mafw_upnp_source_browse_result(GUPnPDIDLLiteParser* parser,
 }
 
 /**
- * mafw_upnp_source_browse_cb:
- * @service:   A CDS Service proxy that completed a browse action
- * @action:    The completed browse action
- * @user_data: #BrowseArgs*
+ * mafw_upnp_source_browse_emit:
+ * @args: #BrowseArgs*
+ * @page: The first received page of @args
  *
- * Callback that is called when results from a browse action invocation are
- * received. Parses the resulting DIDL-Lite node tree and sends the requested
- * information (if found) back to the requester.
+ * Parses the DIDL-Lite of @page and sends the items (if found) back to the
+ * requester.
+ *
+ * Returns: %TRUE if the browse operation continues after @page.
  */
-static void mafw_upnp_source_browse_cb(GUPnPServiceProxy* service,
-					GUPnPServiceProxyAction* action,
-					gpointer user_data)
+static gboolean mafw_upnp_source_browse_emit(BrowseArgs* args,
+					     BrowsePage* page)
 {
-	BrowseArgs* args = (BrowseArgs*) user_data;
 	GError* gupnp_error = NULL;
-	gboolean result = FALSE;
-	gchar* didl = NULL;
-
-	g_assert(args != NULL);
-
-	/* This action was completed, remove it from args because it cannot be
-	   cancelled anymore, since this function runs all the way thru the
-	   returned set of results and returns to main loop after it's done. */
-	args->action = NULL;
-
-	/* Parse the action result and number of items returned in this set */
-	result = gupnp_service_proxy_end_action(
-		service, action, &gupnp_error,
-		"Result",         G_TYPE_STRING, &didl,
-		"NumberReturned", G_TYPE_UINT,   &args->number_returned,
-		"TotalMatches",   G_TYPE_UINT,   &args->total_matches,
-		NULL);
-
-	g_debug("CDS server with UUID [%s] browse result consists of:"
-		"\tNumberReturned: %d\n"
-		"\tTotalMatches: %d\n",
-		mafw_extension_get_uuid(MAFW_EXTENSION(args->source)),
-		args->number_returned, args->total_matches);
+	gboolean parser_return;
+	guint object_signal_id;
+	guint current;
 
 	if (args->remaining_count == UINT_MAX)
 	{// Calculate the new remaining count
@@ -1452,22 +1712,22 @@ static void mafw_upnp_source_browse_cb(GUPnPServiceProxy* service,
 			args->remaining_count =	args->item_count;
 		}
 	}
-	if (result == FALSE || didl == NULL || args->total_matches == 0)
+	if (page->result == FALSE || page->didl == NULL ||
+	    args->total_matches == 0)
 	{
 		/* Action failed completely, no results. */
 		GError* error = NULL;
-		if (gupnp_error != NULL)
+		if (page->error != NULL)
 		{
-			g_warning("Action failed: %s", gupnp_error->message);
+			g_warning("Action failed: %s", page->error->message);
 
 			/* g_set_error() takes its message argument as a
-			 * printf() format string.  gupnp_error->message
+			 * printf() format string.  page->error->message
 			 * may contain format specifiers (XML fragments). */
 			g_set_error(&error,
 				    MAFW_SOURCE_ERROR,
 				    MAFW_SOURCE_ERROR_BROWSE_RESULT_FAILED,
-				    "Action failed: %s", gupnp_error->message);
-			g_error_free(gupnp_error);
+				    "Action failed: %s", page->error->message);
 		}
 
 		/* Call the callback function with invalid values and an error.
@@ -1484,144 +1744,226 @@ static void mafw_upnp_source_browse_cb(GUPnPServiceProxy* service,
 		if (error) {
 			g_error_free(error);
 		}
+
+		return FALSE;
 	}
-	else
+
+	/* Don't cache a listing that changed while it was browsed */
+	if (page->start == 0)
+		args->update_id = page->update_id;
+	else if (page->update_id != args->update_id)
+		mafw_upnp_source_cache_drop(args);
+
+	current = args->current;
+
+	object_signal_id = g_signal_connect(parser, "object-available",
+				(GCallback)mafw_upnp_source_browse_result,
+				args);
+	/* Parse the DIDL-Lite one object at a time, each of them is sent
+	   by mafw_upnp_source_browse_result() as soon as it is read.  The
+	   rest of the page is left unparsed if the browse is cancelled. */
+	parser_return = didl_parse_incremental(
+		parser,
+		page->didl,
+		&args->cancelled,
+		&gupnp_error);
+	g_signal_handler_disconnect(parser, object_signal_id);
+	if (!parser_return || gupnp_error != NULL)
 	{
-		gboolean parser_return;
-		guint object_signal_id;
-		
-		object_signal_id = g_signal_connect(parser, "object-available",
-					(GCallback)mafw_upnp_source_browse_result,
-					args);
-		/* Parse the DIDL-Lite into an xmlNode tree and parse them
-		   one by one, using mafw_upnp_source_browse_result() */
-		parser_return = gupnp_didl_lite_parser_parse_didl(
-			parser,
-			didl,
-			&gupnp_error);
-		g_signal_handler_disconnect(parser, object_signal_id);
-		if (!parser_return || gupnp_error != NULL)
-		{
-			/* DIDL-Lite parsing failed */
+		/* DIDL-Lite parsing failed */
 
-			GError* error = NULL;
+		GError* error = NULL;
+		if (gupnp_error)
+			g_set_error(&error,
+			    MAFW_SOURCE_ERROR,
+			    MAFW_SOURCE_ERROR_BROWSE_RESULT_FAILED,
+			    "DIDL-Lite parsing failed: %s", gupnp_error->message);
+		else
+			g_set_error(&error,
+			    MAFW_SOURCE_ERROR,
+			    MAFW_SOURCE_ERROR_BROWSE_RESULT_FAILED,
+			    "DIDL-Lite parsing failed");
+		/* Call the callback function with invalid values and
+		   an error. */
+		if (args->remaining_count > 0)
+		{
 			if (gupnp_error)
-				g_set_error(&error,
-				    MAFW_SOURCE_ERROR,
-				    MAFW_SOURCE_ERROR_BROWSE_RESULT_FAILED,
-				    "DIDL-Lite parsing failed: %s", gupnp_error->message);
+				g_warning("DIDL-Lite parsing failed: %s."
+				  "Terminating browse session.",
+				  gupnp_error->message);
 			else
-				g_set_error(&error,
-				    MAFW_SOURCE_ERROR,
-				    MAFW_SOURCE_ERROR_BROWSE_RESULT_FAILED,
-				    "DIDL-Lite parsing failed");
-			/* Call the callback function with invalid values and
-			   an error. */
-			if (args->remaining_count > 0)
-			{
-				if (gupnp_error)
-					g_warning("DIDL-Lite parsing failed: %s."
-					  "Terminating browse session.",
-					  gupnp_error->message);
-				else
-					g_warning("DIDL-Lite parsing failed."
-					  "Terminating browse session.");
-
-				args->callback(MAFW_SOURCE(args->source),
-					       args->browse_id, 0, 0, NULL, NULL,
-					       args->user_data, error);
-				args->remaining_count = 0;
-			}
+				g_warning("DIDL-Lite parsing failed."
+				  "Terminating browse session.");
 
-			g_error_free(error);
-			if (gupnp_error)
-				g_error_free(gupnp_error);
-		}
-		/* Continue incremental browse only, if:
-		 * 1. There are items left in the server to browse
-		 * (2. The server returned at least requested_count items)
-		 * 3. All items were requested, or
-		 * 4. the next skip_count won't go beyond the requested count
-		 */
-		else if (args->remaining_count == 0)
-		{
-			/* There are no more items left to browse. Stop. */
-		}
-		/* This happens when no result was obtained in the browse operation.
-		   In  this case, mafw_upnp_source_browse_result is not invoked,
-		   so the remaining_count has not been modified (should be
-		   INT_MAX) and the user callback was never invoked */
-		else if (args->number_returned == 0)
-		{
 			args->callback(MAFW_SOURCE(args->source),
 				       args->browse_id, 0, 0, NULL, NULL,
-				       args->user_data, NULL);
-		}
-#if 0
-		/* Uncommenting this makes DLNA CTT 7.3.64.10 fail, but this
-		   commented version might produce other problems... */
-		else if (args->number_returned < args->requested_count)
-		{
-			/* The latest browse returned less items than what
-			   was requested. It is quite likely that we got all
-			   of them. Stop. */
-		}
-#endif
-		else if (args->item_count != 0 &&
-			 args->current >= (args->item_count - 1))
-		{
-			/* All items were not requested (0 == all) and we got
-			   already all that we wanted. Stop */
-		}
-		else
-		{
-			/* Browse the next increment. */
-			args->action = mafw_upnp_source_browse_internal(args);
+				       args->user_data, error);
+			args->remaining_count = 0;
 		}
+
+		g_error_free(error);
+		if (gupnp_error)
+			g_error_free(gupnp_error);
+
+		return FALSE;
 	}
 
-	g_free(didl);
-	browse_args_unref(args, NULL);
+	/* Continue incremental browse only, if:
+	 * 1. The browse operation was not cancelled from the callback,
+	 * 2. there are items left in the server to browse, and
+	 * 3. the page contained at least one item. Otherwise the server
+	 *    has no more items to give and browse_args_unref() sends the
+	 *    final EOF message.
+	 */
+	return args->cancelled == FALSE &&
+		args->remaining_count > 0 &&
+		args->current > current;
+}
+
+/**
+ * mafw_upnp_source_browse_adapt:
+ * @args: #BrowseArgs*
+ * @page: A page of @args whose reply was just received
+ *
+ * Adjusts the number of items requested per page from this server, so that
+ * a single page takes about %TARGET_PAGE_TIME milliseconds to arrive and its
+ * DIDL-Lite does not grow beyond %MAX_PAGE_SIZE bytes.
+ */
+static void mafw_upnp_source_browse_adapt(BrowseArgs* args, BrowsePage* page)
+{
+	MafwUPnPSourcePrivate* priv = args->source->priv;
+	gdouble elapsed;
+	gdouble count;
+
+	if (page->result == FALSE || page->didl == NULL ||
+	    page->number_returned == 0)
+	{
+		return;
+	}
+
+	elapsed = g_timer_elapsed(page->timer, NULL) * 1000.0;
+
+	/* Items this server delivers within the target round trip time */
+	count = page->number_returned * TARGET_PAGE_TIME / MAX(elapsed, 1.0);
+
+	/* ...but keep the DIDL-Lite of a page reasonably sized */
+	count = MIN(count, (gdouble) MAX_PAGE_SIZE * page->number_returned /
+		    MAX(strlen(page->didl), 1));
+
+	/* Smooth out single slow or fast replies */
+	count = (priv->requested_count + MIN(count, MAX_REQUESTED_COUNT)) / 2;
+	priv->requested_count = CLAMP((guint) count,
+				      MIN_REQUESTED_COUNT,
+				      MAX_REQUESTED_COUNT);
+	if (priv->max_returned != 0)
+		priv->requested_count = MIN(priv->requested_count,
+					    priv->max_returned);
+
+	g_debug("Browse page of %u items took %.0f ms. Next page size: %u",
+		page->number_returned, elapsed, priv->requested_count);
 }
 
+/**
+ * mafw_upnp_source_browse_cb:
+ * @service:   A CDS Service proxy that completed a browse action
+ * @action:    The completed browse action
+ * @user_data: #BrowsePage*
+ *
+ * Callback that is called when results from a browse action invocation are
+ * received. Stores the resulting DIDL-Lite in its page and lets
+ * mafw_upnp_source_browse_dispatch() send the pages back to the requester
+ * in order.
+ */
+static void mafw_upnp_source_browse_cb(GUPnPServiceProxy* service,
+					GUPnPServiceProxyAction* action,
+					gpointer user_data)
+{
+	BrowsePage* page = (BrowsePage*) user_data;
+	BrowseArgs* args;
+
+	g_assert(page != NULL);
+	args = page->args;
+
+	/* This action was completed, remove it from the page because it
+	   cannot be cancelled anymore. */
+	page->action = NULL;
+	page->done = TRUE;
+	g_timer_stop(page->timer);
+
+	/* Parse the action result and number of items returned in this set */
+	page->result = gupnp_service_proxy_end_action(
+		service, action, &page->error,
+		"Result",         G_TYPE_STRING, &page->didl,
+		"NumberReturned", G_TYPE_UINT,   &page->number_returned,
+		"TotalMatches",   G_TYPE_UINT,   &args->total_matches,
+		"UpdateID",       G_TYPE_UINT,   &page->update_id,
+		NULL);
+
+	g_debug("CDS server with UUID [%s] browse result consists of:"
+		"\tStartingIndex: %u\n"
+		"\tNumberReturned: %d\n"
+		"\tTotalMatches: %d\n",
+		mafw_extension_get_uuid(MAFW_EXTENSION(args->source)),
+		args->skip_count + page->start,
+		page->number_returned, args->total_matches);
+
+	mafw_upnp_source_browse_adapt(args, page);
+
+	/* Replies received while the pages are being dispatched (including
+	   the ones completing synchronously inside begin_action()) are
+	   picked up by the running dispatch loop. */
+	if (args->dispatching == FALSE)
+	{
+		browse_args_ref(args);
+		mafw_upnp_source_browse_dispatch(args);
+		browse_args_unref(args, NULL);
+	}
+}
+
+/**
+ * mafw_upnp_source_browse_internal:
+ * @args:  #BrowseArgs*
+ * @count: Number of items to request
+ *
+ * Begins a Browse or Search action for the next @count items of @args and
+ * appends it to the outstanding pages. Must be called with
+ * @args->dispatching set, since the reply may arrive before the action
+ * has even been returned.
+ *
+ * Returns: the begun action or %NULL on error.
+ */
 static GUPnPServiceProxyAction* mafw_upnp_source_browse_internal(
-	BrowseArgs* args)
+	BrowseArgs* args, guint count)
 {
 	GUPnPServiceProxyAction *action;
+	BrowsePage* page;
 	gint skip_count;
 
 	g_assert(args != NULL);
+	g_assert(args->dispatching == TRUE);
 
-	browse_args_ref(args);
-
-	skip_count = args->skip_count + args->current;
+	page = g_new0(BrowsePage, 1);
+	page->args = browse_args_ref(args);
+	page->start = args->next_index;
+	page->count = count;
+	page->timer = g_timer_new();
+	g_queue_push_tail(args->pages, page);
 
-	if (args->item_count == 0)
-	{
-		/* All items were requested by the user. Get default amount. */
-		args->requested_count = DEFAULT_REQUESTED_COUNT;
-	}
-	else
-	{
-		/* A specific number of items was requested by the user.
-		   Choose the smaller value between DEFAULT and items left. */
-		args->requested_count = MIN(DEFAULT_REQUESTED_COUNT,
-					    args->item_count);
-	}
+	skip_count = args->skip_count + page->start;
 
 	g_debug("Browse increment: %s\n\tSkip: %d -- Count: %d\n",
-		args->itemid, skip_count, args->requested_count);
+		args->itemid, skip_count, count);
 
 	if (args->search_criteria == NULL)
 	{
 		action = gupnp_service_proxy_begin_action(
 			args->source->priv->service,
-			"Browse",         mafw_upnp_source_browse_cb, args,
+			"Browse",         mafw_upnp_source_browse_cb, page,
 			"ObjectID",       G_TYPE_STRING, args->itemid,
 			"BrowseFlag",     G_TYPE_STRING, "BrowseDirectChildren",
 			"Filter",         G_TYPE_STRING, args->meta_keys_csv,
 			"StartingIndex",  G_TYPE_UINT,   skip_count,
-			"RequestedCount", G_TYPE_UINT,   args->requested_count,
+			"RequestedCount", G_TYPE_UINT,   count,
 			"SortCriteria",   G_TYPE_STRING, args->sort_criteria,
 			NULL);
 	}
@@ -1629,19 +1971,282 @@ static GUPnPServiceProxyAction* mafw_upnp_source_browse_internal(
 	{
 		action = gupnp_service_proxy_begin_action(
 			args->source->priv->service,
-			"Search",         mafw_upnp_source_browse_cb, args,
+			"Search",         mafw_upnp_source_browse_cb, page,
 			"ContainerID",    G_TYPE_STRING, args->itemid,
 			"SearchCriteria", G_TYPE_STRING, args->search_criteria,
 			"Filter",         G_TYPE_STRING, args->meta_keys_csv,
 			"StartingIndex",  G_TYPE_UINT,   skip_count,
-			"RequestedCount", G_TYPE_UINT,   args->requested_count,
+			"RequestedCount", G_TYPE_UINT,   count,
 			"SortCriteria",   G_TYPE_STRING, args->sort_criteria,
 			NULL);
 	}
 
+	if (action == NULL)
+	{
+		g_queue_remove(args->pages, page);
+		browse_page_free(page);
+	}
+	else
+	{
+		args->next_index += count;
+
+		/* Keep the action for cancelling, unless it has already
+		   completed. */
+		if (page->done == FALSE)
+			page->action = action;
+	}
+
 	return action;
 }
 
+/**
+ * mafw_upnp_source_browse_request:
+ * @args: #BrowseArgs*
+ *
+ * Requests more pages of @args until %BROWSE_PIPELINE_DEPTH actions are
+ * outstanding or all the remaining items have been requested. Until the
+ * first reply tells the number of matches, only one page is requested.
+ */
+static void mafw_upnp_source_browse_request(BrowseArgs* args)
+{
+	guint depth;
+	guint end;
+
+	if (args->cancelled == TRUE)
+	{
+		return;
+	}
+
+	if (args->remaining_count == UINT_MAX)
+	{
+		depth = 1;
+		end = args->item_count != 0 ? args->item_count : UINT_MAX;
+	}
+	else
+	{
+		depth = BROWSE_PIPELINE_DEPTH;
+		end = args->current + args->remaining_count;
+	}
+
+	while (g_queue_get_length(args->pages) < depth &&
+	       args->next_index < end)
+	{
+		if (mafw_upnp_source_browse_internal(
+			    args,
+			    MIN(args->source->priv->requested_count,
+				end - args->next_index)) == NULL)
+		{
+			g_warning("Unable to request the next browse page");
+			break;
+		}
+	}
+}
+
+/**
+ * mafw_upnp_source_browse_dispatch:
+ * @args: #BrowseArgs*
+ *
+ * Emits the received pages of @args in the order of their starting index
+ * and keeps the pipeline of outstanding actions full. Ends the browse
+ * operation when no more pages are needed. The caller must hold a
+ * reference to @args.
+ */
+static void mafw_upnp_source_browse_dispatch(BrowseArgs* args)
+{
+	BrowsePage* page;
+	gboolean short_page;
+	guint number_returned;
+
+	g_assert(args->dispatching == FALSE);
+	args->dispatching = TRUE;
+
+	for (;;)
+	{
+		page = g_queue_peek_head(args->pages);
+		if (page == NULL || page->done == FALSE)
+		{
+			/* Nothing to emit yet. Begin more actions; their
+			   replies may arrive synchronously. */
+			mafw_upnp_source_browse_request(args);
+
+			page = g_queue_peek_head(args->pages);
+			if (page == NULL || page->done == FALSE)
+				break;
+		}
+
+		g_queue_pop_head(args->pages);
+		short_page = page->result == TRUE &&
+			page->number_returned > 0 &&
+			page->number_returned < page->count;
+		number_returned = page->number_returned;
+		if (mafw_upnp_source_browse_emit(args, page) == FALSE)
+		{
+			browse_page_free(page);
+			mafw_upnp_source_browse_drop_pages(args);
+			mafw_upnp_source_cache_store(args);
+			break;
+		}
+		browse_page_free(page);
+
+		/* Many servers cap the number of items they return per
+		   action. Do not ask for more, so that the following pages
+		   line up with what the server returns. */
+		if (short_page == TRUE && args->remaining_count > 0)
+		{
+			MafwUPnPSourcePrivate* priv = args->source->priv;
+
+			priv->max_returned = number_returned;
+			priv->requested_count = MIN(priv->requested_count,
+						    number_returned);
+		}
+
+		/* If the server returned fewer items than requested, the
+		   pages after this one start from a wrong index. Request
+		   them again from the first missing item. */
+		page = g_queue_peek_head(args->pages);
+		if (page != NULL ? page->start != args->current
+				 : args->next_index != args->current)
+		{
+			mafw_upnp_source_browse_drop_pages(args);
+			args->next_index = args->current;
+		}
+	}
+
+	args->dispatching = FALSE;
+}
+
+/**
+ * mafw_upnp_source_browse_cache_cb:
+ * @args: #BrowseArgs*
+ *
+ * Emits the next %CACHE_BATCH_SIZE items of a browse answered from the
+ * cache.
+ */
+static gboolean mafw_upnp_source_browse_cache_cb(BrowseArgs* args)
+{
+	sqlite3_stmt* stmt;
+	GPtrArray* objectids;
+	GPtrArray* metadata;
+	gboolean more;
+	guint current;
+	guint i;
+
+	/* Read the batch before emitting it, so that the statement is not
+	   active while the callback runs. */
+	objectids = g_ptr_array_new();
+	metadata = g_ptr_array_new();
+	stmt = cache_items(args->cache_listing,
+			   args->skip_count + args->current,
+			   MIN(args->remaining_count, CACHE_BATCH_SIZE));
+	while (mafw_db_select(stmt, FALSE) == SQLITE_ROW)
+	{
+		g_ptr_array_add(objectids,
+				g_strdup(mafw_db_column_text(stmt, 0)));
+		g_ptr_array_add(metadata, mafw_metadata_thaw(
+					mafw_db_column_blob(stmt, 1),
+					sqlite3_column_bytes(stmt, 1)));
+	}
+	sqlite3_reset(stmt);
+
+	args->dispatching = TRUE;
+	for (i = 0; i < objectids->len && args->cancelled == FALSE; i++)
+	{
+		current = args->current++;
+		args->remaining_count--;
+		args->callback(MAFW_SOURCE(args->source),
+			       args->browse_id,
+			       args->remaining_count,
+			       current,
+			       g_ptr_array_index(objectids, i),
+			       g_ptr_array_index(metadata, i),
+			       args->user_data,
+			       NULL);
+	}
+	args->dispatching = FALSE;
+
+	/* Stop when done or cancelled, or if the listing was removed
+	   under us. The final unref terminates the browse then. */
+	more = objectids->len > 0 && args->remaining_count > 0 &&
+		args->cancelled == FALSE;
+
+	g_ptr_array_foreach(objectids, (GFunc) g_free, NULL);
+	g_ptr_array_free(objectids, TRUE);
+	g_ptr_array_foreach(metadata, (GFunc) g_hash_table_unref, NULL);
+	g_ptr_array_free(metadata, TRUE);
+
+	if (more == FALSE)
+	{
+		args->cache_source = 0;
+		browse_args_unref(args, NULL);
+	}
+
+	return more;
+}
+
+/**
+ * mafw_upnp_source_browse_cached:
+ * @args: #BrowseArgs*
+ *
+ * Answers the browse from the cache if the container has not changed
+ * since its listing was cached: the server still has the same
+ * SystemUpdateID, or the container the same UpdateID, as evented.
+ * Search results cover all the descendants of the container, whose
+ * changes do not bump its UpdateID, so only the former validates them.
+ *
+ * Returns: %TRUE if the browse is answered from the cache.
+ */
+static gboolean mafw_upnp_source_browse_cached(BrowseArgs* args)
+{
+	MafwUPnPSourcePrivate* priv = args->source->priv;
+	gint64 listing, system_update_id;
+	guint update_id, total, available;
+	gpointer evented;
+	gboolean container_known;
+	gchar* query;
+
+	query = mafw_upnp_source_cache_query(args);
+	listing = cache_lookup(mafw_extension_get_uuid(
+				       MAFW_EXTENSION(args->source)),
+			       args->itemid, query,
+			       &system_update_id, &update_id, &total);
+	g_free(query);
+	if (listing == 0)
+		return FALSE;
+
+	container_known = args->search_criteria == NULL &&
+		g_hash_table_lookup_extended(priv->container_update_ids,
+					     args->itemid, NULL, &evented);
+	if (!(priv->system_update_id >= 0 &&
+	      priv->system_update_id == system_update_id) &&
+	    !(container_known && GPOINTER_TO_UINT(evented) == update_id))
+	{
+		/* Nothing is known until the server events its state. Once
+		   it is, an older listing can never become valid again. */
+		if (priv->system_update_id >= 0 || container_known)
+			cache_remove(listing);
+		return FALSE;
+	}
+
+	available = total > args->skip_count ? total - args->skip_count : 0;
+	if (available == 0)
+		return FALSE;
+
+	g_debug("Browsing %s from the cache", args->itemid);
+
+	cache_touch(listing);
+	args->total_matches = total;
+	args->remaining_count = args->item_count != 0 ?
+		MIN(available, args->item_count) : available;
+	args->cache_listing = listing;
+
+	/* The idle callback holds a reference until it is done */
+	browse_args_ref(args);
+	args->cache_source = g_idle_add(
+		(GSourceFunc) mafw_upnp_source_browse_cache_cb, args);
+
+	return TRUE;
+}
+
 /**
  * Convert a MAFW-style sort criteria string to contain UPnP-style keys.
  */
@@ -1711,7 +2316,7 @@ static guint mafw_upnp_source_browse(MafwSource *source,
 				      MafwSourceBrowseResultCb browse_cb,
 				      gpointer user_data)
 {
-	GUPnPServiceProxyAction* action;
+	guint browse_id;
 	MafwUPnPSource* self;
 	BrowseArgs* args;
 	gchar* upsc;
@@ -1762,22 +2367,10 @@ static guint mafw_upnp_source_browse(MafwSource *source,
 	if (upnp_sort_criteria == NULL)
 		upnp_sort_criteria = g_strdup("");
 
-	/*
-	 * Register the current browseid now.  This is necessary because
-	 * gupnp_service_proxy_begin_action() may smartly call the callback
-	 * (which removes the entry) before it returns.  To avoid state
-	 * entries in ->browses we need to add it before beginning the
-	 * action.
-	 */
-	g_assert(!g_tree_lookup_extended(self->priv->browses,
-				 GUINT_TO_POINTER(_plugin->next_browse_id),
-				 NULL, NULL));
-	g_tree_insert(self->priv->browses,
-		      GUINT_TO_POINTER(_plugin->next_browse_id), NULL);
-
 	/* Some parameters we need to pass to the browse callbacks */
 	args = g_new0(BrowseArgs, 1);
 	args->source = self;
+	args->pages = g_queue_new();
 	args->itemid = itemid; /* Already strdupped */
 	args->search_criteria = upsc;
 	args->sort_criteria = upnp_sort_criteria;
@@ -1806,8 +2399,9 @@ static guint mafw_upnp_source_browse(MafwSource *source,
 	args->item_count = item_count;
 	args->callback = browse_cb;
 	args->user_data = user_data;
-	args->browse_id = _plugin->next_browse_id;
+	args->browse_id = browse_id = _plugin->next_browse_id++;
 	args->remaining_count = UINT_MAX;
+	args->system_update_id = self->priv->system_update_id;
 
 	g_debug("Browse: %s\n"
 		"\tID: %u\n"
@@ -1817,9 +2411,36 @@ static guint mafw_upnp_source_browse(MafwSource *source,
 		object_id, args->browse_id, args->meta_keys_csv,
 		args->sort_criteria, args->search_criteria);
 
+	/*
+	 * Register the browse operation now.  This is necessary because
+	 * gupnp_service_proxy_begin_action() may smartly call the callback
+	 * before it returns.  Hold a reference until the first page has
+	 * been requested and any synchronous replies dispatched.
+	 */
+	g_assert(!g_tree_lookup_extended(self->priv->browses,
+				 GUINT_TO_POINTER(browse_id), NULL, NULL));
+	g_tree_insert(self->priv->browses, GUINT_TO_POINTER(browse_id), args);
+	browse_args_ref(args);
+
+	if (mafw_upnp_source_browse_cached(args))
+	{
+		browse_args_unref(args, NULL);
+		return browse_id;
+	}
+
+	/* Collect complete listings for the cache */
+	if (skip_count == 0 && item_count == 0)
+	{
+		args->cache_ids = g_ptr_array_new();
+		args->cache_metadata = g_ptr_array_new();
+	}
+
 	/* Invoke the browse action on the given object (container) id */
-	action = mafw_upnp_source_browse_internal(args);
-	if (action == NULL)
+	args->dispatching = TRUE;
+	mafw_upnp_source_browse_request(args);
+	args->dispatching = FALSE;
+
+	if (g_queue_is_empty(args->pages))
 	{
 		g_warning("Unable to initiate browse. Terminating session.");
 		if (browse_cb)
@@ -1833,44 +2454,53 @@ static guint mafw_upnp_source_browse(MafwSource *source,
 			g_error_free(error);
 		}
 
-		/* Action invocation failed before it even begun */
+		/* Action invocation failed before it even begun. The
+		   error was the final result already. */
+		args->remaining_count = 0;
 		browse_args_unref(args, NULL);
 		return MAFW_SOURCE_INVALID_BROWSE_ID;
 	}
-	else
-	{
-		/* Set the new action as the current browse operation's action
-		   so that we can cancel it. */
-		args->action = action;
 
-		/* Save args struct so we can cancel its action later */
-		g_tree_insert(self->priv->browses,
-			      GUINT_TO_POINTER(_plugin->next_browse_id), args);
+	/* Emit the first page if it was received already, and keep the
+	   browse going. */
+	mafw_upnp_source_browse_dispatch(args);
+	browse_args_unref(args, NULL);
 
-		return _plugin->next_browse_id++;
-	}
+	return browse_id;
 }
 
 static void _cancel_request(MafwUPnPSourcePrivate *priv, BrowseArgs *args, GError *err)
 {
 	g_assert(args != NULL);
 
-	if (args->action != NULL)
-	{
-		/* Cancel the action related to the given browse ID */
-		gupnp_service_proxy_cancel_action(priv->service,
-						  args->action);
-
-		/* Unref args, since the UPnP action handler callback
-		   won't be called anymore. This will also take care of
-		   removing the browse id from the hash table, as well
-		   as sending the last EOF msg to the user callback. */
-		browse_args_unref(args, err);
+	if (args->cancelled == FALSE)
+	{
+		/* Cancel all actions related to the given browse ID and
+		   stop emitting the pages received already. The last unref
+		   will also take care of removing the browse id from the
+		   tree, as well as sending the last EOF msg to the user
+		   callback. */
+		args->cancelled = TRUE;
+		if (err != NULL && args->error == NULL)
+			args->error = g_error_copy(err);
+		browse_args_ref(args);
+		mafw_upnp_source_browse_drop_pages(args);
+		if (args->cache_source != 0 && args->dispatching == FALSE)
+		{
+			/* Drop the reference of the idle callback emitting
+			   the cached listing. */
+			g_source_remove(args->cache_source);
+			args->cache_source = 0;
+			browse_args_unref(args, NULL);
+		}
+		/* Not necessarily the last reference, the error is kept
+		   in @args for the final one. */
+		browse_args_unref(args, NULL);
 	}
 	else
 	{
-		/* The UPnP action was completed and it cannot be
-		   cancelled anymore. */
+		/* The browse operation was cancelled already, but the
+		   callback emitting its results is still running. */
 	}
 }
 
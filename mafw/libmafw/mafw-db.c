@@ -52,6 +52,19 @@
  */
 #define MAFW_DFLT_DB_FNAME	".mafw.db"
 
+/* How long a busy handler sleeps before retrying, in milliseconds. */
+#define BUSY_SLEEP		5
+
+/* Whether mafw_db_trace() has been called. */
+static gboolean tracing;
+
+/* Statements of mafw_db_prepare_cached() keyed by their SQL text. */
+static GHashTable *stmt_cache;
+
+/* Counters reported by mafw_db_get_stats(), updated from any thread. */
+static MafwDbStats stats;
+G_LOCK_DEFINE_STATIC(stats);
+
 /* Program code */
 /* sqlite3_trace() function callback. */
 static void tracefun(void *unused, char const *sql)
@@ -59,6 +72,108 @@ static void tracefun(void *unused, char const *sql)
 	g_warning("%s", sql);
 }
 
+/* sqlite3_profile() function callback, accounts the latency of $sql. */
+static void profilefun(void *unused, char const *sql, sqlite3_uint64 ns)
+{
+	guint64 us;
+
+	us = ns / 1000;
+	G_LOCK(stats);
+	stats.queries++;
+	stats.query_time += us;
+	if (us > stats.slowest_query)
+		stats.slowest_query = us;
+	G_UNLOCK(stats);
+}
+
+/*
+ * sqlite3_busy_handler() callback.  Sleeps and retries until the timeout
+ * of the connection (in milliseconds) elapses, counting the time spent
+ * waiting for locks.
+ */
+static int busy_handler(void *timeout, int count)
+{
+	if (count * BUSY_SLEEP >= GPOINTER_TO_INT(timeout))
+		return 0;
+
+	g_usleep(BUSY_SLEEP * 1000);
+	G_LOCK(stats);
+	if (!count)
+		stats.lock_waits++;
+	stats.lock_wait_time += BUSY_SLEEP * 1000;
+	G_UNLOCK(stats);
+	return 1;
+}
+
+/* Returns the path of the database file.  Free it with g_free(). */
+static gchar *db_path(void)
+{
+	const char *path, *home;
+
+	/* Figure out where to place the database file.
+	 * First try $MAFW_DB, then $HOME/MAFW_DFLT_DB_FNAME
+	 * and finally /home/user/MAFW_DFLT_DB_FNAME. */
+	if ((path = getenv("MAFW_DB")))
+		return g_strdup(path);
+	if (!(home = getenv("HOME")))
+		home = "/home/user";
+	return g_strdup_printf("%s/%s", home, MAFW_DFLT_DB_FNAME);
+}
+
+/* Sets up what is common to all connections of $db. */
+static void setup_connection(sqlite3 *db)
+{
+	/* Set a random timeout, so concurrent writers will have more
+	 * chance avoiding starvation. */
+	sqlite3_busy_handler(db, busy_handler,
+			     GINT_TO_POINTER(g_random_int_range(100, 1001)));
+	if (tracing) {
+		sqlite3_trace(db, tracefun, NULL);
+		sqlite3_profile(db, profilefun, NULL);
+	}
+}
+
+/* Switches $db to write-ahead logging, if it can be. */
+static void setup_journal(sqlite3 *db)
+{
+	sqlite3_stmt *stmt;
+	gboolean wal;
+
+	/* Older libraries ignore the pragma and in-memory databases
+	 * keep their own journal; either way the statement succeeds,
+	 * reporting the mode the database actually has. */
+	if (sqlite3_prepare_v2(db, "PRAGMA journal_mode = WAL", -1,
+			       &stmt, NULL) != SQLITE_OK)
+		return;
+	wal = sqlite3_step(stmt) == SQLITE_ROW
+		&& sqlite3_column_text(stmt, 0)
+		&& !g_ascii_strcasecmp(
+			(const gchar *)sqlite3_column_text(stmt, 0), "wal");
+	sqlite3_finalize(stmt);
+
+	/* In WAL mode a commit needs not be synced to be durable
+	 * against application crashes.  It would not be with the
+	 * rollback journal. */
+	if (wal)
+		sqlite3_exec(db, "PRAGMA synchronous = NORMAL",
+			     NULL, NULL, NULL);
+}
+
+static gpointer open_db(gpointer unused)
+{
+	sqlite3 *db;
+	gchar *path;
+
+	path = db_path();
+	if (sqlite3_open(path, &db) != SQLITE_OK)
+		g_error("Could not open the database: %s", sqlite3_errmsg(db));
+	g_free(path);
+	setup_connection(db);
+	setup_journal(db);
+
+	return db;
+}
+
 /* These functions are global, but reserved for internal use by MAFW. */
 /**
  * mafw_db_get:
@@ -67,50 +182,96 @@ static void tracefun(void *unused, char const *sql)
  * database creation and error handling.  As this resource is global
  * may not free it.
  *
+ * The database is switched to write-ahead logging if the SQLite
+ * library supports it, so that readers in other processes and in
+ * mafw_db_open_reader() connections do not block the writer and
+ * vice versa.
+ *
  * Returns: the handle
  */
 sqlite3 *mafw_db_get(void)
 {
-	static sqlite3 *db = NULL;
-	char const *path;
-	gboolean path_allocated;
+	/* mafw_db_open_reader() may be the first to get here, from
+	 * any thread. */
+	static GOnce db = G_ONCE_INIT;
 
-	if (db != NULL)
-		return db;
-
-	/* Figure out where to place the database file.
-	 * First try $MAFW_DB, then $HOME/MAFW_DFLT_DB_FNAME
-	 * and finally /home/user/MAFW_DFLT_DB_FNAME. */
-	path_allocated = FALSE;
-	if (!(path = getenv("MAFW_DB"))) {
-		const char *home;
-
-		if (!(home = getenv("HOME")))
-			home = "/home/user";
-		path = g_strdup_printf("%s/%s", home, MAFW_DFLT_DB_FNAME);
-		path_allocated = TRUE;
-	}
+	return g_once(&db, open_db, NULL);
+}
 
-	/* Open the database and set a random timeout, so concurrent
-	 * writers will have more chance avoiding starvation. */
-	if (sqlite3_open(path, &db) != SQLITE_OK)
-		g_error("Could not open the database: %s", sqlite3_errmsg(db));
-	sqlite3_busy_timeout(db, g_random_int_range(100, 1001));
+/**
+ * mafw_db_open_reader:
+ *
+ * Opens a new read-only connection to the framework database.  Unlike
+ * the handle of mafw_db_get(), which belongs to the main thread, it may
+ * be used from a worker thread, one connection per thread.  Statements
+ * of the connection must be prepared with sqlite3_prepare_v2() and may
+ * be executed with mafw_db_select().
+ *
+ * Returns: the handle, or %NULL if the database could not be opened.
+ * Close it with mafw_db_close_reader().
+ */
+sqlite3 *mafw_db_open_reader(void)
+{
+	sqlite3 *db;
+	gchar *path;
+
+	/* Make sure the database exists and is in WAL mode. */
+	mafw_db_get();
+
+	path = db_path();
+	if (sqlite3_open_v2(path, &db, SQLITE_OPEN_READONLY,
+			    NULL) != SQLITE_OK) {
+		g_warning("Could not open the database: %s",
+			  sqlite3_errmsg(db));
+		sqlite3_close(db);
+		db = NULL;
+	} else
+		setup_connection(db);
+	g_free(path);
 
-	if (path_allocated)
-		g_free((char *)path);
 	return db;
 }
 
+/**
+ * mafw_db_close_reader:
+ * @db: a connection returned by mafw_db_open_reader()
+ *
+ * Closes @db.  All its statements must have been finalized.
+ */
+void mafw_db_close_reader(sqlite3 *db)
+{
+	if (sqlite3_close(db) != SQLITE_OK)
+		g_warning("Could not close the database: %s",
+			  sqlite3_errmsg(db));
+}
+
 /**
  * mafw_db_trace:
  * 
  * Print every SQL statement about to be executed.
- * Host variables are not expanded.
+ * Host variables are not expanded.  From now on the latency of the
+ * statements is accounted too, see mafw_db_get_stats().  Connections
+ * opened later by mafw_db_open_reader() are traced as well.
  */
 void mafw_db_trace(void)
 {
+	tracing = TRUE;
 	sqlite3_trace(mafw_db_get(), tracefun, NULL);
+	sqlite3_profile(mafw_db_get(), profilefun, NULL);
+}
+
+/**
+ * mafw_db_get_stats:
+ * @st: where to store the counters
+ *
+ * Retrieves the lock-wait counters of all connections, and the
+ * query-latency counters collected since mafw_db_trace() was called.
+ */
+void mafw_db_get_stats(MafwDbStats *st)
+{
+	G_LOCK(stats);
+	*st = stats;
+	G_UNLOCK(stats);
 }
 
 /**
@@ -147,6 +308,37 @@ sqlite3_stmt *mafw_db_prepare(gchar const *query)
 	return stmt;
 }
 
+/**
+ * mafw_db_prepare_cached:
+ * @query: the query
+ *
+ * Like mafw_db_prepare(), but the statement is kept in a cache keyed
+ * by @query, so repeated ad-hoc queries are compiled only once.  The
+ * statement is returned reset and with its bindings cleared.  It is
+ * owned by the cache: do not finalize it, sqlite3_reset() it when done
+ * instead.  Only one user may have the same statement at a time.
+ *
+ * Returns: the statement
+ */
+sqlite3_stmt *mafw_db_prepare_cached(gchar const *query)
+{
+	sqlite3_stmt *stmt;
+
+	if (!stmt_cache)
+		stmt_cache = g_hash_table_new_full(g_str_hash, g_str_equal,
+						   g_free, NULL);
+
+	if ((stmt = g_hash_table_lookup(stmt_cache, query)) != NULL) {
+		sqlite3_reset(stmt);
+		sqlite3_clear_bindings(stmt);
+		return stmt;
+	}
+
+	stmt = mafw_db_prepare(query);
+	g_hash_table_insert(stmt_cache, g_strdup(query), stmt);
+	return stmt;
+}
+
 /**
  * mafw_db_exec:
  * @query: the query to execute
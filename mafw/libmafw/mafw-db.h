@@ -169,12 +169,34 @@
  */
 #define mafw_db_column_int64		sqlite3_column_int64
 
+/**
+ * MafwDbStats:
+ * @queries: number of statements executed while tracing
+ * @query_time: their total execution time, in microseconds
+ * @slowest_query: execution time of the slowest one, in microseconds
+ * @lock_waits: number of times a connection had to wait for a lock
+ * @lock_wait_time: total time spent waiting for locks, in microseconds
+ *
+ * Counters of the framework database, see mafw_db_get_stats().
+ */
+typedef struct {
+	guint queries;
+	guint64 query_time;
+	guint64 slowest_query;
+	guint lock_waits;
+	guint64 lock_wait_time;
+} MafwDbStats;
+
 /* Function prototypes */
 G_BEGIN_DECLS
 
 extern sqlite3      *mafw_db_get(void);
+extern sqlite3      *mafw_db_open_reader(void);
+extern void          mafw_db_close_reader(sqlite3 *db);
 extern void          mafw_db_trace(void);
+extern void          mafw_db_get_stats(MafwDbStats *st);
 extern sqlite3_stmt *mafw_db_prepare(gchar const *query);
+extern sqlite3_stmt *mafw_db_prepare_cached(gchar const *query);
 
 extern gint mafw_db_exec(gchar const *query);
 extern gint mafw_db_do(sqlite3_stmt *stmt);
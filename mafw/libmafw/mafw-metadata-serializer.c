@@ -192,6 +192,388 @@ static void bary2gval(GValue *value, GByteArray *bary, gsize *index)
 	}
 }
 
+/* Streams */
+/*
+ * Metadata hash tables are frozen into versioned streams, laid out so that
+ * the receiver can look up single keys right in the stream (see
+ * #MafwMetadataView) without materializing the hash table.  All offsets
+ * are counted from the start of the stream, all numbers are in host byte
+ * order, and every item starts at a multiple of 8 bytes:
+ *
+ * header:  STREAM_MAGIC, the version (1 byte) and the number of keys
+ *          (uint32)
+ * index:   the key dictionary, the offsets of the key (uint32) and of its
+ *          values (uint32) for each key, sorted by key
+ * key:     length (uint32) and the bytes of the key, then '\0'
+ * values:  number of values (uint32), reserved (uint32), then the values
+ * value:   GType (uint32), size of the data (uint32), then the data:
+ *          gint32 for booleans, ints, uints and floats, gint64 for longs
+ *          ulongs and 64-bit ints, double for doubles and '\0'-terminated
+ *          bytes for strings
+ *
+ * The magic starts with 0xFF, a byte which is not valid in UTF-8, so it
+ * can't be confused with the first key of an earlier, unversioned stream
+ * (see mafw_metadata_freeze_bary()).  Those are still accepted by
+ * mafw_metadata_thaw() and mafw_metadata_view_init().
+ */
+#define STREAM_MAGIC		"\xffMD"
+#define STREAM_VERSION		1
+#define STREAM_HEADER		8
+#define STREAM_ALIGN(n)		(((n) + 7) & ~(gsize)7)
+
+/* A key and its values to be frozen. */
+typedef struct {
+	const gchar *key;
+	gsize klen;
+	GValueArray *val;
+} StreamEntry;
+
+static void collect_entry(const gchar *key, GValueArray *val, GArray *ents)
+{
+	StreamEntry e;
+
+	e.key = key;
+	e.klen = strlen(key);
+	e.val = val;
+	g_array_append_val(ents, e);
+}
+
+static gint cmp_entries(gconstpointer a, gconstpointer b)
+{
+	return strcmp(((const StreamEntry *)a)->key,
+		      ((const StreamEntry *)b)->key);
+}
+
+/* Returns the size of the data of $value, and the length of the string in
+ * $slen if it is one. */
+static gsize gval_size(const GValue *value, gsize *slen)
+{
+	switch (G_VALUE_TYPE(value)) {
+	case G_TYPE_BOOLEAN:
+	case G_TYPE_INT:
+	case G_TYPE_UINT:
+	case G_TYPE_FLOAT:
+		return sizeof(gint32);
+	case G_TYPE_LONG:
+	case G_TYPE_ULONG:
+	case G_TYPE_INT64:
+	case G_TYPE_UINT64:
+		return sizeof(gint64);
+	case G_TYPE_DOUBLE:
+		return sizeof(gdouble);
+	case G_TYPE_STRING:
+		*slen = strlen(g_value_get_string(value));
+		return *slen + 1;
+	default:
+		g_assert_not_reached();
+	}
+}
+
+static void put32(guint8 *p, guint32 val)
+{
+	memcpy(p, &val, sizeof(val));
+}
+
+static guint32 get32(const guint8 *p)
+{
+	guint32 val;
+
+	memcpy(&val, p, sizeof(val));
+	return val;
+}
+
+/* Writes the data of $value of $size bytes to $p. */
+static void gval2stream(guint8 *p, const GValue *value, gsize size)
+{
+	union {
+		gint32 i32;
+		gint64 i64;
+		gfloat f;
+		gdouble d;
+	} u;
+
+	switch (G_VALUE_TYPE(value)) {
+	case G_TYPE_BOOLEAN:
+		u.i32 = g_value_get_boolean(value);
+		break;
+	case G_TYPE_INT:
+		u.i32 = g_value_get_int(value);
+		break;
+	case G_TYPE_UINT:
+		u.i32 = (gint32)g_value_get_uint(value);
+		break;
+	case G_TYPE_FLOAT:
+		u.f = g_value_get_float(value);
+		break;
+	case G_TYPE_LONG:
+		u.i64 = g_value_get_long(value);
+		break;
+	case G_TYPE_ULONG:
+		u.i64 = (gint64)g_value_get_ulong(value);
+		break;
+	case G_TYPE_INT64:
+		u.i64 = g_value_get_int64(value);
+		break;
+	case G_TYPE_UINT64:
+		u.i64 = (gint64)g_value_get_uint64(value);
+		break;
+	case G_TYPE_DOUBLE:
+		u.d = g_value_get_double(value);
+		break;
+	case G_TYPE_STRING:
+		memcpy(p, g_value_get_string(value), size);
+		return;
+	default:
+		g_assert_not_reached();
+	}
+	memcpy(p, &u, size);
+}
+
+/* Freezes $md into a versioned stream.  The size of the stream is computed
+ * first, so it is allocated once and every string is scanned only once. */
+static GByteArray *md2stream(GHashTable *md)
+{
+	GByteArray *bary;
+	GArray *ents, *slens;
+	StreamEntry *e;
+	GValue *value;
+	gsize size, dsize, slen;
+	guint i, o, s;
+	guint8 *p;
+
+	ents = g_array_sized_new(FALSE, FALSE, sizeof(StreamEntry),
+				 g_hash_table_size(md));
+	g_hash_table_foreach(md, (GHFunc)collect_entry, ents);
+	g_array_sort(ents, cmp_entries);
+
+	/* Size it up, and remember the lengths of the strings. */
+	slens = g_array_new(FALSE, FALSE, sizeof(gsize));
+	size = STREAM_HEADER + STREAM_ALIGN(2 * sizeof(guint32) * ents->len);
+	for (i = 0; i < ents->len; i++) {
+		e = &g_array_index(ents, StreamEntry, i);
+		size += STREAM_ALIGN(sizeof(guint32) + e->klen + 1);
+		size += 2 * sizeof(guint32);
+		for (o = 0; o < e->val->n_values; o++) {
+			value = g_value_array_get_nth(e->val, o);
+			slen = 0;
+			dsize = gval_size(value, &slen);
+			if (G_VALUE_HOLDS_STRING(value))
+				g_array_append_val(slens, slen);
+			size += 2 * sizeof(guint32) + STREAM_ALIGN(dsize);
+		}
+	}
+
+	bary = g_byte_array_sized_new(size);
+	g_byte_array_set_size(bary, size);
+	memset(bary->data, 0, size);
+
+	p = bary->data;
+	memcpy(p, STREAM_MAGIC, sizeof(STREAM_MAGIC) - 1);
+	p[sizeof(STREAM_MAGIC) - 1] = STREAM_VERSION;
+	put32(p + 4, ents->len);
+
+	p = bary->data + STREAM_HEADER
+		+ STREAM_ALIGN(2 * sizeof(guint32) * ents->len);
+	for (i = s = 0; i < ents->len; i++) {
+		e = &g_array_index(ents, StreamEntry, i);
+
+		put32(bary->data + STREAM_HEADER + 8 * i, p - bary->data);
+		put32(p, e->klen);
+		memcpy(p + sizeof(guint32), e->key, e->klen);
+		p += STREAM_ALIGN(sizeof(guint32) + e->klen + 1);
+
+		put32(bary->data + STREAM_HEADER + 8 * i + 4, p - bary->data);
+		put32(p, e->val->n_values);
+		p += 2 * sizeof(guint32);
+		for (o = 0; o < e->val->n_values; o++) {
+			value = g_value_array_get_nth(e->val, o);
+			if (G_VALUE_HOLDS_STRING(value))
+				dsize = g_array_index(slens, gsize, s++) + 1;
+			else
+				dsize = gval_size(value, NULL);
+			put32(p, G_VALUE_TYPE(value));
+			put32(p + sizeof(guint32), dsize);
+			p += 2 * sizeof(guint32);
+			gval2stream(p, value, dsize);
+			p += STREAM_ALIGN(dsize);
+		}
+	}
+	g_assert(p == bary->data + size);
+
+	g_array_free(slens, TRUE);
+	g_array_free(ents, TRUE);
+	return bary;
+}
+
+/* Returns whether $stream of $sstream bytes is a versioned stream. */
+static gboolean is_stream(const gchar *stream, gsize sstream)
+{
+	return sstream > 0 && (guchar)stream[0] == (guchar)STREAM_MAGIC[0];
+}
+
+/* Returns the offset of the values of the $i:th key of $view. */
+static guint32 view_values(const MafwMetadataView *view, guint i)
+{
+	return get32(view->data + STREAM_HEADER + 8 * i + 4);
+}
+
+/* Returns the index of $key in $view, or -1. */
+static gint view_find(const MafwMetadataView *view, const gchar *key)
+{
+	gint lo, hi, mid, cmp;
+
+	lo = 0;
+	hi = (gint)view->nkeys - 1;
+	while (lo <= hi) {
+		mid = (lo + hi) / 2;
+		cmp = strcmp(key, mafw_metadata_view_key(view, mid));
+		if (cmp == 0)
+			return mid;
+		else if (cmp < 0)
+			hi = mid - 1;
+		else
+			lo = mid + 1;
+	}
+	return -1;
+}
+
+/* Locates the $nth value of $key in $view.  Returns the offset of its data
+ * and its type and size in $typep and $sizep, or 0 if there is no such
+ * value or it doesn't fit in the stream. */
+static gsize view_datum(const MafwMetadataView *view, const gchar *key,
+			guint nth, GType *typep, gsize *sizep)
+{
+	gint i;
+	gsize off, size;
+	guint32 nvalues;
+
+	if ((i = view_find(view, key)) < 0)
+		return 0;
+	off = view_values(view, i);
+	nvalues = get32(view->data + off);
+	if (nth >= nvalues)
+		return 0;
+	off += 2 * sizeof(guint32);
+	for (;;) {
+		if (off + 2 * sizeof(guint32) > view->size)
+			return 0;
+		size = get32(view->data + off + sizeof(guint32));
+		if (size > view->size - off - 2 * sizeof(guint32))
+			return 0;
+		if (!nth--)
+			break;
+		off += 2 * sizeof(guint32) + STREAM_ALIGN(size);
+	}
+	*typep = get32(view->data + off);
+	*sizep = size;
+	return off + 2 * sizeof(guint32);
+}
+
+/* Decodes the $size bytes of data of $type at $p into $value.  Strings are
+ * copied if $copy, otherwise they point into the stream. */
+static gboolean stream2gval(GValue *value, GType type, const guint8 *p,
+			    gsize size, gboolean copy)
+{
+	union {
+		gint32 i32;
+		gint64 i64;
+		gfloat f;
+		gdouble d;
+	} u;
+
+	switch (type) {
+	case G_TYPE_BOOLEAN:
+	case G_TYPE_INT:
+	case G_TYPE_UINT:
+	case G_TYPE_FLOAT:
+		if (size != sizeof(gint32))
+			return FALSE;
+		break;
+	case G_TYPE_LONG:
+	case G_TYPE_ULONG:
+	case G_TYPE_INT64:
+	case G_TYPE_UINT64:
+	case G_TYPE_DOUBLE:
+		if (size != sizeof(gint64))
+			return FALSE;
+		break;
+	case G_TYPE_STRING:
+		if (!size || p[size - 1] != '\0')
+			return FALSE;
+		break;
+	default:
+		return FALSE;
+	}
+
+	g_value_init(value, type);
+	if (type == G_TYPE_STRING) {
+		if (copy)
+			g_value_set_string(value, (const gchar *)p);
+		else
+			g_value_set_static_string(value, (const gchar *)p);
+		return TRUE;
+	}
+
+	memcpy(&u, p, size);
+	switch (type) {
+	case G_TYPE_BOOLEAN:
+		g_value_set_boolean(value, u.i32);
+		break;
+	case G_TYPE_INT:
+		g_value_set_int(value, u.i32);
+		break;
+	case G_TYPE_UINT:
+		g_value_set_uint(value, (guint32)u.i32);
+		break;
+	case G_TYPE_FLOAT:
+		g_value_set_float(value, u.f);
+		break;
+	case G_TYPE_LONG:
+		g_value_set_long(value, u.i64);
+		break;
+	case G_TYPE_ULONG:
+		g_value_set_ulong(value, (guint64)u.i64);
+		break;
+	case G_TYPE_INT64:
+		g_value_set_int64(value, u.i64);
+		break;
+	case G_TYPE_UINT64:
+		g_value_set_uint64(value, (guint64)u.i64);
+		break;
+	case G_TYPE_DOUBLE:
+		g_value_set_double(value, u.d);
+		break;
+	}
+	return TRUE;
+}
+
+/* Like mafw_metadata_view_lookup(), optionally copying the strings. */
+static GValueArray *view_lookup(const MafwMetadataView *view,
+				const gchar *key, gboolean copy)
+{
+	GValueArray *val;
+	GValue value;
+	GType type;
+	gsize off, size;
+	guint nvalues, i;
+
+	if (!(nvalues = mafw_metadata_view_nvalues(view, key)))
+		return NULL;
+
+	memset(&value, 0, sizeof(value));
+	val = g_value_array_new(nvalues);
+	for (i = 0; i < nvalues; i++) {
+		if (!(off = view_datum(view, key, i, &type, &size)) ||
+		    !stream2gval(&value, type, view->data + off, size, copy)) {
+			g_value_array_free(val);
+			return NULL;
+		}
+		g_value_array_append(val, &value);
+		g_value_unset(&value);
+	}
+	return val;
+}
+
 /* Interface functions */
 /**
  * mafw_metadata_freeze_bary:
@@ -199,7 +581,13 @@ static void bary2gval(GValue *value, GByteArray *bary, gsize *index)
  *
  * Serializes a mafw metadata hash table.  The returned stream is
  * suitable for sending to another process or storing on the disk,
- * but is not architecture-independent. @md can be %NULL.
+ * but is not architecture-independent. @md can be %NULL, in which
+ * case the stream is empty.
+ *
+ * The stream is versioned, and can be read either by
+ * mafw_metadata_thaw_bary() or, without materializing the whole hash
+ * table, with a #MafwMetadataView.  Earlier versions of the library
+ * produced unversioned streams, which are still accepted:
  *
  * <itemizedlist>
  * <listitem><code>stream	:= &lt;entry&gt; *</code></listitem>
@@ -215,12 +603,9 @@ static void bary2gval(GValue *value, GByteArray *bary, gsize *index)
  */
 GByteArray *mafw_metadata_freeze_bary(GHashTable *md)
 {
-	GByteArray *bary;
-
-	bary = g_byte_array_new();
-	if (md != NULL)
-		g_hash_table_foreach(md, (GHFunc)mdkv2bary, bary);
-	return bary;
+	if (md == NULL || !g_hash_table_size(md))
+		return g_byte_array_new();
+	return md2stream(md);
 }
 
 /**
@@ -261,7 +646,8 @@ gpointer mafw_metadata_val_thaw_bary(GByteArray *bary, gsize *i)
  * Recreates the mafw metadata hash table from its serialized from.
  * The serialized and deserialized hash tables contain the same
  * information, but are not byte-equivalent.  Returns %NULL if @bary
- * does not contain any keys after all.  If the input stream is found
+ * does not contain any keys after all, or if it is a malformed
+ * versioned stream.  If an unversioned input stream is found
  * syntactically incorrect the program is aborted.
  *
  * Returns: a #GHashTable.
@@ -271,6 +657,30 @@ GHashTable *mafw_metadata_thaw_bary(GByteArray *bary)
 	gsize i;
 	GHashTable *md;
 	const char *key;
+	MafwMetadataView view;
+	GValueArray *val;
+
+	if (is_stream((const gchar *)bary->data, bary->len)) {
+		if (!mafw_metadata_view_init(&view, bary->data, bary->len)) {
+			g_critical("malformed metadata stream");
+			return NULL;
+		}
+		md = NULL;
+		for (i = 0; i < view.nkeys; i++) {
+			key = mafw_metadata_view_key(&view, i);
+			if (!(val = view_lookup(&view, key, TRUE))) {
+				g_critical("malformed metadata stream");
+				mafw_metadata_release(md);
+				md = NULL;
+				break;
+			}
+			if (md == NULL)
+				md = mafw_metadata_new();
+			g_hash_table_insert(md, g_strdup(key), val);
+		}
+		mafw_metadata_view_clear(&view);
+		return md;
+	}
 
 	i = 0;
 	md = NULL;
@@ -344,6 +754,192 @@ gchar *mafw_metadata_val_freeze(gpointer val, gsize *sstreamp)
 	*sstreamp = bary->len;
 	return (gchar *)g_byte_array_free(bary, FALSE);
 }
+/**
+ * mafw_metadata_view_init:
+ * @view: the #MafwMetadataView to initialize
+ * @stream: a stream produced by mafw_metadata_freeze()
+ * @sstream: the stream size
+ *
+ * Sets up @view to look up keys of the serialized metadata in @stream
+ * directly, without thawing it into a hash table.  Only the key
+ * dictionary is checked here, values are checked as they are looked up.
+ * @stream must outlive @view, unless it is an unversioned stream, which
+ * is converted first.  Release the view with mafw_metadata_view_clear().
+ *
+ * Returns: %FALSE if @stream is malformed.
+ */
+gboolean mafw_metadata_view_init(MafwMetadataView *view,
+				 gconstpointer stream, gsize sstream)
+{
+	const guint8 *p;
+	guint32 koff, klen, voff;
+	const gchar *prev;
+	GHashTable *md;
+	guint i;
+
+	memset(view, 0, sizeof(*view));
+	if (!sstream)
+		return TRUE;
+
+	if (!is_stream(stream, sstream)) {
+		/* Convert it, so that we need to deal with only one kind. */
+		md = mafw_metadata_thaw(stream, sstream);
+		if (md == NULL)
+			return TRUE;
+		view->converted = md2stream(md);
+		mafw_metadata_release(md);
+		stream = view->converted->data;
+		sstream = view->converted->len;
+	}
+
+	p = stream;
+	if (sstream < STREAM_HEADER ||
+	    memcmp(p, STREAM_MAGIC, sizeof(STREAM_MAGIC) - 1) ||
+	    p[sizeof(STREAM_MAGIC) - 1] != STREAM_VERSION)
+		goto fail;
+	view->data = p;
+	view->size = sstream;
+	view->nkeys = get32(p + 4);
+	if (view->nkeys > (sstream - STREAM_HEADER) / (2 * sizeof(guint32)))
+		goto fail;
+
+	prev = NULL;
+	for (i = 0; i < view->nkeys; i++) {
+		koff = get32(p + STREAM_HEADER + 8 * i);
+		voff = view_values(view, i);
+		if (koff > sstream - sizeof(guint32))
+			goto fail;
+		klen = get32(p + koff);
+		if (klen >= sstream - koff - sizeof(guint32) ||
+		    p[koff + sizeof(guint32) + klen] != '\0')
+			goto fail;
+		if (voff > sstream - 2 * sizeof(guint32) || !get32(p + voff))
+			goto fail;
+		/* Keys must be sorted and unique for view_find(). */
+		if (prev && strcmp(prev, (const gchar *)p + koff
+				   + sizeof(guint32)) >= 0)
+			goto fail;
+		prev = (const gchar *)p + koff + sizeof(guint32);
+	}
+	return TRUE;
+
+fail:
+	mafw_metadata_view_clear(view);
+	return FALSE;
+}
+
+/**
+ * mafw_metadata_view_clear:
+ * @view: a #MafwMetadataView
+ *
+ * Releases the resources of @view.  The stream it was set up with is not
+ * touched.
+ */
+void mafw_metadata_view_clear(MafwMetadataView *view)
+{
+	if (view->converted)
+		g_byte_array_free(view->converted, TRUE);
+	memset(view, 0, sizeof(*view));
+}
+
+/**
+ * mafw_metadata_view_key:
+ * @view: a #MafwMetadataView
+ * @i: index of the key, less than the @nkeys of @view
+ *
+ * Keys are kept in strcmp() order, so this function can be used to
+ * enumerate them.
+ *
+ * Returns: the @i:th key of @view, pointing into the stream.
+ */
+const gchar *mafw_metadata_view_key(const MafwMetadataView *view, guint i)
+{
+	g_return_val_if_fail(i < view->nkeys, NULL);
+	return (const gchar *)view->data
+		+ get32(view->data + STREAM_HEADER + 8 * i) + sizeof(guint32);
+}
+
+/**
+ * mafw_metadata_view_nvalues:
+ * @view: a #MafwMetadataView
+ * @key: the key to look up
+ *
+ * Returns: the number of values of @key in @view, or 0 if it's missing.
+ */
+guint mafw_metadata_view_nvalues(const MafwMetadataView *view,
+				 const gchar *key)
+{
+	gint i;
+
+	if ((i = view_find(view, key)) < 0)
+		return 0;
+	return get32(view->data + view_values(view, i));
+}
 
+/**
+ * mafw_metadata_view_get_value:
+ * @view: a #MafwMetadataView
+ * @key: the key to look up
+ * @nth: the index of the value to get
+ * @value: an uninitialized (zero-filled) #GValue to return the value in
+ *
+ * Decodes one value of @key.  String values are not copied, they point
+ * into the stream and are only valid as long as the stream.  The caller
+ * needs to g_value_unset() @value after use.
+ *
+ * Returns: %FALSE if there is no such value, or it is malformed.
+ */
+gboolean mafw_metadata_view_get_value(const MafwMetadataView *view,
+				      const gchar *key, guint nth,
+				      GValue *value)
+{
+	GType type;
+	gsize off, size;
+
+	if (!(off = view_datum(view, key, nth, &type, &size)))
+		return FALSE;
+	return stream2gval(value, type, view->data + off, size, FALSE);
+}
+
+/**
+ * mafw_metadata_view_get_string:
+ * @view: a #MafwMetadataView
+ * @key: the key to look up
+ *
+ * Convenience function to get the first value of @key if it is a string.
+ *
+ * Returns: the string pointing into the stream, or %NULL if @key is
+ * missing or its value is not a string.
+ */
+const gchar *mafw_metadata_view_get_string(const MafwMetadataView *view,
+					   const gchar *key)
+{
+	GType type;
+	gsize off, size;
+
+	if (!(off = view_datum(view, key, 0, &type, &size)) ||
+	    type != G_TYPE_STRING || !size ||
+	    view->data[off + size - 1] != '\0')
+		return NULL;
+	return (const gchar *)view->data + off;
+}
+
+/**
+ * mafw_metadata_view_lookup:
+ * @view: a #MafwMetadataView
+ * @key: the key to look up
+ *
+ * Materializes the values of a single key, like they would be found in
+ * the hash table returned by mafw_metadata_thaw().  String values point
+ * into the stream.
+ *
+ * Returns: a newly allocated #GValueArray, or %NULL if @key is missing
+ * or malformed.
+ */
+GValueArray *mafw_metadata_view_lookup(const MafwMetadataView *view,
+				       const gchar *key)
+{
+	return view_lookup(view, key, FALSE);
+}
 
 /* vi: set noexpandtab ts=8 sw=8 cino=t0,(0: */
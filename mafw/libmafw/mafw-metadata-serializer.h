@@ -26,6 +26,7 @@
 #define __MAFW_METADATA_DBUS_H__
 
 #include <glib.h>
+#include <glib-object.h>
 
 G_BEGIN_DECLS
 extern GByteArray *mafw_metadata_freeze_bary(GHashTable *md);
@@ -38,6 +39,37 @@ extern void mafw_metadata_val_freeze_bary(GByteArray *bary, gpointer val);
 extern gpointer mafw_metadata_val_thaw_bary(GByteArray *bary, gsize *i);
 
 extern gchar *mafw_metadata_val_freeze(gpointer val, gsize *sstreamp);
+
+/**
+ * MafwMetadataView:
+ * @data:  the stream being looked at
+ * @size:  size of @data
+ * @nkeys: number of keys in the stream
+ *
+ * Read-only view of serialized metadata, see mafw_metadata_view_init().
+ */
+typedef struct {
+	const guint8 *data;
+	gsize size;
+	guint nkeys;
+	/*< private >*/
+	GByteArray *converted;
+} MafwMetadataView;
+
+extern gboolean mafw_metadata_view_init(MafwMetadataView *view,
+					gconstpointer stream, gsize sstream);
+extern void mafw_metadata_view_clear(MafwMetadataView *view);
+extern const gchar *mafw_metadata_view_key(const MafwMetadataView *view,
+					   guint i);
+extern guint mafw_metadata_view_nvalues(const MafwMetadataView *view,
+					const gchar *key);
+extern gboolean mafw_metadata_view_get_value(const MafwMetadataView *view,
+					     const gchar *key, guint nth,
+					     GValue *value);
+extern const gchar *mafw_metadata_view_get_string(const MafwMetadataView *view,
+						  const gchar *key);
+extern GValueArray *mafw_metadata_view_lookup(const MafwMetadataView *view,
+					      const gchar *key);
 G_END_DECLS
 
 #endif
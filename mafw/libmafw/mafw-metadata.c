@@ -24,6 +24,7 @@
 
 #define _GNU_SOURCE
 
+#include <ctype.h>
 #include <stdlib.h>
 #include <string.h>
 #include <fnmatch.h>
@@ -232,6 +233,10 @@ static gint eval_filter(GHashTable *md, const MafwFilter *filter,
 static gint compare_mvals(const GValue *lhs, const GValue *rhs,
 			  const gchar *key, MafwMetadataComparator funcomp)
 {
+	/* The default comparator can tell the relation in one go. */
+	if (funcomp == mafw_metadata_ordered)
+		return mafw_metadata_collate(key, lhs, rhs);
+
 	/* $funcomp() can only tell us if $lhs and $rhs are in a particular
 	 * relation, so lots of time we'll need to call it more than once.
 	 * This can be considered a suboptimal approach. */
@@ -244,6 +249,356 @@ static gint compare_mvals(const GValue *lhs, const GValue *rhs,
 		return 0;
 }
 
+/*
+ * Makes sure strings of filters can be converted into the types accepted
+ * in mafw metadata hash tables, to perform comparison.  Note that it will
+ * (probably) take over any previous conversions between these types if
+ * the user happened to define one.
+ */
+static void register_transforms(void)
+{
+	static gboolean hacked = FALSE;
+
+	if (!hacked) {
+		g_value_register_transform_func(G_TYPE_STRING, G_TYPE_INT,
+						gvstr2gvint);
+		hacked = TRUE;
+	}
+}
+
+/* Compiled filters */
+/*
+ * A node of a filter, compiled into a flat array in prefix order, so that
+ * the subexpressions of a complex one follow it immediately.
+ *
+ * @type:	like MafwFilter.type
+ * @end:	index of the first instruction after this subexpression
+ * @key:	index of the key of a simple expression in
+ *		MafwCompiledFilter.keys
+ * @value:	the constant of a simple expression, as a string
+ * @ival:	@value converted to an integer
+ * @collkey:	the collation key of @value, used by the default comparator
+ * @ctype:	the last type @value was converted to for a
+ *		#MafwMetadataComparator, or %G_TYPE_INVALID
+ * @cval:	@value converted to @ctype
+ * @cok:	whether the conversion to @ctype succeeded
+ */
+typedef struct {
+	MafwFilterType type;
+	guint end;
+	guint key;
+	GValue value;
+	gint ival;
+	gchar *collkey;
+	GType ctype;
+	GValue cval;
+	gboolean cok;
+} FilterInsn;
+
+/*
+ * @insns:	the instructions, the first one being the root of the filter
+ * @ninsns:	number of @insns
+ * @keys:	the distinct keys referred to by the filter, interned
+ * @nkeys:	number of @keys
+ * @funcomp:	the comparator, or %NULL for mafw_metadata_ordered()
+ */
+struct _MafwCompiledFilter {
+	FilterInsn *insns;
+	guint ninsns;
+	const gchar **keys;
+	guint nkeys;
+	MafwMetadataComparator funcomp;
+};
+
+/* Returns the number of nodes of $filter. */
+static guint count_filter(const MafwFilter *filter)
+{
+	guint i, n;
+
+	n = 1;
+	if (filter->type < MAFW_F_COMPLEX)
+		for (i = 0; filter->parts[i]; i++)
+			n += count_filter(filter->parts[i]);
+	return n;
+}
+
+/* Compiles $filter into $cf->insns from *$ip on. */
+static void compile_filter(MafwCompiledFilter *cf, const MafwFilter *filter,
+			   guint *ip)
+{
+	FilterInsn *insn;
+	const gchar *key;
+	guint i;
+
+	insn = &cf->insns[(*ip)++];
+	insn->type = filter->type;
+	if (filter->type < MAFW_F_COMPLEX) {
+		for (i = 0; filter->parts[i]; i++)
+			compile_filter(cf, filter->parts[i], ip);
+		insn->end = *ip;
+		return;
+	}
+	insn->end = *ip;
+
+	/* Keys are interned, so they are equal if their pointers are. */
+	key = g_intern_string(filter->key);
+	for (i = 0; i < cf->nkeys; i++)
+		if (cf->keys[i] == key)
+			break;
+	if (i == cf->nkeys)
+		cf->keys[cf->nkeys++] = key;
+	insn->key = i;
+
+	if (filter->type == mafw_f_exists)
+		return;
+	g_value_init(&insn->value, G_TYPE_STRING);
+	g_value_set_string(&insn->value, filter->value);
+	insn->ival = atoi(filter->value);
+	if (!cf->funcomp && filter->type != mafw_f_approx)
+		insn->collkey = g_utf8_collate_key(filter->value, -1);
+}
+
+/* Returns the constant of $insn converted to $type, or NULL if it can't be
+ * done. */
+static const GValue *insn_rhs(FilterInsn *insn, GType type)
+{
+	if (type == G_TYPE_STRING)
+		return &insn->value;
+	if (insn->ctype != type) {
+		if (insn->ctype != G_TYPE_INVALID)
+			g_value_unset(&insn->cval);
+		insn->ctype = type;
+		g_value_init(&insn->cval, type);
+		insn->cok = g_value_transform(&insn->value, &insn->cval);
+	}
+	return insn->cok ? &insn->cval : NULL;
+}
+
+/* Like mafw_metadata_ordered() with the constant of $insn on the right-hand
+ * side, only faster. */
+static gboolean insn_ordered(const FilterInsn *insn, const GValue *lhsgv)
+{
+	gint cmp;
+
+	switch (G_VALUE_TYPE(lhsgv)) {
+	case G_TYPE_STRING: {
+		const gchar *lhs;
+		gchar *lhsk;
+
+		lhs = g_value_get_string(lhsgv);
+		if (insn->type == mafw_f_approx)
+			return fnmatch(g_value_get_string(&insn->value), lhs,
+				       FNM_CASEFOLD) == 0;
+		lhsk = g_utf8_collate_key(lhs, -1);
+		cmp = strcasecmp(lhsk, insn->collkey);
+		g_free(lhsk);
+		break;
+	}
+	case G_TYPE_INT: {
+		gint lhs;
+
+		lhs = g_value_get_int(lhsgv);
+		cmp = lhs < insn->ival ? -1 : lhs > insn->ival;
+		if (insn->type == mafw_f_approx)
+			return cmp == 0;
+		break;
+	}
+	default:
+		g_assert_not_reached();
+	}
+
+	switch (insn->type) {
+	case mafw_f_eq:
+		return cmp == 0;
+	case mafw_f_lt:
+		return cmp < 0;
+	case mafw_f_gt:
+		return cmp > 0;
+	default:
+		g_assert_not_reached();
+	}
+}
+
+/*
+ * Evaluates the subexpression of $cf at *$ip against $md, like
+ * eval_filter(), and advances *$ip past it.  $vals caches the values of
+ * the keys of $cf in $md, (gpointer)-1 meaning not looked up yet.
+ */
+static gint eval_insns(MafwCompiledFilter *cf, GHashTable *md,
+		       gpointer *vals, guint *ip)
+{
+	FilterInsn *insn;
+	gpointer lhs;
+	const GValue *rhs;
+	MafwMetadataComparator funcomp;
+	GType type;
+	guint i;
+
+	insn = &cf->insns[(*ip)++];
+	if (insn->type < MAFW_F_COMPLEX) {
+		gint ret, now;
+		gboolean cond, action;
+
+		switch (insn->type) {
+		case mafw_f_and:
+			cond = action = FALSE;
+			break;
+		case mafw_f_or:
+			cond = action = TRUE;
+			break;
+		case mafw_f_not:
+			cond   = TRUE;
+			action = FALSE;
+			break;
+		default:
+			g_assert_not_reached();
+		}
+
+		ret = -1;
+		while (*ip < insn->end) {
+			now = eval_insns(cf, md, vals, ip);
+			if (now == cond) {
+				/* Short-circuit the rest. */
+				*ip = insn->end;
+				return action;
+			} else if (now == !cond)
+				ret = !action;
+		}
+		return ret;
+	}
+
+	if (vals[insn->key] == (gpointer)-1)
+		vals[insn->key] = g_hash_table_lookup(md,
+						      cf->keys[insn->key]);
+	lhs = vals[insn->key];
+	if (insn->type == mafw_f_exists)
+		return lhs != NULL;
+	if (!lhs)
+		return -1;
+
+	type = G_VALUE_TYPE(g_value_array_get_nth(lhs, 0));
+	if (!cf->funcomp && (type == G_TYPE_STRING || type == G_TYPE_INT)) {
+		for (i = 0; i < ((GValueArray *)lhs)->n_values; i++)
+			if (insn_ordered(insn, g_value_array_get_nth(lhs, i)))
+				return TRUE;
+		return FALSE;
+	}
+
+	/* Multi-valued tag, return whether at least one of the values
+	 * holds against the relation. */
+	if (!(rhs = insn_rhs(insn, type)))
+		return -1;
+	funcomp = cf->funcomp ? cf->funcomp : mafw_metadata_ordered;
+	for (i = 0; i < ((GValueArray *)lhs)->n_values; i++)
+		if (funcomp(insn->type, cf->keys[insn->key],
+			    g_value_array_get_nth(lhs, i), rhs))
+			return TRUE;
+	return FALSE;
+}
+
+/* Sort keys */
+/*
+ * A sort key is the concatenation of the encoded sorting terms of a mafw
+ * metadata hash table, such that memcmp() orders sort keys the way
+ * mafw_metadata_compare() orders their hash tables.  For each term:
+ *
+ * - SK_PRESENT or SK_MISSING, so that hash tables lacking the key sort
+ *   downwards regardless of the direction of the term
+ * - if present, SK_VALUE, the type and the encoded data of each value,
+ *   then SK_END, so that fewer values sort upwards like in
+ *   mafw_metadata_compare().  These bytes are inverted if the term is
+ *   descending.
+ *
+ * Integers are encoded big-endian with the sign bit flipped, strings as
+ * their case-folded collation key terminated by '\0', which does not occur
+ * in collation keys.  Every part is prefix-free, so keys which are equal
+ * up to the length of the shorter one are equal.
+ */
+#define SK_PRESENT	0x00
+#define SK_MISSING	0x01
+#define SK_END		0x01
+#define SK_VALUE	0x02
+
+struct _MafwMetadataSortKey {
+	gsize len;
+	guint8 data[1];
+};
+
+static void sk_put_be(GByteArray *sk, guint64 val, guint nbytes)
+{
+	guint8 buf[8];
+	guint i;
+
+	for (i = 0; i < nbytes; i++)
+		buf[i] = val >> (8 * (nbytes - 1 - i));
+	g_byte_array_append(sk, buf, nbytes);
+}
+
+/* Appends the encoding of $value to $sk. */
+static void sk_put_value(GByteArray *sk, const GValue *value)
+{
+	guint8 tag;
+	union {
+		gdouble d;
+		guint64 u;
+	} dbl;
+
+	tag = G_TYPE_FUNDAMENTAL(G_VALUE_TYPE(value))
+		>> G_TYPE_FUNDAMENTAL_SHIFT;
+	g_byte_array_append(sk, &tag, 1);
+	switch (G_VALUE_TYPE(value)) {
+	case G_TYPE_STRING: {
+		gchar *collkey;
+		guint i;
+
+		/* Like _compare_utf_str(). */
+		collkey = g_utf8_collate_key(g_value_get_string(value), -1);
+		for (i = 0; collkey[i]; i++)
+			collkey[i] = tolower((guchar)collkey[i]);
+		g_byte_array_append(sk, (guint8 *)collkey, i + 1);
+		g_free(collkey);
+		break;
+	}
+	case G_TYPE_BOOLEAN:
+		sk_put_be(sk, g_value_get_boolean(value) != FALSE, 1);
+		break;
+	case G_TYPE_INT:
+		sk_put_be(sk, (guint32)g_value_get_int(value) ^ 0x80000000U, 4);
+		break;
+	case G_TYPE_UINT:
+		sk_put_be(sk, g_value_get_uint(value), 4);
+		break;
+	case G_TYPE_LONG:
+		sk_put_be(sk, (guint64)(gint64)g_value_get_long(value)
+			  ^ G_GUINT64_CONSTANT(0x8000000000000000), 8);
+		break;
+	case G_TYPE_ULONG:
+		sk_put_be(sk, g_value_get_ulong(value), 8);
+		break;
+	case G_TYPE_INT64:
+		sk_put_be(sk, (guint64)g_value_get_int64(value)
+			  ^ G_GUINT64_CONSTANT(0x8000000000000000), 8);
+		break;
+	case G_TYPE_UINT64:
+		sk_put_be(sk, g_value_get_uint64(value), 8);
+		break;
+	case G_TYPE_FLOAT:
+	case G_TYPE_DOUBLE:
+		dbl.d = G_VALUE_TYPE(value) == G_TYPE_FLOAT
+			? g_value_get_float(value)
+			: g_value_get_double(value);
+		/* Negative numbers order backwards by their bits. */
+		if (dbl.u & G_GUINT64_CONSTANT(0x8000000000000000))
+			dbl.u = ~dbl.u;
+		else
+			dbl.u ^= G_GUINT64_CONSTANT(0x8000000000000000);
+		sk_put_be(sk, dbl.u, 8);
+		break;
+	default:
+		g_assert_not_reached();
+	}
+}
+
 /* Interface functions */
 
 /**
@@ -587,6 +942,59 @@ static gint _compare_utf_str(const gchar *lval, const gchar *rval)
 	return compval;
 }
 
+/**
+ * mafw_metadata_collate:
+ * @key: key
+ * @lhsgv: left comparison element
+ * @rhsgv: right comparison element
+ *
+ * Three-way counterpart of mafw_metadata_ordered(), ordering values the
+ * same way with a single comparison.  Besides strings and integers it
+ * handles every type allowed in mafw metadata hash tables.  @key is
+ * ignored.
+ *
+ * Returns: a negative integer if @lhsgv is ordered before @rhsgv, 0 if
+ * they are equal and a positive integer otherwise.
+ */
+gint mafw_metadata_collate(const gchar *key, const GValue *lhsgv,
+			   const GValue *rhsgv)
+{
+	g_assert(G_VALUE_TYPE(lhsgv) == G_VALUE_TYPE(rhsgv));
+
+#define CMP3(get) (get(lhsgv) < get(rhsgv) ? -1 : get(lhsgv) > get(rhsgv))
+	switch (G_VALUE_TYPE(lhsgv)) {
+	case G_TYPE_STRING: {
+		gint cmp;
+
+		cmp = _compare_utf_str(g_value_get_string(lhsgv),
+				       g_value_get_string(rhsgv));
+		return cmp < 0 ? -1 : cmp > 0;
+	}
+	case G_TYPE_BOOLEAN:
+		return (g_value_get_boolean(lhsgv) != FALSE)
+			- (g_value_get_boolean(rhsgv) != FALSE);
+	case G_TYPE_INT:
+		return CMP3(g_value_get_int);
+	case G_TYPE_UINT:
+		return CMP3(g_value_get_uint);
+	case G_TYPE_LONG:
+		return CMP3(g_value_get_long);
+	case G_TYPE_ULONG:
+		return CMP3(g_value_get_ulong);
+	case G_TYPE_INT64:
+		return CMP3(g_value_get_int64);
+	case G_TYPE_UINT64:
+		return CMP3(g_value_get_uint64);
+	case G_TYPE_FLOAT:
+		return CMP3(g_value_get_float);
+	case G_TYPE_DOUBLE:
+		return CMP3(g_value_get_double);
+	default:
+		g_assert_not_reached();
+	}
+#undef CMP3
+}
+
 /**
  * mafw_metadata_ordered:
  * @rel: filter type
@@ -704,28 +1112,112 @@ gboolean mafw_metadata_ordered(MafwFilterType rel, const gchar *key,
 gboolean mafw_metadata_filter(GHashTable *md, const MafwFilter *filter,
 			      MafwMetadataComparator funcomp)
 {
-	static gboolean hacked = FALSE;
-
 	if (!filter || !md)
 		return TRUE;
 
-	/*
-	 * We'll need to convert strings of $filter into types accepted
-	 * in the hash table to perform comparison.  Note that it will
-	 * (probably) take over any previous conversions between these
-	 * types if the user happened to define one.
-	 */
-	if (!hacked) {
-		g_value_register_transform_func(G_TYPE_STRING, G_TYPE_INT,
-						gvstr2gvint);
-		hacked = TRUE;
-	}
-	
+	register_transforms();
 	if (!funcomp)
 		funcomp = mafw_metadata_ordered;
 	return eval_filter(md, filter, funcomp) != FALSE;
 }
 
+/**
+ * mafw_filter_compile:
+ * @filter: filter
+ * @funcomp: comparison function
+ *
+ * Prepares @filter to be evaluated against many mafw metadata hash
+ * tables with mafw_compiled_filter_eval(), for example by sources
+ * filtering browse results themselves.  Keys are interned, the
+ * expression tree is flattened, and the values of @filter are
+ * converted to the types they are compared with once rather than for
+ * every comparison.  @funcomp is like in mafw_metadata_filter(); when
+ * it is %NULL the comparisons are done in place, without wrapping the
+ * values in #GValue:s.  @filter is not referenced after the call.
+ *
+ * Returns: the compiled filter to be freed with
+ * mafw_compiled_filter_free(), or %NULL if @filter is %NULL.
+ */
+MafwCompiledFilter *mafw_filter_compile(const MafwFilter *filter,
+					MafwMetadataComparator funcomp)
+{
+	MafwCompiledFilter *cf;
+	guint i;
+
+	if (!filter)
+		return NULL;
+
+	register_transforms();
+	cf = g_new0(MafwCompiledFilter, 1);
+	cf->funcomp = funcomp != mafw_metadata_ordered ? funcomp : NULL;
+	cf->ninsns = count_filter(filter);
+	cf->insns = g_new0(FilterInsn, cf->ninsns);
+	cf->keys = g_new(const gchar *, cf->ninsns);
+	i = 0;
+	compile_filter(cf, filter, &i);
+	g_assert(i == cf->ninsns);
+	return cf;
+}
+
+/**
+ * mafw_compiled_filter_eval:
+ * @cf: a compiled filter, or %NULL
+ * @md: hash table
+ *
+ * Returns whether @md matches the filter compiled into @cf, with the
+ * same semantics as mafw_metadata_filter().  Each key of the filter is
+ * looked up in @md at most once.  @cf caches conversions, so it must not
+ * be evaluated from multiple threads at the same time.
+ *
+ * Returns: %TRUE if match, %FALSE otherwise.
+ */
+gboolean mafw_compiled_filter_eval(MafwCompiledFilter *cf, GHashTable *md)
+{
+	gpointer stackvals[16], *vals;
+	gboolean ret;
+	guint i;
+
+	if (!cf || !md)
+		return TRUE;
+
+	vals = cf->nkeys <= G_N_ELEMENTS(stackvals)
+		? stackvals : g_new(gpointer, cf->nkeys);
+	for (i = 0; i < cf->nkeys; i++)
+		vals[i] = (gpointer)-1;
+	i = 0;
+	ret = eval_insns(cf, md, vals, &i) != FALSE;
+	if (vals != stackvals)
+		g_free(vals);
+	return ret;
+}
+
+/**
+ * mafw_compiled_filter_free:
+ * @cf: a compiled filter, or %NULL
+ *
+ * Frees a filter compiled by mafw_filter_compile().
+ */
+void mafw_compiled_filter_free(MafwCompiledFilter *cf)
+{
+	guint i;
+
+	if (!cf)
+		return;
+	for (i = 0; i < cf->ninsns; i++) {
+		FilterInsn *insn;
+
+		insn = &cf->insns[i];
+		if (G_VALUE_TYPE(&insn->value) != G_TYPE_INVALID)
+			g_value_unset(&insn->value);
+		if (insn->ctype != G_TYPE_INVALID)
+			g_value_unset(&insn->cval);
+		g_free(insn->collkey);
+	}
+	g_free(cf->insns);
+	g_free(cf->keys);
+	g_free(cf);
+}
+
 /**
  * mafw_metadata_compare: 
  * @md1: first hash table
@@ -740,7 +1232,11 @@ gboolean mafw_metadata_filter(GHashTable *md, const MafwFilter *filter,
  * (but not exactly so because it takes more parameters).  The order
  * of the hash tables is a function of the sorting @terms, a sliced
  * mafw_source_browse() sorting expression. @funcomp is used to
- * compare metadata values, and defaults to mafw_metadata_ordered().
+ * compare metadata values, and defaults to mafw_metadata_ordered(),
+ * in which case each pair of values is compared in a single step by
+ * mafw_metadata_collate().  To sort many hash tables with the default
+ * comparator, consider comparing their mafw_metadata_sort_key_new()
+ * instead.
  *
  * For each tag in @terms if one of the hash tables has value for it,
  * but the other does not, the latter is sorted downwards.  Otherwise
@@ -847,4 +1343,116 @@ gint mafw_metadata_compare(GHashTable *md1, GHashTable *md2,
 	return 0;
 }
 
+/**
+ * mafw_metadata_sort_key_new:
+ * @md: hash table, or %NULL
+ * @terms: comparison terms, like for mafw_metadata_compare()
+ *
+ * Precomputes what mafw_metadata_compare() needs to know about @md with
+ * the default comparator, collation keys of strings included, so that
+ * sorting many hash tables with mafw_metadata_sort_key_compare() is
+ * reduced to comparing bytes.  The sort key does not refer to @md or
+ * @terms.
+ *
+ * Returns: a sort key to be freed with mafw_metadata_sort_key_free().
+ */
+MafwMetadataSortKey *mafw_metadata_sort_key_new(GHashTable *md,
+						const gchar *const *terms)
+{
+	MafwMetadataSortKey *sk;
+	GByteArray *bary;
+	guint i, o, start;
+	guint8 b;
+
+	bary = g_byte_array_new();
+	for (i = 0; terms[i]; i++) {
+		const gchar *key;
+		GValueArray *vals;
+		gboolean desc;
+
+		key = terms[i];
+		desc = key[0] == '-';
+		if (key[0] == '+' || key[0] == '-')
+			key++;
+
+		vals = md ? g_hash_table_lookup(md, key) : NULL;
+		b = vals ? SK_PRESENT : SK_MISSING;
+		g_byte_array_append(bary, &b, 1);
+		if (!vals)
+			continue;
+
+		start = bary->len;
+		for (o = 0; o < vals->n_values; o++) {
+			b = SK_VALUE;
+			g_byte_array_append(bary, &b, 1);
+			sk_put_value(bary, g_value_array_get_nth(vals, o));
+		}
+		b = SK_END;
+		g_byte_array_append(bary, &b, 1);
+		if (desc)
+			for (o = start; o < bary->len; o++)
+				bary->data[o] = ~bary->data[o];
+	}
+
+	sk = g_malloc(G_STRUCT_OFFSET(MafwMetadataSortKey, data)
+		      + bary->len);
+	sk->len = bary->len;
+	memcpy(sk->data, bary->data, bary->len);
+	g_byte_array_free(bary, TRUE);
+	return sk;
+}
+
+/**
+ * mafw_metadata_sort_key_compare:
+ * @sk1: sort key
+ * @sk2: sort key
+ *
+ * Compares two sort keys made with the same terms.  The result agrees
+ * with what mafw_metadata_compare() would tell about their hash tables
+ * with the default comparator.
+ *
+ * Returns: value greater than 0 if @sk1 is greater than @sk2, a negative
+ * value if @sk1 is smaller than @sk2, and 0 if they are equal.
+ */
+gint mafw_metadata_sort_key_compare(const MafwMetadataSortKey *sk1,
+				    const MafwMetadataSortKey *sk2)
+{
+	gint cmp;
+
+	cmp = memcmp(sk1->data, sk2->data, MIN(sk1->len, sk2->len));
+	if (cmp)
+		return cmp < 0 ? -1 : +1;
+	return sk1->len < sk2->len ? -1 : sk1->len > sk2->len;
+}
+
+/**
+ * mafw_metadata_sort_key_data:
+ * @sk: sort key
+ * @len: return location for the length of the data
+ *
+ * Exposes the bytes of @sk, for example to let a database order rows
+ * by them.  Comparing the bytes of two sort keys with memcmp(), the
+ * shorter one ordering first if it is a prefix of the other, agrees
+ * with mafw_metadata_sort_key_compare().
+ *
+ * Returns: the data of @sk, owned by @sk.
+ */
+const guint8 *mafw_metadata_sort_key_data(const MafwMetadataSortKey *sk,
+					  gsize *len)
+{
+	*len = sk->len;
+	return sk->data;
+}
+
+/**
+ * mafw_metadata_sort_key_free:
+ * @sk: a sort key, or %NULL
+ *
+ * Frees a sort key made by mafw_metadata_sort_key_new().
+ */
+void mafw_metadata_sort_key_free(MafwMetadataSortKey *sk)
+{
+	g_free(sk);
+}
+
 /* vi: set noexpandtab ts=8 sw=8 cino=t0,(0: */
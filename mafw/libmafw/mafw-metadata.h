@@ -784,6 +784,21 @@ typedef gboolean (*MafwMetadataComparator)(MafwFilterType rel,
 					   const GValue *lhsgv,
 					   const GValue *rshgv);
 
+/**
+ * MafwMetadataSortKey:
+ *
+ * Precomputed sorting terms of a mafw metadata hash table, see
+ * mafw_metadata_sort_key_new().
+ */
+typedef struct _MafwMetadataSortKey MafwMetadataSortKey;
+
+/**
+ * MafwCompiledFilter:
+ *
+ * A #MafwFilter prepared for repeated evaluation by mafw_filter_compile().
+ */
+typedef struct _MafwCompiledFilter MafwCompiledFilter;
+
 G_BEGIN_DECLS
 
 /* Function prototypes */
@@ -803,13 +818,27 @@ extern const gchar **mafw_metadata_relevant_keys(const gchar *const *keys,
 						 const MafwFilter *filter,
 						 const gchar *const *sorting);
 
+extern gint mafw_metadata_collate(const gchar *key, const GValue *lhsgv,
+				  const GValue *rhsgv);
 extern gboolean mafw_metadata_ordered(MafwFilterType rel, const gchar *key,
 				      const GValue *lhsgv, const GValue *rhsgv);
 extern gboolean mafw_metadata_filter(GHashTable *md, const MafwFilter *filter,
 				     MafwMetadataComparator funcomp);
+extern MafwCompiledFilter *mafw_filter_compile(const MafwFilter *filter,
+					       MafwMetadataComparator funcomp);
+extern gboolean mafw_compiled_filter_eval(MafwCompiledFilter *cf,
+					  GHashTable *md);
+extern void mafw_compiled_filter_free(MafwCompiledFilter *cf);
 extern gint mafw_metadata_compare(GHashTable *md1, GHashTable *md2,
 				  const gchar *const *terms,
 				  MafwMetadataComparator funcomp);
+extern MafwMetadataSortKey *mafw_metadata_sort_key_new(GHashTable *md,
+						const gchar *const *terms);
+extern gint mafw_metadata_sort_key_compare(const MafwMetadataSortKey *sk1,
+					   const MafwMetadataSortKey *sk2);
+extern const guint8 *mafw_metadata_sort_key_data(const MafwMetadataSortKey *sk,
+						 gsize *len);
+extern void mafw_metadata_sort_key_free(MafwMetadataSortKey *sk);
 
 G_END_DECLS
 
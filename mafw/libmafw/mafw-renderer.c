@@ -319,6 +319,7 @@ enum {
 	PLAYSTATE_CHANGED,
 	BUFFERING_INFO,
 	METADATA_CHANGED,
+	METADATAS_CHANGED,
 	PROPERTY_CHANGED,
 	LAST_SIGNAL,
 };
@@ -335,6 +336,21 @@ mafw_renderer_default_emit_buffering_info(MafwRenderer *self, gfloat fraction)
 	g_signal_emit_by_name(self, "buffering-info", fraction);
 }
 
+/* Keeps MafwRenderer::metadata-changed going for those not interested
+ * in the aggregated signal. */
+static void
+mafw_renderer_default_metadatas_changed(MafwRenderer *self,
+					GHashTable *metadata)
+{
+	GHashTableIter iter;
+	gpointer key, values;
+
+	g_hash_table_iter_init(&iter, metadata);
+	while (g_hash_table_iter_next(&iter, &key, &values))
+		g_signal_emit(self, mafw_renderer_signals[METADATA_CHANGED], 0,
+			      key, values);
+}
+
 
 /*----------------------------------------------------------------------------
   GObject init
@@ -348,6 +364,8 @@ static void mafw_renderer_init(MafwRenderer *self)
 
 static void mafw_renderer_class_init(MafwRendererClass *klass)
 {
+	GType param_types[1];
+
 	/* Playback */
 
 	klass->play        = mafw_renderer_default_play;
@@ -477,6 +495,32 @@ static void mafw_renderer_class_init(MafwRendererClass *klass)
 			 NULL,
 			 mafw_marshal_VOID__STRING_BOXED,
 			 G_TYPE_NONE, 2, G_TYPE_STRING, G_TYPE_VALUE_ARRAY);
+
+	/**
+	 * MafwRenderer::metadatas-changed:
+	 * @self:     a #MafwRenderer instance.
+	 * @metadata: metadata hash table of the keys that changed together.
+	 *
+	 * Emitted when several metadata of the currently playing item have
+	 * changed at once.  The default handler emits
+	 * #MafwRenderer::metadata-changed for each key in @metadata, after
+	 * the handlers connected to this signal have run.
+	 */
+	/* MafwRendererClass has no room for a new vfunc without breaking
+	 * the ABI of renderers built against older headers, so the default
+	 * handler is a class closure. */
+	param_types[0] = G_TYPE_HASH_TABLE;
+	mafw_renderer_signals[METADATAS_CHANGED] =
+	    g_signal_newv("metadatas-changed",
+			  G_TYPE_FROM_CLASS(klass),
+			  G_SIGNAL_RUN_LAST,
+			  g_cclosure_new(G_CALLBACK(
+				  mafw_renderer_default_metadatas_changed),
+					 NULL, NULL),
+			  NULL,
+			  NULL,
+			  g_cclosure_marshal_VOID__BOXED,
+			  G_TYPE_NONE, 1, param_types);
 }
 
 /**
@@ -543,6 +587,23 @@ void mafw_renderer_emit_metadata(MafwRenderer *self, const gchar *name,
 	g_value_array_free(arr);
 }
 
+/**
+ * mafw_renderer_emit_metadatas:
+ * @self:     a #MafwRenderer instance.
+ * @metadata: metadata hash table of the keys that changed.
+ *
+ * Emits #MafwRenderer::metadatas-changed for all the keys in @metadata at
+ * once, which goes over D-Bus in a single message.  Does nothing if
+ * @metadata is empty.
+ */
+void mafw_renderer_emit_metadatas(MafwRenderer *self, GHashTable *metadata)
+{
+	if (metadata == NULL || g_hash_table_size(metadata) == 0)
+		return;
+	g_signal_emit(self, mafw_renderer_signals[METADATAS_CHANGED], 0,
+		      metadata);
+}
+
 /**
  * mafw_renderer_emit_buffering_info:
  * @self: a #MafwRenderer instance
@@ -290,6 +290,8 @@ GType mafw_renderer_get_type(void);
 
 extern void mafw_renderer_emit_metadata(MafwRenderer *self, const gchar *name,
 				    GType type, guint nargs, ...);
+extern void mafw_renderer_emit_metadatas(MafwRenderer *self,
+					 GHashTable *metadata);
 
 /**
  * mafw_renderer_emit_metadata_boolean:
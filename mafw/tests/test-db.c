@@ -24,6 +24,7 @@
 
 #include <glib.h>
 #include <glib/gstdio.h>
+#include <string.h>
  
 #include "checkmore.h"
 #include <libmafw/mafw-db.h>
@@ -135,6 +136,85 @@ START_TEST(test_basic)
 }
 END_TEST
 
+START_TEST(test_cached_statements)
+{
+	sqlite3_stmt *stmt, *stmt2;
+
+	stmt = mafw_db_prepare_cached("SELECT id "
+				      "FROM " TEST_TABLE " WHERE id = :id");
+	fail_if(stmt == NULL);
+	mafw_db_bind_int(stmt, 0, 32);
+	fail_if(mafw_db_select(stmt, FALSE) != SQLITE_ROW);
+
+	/* The same statement comes back reset, without bindings. */
+	stmt2 = mafw_db_prepare_cached("SELECT id "
+				       "FROM " TEST_TABLE " WHERE id = :id");
+	fail_if(stmt2 != stmt);
+	fail_if(mafw_db_select(stmt2, FALSE) != SQLITE_DONE);
+	sqlite3_reset(stmt2);
+}
+END_TEST
+
+START_TEST(test_reader)
+{
+	sqlite3 *db;
+	sqlite3_stmt *stmt;
+	MafwDbStats stats;
+	gint i = 0;
+
+	mafw_db_trace();
+	db = mafw_db_open_reader();
+	fail_if(db == NULL);
+	fail_if(db == mafw_db_get());
+	fail_if(sqlite3_prepare_v2(db, "SELECT id FROM " TEST_TABLE,
+				   -1, &stmt, NULL) != SQLITE_OK);
+	while (mafw_db_select(stmt, FALSE) == SQLITE_ROW)
+		i++;
+	fail_if(i != 1);
+	sqlite3_finalize(stmt);
+
+	/* Read-only */
+	fail_if(sqlite3_exec(db, "DELETE FROM " TEST_TABLE,
+			     NULL, NULL, NULL) == SQLITE_OK);
+	mafw_db_close_reader(db);
+
+	mafw_db_get_stats(&stats);
+	fail_if(stats.queries == 0);
+	fail_if(stats.slowest_query > stats.query_time);
+}
+END_TEST
+
+static gchar *pragma(const gchar *sql)
+{
+	sqlite3_stmt *stmt;
+	gchar *value = NULL;
+
+	fail_if(sqlite3_prepare_v2(mafw_db_get(), sql, -1, &stmt,
+				   NULL) != SQLITE_OK);
+	if (sqlite3_step(stmt) == SQLITE_ROW)
+		value = g_strdup((const gchar *)sqlite3_column_text(stmt, 0));
+	sqlite3_finalize(stmt);
+	return value;
+}
+
+START_TEST(test_journal)
+{
+	gchar *mode, *sync;
+
+	/* Syncing less is only safe with write-ahead logging. */
+	mode = pragma("PRAGMA journal_mode");
+	sync = pragma("PRAGMA synchronous");
+	fail_if(mode == NULL || sync == NULL);
+	if (!g_ascii_strcasecmp(mode, "wal"))
+		fail_if(strcmp(sync, "1"), "synchronous is %s", sync);
+	else
+		fail_if(!strcmp(sync, "1"),
+			"synchronous = NORMAL with %s journal", mode);
+	g_free(mode);
+	g_free(sync);
+}
+END_TEST
+
 int main(void)
 {
 	TCase *tc;
@@ -150,6 +230,9 @@ int main(void)
 	if (1) tcase_add_test(tc, test_basic);
 	if (1) tcase_add_test(tc, test_statements);
 	if (1) tcase_add_test(tc, test_error_statements);
+	if (1) tcase_add_test(tc, test_cached_statements);
+	if (1) tcase_add_test(tc, test_reader);
+	if (1) tcase_add_test(tc, test_journal);
 
 	return checkmore_run(srunner_create(suite), FALSE);
 }
@@ -224,6 +224,20 @@ static void renderer_mdata_chd_cb(MafwRenderer *self, gchar *name,
 	*(gboolean*)user_data = TRUE;
 }
 
+static void renderer_mdata_count_cb(MafwRenderer *self, gchar *name,
+				    GValueArray *value, guint *user_data)
+{
+	(*user_data)++;
+}
+
+static void renderer_mdatas_chd_cb(MafwRenderer *self, GHashTable *metadata,
+				   gboolean *user_data)
+{
+	fail_if(g_hash_table_size(metadata) != 2);
+	fail_if(*(gboolean*)user_data);
+	*(gboolean*)user_data = TRUE;
+}
+
 START_TEST(test_renderer)
 {
 	MafwRenderer *renderer = g_object_new(frenderer_get_type(),
@@ -231,6 +245,8 @@ START_TEST(test_renderer)
 			    NULL);
 	GError *error = NULL;
 	gboolean cb_called = FALSE;
+	GHashTable *metadata;
+	guint nkeys = 0;
 	
 	g_signal_connect(renderer, "buffering-info",
 			(GCallback)buffering_info_cb, &cb_called);
@@ -314,6 +330,25 @@ START_TEST(test_renderer)
 	cb_called = FALSE;
 	mafw_renderer_emit_metadata_boolean(renderer, "bool");
 	fail_if(cb_called);
+
+	/* Several keys at once, each of them goes through metadata-changed
+	 * too */
+	g_signal_handlers_disconnect_by_func(renderer, renderer_mdata_chd_cb,
+					     &cb_called);
+	g_signal_connect(renderer, "metadata-changed",
+			(GCallback)renderer_mdata_count_cb, &nkeys);
+	g_signal_connect(renderer, "metadatas-changed",
+			(GCallback)renderer_mdatas_chd_cb, &cb_called);
+	metadata = mafw_metadata_new();
+	mafw_renderer_emit_metadatas(renderer, metadata);
+	fail_if(cb_called);
+	fail_if(nkeys != 0);
+	mafw_metadata_add_int(metadata, "int", 3);
+	mafw_metadata_add_str(metadata, "string", "str");
+	mafw_renderer_emit_metadatas(renderer, metadata);
+	fail_if(!cb_called);
+	fail_if(nkeys != 2);
+	mafw_metadata_release(metadata);
 	
 	g_object_unref(renderer);
 }
@@ -38,24 +38,65 @@
 #define FILTER(md, filter_str, outcome)			\
 do {							\
 	MafwFilter *filter;				\
+	MafwCompiledFilter *cf;				\
 							\
 	filter = mafw_filter_parse(filter_str);		\
 	outcome(mafw_metadata_filter(md, filter, NULL));\
+	/* Compiled filters must agree, with both the	\
+	 * built-in and a custom comparator, also when	\
+	 * evaluated repeatedly. */			\
+	cf = mafw_filter_compile(filter, NULL);		\
+	outcome(mafw_compiled_filter_eval(cf, md));	\
+	outcome(mafw_compiled_filter_eval(cf, md));	\
+	mafw_compiled_filter_free(cf);			\
+	cf = mafw_filter_compile(filter, custom_ordered);\
+	outcome(mafw_compiled_filter_eval(cf, md));	\
+	outcome(mafw_compiled_filter_eval(cf, md));	\
+	mafw_compiled_filter_free(cf);			\
 	mafw_filter_free(filter);			\
 } while (0)
 
 #define FILTER_ACK(md, filter_str) FILTER(md, filter_str, fail_unless)
 #define FILTER_NAK(md, filter_str) FILTER(md, filter_str, fail_if)
 
+/* Compares the bytes of sort keys like a database would order BLOBs. */
+static gint compare_sort_key_data(const MafwMetadataSortKey *sk1,
+				  const MafwMetadataSortKey *sk2)
+{
+	const guint8 *d1, *d2;
+	gsize l1, l2;
+	gint cmp;
+
+	d1 = mafw_metadata_sort_key_data(sk1, &l1);
+	d2 = mafw_metadata_sort_key_data(sk2, &l2);
+	cmp = memcmp(d1, d2, MIN(l1, l2));
+	if (cmp)
+		return cmp;
+	return l1 < l2 ? -1 : l1 > l2;
+}
+
 /* For test_compare() */
 #define COMPARE(md1, rel, md2, sexp)			\
 do {							\
 	gchar **sorting;				\
+	MafwMetadataSortKey *sk1, *sk2;			\
 							\
 	sorting = mafw_metadata_sorting_terms(sexp);	\
 	fail_unless(mafw_metadata_compare(md1, md2,	\
 					  (const gchar *const *)sorting, \
 					  NULL) rel 0);	\
+	fail_unless(mafw_metadata_compare(md1, md2,	\
+					  (const gchar *const *)sorting, \
+					  custom_ordered) rel 0);	\
+	/* Sort keys must agree. */			\
+	sk1 = mafw_metadata_sort_key_new(md1,		\
+				(const gchar *const *)sorting);	\
+	sk2 = mafw_metadata_sort_key_new(md2,		\
+				(const gchar *const *)sorting);	\
+	fail_unless(mafw_metadata_sort_key_compare(sk1, sk2) rel 0);	\
+	fail_unless(compare_sort_key_data(sk1, sk2) rel 0);	\
+	mafw_metadata_sort_key_free(sk1);		\
+	mafw_metadata_sort_key_free(sk2);		\
 	g_strfreev(sorting);				\
 } while (0)
 /* }}} */
@@ -546,6 +587,14 @@ START_TEST(test_relevant_keys)
 END_TEST
 /* }}} */
 
+/* Forwards to the default comparator, but is not recognized as such by
+ * mafw_filter_compile(). */
+static gboolean custom_ordered(MafwFilterType rel, const gchar *key,
+			       const GValue *lhsgv, const GValue *rhsgv)
+{
+	return mafw_metadata_ordered(rel, key, lhsgv, rhsgv);
+}
+
 /* test_filter() {{{ */
 START_TEST(test_filter)
 {
@@ -571,6 +620,8 @@ START_TEST(test_filter)
 	FILTER_NAK(md, "(beta~t*ko)");
 	FILTER_ACK(md, "(beta<threee)");
 	FILTER_NAK(md, "(beta=four)");
+	FILTER_ACK(md, "(|(beta=four)(beta=five)(beta=three))");
+	FILTER_NAK(md, "(&(beta=one)(beta=four)(alpha=10))");
 
 	/* Complex expressions, all keys are valid */
 	FILTER_ACK(md, "(&(alpha=10)(beta=one))");
@@ -135,12 +135,153 @@ START_TEST(test_serialization)
 }
 END_TEST
 
+static GHashTable *sample_md(void)
+{
+	GHashTable *md;
+
+	md = mafw_metadata_new();
+	mafw_metadata_add_int(md, "pain", 9, 9, 9);
+	mafw_metadata_add_int64(md, "lluau", 0LL, 2LL, 6LL, 0LL);
+	mafw_metadata_add_double(md, "duau", 2.7182818284590452354);
+	mafw_metadata_add_str(md, "*_*", "kiss", "me", "now");
+	mafw_metadata_add_str(md, "bimm", "bamm");
+	return md;
+}
+
+START_TEST(test_view)
+{
+	gchar *stream;
+	gsize sstream;
+	const gchar *str;
+	GHashTable *src;
+	GValueArray *val;
+	GValue value;
+	MafwMetadataView view;
+	guint i;
+
+	fail_unless(mafw_metadata_view_init(&view, NULL, 0));
+	fail_unless(view.nkeys == 0);
+	fail_unless(mafw_metadata_view_nvalues(&view, "pain") == 0);
+	mafw_metadata_view_clear(&view);
+
+	src = sample_md();
+	stream = mafw_metadata_freeze(src, &sstream);
+	fail_unless(mafw_metadata_view_init(&view, stream, sstream));
+	fail_unless(view.nkeys == g_hash_table_size(src));
+	for (i = 1; i < view.nkeys; i++)
+		fail_unless(strcmp(mafw_metadata_view_key(&view, i - 1),
+				   mafw_metadata_view_key(&view, i)) < 0);
+
+	/* Strings are looked up in place. */
+	str = mafw_metadata_view_get_string(&view, "bimm");
+	fail_if(str == NULL);
+	fail_if(strcmp(str, "bamm"));
+	fail_unless(str > stream && str < stream + sstream);
+	fail_unless(mafw_metadata_view_get_string(&view, "pain") == NULL);
+	fail_unless(mafw_metadata_view_get_string(&view, "nope") == NULL);
+
+	fail_unless(mafw_metadata_view_nvalues(&view, "*_*") == 3);
+	fail_unless(mafw_metadata_view_nvalues(&view, "nope") == 0);
+	memset(&value, 0, sizeof(value));
+	fail_unless(mafw_metadata_view_get_value(&view, "*_*", 2, &value));
+	fail_if(strcmp(g_value_get_string(&value), "now"));
+	g_value_unset(&value);
+	fail_if(mafw_metadata_view_get_value(&view, "*_*", 3, &value));
+	fail_unless(mafw_metadata_view_get_value(&view, "lluau", 2, &value));
+	fail_unless(g_value_get_int64(&value) == 6LL);
+	g_value_unset(&value);
+
+	val = mafw_metadata_view_lookup(&view, "duau");
+	fail_if(val == NULL);
+	compare_cb("duau", val, src);
+	g_value_array_free(val);
+	fail_unless(mafw_metadata_view_lookup(&view, "nope") == NULL);
+
+	mafw_metadata_view_clear(&view);
+	g_free(stream);
+	g_hash_table_unref(src);
+}
+END_TEST
+
+/* Streams of earlier versions are still understood. */
+START_TEST(test_unversioned)
+{
+	GByteArray *bary;
+	GHashTable *src, *dst;
+	MafwMetadataView view;
+
+	src = sample_md();
+	bary = g_byte_array_new();
+	g_byte_array_append(bary, (guint8 *)"bimm", sizeof("bimm"));
+	mafw_metadata_val_freeze_bary(bary,
+				      g_hash_table_lookup(src, "bimm"));
+	g_byte_array_append(bary, (guint8 *)"pain", sizeof("pain"));
+	mafw_metadata_val_freeze_bary(bary,
+				      g_hash_table_lookup(src, "pain"));
+
+	dst = mafw_metadata_thaw_bary(bary);
+	fail_if(dst == NULL);
+	fail_unless(g_hash_table_size(dst) == 2);
+	g_hash_table_foreach(dst, (GHFunc)compare_cb, src);
+	g_hash_table_unref(dst);
+
+	fail_unless(mafw_metadata_view_init(&view, bary->data, bary->len));
+	fail_unless(view.nkeys == 2);
+	fail_if(strcmp(mafw_metadata_view_get_string(&view, "bimm"), "bamm"));
+	fail_unless(mafw_metadata_view_nvalues(&view, "pain") == 3);
+	mafw_metadata_view_clear(&view);
+
+	g_byte_array_free(bary, TRUE);
+	g_hash_table_unref(src);
+}
+END_TEST
+
+/* Truncated or corrupted streams are refused. */
+START_TEST(test_malformed)
+{
+	gchar *stream;
+	gsize sstream, i;
+	GHashTable *src;
+	MafwMetadataView view;
+
+	checkmore_ignore("malformed metadata stream");
+	src = sample_md();
+	stream = mafw_metadata_freeze(src, &sstream);
+	for (i = 1; i < 16; i++) {
+		fail_if(mafw_metadata_view_init(&view, stream, i));
+		fail_unless(mafw_metadata_thaw(stream, i) == NULL);
+	}
+
+	/* Unknown version */
+	stream[3]++;
+	fail_if(mafw_metadata_view_init(&view, stream, sstream));
+	fail_unless(mafw_metadata_thaw(stream, sstream) == NULL);
+	stream[3]--;
+
+	/* Values are checked when they are looked up. */
+	fail_unless(mafw_metadata_view_init(&view, stream, sstream - 8));
+	fail_unless(mafw_metadata_view_lookup(
+			    &view, mafw_metadata_view_key(&view,
+							  view.nkeys - 1))
+		    == NULL);
+	mafw_metadata_view_clear(&view);
+	fail_unless(mafw_metadata_thaw(stream, sstream - 8) == NULL);
+
+	checkmore_ignore(NULL);
+	g_free(stream);
+	g_hash_table_unref(src);
+}
+END_TEST
+
 int main(void)
 {
 	Suite *suite;
 
 	suite = suite_create("metadata serialization");
 	checkmore_add_tcase(suite, "freeze & thaw", test_serialization);
+	checkmore_add_tcase(suite, "view", test_view);
+	checkmore_add_tcase(suite, "unversioned", test_unversioned);
+	checkmore_add_tcase(suite, "malformed", test_malformed);
 	return checkmore_run(srunner_create(suite), FALSE);
 }
 